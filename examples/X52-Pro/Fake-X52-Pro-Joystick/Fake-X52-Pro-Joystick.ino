@@ -17,13 +17,30 @@
 // - Teensyduino 1.53 (add-on for the Arduino IDE)
 
 #define X52_DEBUG 1
+// X52_DEBUG_LOG_DEFERRED makes the debug log non-blocking so a debug build can
+// run at the same frame rate as a release build. The serial output has to be
+// expanded with extras/linux/x52_log_expand on the PC.
+#define X52_DEBUG_LOG_DEFERRED 0
 #define X52_PRO_IMPROVED_THROTTLE_CLIENT_DESYNC_DETECTION 1
 #include <x52_hotas.h>
+#include <x52_stream.h>
+
+
+// STATE_FROM_HOST sends the states of any PC joystick to the throttle: on a
+// Linux PC extras/linux/x52_evdev_feeder reads the joystick and streams its
+// states over serial in the binary format of x52::stream (x52_stream.h).
+// The JoystickConfigs of the throttle (the LEDs) are streamed back to the
+// feeder. The debug log uses the same serial port so this works only with
+// X52_DEBUG=0.
+#define STATE_FROM_HOST 0
 
 
 // The throttle can handle only 100-125 updates per second on average so there is
 // no good reason to cap the update rate. MAX_UPDATES_PER_SECOND=0 means unlimited.
 #define MAX_UPDATES_PER_SECOND 0
+// MAX_UPDATE_BURST is the number of catch-up updates of the rate limiter
+// (see x52::util::RateLimiter).
+#define MAX_UPDATE_BURST 8
 
 // RATE_LOG_PERIOD_MILLIS defines the period for the update rate logger.
 // Rate logging is disabled if X52_DEBUG or RATE_LOG_PERIOD_MILLIS is zero.
@@ -33,33 +50,66 @@
 // TODO: Choose your favorite digital pins on your board.
 x52::pro::ThrottleClient<16, 5, 3, 2> throttle_client;
 
+#if STATE_FROM_HOST
+#if X52_DEBUG
+#error STATE_FROM_HOST requires X52_DEBUG=0
+#endif
+// The latest state received from the host. It's sent when the throttle's
+// poll arrives so the latency is the serial transfer plus the wait for the
+// next poll of the throttle.
+x52::PreEncodedState<x52::pro::JoystickState> host_state;
+x52::stream::Receiver<decltype(Serial)> stream_receiver(Serial);
+x52::stream::Writer<decltype(Serial)> stream_writer(Serial);
+#endif
+
 
 void setup() {
-#if X52_DEBUG
+#if STATE_FROM_HOST
+	// The baud rate matters only on boards without native USB serial.
+	Serial.begin(115200);
+#elif X52_DEBUG
 	Serial.begin(9600);
 #endif
 
 	throttle_client.Setup();
 
+#if STATE_FROM_HOST
+	// A centered stick until the first state of the host arrives.
+	x52::pro::JoystickState centered;
+	centered.x = x52::pro::JoystickState::CENTER_X;
+	centered.y = x52::pro::JoystickState::CENTER_Y;
+	centered.z = x52::pro::JoystickState::CENTER_Z;
+	centered.mode = x52::Mode1;
+	host_state.Publish(centered);
+#endif
+
 	// TODO: Deal with unused/floating input pins if you want to do it by the book.
 }
 
 
 void loop() {
+#if STATE_FROM_HOST
+	// SendLatestJoystickState returns only when the throttle starts its next
+	// poll (the last clock cycle of a frame ends with C02=1) so the bus is
+	// rarely idle here. Poll reads only the bytes that have already arrived:
+	// it delays the answer to the poll by the decoding of a few frames.
+	stream_receiver.Poll(host_state);
+#endif
+
 	if (!throttle_client.IsPollInProgress()) {
-#if !X52_BUSY_WAIT
-		delayMicroseconds(100);
+#if !STATE_FROM_HOST
+		// The bus is idle: a good time to print the deferred debug log.
+		X52DebugLogDrain();
+		x52::WaitStrategy::Idle(100);
 #endif
 		return;
 	}
 
 #if MAX_UPDATES_PER_SECOND
-	static x52::util::RateLimiter<MAX_UPDATES_PER_SECOND,MAX_UPDATES_PER_SECOND> rate_limiter;
+	static x52::util::RateLimiter<MAX_UPDATES_PER_SECOND,MAX_UPDATE_BURST> rate_limiter;
 	unsigned long d = rate_limiter.MicrosTillNextUpdate();
 	if (d > 0) {
-#if !X52_BUSY_WAIT
-		delayMicroseconds(d);
-#endif
+		x52::WaitStrategy::Idle(d);
 		return;
 	}
 #endif
@@ -73,11 +123,40 @@ void loop() {
 }
 
 
+#if STATE_FROM_HOST
+
+bool send_joystick_state() {
+	x52::pro::JoystickConfig cfg;
+	auto timeout_micros = throttle_client.SendLatestJoystickState(host_state, cfg);
+	if (timeout_micros) {
+		delayMicroseconds(timeout_micros);
+		return false;
+	}
+
+	// The config goes back to the host when it changes and once per second.
+	static x52::pro::JoystickConfig::Binary last_cfg;
+	static unsigned long last_cfg_millis;
+	x52::pro::JoystickConfig::Binary binary;
+	cfg.ToBinary(binary);
+	if (binary != last_cfg || millis() - last_cfg_millis >= 1000) {
+		if (stream_writer.Write(binary, micros())) {
+			last_cfg = binary;
+			last_cfg_millis = millis();
+		}
+	}
+	return true;
+}
+
+#else
+
 bool send_joystick_state() {
 	x52::pro::JoystickState state;
 
 	// TODO: Fill the JoystickState with the values read from your custom input sensors.
 	//  I put here some constant values to help me with debugging.
+	//  Don't call analogRead here: it's slow and it sits between two polls of the
+	//  throttle. x52_analog.h has a background ADC pipeline that keeps the
+	//  latest axis values and debounced buttons ready.
 	state.x = x52::pro::JoystickState::MAX_X / 4;
 	state.y = x52::pro::JoystickState::MAX_Y / 4;
 	state.z = x52::pro::JoystickState::MAX_Z * 3 / 4;
@@ -89,16 +168,21 @@ bool send_joystick_state() {
 	x52::pro::JoystickConfig cfg;
 	auto timeout_micros = throttle_client.SendJoystickState(state, cfg);
 	if (timeout_micros) {
-		Serial.println("SendJoystickState failed");
+		X52DebugLog("SendJoystickState failed");
 		delayMicroseconds(timeout_micros);
 		return false;
 	}
 
 	// TODO: Do something with the JoystickConfig recevied from the throttle.
 
-	// DebugPrinting after every 100th update
+	// Logging after every 100th update
 	static int counter = 0;
 	if (counter++ % 100 == 0) {
+#if X52_DEBUG_LOG_DEFERRED
+		X52DebugLog("Brightness POV1 fire: ", cfg.led_brightness, cfg.pov_1_led_blinking, cfg.button_fire_led);
+		X52DebugLog("LEDs POV2 A B: ", cfg.pov_2_led, cfg.button_a_led, cfg.button_b_led);
+		X52DebugLog("LEDs T1/2 T3/4 T5/6: ", cfg.button_t1_t2_led, cfg.button_t3_t4_led, cfg.button_t5_t6_led);
+#else
 		X52DebugPrint("Brightness:");
 		X52DebugPrint(cfg.led_brightness);
 		X52DebugPrint(" POV1:");
@@ -117,6 +201,9 @@ bool send_joystick_state() {
 		X52DebugPrint(cfg.button_t3_t4_led);
 		X52DebugPrint(" T5/6:");
 		X52DebugPrintln(cfg.button_t5_t6_led);
+#endif
 	}
 	return true;
 }
+
+#endif
@@ -43,8 +43,13 @@
 // - https://github.com/MHeironimus/ArduinoJoystickLibrary 2.0.7
 
 #define X52_DEBUG 1
+// X52_DEBUG_LOG_DEFERRED makes the debug log non-blocking so a debug build can
+// run at the same frame rate as a release build. The serial output has to be
+// expanded with extras/linux/x52_log_expand on the PC.
+#define X52_DEBUG_LOG_DEFERRED 0
 #define X52_PRO_IMPROVED_JOYSTICK_CLIENT_DESYNC_DETECTION 1
 #include <x52_hotas.h>
+#include <x52_stream.h>
 
 
 // LOG_JOYSTICK_STATE periodically logs the joystick state to serial if X52_DEBUG=1.
@@ -61,6 +66,13 @@
 // You have to install that library before building with this switch enabled.
 #define USB_JOYSTICK_MHEIRONIMUS 0
 
+// STREAM_TO_HOST sends the joystick states over serial in the binary format
+// of x52::stream (x52_stream.h). On a Linux PC extras/linux/x52_uinputd turns
+// this stream into an input device with all buttons, the mode switch and the
+// capture timestamps. The debug log uses the same serial port so this works
+// only with X52_DEBUG=0.
+#define STREAM_TO_HOST 0
+
 // MAX_UPDATES_PER_SECOND puts a max limit on the number of updates the
 // joystick can push to your board in one second. My X52 Pro joystick is capable
 // of 250-400 updates per second. If the joystick is idle then the rate
@@ -74,6 +86,13 @@
 // fluctuate wildly between 250 and 400.
 #define MAX_UPDATES_PER_SECOND 250
 
+// MAX_UPDATE_BURST is the number of updates the rate limiter lets through
+// back-to-back to catch up after late frames (see x52::util::RateLimiter).
+// In any second there are at most MAX_UPDATES_PER_SECOND+MAX_UPDATE_BURST-1
+// updates so a small value keeps the rate stable: 8 catches up after ~30ms
+// of delays. (With 250 it would allow up to 499 updates in a second.)
+#define MAX_UPDATE_BURST 8
+
 // RATE_LOG_PERIOD_MILLIS defines the period for the update rate logger.
 // Rate logging is disabled if X52_DEBUG or RATE_LOG_PERIOD_MILLIS is zero.
 #define RATE_LOG_PERIOD_MILLIS 3000
@@ -89,8 +108,16 @@ Joystick_ joystick;
 #endif
 
 
-void setup() {
+#if STREAM_TO_HOST
 #if X52_DEBUG
+#error STREAM_TO_HOST requires X52_DEBUG=0
+#endif
+x52::stream::Writer<decltype(Serial)> stream_writer(Serial);
+#endif
+
+
+void setup() {
+#if X52_DEBUG || STREAM_TO_HOST
 	Serial.begin(9600);
 #endif
 
@@ -109,6 +136,9 @@ void setup() {
 
 
 void loop() {
+	// The bus is idle: a good time to print the deferred debug log.
+	X52DebugLogDrain();
+
 	// Calling PrepareForPoll is optional (this firmware works without it)
 	// but it eliminates almost all jitter from the timing of the updates.
 	// With PrepareForPoll we ask the joystick to prepare for the next
@@ -119,12 +149,10 @@ void loop() {
 	joystick_client.PrepareForPoll();
 
 #if MAX_UPDATES_PER_SECOND
-	static x52::util::RateLimiter<MAX_UPDATES_PER_SECOND,MAX_UPDATES_PER_SECOND> rate_limiter;
+	static x52::util::RateLimiter<MAX_UPDATES_PER_SECOND,MAX_UPDATE_BURST> rate_limiter;
 	unsigned long d = rate_limiter.MicrosTillNextUpdate();
 	if (d > 0) {
-#if !X52_BUSY_WAIT
-		delayMicroseconds(d);
-#endif
+		x52::WaitStrategy::Idle(d);
 		return;
 	}
 #endif
@@ -149,19 +177,31 @@ bool update_joystick() {
 
 	// TODO: set other JoystickConfig values if you want
 
+#if USB_JOYSTICK_TEENSY
+	// The teensy report is built straight from the Binary of the state
+	x52::hid::BinaryCapture<x52::pro::JoystickState> capture;
+	auto timeout_micros = joystick_client.PollJoystickState(state, cfg, capture);
+#else
 	auto timeout_micros = joystick_client.PollJoystickState(state, cfg);
+#endif
 	if (timeout_micros) {
-		X52DebugPrintln("PollJoystickState failed");
+		X52DebugLog("PollJoystickState failed");
 		delayMicroseconds(timeout_micros);
 		return false;
 	}
 
+#if STREAM_TO_HOST
+	x52::pro::JoystickState::Binary binary;
+	state.ToBinary(binary);
+	stream_writer.Write(binary, micros());
+#endif
+
 #if X52_DEBUG && LOG_JOYSTICK_STATE
 	serial_log_joystick_state(state);
 #endif
 
 #if USB_JOYSTICK_TEENSY
-	send_teensy_usb_joystick_state(state);
+	send_teensy_usb_joystick_state(capture.binary);
 #endif
 
 #if USB_JOYSTICK_MHEIRONIMUS
@@ -173,11 +213,34 @@ bool update_joystick() {
 #if X52_DEBUG && LOG_JOYSTICK_STATE
 
 void serial_log_joystick_state(const x52::pro::JoystickState& state) {
-	// DebugPrinting after every 100th call
+	// Logging after every 100th call
 	static int counter = 0;
 	if (counter++ % 100 != 0)
 		return;
 
+	// The deferred log stores only numbers: the directions and the buttons
+	// are logged as bit masks and x52_log_expand prints them as numbers.
+#if X52_DEBUG_LOG_DEFERRED
+	X52DebugLog("x y z: ", state.x, state.y, state.z);
+	X52DebugLog("pov1 pov2 mode (pov bits: 1=Right 2=Down 4=Left 8=Up): ", state.pov_1, state.pov_2, state.mode);
+
+	// bits 0..12: trigger_stage_1, trigger_stage_2, pinkie, fire, A, B, C, T1..T6
+	long buttons =
+		long(state.trigger_stage_1) |
+		long(state.trigger_stage_2) << 1 |
+		long(state.pinkie_switch) << 2 |
+		long(state.button_fire) << 3 |
+		long(state.button_a) << 4 |
+		long(state.button_b) << 5 |
+		long(state.button_c) << 6 |
+		long(state.button_t1) << 7 |
+		long(state.button_t2) << 8 |
+		long(state.button_t3) << 9 |
+		long(state.button_t4) << 10 |
+		long(state.button_t5) << 11 |
+		long(state.button_t6) << 12;
+	X52DebugLog("buttons: ", buttons);
+#else
 	X52DebugPrint("x:");
 	X52DebugPrint(state.x);
 	X52DebugPrint(" y:");
@@ -243,6 +306,7 @@ void serial_log_joystick_state(const x52::pro::JoystickState& state) {
 	X52DebugPrint(state.button_t6);
 
 	X52DebugPrint("\n");
+#endif
 }
 
 #endif
@@ -251,44 +315,19 @@ void serial_log_joystick_state(const x52::pro::JoystickState& state) {
 
 // This function is specific to teensy boards and uses the joystick library
 // of the Teensyduno addon so it's unlikely to work with other types of boards.
-void send_teensy_usb_joystick_state(const x52::pro::JoystickState& state) {
-	Joystick.X(state.x);
-	Joystick.Y(state.y);
-	Joystick.Zrotate(state.z);
-
-	static int hat_angles[16] = {
-		-1, 90, 180, 135, 270, -1, 225, 180, 0, 45, -1, 90, 315, 0, 270, -1
-	};
-	Joystick.hat(hat_angles[state.pov_1]);
-
-	// These button numbers may look random but I just tried
-	// to increase compatibility with xbox and ps controllers.
-
-	// The teensy joystick library supports only 1 hat switch
-	// so pov_2 is used as 4 separate buttons:
-	Joystick.button(13, bool(state.pov_2 & x52::Up));
-	Joystick.button(16, bool(state.pov_2 & x52::Right));
-	Joystick.button(14, bool(state.pov_2 & x52::Down));
-	Joystick.button(15, bool(state.pov_2 & x52::Left));
-
-	// This library uses one-based button indexes [1..32]
-	Joystick.button(8, state.trigger_stage_1);
-	Joystick.button(29, state.trigger_stage_2);
-	Joystick.button(7, state.pinkie_switch);
-	Joystick.button(4, state.button_fire);
-	Joystick.button(1, state.button_a);
-	Joystick.button(2, state.button_b);
-	Joystick.button(3, state.button_c);
-	Joystick.button(9, state.button_t1);
-	Joystick.button(5, state.button_t2);
-	Joystick.button(10, state.button_t3);
-	Joystick.button(6, state.button_t4);
-	Joystick.button(11, state.button_t5);
-	Joystick.button(12, state.button_t6);
-	Joystick.button(30, state.mode == x52::Mode1);
-	Joystick.button(31, state.mode == x52::Mode2);
-	Joystick.button(32, state.mode == x52::Mode3);
-
+//
+// It writes the whole report of the joystick library with one
+// x52::hid::BuildReport call instead of decoding the state and calling its
+// setters. The button numbers may look random but I just tried to increase
+// compatibility with xbox and ps controllers: see the layout of
+// x52::hid::TeensyJoystick in x52_hid.h. The teensy joystick library supports
+// only 1 hat switch so pov_2 is used as 4 separate buttons.
+void send_teensy_usb_joystick_state(const x52::pro::JoystickState::Binary& binary) {
+#ifdef JOYSTICK_SIZE
+	static_assert(JOYSTICK_SIZE == x52::hid::TeensyJoystick::REPORT_SIZE,
+		"x52::hid::TeensyJoystick supports only the 12-byte joystick report");
+#endif
+	x52::hid::BuildReport<x52::hid::TeensyJoystick>(binary, reinterpret_cast<uint8_t*>(usb_joystick_data));
 	Joystick.send_now();
 }
 
@@ -296,6 +335,9 @@ void send_teensy_usb_joystick_state(const x52::pro::JoystickState& state) {
 
 #if USB_JOYSTICK_MHEIRONIMUS
 
+// The Joystick library has its own report layout behind its setters. Without
+// the library x52::hid::Gamepad (x52_hid.h) builds a report with two hat
+// switches straight from the Binary for the PluggableUSB HID of the AVR boards.
 void send_mheironimus_usb_joystick_state(const x52::pro::JoystickState& state) {
 	joystick.setXAxis(state.x);
 	joystick.setYAxis(state.y);
@@ -13,19 +13,37 @@
 // - Teensyduino 1.53 (add-on for the Arduino IDE)
 
 #define X52_DEBUG 1
+// X52_DEBUG_LOG_DEFERRED makes the debug log non-blocking so a debug build can
+// run at the same frame rate as a release build. The serial output has to be
+// expanded with extras/linux/x52_log_expand on the PC.
+#define X52_DEBUG_LOG_DEFERRED 0
 #include <x52_hotas.h>
 
 
 // MAX_UPDATES_PER_SECOND=0 means unlimited.
 #define MAX_UPDATES_PER_SECOND 0
+// MAX_UPDATE_BURST is the number of catch-up updates of the rate limiter
+// (see x52::util::RateLimiter).
+#define MAX_UPDATE_BURST 8
 
 // RATE_LOG_PERIOD_MILLIS defines the period for the update rate logger.
 // Rate logging is disabled if X52_DEBUG or RATE_LOG_PERIOD_MILLIS is zero.
 #define RATE_LOG_PERIOD_MILLIS 3000
 
+// INTERRUPT_THROTTLE_CLIENT transmits the frames from interrupt handlers
+// (x52::std::InterruptThrottleClient) so the CPU can do something else while
+// the throttle is clocking a frame. It needs a one-shot timer for the C04
+// pulses: this example uses the IntervalPulseTimer of the teensy.
+#define INTERRUPT_THROTTLE_CLIENT 0
+
 
 // TODO: Choose your favorite digital pins on your board.
+#if INTERRUPT_THROTTLE_CLIENT
+//  PIN_C02 (the 2nd template parameter) must be an interrupt-capable digital pin.
+x52::std::InterruptThrottleClient<16, 5, 3, 2, x52::IntervalPulseTimer<>> throttle_client;
+#else
 x52::std::ThrottleClient<16, 5, 3, 2> throttle_client;
+#endif
 
 
 void setup() {
@@ -41,19 +59,17 @@ void setup() {
 
 void loop() {
 	if (!throttle_client.IsPollInProgress()) {
-#if !X52_BUSY_WAIT
-		delayMicroseconds(100);
-#endif
+		// The bus is idle: a good time to print the deferred debug log.
+		X52DebugLogDrain();
+		x52::WaitStrategy::Idle(100);
 		return;
 	}
 
 #if MAX_UPDATES_PER_SECOND
-	static x52::util::RateLimiter<MAX_UPDATES_PER_SECOND,MAX_UPDATES_PER_SECOND> rate_limiter;
+	static x52::util::RateLimiter<MAX_UPDATES_PER_SECOND,MAX_UPDATE_BURST> rate_limiter;
 	unsigned long d = rate_limiter.MicrosTillNextUpdate();
 	if (d > 0) {
-#if !X52_BUSY_WAIT
-		delayMicroseconds(d);
-#endif
+		x52::WaitStrategy::Idle(d);
 		return;
 	}
 #endif
@@ -72,6 +88,9 @@ bool send_joystick_state() {
 
 	// TODO: Fill the JoystickState with the values read from your custom input sensors.
 	//  I put here some constant values to help me with debugging.
+	//  Don't call analogRead here: it's slow and it sits between two polls of the
+	//  throttle. x52_analog.h has a background ADC pipeline that keeps the
+	//  latest axis values and debounced buttons ready.
 	state.x = x52::std::JoystickState::MAX_X / 4;
 	state.y = x52::std::JoystickState::MAX_Y / 4;
 	state.z = x52::std::JoystickState::MAX_Z * 3 / 4;
@@ -81,22 +100,34 @@ bool send_joystick_state() {
 	state.mode = x52::Mode1;
 
 	x52::std::JoystickConfig cfg;
+#if INTERRUPT_THROTTLE_CLIENT
+	throttle_client.StartSendJoystickState(state);
+	while (throttle_client.IsSendInProgress()) {
+		// TODO: Sample your sensors here while the throttle is clocking the frame.
+	}
+	auto timeout_micros = throttle_client.FinishSendJoystickState(cfg);
+#else
 	auto timeout_micros = throttle_client.SendJoystickState(state, cfg);
+#endif
 	if (timeout_micros) {
-		Serial.println("SendJoystickState failed");
+		X52DebugLog("SendJoystickState failed");
 		delayMicroseconds(timeout_micros);
 		return false;
 	}
 
 	// TODO: Do something with the JoystickConfig recevied from the throttle.
 
-	// DebugPrinting after every 100th update
+	// Logging after every 100th update
 	static int counter = 0;
 	if (counter++ % 100 == 0) {
+#if X52_DEBUG_LOG_DEFERRED
+		X52DebugLog("Brightness POV1: ", cfg.led_brightness, cfg.pov_1_led_blinking);
+#else
 		X52DebugPrint("Brightness:");
 		X52DebugPrint(cfg.led_brightness);
 		X52DebugPrint(" POV1:");
 		X52DebugPrintln(cfg.pov_1_led_blinking);
+#endif
 	}
 	return true;
 }
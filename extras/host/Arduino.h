@@ -0,0 +1,138 @@
+// A minimal stand-in for the Arduino core that makes it possible to compile
+// the library on a Linux/POSIX host (e.g. for the tools in extras/linux).
+// Put this directory on the include path before the library's src directory.
+//
+// The time functions use the monotonic clock of the host. The pins are
+// plain variables: digitalWrite calls the interrupt handler attached to the
+// pin and the interrupt functions do nothing. The pin changes can be traced
+// through x52_host_write_hook (see x52_vcd.h).
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+#define HIGH 1
+#define LOW 0
+
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+#define X52_HOST_NUM_PINS 64
+
+
+// micros() and millis() aren't truncated to 32 bits: with the 64-bit
+// unsigned long of LP64 hosts the truncated micros() would wrap every 71.6
+// minutes and a deadline computed as micros() + wait across the wrap would
+// never be reached.
+inline unsigned long micros() {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long)(uint64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000);
+}
+
+inline unsigned long millis() {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long)(uint64_t(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000);
+}
+
+inline void delayMicroseconds(unsigned long us) {
+	unsigned long start = micros();
+	while (micros() - start < us) {}
+}
+
+inline void delay(unsigned long ms) {
+	delayMicroseconds(ms * 1000);
+}
+
+
+typedef void (*X52HostISR)();
+
+struct X52HostPin {
+	volatile uint8_t state;
+	X52HostISR isr;
+	int isr_mode;
+};
+
+inline X52HostPin* x52_host_pins() {
+	static X52HostPin pins[X52_HOST_NUM_PINS];
+	return pins;
+}
+
+// x52_host_write_hook is called by digitalWrite after every change of a pin
+// state, before the interrupt handler of the pin. Set it before starting
+// the threads that write the pins.
+typedef void (*X52HostWriteHook)(uint8_t pin, uint8_t value);
+
+inline X52HostWriteHook& x52_host_write_hook() {
+	static X52HostWriteHook hook;
+	return hook;
+}
+
+inline void pinMode(uint8_t, uint8_t) {}
+
+inline int digitalRead(uint8_t pin) {
+	return x52_host_pins()[pin].state;
+}
+
+inline void digitalWrite(uint8_t pin, uint8_t value) {
+	X52HostPin& p = x52_host_pins()[pin];
+	uint8_t old = p.state;
+	p.state = value ? HIGH : LOW;
+	if (old == p.state)
+		return;
+	if (X52HostWriteHook hook = x52_host_write_hook())
+		hook(pin, p.state);
+	if (!p.isr)
+		return;
+	if (p.isr_mode == CHANGE || (p.isr_mode == RISING) == bool(p.state))
+		p.isr();
+}
+
+inline int digitalPinToInterrupt(int pin) {
+	return pin;
+}
+
+inline void attachInterrupt(int interrupt, X52HostISR isr, int mode) {
+	x52_host_pins()[interrupt].isr = isr;
+	x52_host_pins()[interrupt].isr_mode = mode;
+}
+
+inline void detachInterrupt(int interrupt) {
+	x52_host_pins()[interrupt].isr = nullptr;
+}
+
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+
+// Serial writes to stdout.
+struct X52HostSerial {
+	void begin(unsigned long) {}
+	int availableForWrite() { return 4096; }
+	size_t write(uint8_t b) { return fwrite(&b, 1, 1, stdout); }
+	size_t write(const uint8_t* buf, size_t size) { return fwrite(buf, 1, size, stdout); }
+	void print(const char* s) { fputs(s, stdout); }
+	void print(char c) { fputc(c, stdout); }
+	void print(int v) { printf("%d", v); }
+	void print(unsigned int v) { printf("%u", v); }
+	void print(long v) { printf("%ld", v); }
+	void print(unsigned long v) { printf("%lu", v); }
+	void print(double v) { printf("%.2f", v); }
+	template <typename T> void println(T v) { print(v); print('\n'); }
+	void println() { print('\n'); }
+};
+
+static X52HostSerial Serial;
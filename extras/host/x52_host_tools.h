@@ -0,0 +1,122 @@
+// The helpers shared by the tools in extras/linux: the host clocks, the
+// percentiles of the reports, the HAL of the virtual PS/2 wires that
+// connect a JoystickClient and a ThrottleClient running on two threads and
+// the driver of the std::InterruptThrottleClient.
+// Include it after x52_hotas.h.
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "Arduino.h"
+#include "x52_engine.h"
+
+
+// x52_host_now_ns returns the monotonic clock of the host in nanoseconds.
+inline uint64_t x52_host_now_ns() {
+	return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+
+// x52_host_now_ticks returns the time stamp counter of x86 hosts (0 on the
+// others). It's the unit of the cycle counts of the benchmarks.
+inline uint64_t x52_host_now_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+
+// x52_host_percentile returns the p (0..1) percentile of a sorted vector or 0
+// if it's empty.
+template <typename T>
+T x52_host_percentile(const std::vector<T>& sorted, double p) {
+	if (sorted.empty())
+		return T(0);
+	return sorted[std::min(sorted.size() - 1, size_t(p * double(sorted.size())))];
+}
+
+
+// X52HostWireHAL is the HAL of both sides of a virtual cable: the
+// ArduinoHAL with every write passed on to Wire::Propagate(pin, value) that
+// sets the pin of the other side. The reads yield the CPU: the two sides
+// busy-wait for each other and without the yields a host with fewer CPUs
+// than threads would advance only one edge per scheduler tick.
+template <typename Wire>
+struct X52HostWireHAL : x52::ArduinoHAL {
+	static int Read(uint8_t pin) {
+		std::this_thread::yield();
+		return digitalRead(pin);
+	}
+
+	static void Write(uint8_t pin, int value) {
+		digitalWrite(pin, uint8_t(value));
+		Wire::Propagate(pin, value);
+	}
+
+	static bool WaitForPinState(uint8_t pin, int state, unsigned long deadline_micros) {
+		while (Read(pin) != state) {
+			if (long(micros() - deadline_micros) >= 0)
+				return false;
+		}
+		return true;
+	}
+};
+
+
+// X52HostLoopback is a cable without faults: pin k is connected to pin
+// k+PEER_OFFSET (for k in 1..PEER_OFFSET).
+template <int PEER_OFFSET>
+struct X52HostLoopback {
+	static void Propagate(uint8_t pin, int value) {
+		digitalWrite(uint8_t(pin > PEER_OFFSET ? pin - PEER_OFFSET : pin + PEER_OFFSET), uint8_t(value));
+	}
+};
+
+template <int PEER_OFFSET>
+using X52HostLoopbackHAL = X52HostWireHAL<X52HostLoopback<PEER_OFFSET>>;
+
+
+// X52HostInterruptThrottle gives a std::InterruptThrottleClient the blocking
+// SendJoystickState of the ThrottleClient. The sending loop is also the
+// "hardware" of its MockPulseTimer: it fires the timer when the duration
+// of the pulse has passed. The C02 interrupt handler of the client is
+// called by the digitalWrite of the other side of the cable.
+template <typename Client, typename Timer>
+struct X52HostInterruptThrottle {
+	void Setup() {
+		client.Setup();
+	}
+
+	unsigned long SendJoystickState(const x52::std::JoystickState& s, x52::std::JoystickConfig& c, unsigned long wait_micros) {
+		client.StartSendJoystickState(s, wait_micros);
+		bool timing = false;
+		unsigned long pulse_start = 0;
+		while (client.IsSendInProgress()) {
+			if (!Timer::IsRunning()) {
+				timing = false;
+			} else if (!timing) {
+				timing = true;
+				pulse_start = micros();
+			} else if (micros() - pulse_start >= Timer::Micros()) {
+				timing = false;
+				Timer::Fire();
+			}
+			std::this_thread::yield();
+		}
+		return client.FinishSendJoystickState(c);
+	}
+
+	Client client;
+};
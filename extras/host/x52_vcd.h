@@ -0,0 +1,312 @@
+// X52VcdRecorder records the pin changes of the host Arduino stand-in
+// (Arduino.h) into a Value Change Dump (VCD) file that can be opened with
+// GTKWave. It's the host version of the logic analyzer screenshots of the
+// docs: the tools in extras/linux use it to show the timing of the clients.
+//
+// The changes are recorded into a preallocated buffer from the
+// x52_host_write_hook (a timestamp and a store under an uncontended lock per
+// edge) and the file is formatted only by Write after the run, so the
+// recording doesn't slow down the wait loops much.
+//
+// The timestamps are in microseconds of the micros() of Arduino.h, the
+// clock the clients compute their deadlines with, so a timeout in the dump
+// is the timeout of the code. With ChangeTimestamps every change is one tick
+// later than the previous one instead: the dump shows only the order of the
+// changes and the dumps of two runs with the same edge sequence are
+// identical, whatever the scheduler of the host did.
+//
+// The recording can be limited to a time window and to a range of frames.
+// The frames are counted by BeginFrame (call it before every poll) and they
+// are recorded as the "frame" signal of the dump. The times in the file
+// start at 0 at the beginning of the recorded part.
+//
+// Usage:
+//   X52VcdRecorder rec;
+//   rec.AddSignal(1, "C01"); ... rec.AddSignal(4, "C04");
+//   rec.Start();
+//   for (...) { rec.BeginFrame(); client.PollJoystickState(...); }
+//   rec.Stop();
+//   rec.Write("trace.vcd");
+#pragma once
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include "Arduino.h"
+#include "x52_host_tools.h"
+
+
+class X52VcdRecorder {
+public:
+	enum {
+		MAX_SIGNALS = 16,
+		// the index of the frame counter in the events
+		FRAME_SIGNAL = MAX_SIGNALS,
+	};
+
+	enum Timestamps {
+		MicrosTimestamps,
+		ChangeTimestamps,
+	};
+
+	struct Filter {
+		// the time window relative to Start in the unit of the timestamps
+		uint64_t from = 0;
+		uint64_t to = UINT64_MAX;
+		// the range of frames (counted from 1 by BeginFrame, 0 is the time before the first frame)
+		unsigned long first_frame = 0;
+		unsigned long last_frame = ULONG_MAX;
+	};
+
+	explicit X52VcdRecorder(size_t max_events=1 << 20, Timestamps timestamps=MicrosTimestamps)
+		: m_MaxEvents(max_events), m_Timestamps(timestamps) {}
+
+	~X52VcdRecorder() {
+		Stop();
+	}
+
+	// AddSignal adds a pin to the dump. Call it before Start.
+	bool AddSignal(uint8_t pin, const char* name) {
+		if (m_NumSignals >= MAX_SIGNALS)
+			return false;
+		m_Pins[m_NumSignals] = pin;
+		m_Names[m_NumSignals] = name;
+		m_NumSignals++;
+		return true;
+	}
+
+	void SetFilter(const Filter& filter) {
+		m_Filter = filter;
+	}
+
+	// Start installs the write hook. Only one recorder can be active at a time.
+	void Start() {
+		m_Events.clear();
+		m_Events.reserve(m_MaxEvents);
+		m_Dropped = 0;
+		m_Frame = 0;
+		m_Opened = false;
+		m_Done = false;
+		m_Open = m_Last = 0;
+		m_NumChanges = 0;
+		for (int i=0; i<m_NumSignals; i++)
+			m_Current[i] = uint32_t(digitalRead(m_Pins[i]));
+		m_Current[FRAME_SIGNAL] = 0;
+		m_StartMicros = micros();
+		Active() = this;
+		x52_host_write_hook() = OnWrite;
+	}
+
+	void Stop() {
+		if (Active() != this)
+			return;
+		x52_host_write_hook() = nullptr;
+		Active() = nullptr;
+	}
+
+	void BeginFrame() {
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		Record(FRAME_SIGNAL, uint32_t(++m_Frame));
+	}
+
+	// Done returns true after the end of the time window or the frame range.
+	bool Done() const {
+		return m_Done;
+	}
+
+	size_t NumEvents() const {
+		return m_Events.size();
+	}
+
+	// NumDropped is the number of changes lost because the buffer was full.
+	unsigned long NumDropped() const {
+		return m_Dropped;
+	}
+
+	// Write writes the recorded part into a VCD file. Call it after Stop.
+	bool Write(const char* path, const char* comment=nullptr) const {
+		FILE* f = fopen(path, "w");
+		if (!f)
+			return false;
+		static char buf[1 << 16];
+		setvbuf(f, buf, _IOFBF, sizeof(buf));
+
+		fprintf(f, "$version x52 host VCD recorder $end\n");
+		if (comment)
+			fprintf(f, "$comment %s $end\n", comment);
+		if (m_Timestamps == ChangeTimestamps)
+			fprintf(f, "$comment one tick per change $end\n");
+		fprintf(f, "$timescale 1us $end\n$scope module x52 $end\n");
+		for (int i=0; i<m_NumSignals; i++)
+			fprintf(f, "$var wire 1 %c %s $end\n", Id(i), m_Names[i]);
+		fprintf(f, "$var integer 32 %c frame $end\n", Id(FRAME_SIGNAL));
+		fprintf(f, "$upscope $end\n$enddefinitions $end\n");
+		if (!m_Opened)
+			return fclose(f) == 0;
+
+		fprintf(f, "#0\n$dumpvars\n");
+		for (int i=0; i<m_NumSignals; i++)
+			WriteValue(f, i, m_Initial[i]);
+		WriteValue(f, FRAME_SIGNAL, m_Initial[FRAME_SIGNAL]);
+		fprintf(f, "$end\n");
+
+		uint64_t last = 0;
+		for (const Event& e : m_Events) {
+			uint64_t t = e.t - m_Open;
+			if (t != last) {
+				fprintf(f, "#%llu\n", (unsigned long long)t);
+				last = t;
+			}
+			WriteValue(f, e.signal, e.value);
+		}
+		return fclose(f) == 0;
+	}
+
+	// PrintResponseTimes prints the distribution of the times from a change of
+	// the "from" signal to the next change of the "to" signal (e.g. a clock
+	// edge of the throttle and the answer of the joystick). A change of
+	// "from" that isn't answered before the next one isn't counted. The times
+	// are in the unit of the timestamps.
+	void PrintResponseTimes(FILE* f, int from, int to) const {
+		if (from < 0 || from >= m_NumSignals || to < 0 || to >= m_NumSignals)
+			return;
+		std::vector<uint64_t> v;
+		bool waiting = false;
+		uint64_t since = 0;
+		for (const Event& e : m_Events) {
+			if (e.signal == from) {
+				waiting = true;
+				since = e.t;
+			} else if (e.signal == to && waiting) {
+				v.push_back(e.t - since);
+				waiting = false;
+			}
+		}
+		std::sort(v.begin(), v.end());
+		if (v.empty()) {
+			fprintf(f, "  %s -> %s: no responses\n", m_Names[from], m_Names[to]);
+			return;
+		}
+		const char* unit = m_Timestamps == ChangeTimestamps ? " changes" : "us";
+		fprintf(f, "  %s -> %s: n=%zu p50=%llu%s p99=%llu%s max=%llu%s\n", m_Names[from], m_Names[to], v.size(),
+			(unsigned long long)x52_host_percentile(v, 0.5), unit,
+			(unsigned long long)x52_host_percentile(v, 0.99), unit,
+			(unsigned long long)x52_host_percentile(v, 1.0), unit);
+	}
+
+	// Signal returns the index of the signal of a pin (for PrintResponseTimes) or -1.
+	int Signal(uint8_t pin) const {
+		for (int i=0; i<m_NumSignals; i++) {
+			if (m_Pins[i] == pin)
+				return i;
+		}
+		return -1;
+	}
+
+private:
+	struct Event {
+		uint64_t t;
+		uint32_t value;
+		uint8_t signal;
+	};
+
+	static X52VcdRecorder*& Active() {
+		static X52VcdRecorder* active;
+		return active;
+	}
+
+	static void OnWrite(uint8_t pin, uint8_t value) {
+		X52VcdRecorder* rec = Active();
+		if (!rec)
+			return;
+		int signal = rec->Signal(pin);
+		if (signal < 0)
+			return;
+		std::lock_guard<std::mutex> lock(rec->m_Mutex);
+		rec->Record(signal, value);
+	}
+
+	static char Id(int signal) {
+		return char('!' + signal);
+	}
+
+	static void WriteValue(FILE* f, int signal, uint32_t value) {
+		if (signal != FRAME_SIGNAL) {
+			fprintf(f, "%c%c\n", value ? '1' : '0', Id(signal));
+			return;
+		}
+		char bits[33];
+		int n = 0;
+		do {
+			bits[n++] = char('0' + (value & 1));
+			value >>= 1;
+		} while (value);
+		fputc('b', f);
+		while (n)
+			fputc(bits[--n], f);
+		fprintf(f, " %c\n", Id(signal));
+	}
+
+	// Now returns the timestamp of a change relative to Start. The micros()
+	// of the host wrap around after ~71 minutes, a longer recording has to
+	// use a window.
+	uint64_t Now() {
+		if (m_Timestamps == ChangeTimestamps)
+			return ++m_NumChanges;
+		return uint32_t(micros() - m_StartMicros);
+	}
+
+	// Record is called with m_Mutex held. The timestamp is taken under the
+	// lock so the events of the two sides are in order.
+	void Record(int signal, uint32_t value) {
+		uint64_t t = Now();
+		unsigned long frame = signal == FRAME_SIGNAL ? value : m_Frame;
+		bool open = !m_Done && t >= m_Filter.from && t < m_Filter.to &&
+			frame >= m_Filter.first_frame && frame <= m_Filter.last_frame;
+		if (open && !m_Opened) {
+			// The initial values are the values before this change. They are
+			// valid since the previous change (or the beginning of the window).
+			m_Opened = true;
+			std::copy(m_Current, m_Current + MAX_SIGNALS + 1, m_Initial);
+			m_Open = std::max(m_Filter.from, signal == FRAME_SIGNAL ? t : m_Last);
+		}
+		m_Current[signal] = value;
+		m_Last = t;
+		if (!open) {
+			if (m_Opened)
+				m_Done = true;
+			return;
+		}
+		if (m_Events.size() >= m_MaxEvents) {
+			m_Dropped++;
+			return;
+		}
+		Event e = {t, value, uint8_t(signal)};
+		m_Events.push_back(e);
+	}
+
+	size_t m_MaxEvents;
+	Timestamps m_Timestamps;
+	int m_NumSignals = 0;
+	uint8_t m_Pins[MAX_SIGNALS];
+	const char* m_Names[MAX_SIGNALS];
+	Filter m_Filter;
+
+	std::mutex m_Mutex;
+	std::vector<Event> m_Events;
+	unsigned long m_Dropped = 0;
+	unsigned long m_Frame = 0;
+	bool m_Opened = false;
+	volatile bool m_Done = false;
+	unsigned long m_StartMicros = 0;
+	uint64_t m_NumChanges = 0;
+	uint64_t m_Open = 0;
+	uint64_t m_Last = 0;
+	uint32_t m_Current[MAX_SIGNALS + 1];
+	uint32_t m_Initial[MAX_SIGNALS + 1];
+};
@@ -0,0 +1,155 @@
+// x52_analog_bench runs the AnalogPipeline (src/x52_analog.h) on a PC with
+// a MockAdc: it plays a stream of noisy samples of known axis positions and
+// bouncing buttons through the interrupt side of the pipeline, checks the
+// decimated axis values and the debounced buttons, and reports the CPU cost
+// per sample (the work of the ADC interrupt handler).
+//
+// The host numbers are only a relative measure for comparing changes of the
+// pipeline, they don't translate to the CPU cost on a microcontroller.
+//
+// Build (from this directory):
+//   g++ -std=c++17 -O2 -Wall -I../host -I../../src x52_analog_bench.cpp -o x52_analog_bench
+//
+// Usage:
+//   x52_analog_bench [--samples <n>] [--noise <lsb>] [--seed <n>]
+#include <stdlib.h>
+#include <math.h>
+
+#include <random>
+#include <string>
+
+#include "x52_hotas.h"
+#include "x52_host_tools.h"
+
+
+namespace {
+
+
+enum {
+	NUM_CHANNELS = 3,
+	SAMPLES_LOG2 = 4,
+};
+
+typedef x52::MockAdc<> Adc;
+typedef x52::AnalogPipeline<Adc, NUM_CHANNELS, SAMPLES_LOG2> Pipeline;
+
+Pipeline g_Pipeline;
+
+// The true positions of the axes in 1/64 LSB of the ADC and the raw levels
+// of the buttons. The ADC side reads them, the checks compare against them.
+uint32_t g_Position[NUM_CHANNELS];
+uint16_t g_RawButtons;
+
+uint16_t read_buttons() {
+	return g_RawButtons;
+}
+
+
+}  // namespace
+
+
+int main(int argc, char** argv) {
+	unsigned long num_samples = 3000000;
+	double noise = 1.0;
+	unsigned long seed = 1;
+
+	for (int i=1; i<argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--samples" && i+1 < argc)
+			num_samples = strtoul(argv[++i], nullptr, 10);
+		else if (arg == "--noise" && i+1 < argc)
+			noise = atof(argv[++i]);
+		else if (arg == "--seed" && i+1 < argc)
+			seed = strtoul(argv[++i], nullptr, 10);
+		else {
+			fprintf(stderr, "usage: x52_analog_bench [--samples <n>] [--noise <lsb>] [--seed <n>]\n");
+			return 2;
+		}
+	}
+
+	std::mt19937 rng(static_cast<uint32_t>(seed));
+	std::normal_distribution<double> gauss(0.0, noise);
+
+	// The samples are generated up front so the timed loop measures only the pipeline.
+	enum { STREAM_SIZE = 1 << 16 };
+	static uint16_t stream[STREAM_SIZE];
+
+	static const uint8_t channels[NUM_CHANNELS] = {0, 1, 2};
+	g_Pipeline.Setup(channels, read_buttons);
+
+	// --- accuracy: the positions move slowly and the buttons bounce ---
+	// A block is compared with the mean of the true positions of its samples.
+	double err_sum[NUM_CHANNELS] = {}, err_max[NUM_CHANNELS] = {}, truth[NUM_CHANNELS] = {};
+	unsigned long num_checks = 0, button_errors = 0, button_glitches = 0, button_changes = 0;
+	uint16_t stable_buttons = 0, prev_stable_buttons = 0;
+	int bounce = 0;
+	uint8_t last_blocks = g_Pipeline.NumBlocks();
+	unsigned long rounds = 0;
+
+	for (unsigned long n=0; n<num_samples/4; n++) {
+		uint8_t ch = Adc::Channel();
+		if (ch == 0) {
+			// a new round: move the axes and the buttons
+			rounds++;
+			for (int c=0; c<NUM_CHANNELS; c++)
+				g_Position[c] = uint32_t((512 + 480 * sin(double(rounds) / (2000.0 + 700*c))) * 64);
+			if (rounds % 500 == 0) {
+				prev_stable_buttons = stable_buttons;
+				stable_buttons ^= uint16_t(1 << (rounds / 500 % 16));
+				bounce = 3;
+				button_changes++;
+			}
+			// a bouncing contact alternates for a few rounds before it settles
+			g_RawButtons = bounce > 0 ? uint16_t(stable_buttons ^ ((bounce & 1) ? 0xFFFF : 0)) : stable_buttons;
+			if (bounce > 0)
+				bounce--;
+		}
+		truth[ch] += double(g_Position[ch]) / 64.0;
+		double v = double(g_Position[ch]) / 64.0 + gauss(rng);
+		Adc::Convert(uint16_t(v < 0 ? 0 : v > 1023 ? 1023 : lround(v)));
+
+		uint8_t blocks = g_Pipeline.NumBlocks();
+		if (blocks != last_blocks) {
+			last_blocks = blocks;
+			num_checks++;
+			for (int c=0; c<NUM_CHANNELS; c++) {
+				// in 11-bit units
+				double err = fabs(double(g_Pipeline.Axis<11>(c)) - truth[c] * 2 / (1 << SAMPLES_LOG2));
+				err_sum[c] += err;
+				if (err > err_max[c])
+					err_max[c] = err;
+				truth[c] = 0;
+			}
+			// The debouncer needs 4 stable rounds after the bounces and it
+			// mustn't show any of the bounces.
+			uint16_t b = g_Pipeline.Buttons();
+			if (b != stable_buttons && b != prev_stable_buttons)
+				button_glitches++;
+			if (bounce == 0 && rounds % 500 > 8 && b != stable_buttons)
+				button_errors++;
+		}
+	}
+
+	printf("accuracy (11-bit units, %lu blocks of %d rounds, noise %.2f LSB):\n", num_checks, 1 << SAMPLES_LOG2, noise);
+	for (int c=0; c<NUM_CHANNELS; c++)
+		printf("  axis %d: mean abs error %.2f  max %.2f\n", c, err_sum[c] / double(num_checks ? num_checks : 1), err_max[c]);
+	printf("buttons: changes=%lu late=%lu glitches=%lu\n", button_changes, button_errors, button_glitches);
+
+	// --- CPU cost of the interrupt side ---
+	for (int i=0; i<STREAM_SIZE; i++) {
+		double v = 512 + gauss(rng);
+		stream[i] = uint16_t(lround(v));
+	}
+	double best = 1e30;
+	for (int r=0; r<5; r++) {
+		uint64_t t = x52_host_now_ns();
+		for (unsigned long n=0; n<num_samples; n++)
+			Adc::Convert(stream[n & (STREAM_SIZE-1)]);
+		double ns = double(x52_host_now_ns() - t) / double(num_samples);
+		if (ns < best)
+			best = ns;
+	}
+	printf("interrupt side: %.1f ns/sample (best of 5 runs of %lu samples)\n", best, num_samples);
+
+	return button_errors || button_glitches ? 1 : 0;
+}
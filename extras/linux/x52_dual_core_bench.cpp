@@ -0,0 +1,258 @@
+// x52_dual_core_bench runs the dual-core deployment mode (src/x52_dual_core.h)
+// on a PC: a pro::JoystickClient polls a simulated joystick on one pinned
+// thread and publishes the states through a DualCoreLink, a second pinned
+// thread consumes them and sends configs back. It reports the throughput,
+// the dropped frames and the latency of the queue.
+//
+// The simulated joystick is a mock HAL: the waits succeed immediately and
+// C03 returns the bits of a generated state so the bench measures the
+// frame engine plus the queues without the timing of real wires. The
+// consumer verifies every state and the mock verifies that the last config
+// sent by the consumer arrives on C01.
+//
+// Build (from this directory):
+//   g++ -std=c++17 -O2 -Wall -pthread -I../host -I../../src x52_dual_core_bench.cpp -o x52_dual_core_bench
+//
+// Usage:
+//   x52_dual_core_bench [--frames <n>] [--rate <frames-per-second>] [--cpus <producer>,<consumer>] [--work-us <consumer-work-per-frame>]
+//
+// Without --rate the producer polls as fast as it can (a stress test of the
+// queues). The real joysticks send at most a few hundred frames per second.
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "x52_hotas.h"
+#include "x52_dual_core.h"
+#include "x52_host_tools.h"
+
+
+namespace {
+
+
+using x52::pro::JoystickState;
+using x52::pro::JoystickConfig;
+typedef x52::pro::Frame<x52::ArduinoHAL> ProFrame;
+
+enum { C01, C02, C03, C04 };
+
+
+void fill_state(JoystickState& s, uint32_t n) {
+	s.x = uint16_t(n % (JoystickState::MAX_X + 1));
+	s.y = uint16_t(n / 7 % (JoystickState::MAX_Y + 1));
+	s.z = uint16_t(n / 3 % (JoystickState::MAX_Z + 1));
+	s.button_a = n & 1;
+}
+
+bool check_state(const JoystickState& s, uint32_t n) {
+	JoystickState expected;
+	fill_state(expected, n);
+	return s.x == expected.x && s.y == expected.y && s.z == expected.z && s.button_a == expected.button_a;
+}
+
+
+// The frame end timestamps of the mock, indexed by frame number.
+// The consumer reads them to measure the latency of the queue.
+struct Stamp {
+	std::atomic<uint32_t> frame;
+	std::atomic<uint64_t> ns;
+};
+Stamp g_Stamps[4096];
+
+
+// MockHAL plays the joystick. Every rising edge of C02 starts a clock cycle:
+// the joystick answers immediately, samples C01 (the config bits) and
+// presents the next state bit on C03.
+struct MockHAL {
+	static uint8_t s_Levels[4];
+	static uint32_t s_Cycles;
+	static JoystickState::Binary s_State;
+	static JoystickConfig::Binary s_RecvConfig;
+	static JoystickConfig::Binary s_LastConfig;
+	static uint32_t s_NumConfigChanges;
+
+	static void PinMode(uint8_t, uint8_t) {}
+	static void SetupWaitPin(uint8_t) {}
+
+	static int Read(uint8_t pin) {
+		if (pin != C03)
+			return s_Levels[pin];
+		int c = int((s_Cycles - 1) % ProFrame::NUM_CYCLES);
+		// the frame validity marker of the fast resync is HIGH
+		return c < JoystickState::NUM_BITS ? s_State.Bit(c) : HIGH;
+	}
+
+	static void Write(uint8_t pin, int value) {
+		bool rising = pin == C02 && value && !s_Levels[C02];
+		s_Levels[pin] = uint8_t(value);
+		if (!rising)
+			return;
+
+		uint32_t frame = s_Cycles / ProFrame::NUM_CYCLES;
+		int c = int(s_Cycles++ % ProFrame::NUM_CYCLES);
+		if (c == 0) {
+			JoystickState s;
+			fill_state(s, frame);
+			s.ToBinary(s_State);
+		} else if (c >= ProFrame::CONFIG_CYCLE) {
+			s_RecvConfig.SetBit(c - ProFrame::CONFIG_CYCLE, s_Levels[C01]);
+		}
+		if (c == ProFrame::NUM_CYCLES - 1) {
+			if (memcmp(s_RecvConfig.Bytes(), s_LastConfig.Bytes(), sizeof(s_LastConfig)) != 0) {
+				s_LastConfig = s_RecvConfig;
+				s_NumConfigChanges++;
+			}
+			Stamp& st = g_Stamps[frame % 4096];
+			st.ns.store(x52_host_now_ns(), std::memory_order_relaxed);
+			st.frame.store(frame, std::memory_order_release);
+		}
+	}
+
+	static bool WaitForPinState(uint8_t, int, unsigned long) {
+		return true;
+	}
+
+	static unsigned long Micros() {
+		return micros();
+	}
+
+	static void DelayMicros(unsigned long) {}
+};
+
+uint8_t MockHAL::s_Levels[4];
+uint32_t MockHAL::s_Cycles;
+JoystickState::Binary MockHAL::s_State;
+JoystickConfig::Binary MockHAL::s_RecvConfig;
+JoystickConfig::Binary MockHAL::s_LastConfig;
+uint32_t MockHAL::s_NumConfigChanges;
+
+
+typedef x52::DualCoreLink<JoystickState, JoystickConfig, 16, 4, MockHAL> Link;
+
+
+void pin_thread(std::thread& t, int cpu) {
+	if (cpu < 0)
+		return;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	int err = pthread_setaffinity_np(t.native_handle(), sizeof(set), &set);
+	if (err)
+		fprintf(stderr, "warning: can't pin a thread to CPU %d (error %d)\n", cpu, err);
+}
+
+
+}  // namespace
+
+
+int main(int argc, char** argv) {
+	uint32_t num_frames = 1000000;
+	int cpus[2] = {0, 1};
+	unsigned long work_us = 0;
+	unsigned long rate = 0;
+
+	for (int i=1; i<argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--frames" && i+1 < argc)
+			num_frames = uint32_t(strtoul(argv[++i], nullptr, 10));
+		else if (arg == "--cpus" && i+1 < argc && sscanf(argv[++i], "%d,%d", &cpus[0], &cpus[1]) == 2)
+			continue;
+		else if (arg == "--work-us" && i+1 < argc)
+			work_us = strtoul(argv[++i], nullptr, 10);
+		else if (arg == "--rate" && i+1 < argc)
+			rate = strtoul(argv[++i], nullptr, 10);
+		else {
+			fprintf(stderr, "usage: x52_dual_core_bench [--frames <n>] [--rate <frames-per-second>] [--cpus <producer>,<consumer>] [--work-us <consumer-work-per-frame>]\n");
+			return 2;
+		}
+	}
+
+	Link link;
+	std::atomic<bool> producer_done(false);
+	JoystickConfig last_sent;
+	uint32_t num_received = 0, num_bad = 0, num_configs_sent = 0;
+	std::vector<uint64_t> latencies;
+	latencies.reserve(num_frames);
+
+	uint64_t start = x52_host_now_ns();
+
+	std::thread producer([&]() {
+		x52::pro::JoystickClient<C01, C02, C03, C04, MockHAL> client;
+		client.Setup();
+		uint64_t next = x52_host_now_ns();
+		for (uint32_t i=0; i<num_frames; i++) {
+			if (rate) {
+				while (x52_host_now_ns() < next) {}
+				next += 1000000000 / rate;
+			}
+			link.PollAndPublish(client);
+		}
+		producer_done.store(true, std::memory_order_release);
+	});
+
+	std::thread consumer([&]() {
+		Link::StateFrame f;
+		for (;;) {
+			if (!link.ReceiveState(f)) {
+				if (producer_done.load(std::memory_order_acquire) && !link.ReceiveState(f))
+					break;
+				std::this_thread::yield();
+				continue;
+			}
+			uint64_t t = x52_host_now_ns();
+			Stamp& st = g_Stamps[f.seq % 4096];
+			if (st.frame.load(std::memory_order_acquire) == f.seq)
+				latencies.push_back(t - st.ns.load(std::memory_order_relaxed));
+
+			JoystickState s;
+			s.SetFromBinary(f.state);
+			if (!check_state(s, f.seq))
+				num_bad++;
+			num_received++;
+
+			if (num_received % 1000 == 0) {
+				JoystickConfig cfg;
+				cfg.led_brightness = uint8_t(num_received / 1000 % (JoystickConfig::MAX_LED_BRIGHTNESS + 1));
+				cfg.button_a_led = (num_received / 1000) & 1 ? x52::pro::Red : x52::pro::Green;
+				if (link.SendConfig(cfg)) {
+					last_sent = cfg;
+					num_configs_sent++;
+				}
+			}
+			if (work_us) {
+				uint64_t end = t + uint64_t(work_us) * 1000;
+				while (x52_host_now_ns() < end) {}
+			}
+		}
+	});
+
+	pin_thread(producer, cpus[0]);
+	pin_thread(consumer, cpus[1]);
+	producer.join();
+	consumer.join();
+	double seconds = double(x52_host_now_ns() - start) / 1e9;
+
+	// The last config reaches the wire in the next frame: poll once more.
+	x52::pro::JoystickClient<C01, C02, C03, C04, MockHAL> client;
+	link.PollAndPublish(client);
+	JoystickConfig::Binary last_sent_bin;
+	last_sent.ToBinary(last_sent_bin);
+	bool config_ok = memcmp(last_sent_bin.Bytes(), MockHAL::s_LastConfig.Bytes(), sizeof(last_sent_bin)) == 0;
+
+	printf("frames: polled=%u received=%u dropped=%u bad=%u\n", num_frames, num_received, link.NumDropped(), num_bad);
+	printf("throughput: %.0f frames/s\n", double(num_frames) / seconds);
+	printf("configs: sent=%u seen_on_wire=%u last_config_ok=%d\n", num_configs_sent, MockHAL::s_NumConfigChanges, int(config_ok));
+	std::sort(latencies.begin(), latencies.end());
+	printf("queue latency (ns): p50=%llu p99=%llu p99.9=%llu max=%llu\n",
+		(unsigned long long)x52_host_percentile(latencies, 0.5),
+		(unsigned long long)x52_host_percentile(latencies, 0.99),
+		(unsigned long long)x52_host_percentile(latencies, 0.999),
+		(unsigned long long)x52_host_percentile(latencies, 1.0));
+	return num_bad || !config_ok ? 1 : 0;
+}
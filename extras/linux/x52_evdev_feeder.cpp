@@ -0,0 +1,541 @@
+// x52_evdev_feeder reads a joystick (any Linux evdev device), maps it to the
+// fields of x52::pro::JoystickState and streams the states to a board
+// running the Fake-X52-Pro-Joystick example with STATE_FROM_HOST=1 in the
+// format of x52::stream (see src/x52_stream.h). The board sends the state to
+// an X52 Pro throttle when it polls and streams the JoystickConfigs (LEDs)
+// of the throttle back: the feeder prints them when they change.
+//
+// A state is sent right after the SYN_REPORT of the input events that
+// changed it (at most one per --min-interval-us) and repeated every
+// --keepalive-ms. The capture timestamp of a frame is the CLOCK_MONOTONIC
+// time of the input event in micros.
+//
+// Build (from this directory):
+//   g++ -std=c++17 -O2 -Wall -I../host -I../../src x52_evdev_feeder.cpp -o x52_evdev_feeder
+//
+// Usage:
+//   x52_evdev_feeder [options] <evdev-device> <serial-device>
+//   x52_evdev_feeder [options] --synthetic <hz> <serial-device>
+//     --map <field>=<code>,...  map evdev codes to the fields (see below)
+//     --invert <field>,...      invert axes (x, y, z)
+//     --grab                    grab the evdev device (other programs don't see its events)
+//     --synthetic <hz>          generate moving axes and buttons instead of reading a device
+//     --min-interval-us <n>     minimum time between two states (default: 1000)
+//     --keepalive-ms <n>        resend the state this often (default: 100, 0: off)
+//     --stats <sec>             print statistics periodically (default: 10, 0: off)
+//
+// Fields: x, y, z (absolute axes), pov_1, pov_2 (the X code of a hat, its Y
+// code is the next one), trigger_stage_1, button_fire, button_a, button_b,
+// button_c, pinkie_switch, trigger_stage_2, button_t1..button_t6, mode_1..mode_3.
+// The codes are the names of <linux/input-event-codes.h> (ABS_*, BTN_*) or
+// numbers. The default map is x=ABS_X, y=ABS_Y, z=ABS_RZ, pov_1=ABS_HAT0X,
+// pov_2=ABS_HAT1X and the buttons of the device in the order of their codes
+// assigned to the buttons in the order above (the order of x52_uinputd).
+// List the codes of a device with evtest.
+//
+// Test without hardware (see x52_feeder_sim):
+//   ./x52_feeder_sim --seconds 10       # prints "pty: /dev/pts/N"
+//   ./x52_evdev_feeder --synthetic 500 /dev/pts/N
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <math.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/signalfd.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "x52_hotas.h"
+#include "x52_stream.h"
+
+
+namespace {
+
+
+uint64_t now_micros() {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+enum Field {
+	FieldX, FieldY, FieldZ, FieldPov1, FieldPov2,
+	FirstButton,
+	FieldTriggerStage1 = FirstButton, FieldButtonFire, FieldButtonA, FieldButtonB, FieldButtonC,
+	FieldPinkieSwitch, FieldTriggerStage2,
+	FieldButtonT1, FieldButtonT2, FieldButtonT3, FieldButtonT4, FieldButtonT5, FieldButtonT6,
+	FieldMode1, FieldMode2, FieldMode3,
+	NUM_FIELDS,
+	NUM_BUTTONS = FieldMode1 - FirstButton,
+};
+
+const char* const g_FieldNames[NUM_FIELDS] = {
+	"x", "y", "z", "pov_1", "pov_2",
+	"trigger_stage_1", "button_fire", "button_a", "button_b", "button_c",
+	"pinkie_switch", "trigger_stage_2",
+	"button_t1", "button_t2", "button_t3", "button_t4", "button_t5", "button_t6",
+	"mode_1", "mode_2", "mode_3",
+};
+
+
+struct CodeName {
+	const char* name;
+	int code;
+};
+
+#define X52_CODE(c) {#c, c}
+const CodeName g_CodeNames[] = {
+	X52_CODE(ABS_X), X52_CODE(ABS_Y), X52_CODE(ABS_Z), X52_CODE(ABS_RX), X52_CODE(ABS_RY), X52_CODE(ABS_RZ),
+	X52_CODE(ABS_THROTTLE), X52_CODE(ABS_RUDDER), X52_CODE(ABS_WHEEL), X52_CODE(ABS_GAS), X52_CODE(ABS_BRAKE),
+	X52_CODE(ABS_HAT0X), X52_CODE(ABS_HAT1X), X52_CODE(ABS_HAT2X), X52_CODE(ABS_HAT3X),
+	X52_CODE(BTN_TRIGGER), X52_CODE(BTN_THUMB), X52_CODE(BTN_THUMB2), X52_CODE(BTN_TOP), X52_CODE(BTN_TOP2),
+	X52_CODE(BTN_PINKIE), X52_CODE(BTN_BASE), X52_CODE(BTN_BASE2), X52_CODE(BTN_BASE3), X52_CODE(BTN_BASE4),
+	X52_CODE(BTN_BASE5), X52_CODE(BTN_BASE6), X52_CODE(BTN_DEAD),
+	X52_CODE(BTN_SOUTH), X52_CODE(BTN_EAST), X52_CODE(BTN_NORTH), X52_CODE(BTN_WEST),
+	X52_CODE(BTN_TL), X52_CODE(BTN_TR), X52_CODE(BTN_TL2), X52_CODE(BTN_TR2),
+	X52_CODE(BTN_SELECT), X52_CODE(BTN_START), X52_CODE(BTN_MODE), X52_CODE(BTN_THUMBL), X52_CODE(BTN_THUMBR),
+	X52_CODE(BTN_TRIGGER_HAPPY1), X52_CODE(BTN_TRIGGER_HAPPY2), X52_CODE(BTN_TRIGGER_HAPPY3),
+	X52_CODE(BTN_TRIGGER_HAPPY4), X52_CODE(BTN_TRIGGER_HAPPY5), X52_CODE(BTN_TRIGGER_HAPPY6),
+};
+#undef X52_CODE
+
+int parse_code(const std::string& s) {
+	for (const CodeName& c : g_CodeNames) {
+		if (s == c.name)
+			return c.code;
+	}
+	char* end;
+	long v = strtol(s.c_str(), &end, 0);
+	return *end || s.empty() ? -1 : int(v);
+}
+
+int parse_field(const std::string& s) {
+	for (int i=0; i<NUM_FIELDS; i++) {
+		if (s == g_FieldNames[i])
+			return i;
+	}
+	return -1;
+}
+
+
+// Mapping turns the evdev events into a JoystickState.
+class Mapping {
+public:
+	Mapping() {
+		for (int i=0; i<NUM_FIELDS; i++)
+			m_Codes[i] = -1;
+		memset(m_Invert, 0, sizeof(m_Invert));
+		memset(m_Hats, 0, sizeof(m_Hats));
+		memset(m_Buttons, 0, sizeof(m_Buttons));
+		m_State.x = x52::pro::JoystickState::CENTER_X;
+		m_State.y = x52::pro::JoystickState::CENTER_Y;
+		m_State.z = x52::pro::JoystickState::CENTER_Z;
+		m_State.mode = x52::Mode1;
+	}
+
+	void Set(int field, int code) { m_Codes[field] = code; }
+	void Invert(int field) { m_Invert[field] = true; }
+	bool IsSet(int field) const { return m_Codes[field] >= 0; }
+
+	// SetDefaults fills the unmapped fields with the default map of the device.
+	void SetDefaults(int fd) {
+		static const int axes[] = {ABS_X, ABS_Y, ABS_RZ, ABS_HAT0X, ABS_HAT1X};
+		for (int i=0; i<=FieldPov2; i++) {
+			if (!IsSet(i))
+				Set(i, axes[i]);
+		}
+		if (fd < 0)
+			return;
+
+		uint8_t keys[KEY_MAX/8 + 1];
+		memset(keys, 0, sizeof(keys));
+		ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keys)), keys);
+		int field = FirstButton;
+		for (int code=BTN_MISC; code<KEY_MAX && field<FirstButton+NUM_BUTTONS; code++) {
+			if (!(keys[code/8] & (1 << (code%8))) || Mapped(code))
+				continue;
+			while (field < FirstButton+NUM_BUTTONS && IsSet(field))
+				field++;
+			if (field < FirstButton+NUM_BUTTONS)
+				Set(field++, code);
+		}
+
+		for (int i=FieldX; i<=FieldZ; i++) {
+			input_absinfo info;
+			if (ioctl(fd, EVIOCGABS(m_Codes[i]), &info) == 0 && info.maximum > info.minimum) {
+				m_Min[i] = info.minimum;
+				m_Max[i] = info.maximum;
+				OnAbs(m_Codes[i], info.value);
+			} else {
+				fprintf(stderr, "warning: the device has no axis %d for %s\n", m_Codes[i], g_FieldNames[i]);
+			}
+		}
+	}
+
+	void Print() const {
+		for (int i=0; i<NUM_FIELDS; i++) {
+			if (IsSet(i))
+				printf("map: %s=%d%s\n", g_FieldNames[i], m_Codes[i], m_Invert[i] ? " (inverted)" : "");
+		}
+		fflush(stdout);
+	}
+
+	void OnAbs(int code, int value) {
+		for (int i=FieldX; i<=FieldZ; i++) {
+			if (code != m_Codes[i])
+				continue;
+			long range = long(m_Max[i]) - long(m_Min[i]);
+			long v = range > 0 ? (long(value) - m_Min[i]) * 1023 / range : 512;
+			v = std::max(0L, std::min(1023L, v));
+			if (m_Invert[i])
+				v = 1023 - v;
+			if (i == FieldX) m_State.x = uint16_t(v);
+			if (i == FieldY) m_State.y = uint16_t(v);
+			if (i == FieldZ) m_State.z = uint16_t(v);
+		}
+		for (int h=0; h<2; h++) {
+			int hat_code = m_Codes[FieldPov1 + h];
+			if (code != hat_code && code != hat_code + 1)
+				continue;
+			m_Hats[h][code - hat_code] = value;
+			int dir = (m_Hats[h][0] < 0 ? x52::Left : m_Hats[h][0] > 0 ? x52::Right : 0) |
+				(m_Hats[h][1] < 0 ? x52::Up : m_Hats[h][1] > 0 ? x52::Down : 0);
+			(h ? m_State.pov_2 : m_State.pov_1) = x52::Direction(dir);
+		}
+	}
+
+	void OnKey(int code, bool pressed) {
+		for (int i=FirstButton; i<NUM_FIELDS; i++) {
+			if (code == m_Codes[i])
+				m_Buttons[i - FirstButton] = pressed;
+		}
+		const bool* b = m_Buttons;
+		m_State.trigger_stage_1 = b[0];
+		m_State.button_fire = b[1];
+		m_State.button_a = b[2];
+		m_State.button_b = b[3];
+		m_State.button_c = b[4];
+		m_State.pinkie_switch = b[5];
+		m_State.trigger_stage_2 = b[6];
+		m_State.button_t1 = b[7];
+		m_State.button_t2 = b[8];
+		m_State.button_t3 = b[9];
+		m_State.button_t4 = b[10];
+		m_State.button_t5 = b[11];
+		m_State.button_t6 = b[12];
+		if (b[FieldMode1 - FirstButton])
+			m_State.mode = x52::Mode1;
+		else if (b[FieldMode2 - FirstButton])
+			m_State.mode = x52::Mode2;
+		else if (b[FieldMode3 - FirstButton])
+			m_State.mode = x52::Mode3;
+	}
+
+	x52::pro::JoystickState& State() { return m_State; }
+
+private:
+	bool Mapped(int code) const {
+		for (int i=FirstButton; i<NUM_FIELDS; i++) {
+			if (m_Codes[i] == code)
+				return true;
+		}
+		return false;
+	}
+
+	int m_Codes[NUM_FIELDS];
+	bool m_Invert[NUM_FIELDS];
+	int m_Min[3] = {0, 0, 0};
+	int m_Max[3] = {1023, 1023, 1023};
+	int m_Hats[2][2];
+	bool m_Buttons[NUM_FIELDS - FirstButton];
+	x52::pro::JoystickState m_State;
+};
+
+
+// FdOutput adapts the serial port to x52::stream::Writer. A frame that
+// doesn't fit into the buffer of the tty is counted as dropped.
+struct FdOutput {
+	int fd;
+	unsigned long dropped;
+
+	int availableForWrite() { return x52::stream::MAX_FRAME_SIZE; }
+
+	size_t write(const uint8_t* buf, size_t size) {
+		ssize_t n = ::write(fd, buf, size);
+		if (n != ssize_t(size))
+			dropped++;
+		return n < 0 ? 0 : size_t(n);
+	}
+};
+
+
+int open_serial(const char* path) {
+	int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	termios tio;
+	if (tcgetattr(fd, &tio) == 0) {
+		cfmakeraw(&tio);
+		// for the boards without native USB serial (see Fake-X52-Pro-Joystick)
+		cfsetspeed(&tio, B115200);
+		tcsetattr(fd, TCSANOW, &tio);
+	}
+	return fd;
+}
+
+
+void print_config(const x52::pro::JoystickConfig& c) {
+	printf("config: brightness=%d pov_1_blinking=%d fire=%d pov_2=%d a=%d b=%d t1_t2=%d t3_t4=%d t5_t6=%d\n",
+		c.led_brightness, c.pov_1_led_blinking, c.button_fire_led, c.pov_2_led, c.button_a_led,
+		c.button_b_led, c.button_t1_t2_led, c.button_t3_t4_led, c.button_t5_t6_led);
+	fflush(stdout);
+}
+
+
+void usage() {
+	fprintf(stderr, "usage: x52_evdev_feeder [--map <field>=<code>,...] [--invert <field>,...] [--grab] "
+		"[--min-interval-us <n>] [--keepalive-ms <n>] [--stats <sec>] (<evdev-device> | --synthetic <hz>) <serial-device>\n");
+	exit(2);
+}
+
+
+// split_list calls f for the comma separated items of s.
+template <typename F>
+bool split_list(const std::string& s, F f) {
+	for (size_t pos = 0; pos <= s.size();) {
+		size_t end = s.find(',', pos);
+		if (end == std::string::npos)
+			end = s.size();
+		if (!f(s.substr(pos, end - pos)))
+			return false;
+		pos = end + 1;
+	}
+	return true;
+}
+
+
+}  // namespace
+
+
+int main(int argc, char** argv) {
+	Mapping mapping;
+	std::vector<const char*> paths;
+	bool grab = false;
+	double synthetic_hz = 0;
+	uint64_t min_interval = 1000, keepalive = 100000;
+	int stats_period = 10;
+
+	for (int i=1; i<argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--map" && i+1 < argc) {
+			bool ok = split_list(argv[++i], [&](const std::string& item) {
+				size_t eq = item.find('=');
+				int field = parse_field(item.substr(0, eq));
+				int code = eq == std::string::npos ? -1 : parse_code(item.substr(eq + 1));
+				if (field < 0 || code < 0)
+					return false;
+				mapping.Set(field, code);
+				return true;
+			});
+			if (!ok)
+				usage();
+		} else if (arg == "--invert" && i+1 < argc) {
+			bool ok = split_list(argv[++i], [&](const std::string& item) {
+				int field = parse_field(item);
+				if (field < FieldX || field > FieldZ)
+					return false;
+				mapping.Invert(field);
+				return true;
+			});
+			if (!ok)
+				usage();
+		} else if (arg == "--grab") {
+			grab = true;
+		} else if (arg == "--synthetic" && i+1 < argc) {
+			synthetic_hz = atof(argv[++i]);
+		} else if (arg == "--min-interval-us" && i+1 < argc) {
+			min_interval = strtoull(argv[++i], nullptr, 10);
+		} else if (arg == "--keepalive-ms" && i+1 < argc) {
+			keepalive = strtoull(argv[++i], nullptr, 10) * 1000;
+		} else if (arg == "--stats" && i+1 < argc) {
+			stats_period = atoi(argv[++i]);
+		} else if (arg[0] != '-') {
+			paths.push_back(argv[i]);
+		} else {
+			usage();
+		}
+	}
+	if (paths.size() != (synthetic_hz > 0 ? 1u : 2u))
+		usage();
+
+	int input_fd = -1;
+	if (synthetic_hz <= 0) {
+		input_fd = open(paths[0], O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+		if (input_fd < 0) {
+			perror(paths[0]);
+			return 1;
+		}
+		int clock = CLOCK_MONOTONIC;
+		ioctl(input_fd, EVIOCSCLOCKID, &clock);
+		if (grab && ioctl(input_fd, EVIOCGRAB, 1) < 0)
+			perror("EVIOCGRAB");
+		char name[256] = "?";
+		ioctl(input_fd, EVIOCGNAME(sizeof(name)), name);
+		printf("input: %s (%s)\n", paths[0], name);
+	}
+	mapping.SetDefaults(input_fd);
+	mapping.Print();
+
+	int serial_fd = open_serial(paths.back());
+	if (serial_fd < 0)
+		return 1;
+
+	sigset_t sigs;
+	sigemptyset(&sigs);
+	sigaddset(&sigs, SIGINT);
+	sigaddset(&sigs, SIGTERM);
+	sigprocmask(SIG_BLOCK, &sigs, nullptr);
+	int sig_fd = signalfd(-1, &sigs, SFD_CLOEXEC);
+
+	int ep = epoll_create1(EPOLL_CLOEXEC);
+	epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	for (int fd : {input_fd, serial_fd, sig_fd}) {
+		if (fd < 0)
+			continue;
+		ev.data.fd = fd;
+		epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+	}
+
+	FdOutput out = {serial_fd, 0};
+	x52::stream::Writer<FdOutput> writer(out);
+	x52::stream::Decoder decoder;
+	x52::pro::JoystickConfig::Binary last_cfg;
+	bool has_cfg = false;
+
+	bool dirty = true;
+	uint32_t capture = uint32_t(now_micros());
+	uint64_t last_send = 0, next_synthetic = now_micros();
+	uint64_t start = now_micros(), next_stats = start + uint64_t(stats_period) * 1000000;
+	unsigned long num_sent = 0, num_configs = 0, num_synthetic = 0;
+
+	for (;;) {
+		uint64_t now = now_micros();
+		// the earliest of: the pending state, the keepalive, the synthetic input and the stats
+		uint64_t wake = UINT64_MAX;
+		if (dirty)
+			wake = last_send + min_interval;
+		else if (keepalive)
+			wake = last_send + keepalive;
+		if (synthetic_hz > 0)
+			wake = std::min(wake, next_synthetic);
+		if (stats_period > 0)
+			wake = std::min(wake, next_stats);
+		int timeout_ms = wake == UINT64_MAX ? -1 : int((wake - std::min(wake, now) + 999) / 1000);
+
+		epoll_event events[3];
+		int n = timeout_ms == 0 ? 0 : epoll_wait(ep, events, 3, timeout_ms);
+		if (n < 0 && errno != EINTR) {
+			perror("epoll_wait");
+			return 1;
+		}
+
+		for (int e=0; e<n; e++) {
+			int fd = events[e].data.fd;
+			if (fd == sig_fd)
+				return 0;
+
+			if (fd == input_fd) {
+				input_event events[64];
+				ssize_t size = read(input_fd, events, sizeof(events));
+				if (size < 0) {
+					if (errno == EAGAIN)
+						continue;
+					perror("read input");
+					return 1;
+				}
+				for (int k=0; k<int(size / sizeof(input_event)); k++) {
+					const input_event& ie = events[k];
+					if (ie.type == EV_ABS)
+						mapping.OnAbs(ie.code, ie.value);
+					else if (ie.type == EV_KEY)
+						mapping.OnKey(ie.code, ie.value != 0);
+					else if (ie.type == EV_SYN && ie.code == SYN_REPORT) {
+						dirty = true;
+						capture = uint32_t(uint64_t(ie.input_event_sec) * 1000000 + ie.input_event_usec);
+					}
+				}
+			} else if (fd == serial_fd) {
+				uint8_t buf[256];
+				ssize_t size = read(serial_fd, buf, sizeof(buf));
+				if (size < 0) {
+					// A pty without a reader on the other side reports EIO.
+					if (errno == EAGAIN || errno == EIO) {
+						if (errno == EIO)
+							usleep(10000);
+						continue;
+					}
+					perror("read serial");
+					return 1;
+				}
+				for (ssize_t i=0; i<size; i++) {
+					x52::pro::JoystickConfig::Binary b;
+					if (!decoder.Feed(buf[i]) || decoder.Type() != x52::stream::ProJoystickConfigFrame || !decoder.PayloadToBinary(b))
+						continue;
+					num_configs++;
+					if (has_cfg && b == last_cfg)
+						continue;
+					last_cfg = b;
+					has_cfg = true;
+					x52::pro::JoystickConfig cfg;
+					cfg.SetFromBinary(b);
+					print_config(cfg);
+				}
+			}
+		}
+
+		now = now_micros();
+		if (synthetic_hz > 0 && now >= next_synthetic) {
+			// slow circles on x/y, a saw on z and a button pattern
+			double t = double(num_synthetic++) / synthetic_hz;
+			x52::pro::JoystickState& s = mapping.State();
+			s.x = uint16_t(512 + 500 * sin(t * 2));
+			s.y = uint16_t(512 + 500 * cos(t * 2));
+			s.z = uint16_t(num_synthetic % 1024);
+			s.button_a = (num_synthetic / 100) & 1;
+			s.pov_1 = (num_synthetic / 250) & 1 ? x52::Up : x52::NoDirection;
+			dirty = true;
+			capture = uint32_t(now);
+			next_synthetic += uint64_t(1e6 / synthetic_hz);
+			if (next_synthetic < now)
+				next_synthetic = now;
+		}
+
+		if ((dirty && now >= last_send + min_interval) || (keepalive && now >= last_send + keepalive)) {
+			x52::pro::JoystickState::Binary b;
+			mapping.State().ToBinary(b);
+			// a keepalive carries the capture time of the state it repeats
+			writer.Write(b, capture);
+			num_sent++;
+			last_send = now;
+			dirty = false;
+		}
+
+		if (stats_period > 0 && now >= next_stats) {
+			printf("stats: states_sent=%lu dropped=%lu configs_received=%lu crc_errors=%lu\n",
+				num_sent, out.dropped, num_configs, decoder.NumErrors());
+			fflush(stdout);
+			next_stats += uint64_t(stats_period) * 1000000;
+		}
+	}
+}
@@ -0,0 +1,579 @@
+// x52_fault_soak is a soak test of the recovery paths of the clients. It
+// connects a JoystickClient and a ThrottleClient (pro, std or the std
+// InterruptThrottleClient) through virtual PS/2 wires and injects faults into the wires:
+//
+//   flip     the next data bit (C01 or C03) arrives inverted
+//   drop     the next clock edge (C02 or C04) doesn't arrive
+//   extra    the next clock edge is followed by a short glitch pulse
+//   stretch  the next clock edge arrives after the frame timeout of the other side
+//   hotplug  the cable is unplugged for 5..200ms (possibly in the middle of a frame)
+//
+// The fault arrival times and the fault types are random (seeded). The
+// states and configs sent through the wires are self-checking so the
+// report can tell the lost frames from the corrupted frames that the
+// clients accepted. For every fault type it reports the frames lost until
+// the first good frame and the distribution of the recovery times. This is
+// the data for tuning the timeout macros (e.g. X52_PRO_THROTTLE_TIMEOUT_MICROS):
+// define them on the compiler command line.
+//
+// The JoystickClient polls with a partial state handler (see NoPartialState
+// in src/x52_common.h). Every frame is checked:
+//   - every StateGroup is delivered once and in the order of the frame
+//   - the std frame ends with one StateVerified call if the checksum matched
+//   - after a successful poll, all the groups are delivered and agree with
+//     the returned state
+// The frames cut by a fault (e.g. a desync in the middle of the frame)
+// deliver only their first groups. The report counts them as "cut" and
+// checks their order too.
+//
+// The wires are driven through a HAL (see src/x52_engine.h). With
+// --protocol std-interrupt the joystick side is the InterruptThrottleClient:
+// its C02 interrupt handler runs on the thread of the JoystickClient (in
+// the write that Wire propagates to its C02) and its C04 pulses are ended
+// by a MockPulseTimer fired from the sending loop.
+//
+// Build (from this directory):
+//   g++ -std=c++17 -O2 -Wall -pthread -I../host -I../../src x52_fault_soak.cpp -o x52_fault_soak
+//
+// Usage:
+//   x52_fault_soak [--protocol pro|std|std-interrupt|all] [--seconds <n>] [--seed <n>]
+//                  [--faults-per-second <n>] [--faults flip,drop,extra,stretch,hotplug]
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "x52_hotas.h"
+#include "x52_host_tools.h"
+
+
+namespace {
+
+
+enum FaultType {
+	NoFault = -1,
+	Flip,
+	Drop,
+	Extra,
+	Stretch,
+	Hotplug,
+	NUM_FAULT_TYPES,
+};
+
+const char* const g_FaultNames[NUM_FAULT_TYPES] = {"flip", "drop", "extra", "stretch", "hotplug"};
+
+
+// The pins of the two sides of the cable: the throttle side (that runs the
+// JoystickClient) uses PIN_BASE+1..4 and the joystick side (the
+// ThrottleClient) uses PIN_BASE+11..14. Wire connects pin k to pin k+10.
+enum {
+	C01 = 1, C02, C03, C04,
+	PEER_OFFSET = 10,
+};
+
+
+// Wire is the model of the cable with the fault injector. Every pin write
+// of the clients goes through Propagate. The mutex is recursive: the write
+// to the peer pin can call the interrupt handler of the
+// InterruptThrottleClient and its writes come back to Propagate.
+class Wire {
+public:
+	void Reset(int pin_base, unsigned long stretch_micros) {
+		std::lock_guard<std::recursive_mutex> lock(m_Mutex);
+		m_PinBase = pin_base;
+		m_StretchMicros = stretch_micros;
+		m_Armed = NoFault;
+		m_Connected = true;
+		memset(m_Outputs, 0, sizeof(m_Outputs));
+		for (int i=0; i<X52_HOST_NUM_PINS; i++)
+			digitalWrite(uint8_t(i), LOW);
+	}
+
+	void Arm(FaultType f) {
+		m_Armed.store(f);
+	}
+
+	void Propagate(uint8_t pin, int value) {
+		int line = (pin - m_PinBase) % PEER_OFFSET;
+		bool clock = line == C02 || line == C04;
+		FaultType f = NoFault;
+		if (m_Armed.load(std::memory_order_relaxed) != NoFault) {
+			int armed = m_Armed.load();
+			if ((armed == Flip && !clock) || ((armed == Drop || armed == Extra || armed == Stretch) && clock))
+				f = FaultType(m_Armed.exchange(NoFault));
+		}
+
+		if (f == Stretch)
+			delayMicroseconds(m_StretchMicros);
+
+		std::lock_guard<std::recursive_mutex> lock(m_Mutex);
+		m_Outputs[pin] = uint8_t(value);
+		if (!m_Connected || f == Drop)
+			return;
+		uint8_t peer = Peer(pin);
+		digitalWrite(peer, uint8_t(f == Flip ? !value : value));
+		if (f == Extra) {
+			delayMicroseconds(2);
+			digitalWrite(peer, uint8_t(!value));
+			delayMicroseconds(2);
+			digitalWrite(peer, uint8_t(value));
+		}
+	}
+
+	// Unplug pulls the inputs of both sides LOW until Plug.
+	void Unplug() {
+		std::lock_guard<std::recursive_mutex> lock(m_Mutex);
+		m_Connected = false;
+		for (int line=C01; line<=C04; line++) {
+			digitalWrite(uint8_t(m_PinBase + line), LOW);
+			digitalWrite(uint8_t(m_PinBase + line + PEER_OFFSET), LOW);
+		}
+	}
+
+	void Plug() {
+		std::lock_guard<std::recursive_mutex> lock(m_Mutex);
+		m_Connected = true;
+		for (int line=C01; line<=C04; line++) {
+			for (int side=0; side<2; side++) {
+				uint8_t pin = uint8_t(m_PinBase + line + side*PEER_OFFSET);
+				digitalWrite(Peer(pin), m_Outputs[pin]);
+			}
+		}
+	}
+
+private:
+	uint8_t Peer(uint8_t pin) const {
+		return uint8_t(pin - m_PinBase > PEER_OFFSET ? pin - PEER_OFFSET : pin + PEER_OFFSET);
+	}
+
+	std::recursive_mutex m_Mutex;
+	int m_PinBase;
+	unsigned long m_StretchMicros;
+	std::atomic<int> m_Armed;
+	bool m_Connected;
+	uint8_t m_Outputs[X52_HOST_NUM_PINS];
+};
+
+Wire g_Wire;
+
+
+// WireHAL is the HAL of both sides: the writes are propagated through the Wire.
+struct GlobalWire {
+	static void Propagate(uint8_t pin, int value) {
+		g_Wire.Propagate(pin, value);
+	}
+};
+
+typedef X52HostWireHAL<GlobalWire> WireHAL;
+
+
+// The states and configs are generated from a counter so the receiver can
+// check their consistency: k is in the x axis and everything else is
+// derived from it.
+const x52::Direction g_Dirs[] = {x52::NoDirection, x52::Up, x52::UpRight, x52::Right, x52::DownRight, x52::Down, x52::DownLeft, x52::Left, x52::UpLeft};
+const x52::Mode g_Modes[] = {x52::Mode1, x52::Mode2, x52::Mode3};
+
+template <typename JoystickState>
+void make_state(JoystickState& s, unsigned k) {
+	k %= 1024;
+	s.x = uint16_t(k);
+	s.y = uint16_t((k*7 + 3) % 1024);
+	s.z = uint16_t((k*13 + 5) % 1024);
+	s.pov_1 = g_Dirs[k % 9];
+	s.pov_2 = g_Dirs[(k/9) % 9];
+	s.mode = g_Modes[k % 3];
+	s.trigger_stage_1 = k & 1;
+	s.trigger_stage_2 = k & 2;
+	s.pinkie_switch = k & 4;
+	s.button_fire = k & 8;
+	s.button_a = k & 16;
+	s.button_b = k & 32;
+	s.button_c = k & 64;
+	s.button_t1 = k & 128;
+	s.button_t2 = k & 256;
+	s.button_t3 = k & 512;
+	s.button_t4 = !(k & 1);
+	s.button_t5 = !(k & 2);
+	s.button_t6 = !(k & 4);
+}
+
+template <typename JoystickState>
+bool check_state(const JoystickState& s) {
+	if (s.x >= 1024)
+		return false;
+	JoystickState expected;
+	make_state(expected, s.x);
+	typename JoystickState::Binary a, b;
+	s.ToBinary(a);
+	expected.ToBinary(b);
+	return a == b;
+}
+
+void make_config(x52::pro::JoystickConfig& c, unsigned k) {
+	c.led_brightness = uint8_t(k % 32);
+	c.pov_1_led_blinking = k & 1;
+	c.button_fire_led = !(k & 2);
+	c.pov_2_led = x52::pro::LEDColor(k % 4);
+	c.button_a_led = x52::pro::LEDColor((k+1) % 4);
+	c.button_b_led = x52::pro::LEDColor((k+2) % 4);
+	c.button_t1_t2_led = x52::pro::LEDColor((k+3) % 4);
+	c.button_t3_t4_led = x52::pro::LEDColor(k/4 % 4);
+	c.button_t5_t6_led = x52::pro::LEDColor((k/4+1) % 4);
+}
+
+bool check_config(const x52::pro::JoystickConfig& c) {
+	x52::pro::JoystickConfig expected;
+	make_config(expected, c.led_brightness);
+	x52::pro::JoystickConfig::Binary a, b;
+	c.ToBinary(a);
+	expected.ToBinary(b);
+	return a == b;
+}
+
+void make_config(x52::std::JoystickConfig& c, unsigned k) {
+	c.led_brightness = uint8_t(k % 128);
+	c.pov_1_led_blinking = __builtin_parity(c.led_brightness);
+}
+
+bool check_config(const x52::std::JoystickConfig& c) {
+	return c.led_brightness <= x52::std::JoystickConfig::MAX_LED_BRIGHTNESS &&
+		c.pov_1_led_blinking == bool(__builtin_parity(c.led_brightness));
+}
+
+
+// same_group compares the fields of a StateGroup of two states.
+template <typename JoystickState>
+bool same_group(JoystickState a, JoystickState b, int group) {
+	switch (group) {
+	case x52::StateX: return a.x == b.x;
+	case x52::StateY: return a.y == b.y;
+	case x52::StateZ: return a.z == b.z;
+	case x52::StatePov1: return a.pov_1 == b.pov_1;
+	case x52::StatePov2: return a.pov_2 == b.pov_2;
+	}
+	// the buttons and the mode: everything else
+	a.x = b.x = 0;
+	a.y = b.y = 0;
+	a.z = b.z = 0;
+	a.pov_1 = b.pov_1 = x52::NoDirection;
+	a.pov_2 = b.pov_2 = x52::NoDirection;
+	typename JoystickState::Binary ba, bb;
+	a.ToBinary(ba);
+	b.ToBinary(bb);
+	return ba == bb;
+}
+
+
+// GroupChecker is the partial state handler of the throttle side. Begin
+// starts a frame, End checks it against the result of the poll.
+template <typename JoystickState>
+class GroupChecker {
+public:
+	enum { NUM_GROUPS = 6 };
+
+	unsigned long frames = 0, cut = 0, out_of_order = 0, mismatch = 0;
+
+	void Begin() {
+		m_Delivered = 0;
+		m_Verified = false;
+		m_InOrder = true;
+	}
+
+	template <typename View>
+	void OnPartialState(const View& view, uint8_t groups) {
+		if (groups & x52::StateVerified) {
+			m_InOrder &= HAS_CHECKSUM && !m_Verified && groups == (x52::StateAllGroups | x52::StateVerified) &&
+				m_Delivered == x52::StateAllGroups;
+			m_Verified = true;
+			return;
+		}
+		// exactly one new group: the first one that hasn't been delivered
+		uint8_t next = uint8_t((m_Delivered + 1) & ~m_Delivered);
+		if (m_Verified || next > x52::StateButtons || groups != (m_Delivered | next)) {
+			m_InOrder = false;
+			return;
+		}
+		m_Delivered = groups;
+		m_Groups[__builtin_ctz(next)] = JoystickState(view);
+	}
+
+	void End(bool ok, const JoystickState& state) {
+		frames++;
+		if (!m_InOrder)
+			out_of_order++;
+		if (!ok) {
+			if (m_Delivered)
+				cut++;
+			return;
+		}
+		bool agree = m_Delivered == x52::StateAllGroups && m_Verified == bool(HAS_CHECKSUM);
+		for (int g=0; g<NUM_GROUPS && agree; g++)
+			agree = same_group(m_Groups[g], state, 1 << g);
+		if (!agree)
+			mismatch++;
+	}
+
+	void Print() const {
+		printf("  partial states: frames=%lu cut=%lu out_of_order=%lu mismatch=%lu\n", frames, cut, out_of_order, mismatch);
+	}
+
+private:
+	static constexpr bool HAS_CHECKSUM = std::is_same<JoystickState, x52::std::JoystickState>::value;
+
+	uint8_t m_Delivered;
+	bool m_Verified;
+	bool m_InOrder;
+	JoystickState m_Groups[NUM_GROUPS];
+};
+
+
+// Stats collects the results of a side of the cable. A fault is "pending"
+// until the first good frame after it: the failed frames and the corrupted
+// frames in the meantime are attributed to it.
+struct Stats {
+	struct PerFault {
+		unsigned long injected = 0;
+		unsigned long recovered = 0;
+		unsigned long lost_frames = 0;
+		unsigned long max_lost_frames = 0;
+		unsigned long corrupted_accepted = 0;
+		std::vector<unsigned long> recovery_micros;
+	};
+
+	std::mutex mutex;
+	PerFault faults[NUM_FAULT_TYPES];
+	unsigned long good = 0, failed = 0, corrupted_accepted = 0;
+	unsigned long unattributed_failed = 0, unattributed_corrupted = 0;
+
+	FaultType pending = NoFault;
+	unsigned long pending_since = 0;
+	unsigned long pending_lost = 0;
+
+	void OnFault(FaultType f, unsigned long now) {
+		std::lock_guard<std::mutex> lock(mutex);
+		faults[f].injected++;
+		// a fault that arrives during the recovery of another one is merged into it
+		if (pending == NoFault) {
+			pending = f;
+			pending_since = now;
+			pending_lost = 0;
+		}
+	}
+
+	void OnFrame(bool ok, bool valid, unsigned long now) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (ok && valid) {
+			good++;
+			if (pending != NoFault) {
+				PerFault& pf = faults[pending];
+				pf.recovered++;
+				pf.lost_frames += pending_lost;
+				pf.max_lost_frames = std::max(pf.max_lost_frames, pending_lost);
+				pf.recovery_micros.push_back(now - pending_since);
+				pending = NoFault;
+			}
+			return;
+		}
+		if (ok) {
+			corrupted_accepted++;
+			if (pending != NoFault)
+				faults[pending].corrupted_accepted++;
+			else
+				unattributed_corrupted++;
+		} else {
+			failed++;
+			if (pending == NoFault)
+				unattributed_failed++;
+		}
+		if (pending != NoFault)
+			pending_lost++;
+	}
+
+	void Print(const char* side) {
+		printf("  %s: good=%lu failed=%lu corrupted_accepted=%lu (without a pending fault: failed=%lu corrupted=%lu)\n",
+			side, good, failed, corrupted_accepted, unattributed_failed, unattributed_corrupted);
+		printf("    %-8s %8s %9s %9s %9s %11s %11s %11s %11s\n", "fault", "injected", "recovered", "lost/avg", "lost/max",
+			"rec_us/p50", "rec_us/p99", "rec_us/max", "corrupt_ok");
+		for (int i=0; i<NUM_FAULT_TYPES; i++) {
+			PerFault& pf = faults[i];
+			if (!pf.injected)
+				continue;
+			std::vector<unsigned long>& v = pf.recovery_micros;
+			std::sort(v.begin(), v.end());
+			printf("    %-8s %8lu %9lu %9.2f %9lu %11lu %11lu %11lu %11lu\n", g_FaultNames[i], pf.injected, pf.recovered,
+				pf.recovered ? double(pf.lost_frames) / double(pf.recovered) : 0.0, pf.max_lost_frames,
+				x52_host_percentile(v, 0.5), x52_host_percentile(v, 0.99), x52_host_percentile(v, 1.0), pf.corrupted_accepted);
+		}
+	}
+};
+
+
+struct Options {
+	double seconds = 10;
+	unsigned seed = 1;
+	double faults_per_second = 20;
+	std::vector<FaultType> faults = {Flip, Drop, Extra, Stretch, Hotplug};
+};
+
+
+// run connects the two clients through the Wire and runs the soak test.
+template <typename JoystickState, typename JoystickConfig, typename JoystickClient, typename ThrottleClient>
+int run(const char* name, int pin_base, unsigned long stretch_micros, const Options& opt) {
+	g_Wire.Reset(pin_base, stretch_micros);
+	JoystickClient joystick_client;
+	ThrottleClient throttle_client;
+	joystick_client.Setup();
+	throttle_client.Setup();
+
+	Stats throttle_side, joystick_side;
+	std::atomic<bool> stop(false);
+
+	// the joystick side: sends the states and receives the configs
+	std::thread joystick([&]() {
+		unsigned k = 0;
+		while (!stop) {
+			JoystickState s;
+			make_state(s, k++);
+			JoystickConfig c;
+			unsigned long res = throttle_client.SendJoystickState(s, c, 20000);
+			// No poll from the other side within 20ms. (This also hides the
+			// garbage frames of the fast resync: they return 1 too.)
+			if (res == 1)
+				continue;
+			joystick_side.OnFrame(!res, !res && check_config(c), micros());
+			if (res)
+				delayMicroseconds(res);
+		}
+	});
+
+	// the fault injector
+	std::thread injector([&]() {
+		std::mt19937 rng(opt.seed);
+		std::exponential_distribution<double> interval(opt.faults_per_second);
+		std::uniform_int_distribution<int> pick(0, int(opt.faults.size()) - 1);
+		std::uniform_int_distribution<int> unplug_millis(5, 200);
+		while (!stop) {
+			unsigned long wake = micros() + (unsigned long)(interval(rng) * 1e6);
+			while (!stop && long(micros() - wake) < 0)
+				usleep(1000);
+			if (stop)
+				break;
+			FaultType f = opt.faults[pick(rng)];
+			unsigned long now = micros();
+			throttle_side.OnFault(f, now);
+			joystick_side.OnFault(f, now);
+			if (f == Hotplug) {
+				g_Wire.Unplug();
+				usleep(useconds_t(unplug_millis(rng) * 1000));
+				g_Wire.Plug();
+			} else {
+				g_Wire.Arm(f);
+			}
+		}
+	});
+
+	// the throttle side: polls the states and sends the configs
+	GroupChecker<JoystickState> checker;
+	unsigned long start = micros();
+	unsigned k = 0;
+	while (micros() - start < (unsigned long)(opt.seconds * 1e6)) {
+		JoystickState s;
+		JoystickConfig c;
+		make_config(c, k++);
+		checker.Begin();
+		unsigned long res = joystick_client.PollJoystickState(s, c, checker, 50000);
+		checker.End(!res, s);
+		throttle_side.OnFrame(!res, !res && check_state(s), micros());
+		if (res)
+			delayMicroseconds(std::min(res, 100000UL));
+	}
+	stop = true;
+	injector.join();
+	joystick.join();
+
+	printf("%s:\n", name);
+	throttle_side.Print("throttle side (JoystickClient, receives states)");
+	checker.Print();
+	joystick_side.Print("joystick side (ThrottleClient, receives configs)");
+	return int(throttle_side.good == 0 || joystick_side.good == 0 || checker.out_of_order || checker.mismatch);
+}
+
+
+}  // namespace
+
+
+int main(int argc, char** argv) {
+	Options opt;
+	std::string protocol = "all";
+	for (int i=1; i<argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--protocol" && i+1 < argc) {
+			protocol = argv[++i];
+		} else if (arg == "--seconds" && i+1 < argc) {
+			opt.seconds = atof(argv[++i]);
+		} else if (arg == "--seed" && i+1 < argc) {
+			opt.seed = unsigned(strtoul(argv[++i], nullptr, 10));
+		} else if (arg == "--faults-per-second" && i+1 < argc) {
+			opt.faults_per_second = atof(argv[++i]);
+		} else if (arg == "--faults" && i+1 < argc) {
+			opt.faults.clear();
+			std::string list = argv[++i];
+			for (size_t pos = 0; pos <= list.size();) {
+				size_t end = list.find(',', pos);
+				if (end == std::string::npos)
+					end = list.size();
+				std::string name = list.substr(pos, end - pos);
+				int f = 0;
+				while (f < NUM_FAULT_TYPES && name != g_FaultNames[f])
+					f++;
+				if (f == NUM_FAULT_TYPES) {
+					fprintf(stderr, "unknown fault: %s\n", name.c_str());
+					return 2;
+				}
+				opt.faults.push_back(FaultType(f));
+				pos = end + 1;
+			}
+		} else {
+			fprintf(stderr, "usage: x52_fault_soak [--protocol pro|std|std-interrupt|all] [--seconds <n>] [--seed <n>] "
+				"[--faults-per-second <n>] [--faults flip,drop,extra,stretch,hotplug]\n");
+			return 2;
+		}
+	}
+	if (opt.faults.empty() || opt.faults_per_second <= 0) {
+		fprintf(stderr, "no faults to inject\n");
+		return 2;
+	}
+
+	printf("seed=%u seconds=%.1f faults_per_second=%.1f\n", opt.seed, opt.seconds, opt.faults_per_second);
+	int res = 0;
+	if (protocol == "pro" || protocol == "all") {
+		res |= run<x52::pro::JoystickState, x52::pro::JoystickConfig,
+			x52::pro::JoystickClient<C01, C02, C03, C04, WireHAL>,
+			x52::pro::ThrottleClient<C01+PEER_OFFSET, C02+PEER_OFFSET, C03+PEER_OFFSET, C04+PEER_OFFSET, WireHAL>>(
+			"pro", 0, X52_PRO_JOYSTICK_TIMEOUT_MICROS + 1000, opt);
+	}
+	if (protocol == "std" || protocol == "all") {
+		enum { B = 20 };
+		res |= run<x52::std::JoystickState, x52::std::JoystickConfig,
+			x52::std::JoystickClient<B+C01, B+C02, B+C03, B+C04, x52::std::InterruptPulseWaiter<B+C04>, WireHAL>,
+			x52::std::ThrottleClient<B+C01+PEER_OFFSET, B+C02+PEER_OFFSET, B+C03+PEER_OFFSET, B+C04+PEER_OFFSET, WireHAL>>(
+			"std", B, X52_JOYSTICK_TIMEOUT_MICROS + 1000, opt);
+	}
+	if (protocol == "std-interrupt" || protocol == "all") {
+		enum { B = 40 };
+		typedef x52::MockPulseTimer<> PulseTimer;
+		res |= run<x52::std::JoystickState, x52::std::JoystickConfig,
+			x52::std::JoystickClient<B+C01, B+C02, B+C03, B+C04, x52::std::InterruptPulseWaiter<B+C04>, WireHAL>,
+			X52HostInterruptThrottle<x52::std::InterruptThrottleClient<B+C01+PEER_OFFSET, B+C02+PEER_OFFSET, B+C03+PEER_OFFSET, B+C04+PEER_OFFSET,
+				PulseTimer, WireHAL>, PulseTimer>>(
+			"std-interrupt", B, X52_JOYSTICK_TIMEOUT_MICROS + 1000, opt);
+	}
+	return res;
+}
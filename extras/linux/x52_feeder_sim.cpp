@@ -0,0 +1,272 @@
+// x52_feeder_sim tests x52_evdev_feeder without a board and a throttle. It
+// creates a pseudo terminal for the feeder and runs the loop of the
+// Fake-X52-Pro-Joystick example with STATE_FROM_HOST=1 (a stream::Receiver
+// and a pro::ThrottleClient) on one thread and a simulated throttle (a
+// pro::JoystickClient that polls periodically and changes the LEDs) on
+// another, connected with loopback pins like in x52_vcd_trace.
+//
+// It prints the age of the states when they arrive at the throttle: the time
+// from the capture by the feeder to the end of the frame that delivered them
+// (the serial transfer, the time in the slot and the frame). The slot keeps
+// only the latest state so with a feeder faster than the polls the age is
+// about the interval of the feeder plus the frame, not the poll period. The
+// configs of the throttle are streamed back to the feeder, it prints them
+// when they change.
+//
+// The two sides run on host threads: on a host with a single CPU the
+// scheduler shows up in the latencies.
+//
+// Build (from this directory):
+//   g++ -std=c++17 -O2 -Wall -pthread -I../host -I../../src x52_feeder_sim.cpp -o x52_feeder_sim
+//
+// Usage:
+//   x52_feeder_sim [--seconds <n>] [--period-us <n>]   # prints "pty: /dev/pts/N"
+//   x52_evdev_feeder --synthetic 500 /dev/pts/N         # in another terminal
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "x52_hotas.h"
+#include "x52_stream.h"
+#include "x52_host_tools.h"
+
+
+namespace {
+
+
+// The throttle side (the JoystickClient) uses the pins 1..4, the board side
+// (the ThrottleClient) uses 11..14.
+enum {
+	C01 = 1, C02, C03, C04,
+	PEER_OFFSET = 10,
+};
+
+
+// LoopbackHAL connects the two sides: a write sets the pin and the pin of
+// the other side.
+typedef X52HostLoopbackHAL<PEER_OFFSET> LoopbackHAL;
+
+
+// FdInput and FdOutput adapt the master side of the pty to the stream
+// Receiver and Writer.
+struct FdInput {
+	int fd;
+	uint8_t buf[256];
+	int pos = 0, size = 0;
+
+	int available() {
+		if (pos == size) {
+			// EAGAIN: no data, EIO: the feeder hasn't opened the pty yet
+			ssize_t n = ::read(fd, buf, sizeof(buf));
+			pos = 0;
+			size = n > 0 ? int(n) : 0;
+		}
+		return size - pos;
+	}
+
+	int read() {
+		return pos < size ? buf[pos++] : -1;
+	}
+};
+
+struct FdOutput {
+	int fd;
+
+	int availableForWrite() { return x52::stream::MAX_FRAME_SIZE; }
+
+	size_t write(const uint8_t* buf, size_t size) {
+		ssize_t n = ::write(fd, buf, size);
+		return n < 0 ? 0 : size_t(n);
+	}
+};
+
+
+int open_pty(std::string& path) {
+	int fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0) {
+		perror("posix_openpt");
+		return -1;
+	}
+	termios tio;
+	if (tcgetattr(fd, &tio) == 0) {
+		cfmakeraw(&tio);
+		tcsetattr(fd, TCSANOW, &tio);
+	}
+	path = ptsname(fd);
+	return fd;
+}
+
+
+// Published is a state published into the slot of the board with the
+// capture time of the feeder.
+struct Published {
+	x52::pro::JoystickState::Binary state;
+	uint32_t capture_micros;
+};
+
+
+}  // namespace
+
+
+int main(int argc, char** argv) {
+	unsigned long seconds = 10, period = 8000;
+	for (int i=1; i<argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--seconds" && i+1 < argc) {
+			seconds = strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "--period-us" && i+1 < argc) {
+			period = strtoul(argv[++i], nullptr, 10);
+		} else {
+			fprintf(stderr, "usage: x52_feeder_sim [--seconds <n>] [--period-us <n>]\n");
+			return 2;
+		}
+	}
+
+	std::string path;
+	int fd = open_pty(path);
+	if (fd < 0)
+		return 1;
+	printf("pty: %s\n", path.c_str());
+	fflush(stdout);
+
+	x52::pro::JoystickClient<C01, C02, C03, C04, LoopbackHAL> joystick_client;
+	x52::pro::ThrottleClient<C01+PEER_OFFSET, C02+PEER_OFFSET, C03+PEER_OFFSET, C04+PEER_OFFSET, LoopbackHAL> throttle_client;
+	joystick_client.Setup();
+	throttle_client.Setup();
+
+	std::mutex mutex;
+	std::vector<Published> published;
+	std::vector<uint32_t> serial_latencies;
+	std::atomic<bool> stop(false);
+	unsigned long configs_sent = 0;
+
+	// The board: the loop of Fake-X52-Pro-Joystick with STATE_FROM_HOST=1.
+	std::thread board([&]() {
+		FdInput in = {fd};
+		FdOutput out = {fd};
+		x52::PreEncodedState<x52::pro::JoystickState> host_state;
+		x52::stream::Receiver<FdInput> receiver(in);
+		x52::stream::Writer<FdOutput> writer(out);
+		x52::pro::JoystickState centered;
+		centered.x = x52::pro::JoystickState::CENTER_X;
+		centered.y = x52::pro::JoystickState::CENTER_Y;
+		centered.z = x52::pro::JoystickState::CENTER_Z;
+		host_state.Publish(centered);
+
+		x52::pro::JoystickConfig::Binary last_cfg;
+		unsigned long last_cfg_millis = 0;
+		while (!stop) {
+			if (receiver.Poll(host_state)) {
+				Published p;
+				host_state.Get(p.state);
+				p.capture_micros = receiver.CaptureMicros();
+				std::lock_guard<std::mutex> lock(mutex);
+				serial_latencies.push_back(uint32_t(micros()) - p.capture_micros);
+				if (published.empty() || published.back().state != p.state)
+					published.push_back(p);
+			}
+			if (!throttle_client.IsPollInProgress())
+				continue;
+
+			x52::pro::JoystickConfig cfg;
+			unsigned long res = throttle_client.SendLatestJoystickState(host_state, cfg);
+			if (res) {
+				delayMicroseconds(res);
+				continue;
+			}
+			x52::pro::JoystickConfig::Binary binary;
+			cfg.ToBinary(binary);
+			if (binary != last_cfg || millis() - last_cfg_millis >= 1000) {
+				if (writer.Write(binary, micros())) {
+					last_cfg = binary;
+					last_cfg_millis = millis();
+					configs_sent++;
+				}
+			}
+		}
+	});
+
+	// The throttle: polls every `period` micros and changes the LEDs twice per second.
+	printf("waiting for the feeder...\n");
+	fflush(stdout);
+	std::vector<uint32_t> latencies;
+	unsigned long polls_ok = 0, polls_failed = 0, changes = 0, unmatched = 0;
+	size_t next_published = 0;
+	x52::pro::JoystickState::Binary last_state;
+	x52::pro::JoystickConfig cfg;
+	unsigned long start = 0, next_poll = micros(), next_cfg = 0;
+	for (;;) {
+		unsigned long now = micros();
+		if (start && now - start >= seconds * 1000000)
+			break;
+		// sleep: a busy wait would starve the board thread on a single CPU
+		if (long(next_poll - now) > 0)
+			usleep(useconds_t(next_poll - now));
+		next_poll += period;
+
+		if (start && long(micros() - next_cfg) >= 0) {
+			cfg.led_brightness = uint8_t((cfg.led_brightness + 1) % (x52::pro::JoystickConfig::MAX_LED_BRIGHTNESS + 1));
+			cfg.button_a_led = x52::pro::LEDColor((cfg.button_a_led + 1) % 4);
+			next_cfg += 500000;
+		}
+
+		x52::pro::JoystickState s;
+		unsigned long res = joystick_client.PollJoystickState(s, cfg);
+		if (res) {
+			polls_failed++;
+			continue;
+		}
+		polls_ok++;
+		x52::pro::JoystickState::Binary b;
+		s.ToBinary(b);
+		uint32_t arrival = uint32_t(micros());
+		if (b == last_state)
+			continue;
+		last_state = b;
+
+		// The states published since the last match, newest first: the
+		// skipped ones were overwritten before a poll.
+		std::lock_guard<std::mutex> lock(mutex);
+		size_t i = published.size();
+		while (i > next_published && published[i-1].state != b)
+			i--;
+		if (i == next_published) {
+			unmatched++;
+			continue;
+		}
+		next_published = i;
+		if (!start) {
+			start = micros();
+			next_cfg = start;
+			printf("receiving states, running for %lu seconds\n", seconds);
+			fflush(stdout);
+			continue;
+		}
+		changes++;
+		latencies.push_back(arrival - published[i-1].capture_micros);
+	}
+	stop = true;
+	board.join();
+
+	std::sort(latencies.begin(), latencies.end());
+	std::sort(serial_latencies.begin(), serial_latencies.end());
+	printf("polls: ok=%lu failed=%lu, period: %luus\n", polls_ok, polls_failed, period);
+	printf("states: published=%zu delivered=%lu unmatched=%lu, configs sent back: %lu\n",
+		published.size(), changes, unmatched, configs_sent);
+	printf("feeder -> board: p50=%uus p99=%uus max=%uus\n",
+		x52_host_percentile(serial_latencies, 0.5), x52_host_percentile(serial_latencies, 0.99),
+		x52_host_percentile(serial_latencies, 1.0));
+	printf("feeder -> throttle: p50=%uus p99=%uus max=%uus\n",
+		x52_host_percentile(latencies, 0.5), x52_host_percentile(latencies, 0.99),
+		x52_host_percentile(latencies, 1.0));
+	return changes ? 0 : 1;
+}
@@ -0,0 +1,187 @@
+// x52_frame_bench measures the cost of the frame transmission code of the
+// four blocking clients (pro::JoystickClient, pro::ThrottleClient,
+// std::JoystickClient, std::ThrottleClient) on the host. Every client talks
+// to a peer that answers instantly: the x52_host_write_hook sets the pins of
+// the other side as soon as the client writes its own, so the measured time
+// is the handshake loop of the client and nothing else.
+//
+// The two C04 pulses of the std::JoystickClient are written with
+// digitalWrite so they go through its InterruptPulseWaiter. Their minimum
+// width is compiled to zero because the peer doesn't spend time between
+// the two edges.
+//
+// The peers send no data, so the clients have to be built with the default
+// desync handling: X52_PRO_FAST_RESYNC and the improved throttle desync
+// detection of the pro::ThrottleClient expect bits on C01 that they never
+// see.
+//
+// The result of a client is the minimum of --frames frames in TSC ticks per
+// frame and per clock cycle. Build it with -DX52_SHARED_FRAME_ENGINE=0 and
+// =1 to compare the two builds of the frame engine (see x52_engine.h). The
+// host numbers are only a relative measure, they don't translate to the
+// cycles of a microcontroller.
+//
+// Build (from this directory):
+//   g++ -std=c++17 -O2 -Wall -I../host -I../../src x52_frame_bench.cpp -o x52_frame_bench
+//
+// Usage:
+//   x52_frame_bench [--frames <n>]
+#include <stdlib.h>
+
+#include <string>
+
+#define X52_FIRST_C04_PULSE_MICROS 0
+#define X52_SECOND_C04_PULSE_MICROS 0
+#include "x52_hotas.h"
+#include "x52_host_tools.h"
+
+
+namespace {
+
+
+// The pins of the clients. The peers are told apart by the pin numbers.
+enum {
+	PRO_JOYSTICK = 0,   // pro::JoystickClient on 1..4
+	PRO_THROTTLE = 10,  // pro::ThrottleClient on 11..14
+	STD_THROTTLE = 20,  // std::ThrottleClient on 21..24
+	STD_JOYSTICK = 30,  // std::JoystickClient on 31..34
+};
+
+// Pro frames have 76 clock cycles, std frames 64 state and 8 config cycles.
+const int PRO_CYCLES = 76;
+const int STD_CYCLES = 72;
+
+// The number of C04 rising edges (std throttle) or C02 changes (std
+// joystick) in the current frame.
+int g_NumEdges;
+
+void set_pin(uint8_t pin, uint8_t value) {
+	x52_host_pins()[pin].state = value;
+}
+
+void peer(uint8_t pin, uint8_t value) {
+	switch (pin) {
+	// pro joystick: C04 follows C02
+	case PRO_JOYSTICK+2:
+		set_pin(PRO_JOYSTICK+4, value);
+		break;
+	// pro throttle: C02 is the inverse of C04
+	case PRO_THROTTLE+4:
+		set_pin(PRO_THROTTLE+2, !value);
+		break;
+	// std throttle: C02 follows the C04 pulses of the state phase and
+	// goes against them in the config phase
+	case STD_THROTTLE+4:
+		if (value)
+			g_NumEdges++;
+		set_pin(STD_THROTTLE+2, g_NumEdges <= 64 ? value : !value);
+		break;
+	// std joystick: a C04 pulse after the first and the 128th C02 change,
+	// C04 is the inverse of C02 during the 63 state cycles between them and
+	// follows C02 during the config cycles
+	case STD_JOYSTICK+2:
+		g_NumEdges++;
+		if (g_NumEdges == 1 || g_NumEdges == 128) {
+			digitalWrite(STD_JOYSTICK+4, HIGH);
+			digitalWrite(STD_JOYSTICK+4, LOW);
+		} else {
+			set_pin(STD_JOYSTICK+4, g_NumEdges < 128 ? !value : value);
+		}
+		break;
+	}
+}
+
+
+struct Result {
+	uint64_t min_ticks;
+	unsigned long ok;
+};
+
+// measure calls frame `frames` times. frame resets the peer, transmits a
+// frame and returns the result of the client. Each client gets its own
+// copy of measure so the inlining decisions of the compiler in one client
+// don't change the code of the others.
+template <typename F>
+__attribute__((noinline)) Result measure(unsigned long frames, F frame) {
+	Result r = {~uint64_t(0), 0};
+	for (unsigned long i=0; i<frames; i++) {
+		uint64_t t0 = x52_host_now_ticks();
+		unsigned long res = frame();
+		uint64_t t = x52_host_now_ticks() - t0;
+		r.ok += res == 0;
+		r.min_ticks = std::min(r.min_ticks, t);
+	}
+	return r;
+}
+
+void print(const char* name, const Result& r, int cycles, unsigned long frames) {
+	printf("  %-20s %7.1f ticks/frame %6.2f ticks/cycle  ok=%lu/%lu\n",
+		name, double(r.min_ticks), double(r.min_ticks) / cycles, r.ok, frames);
+}
+
+
+}  // namespace
+
+
+int main(int argc, char** argv) {
+	unsigned long frames = 100000;
+	for (int i=1; i<argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--frames" && i+1 < argc) {
+			frames = strtoul(argv[++i], nullptr, 10);
+		} else {
+			fprintf(stderr, "usage: x52_frame_bench [--frames <n>]\n");
+			return 2;
+		}
+	}
+
+	x52_host_write_hook() = peer;
+	printf("X52_SHARED_FRAME_ENGINE=%d, min of %lu frames:\n", X52_SHARED_FRAME_ENGINE, frames);
+	bool ok = true;
+
+	{
+		x52::pro::JoystickClient<PRO_JOYSTICK+1, PRO_JOYSTICK+2, PRO_JOYSTICK+3, PRO_JOYSTICK+4> client;
+		client.Setup();
+		x52::pro::JoystickState state;
+		x52::pro::JoystickConfig cfg;
+		Result r = measure(frames, [&]() { return client.PollJoystickState(state, cfg); });
+		print("pro::JoystickClient", r, PRO_CYCLES, frames);
+		ok &= r.ok == frames;
+	}
+	{
+		x52::pro::ThrottleClient<PRO_THROTTLE+1, PRO_THROTTLE+2, PRO_THROTTLE+3, PRO_THROTTLE+4> client;
+		client.Setup();
+		set_pin(PRO_THROTTLE+2, !digitalRead(PRO_THROTTLE+4));
+		x52::pro::JoystickState state;
+		x52::pro::JoystickConfig cfg;
+		Result r = measure(frames, [&]() { return client.SendJoystickState(state, cfg); });
+		print("pro::ThrottleClient", r, PRO_CYCLES, frames);
+		ok &= r.ok == frames;
+	}
+	{
+		x52::std::JoystickClient<STD_JOYSTICK+1, STD_JOYSTICK+2, STD_JOYSTICK+3, STD_JOYSTICK+4> client;
+		client.Setup();
+		x52::std::JoystickState state;
+		x52::std::JoystickConfig cfg;
+		Result r = measure(frames, [&]() {
+			g_NumEdges = 0;
+			return client.PollJoystickState(state, cfg);
+		});
+		print("std::JoystickClient", r, STD_CYCLES, frames);
+		ok &= r.ok == frames;
+	}
+	{
+		x52::std::ThrottleClient<STD_THROTTLE+1, STD_THROTTLE+2, STD_THROTTLE+3, STD_THROTTLE+4> client;
+		client.Setup();
+		x52::std::JoystickState state;
+		x52::std::JoystickConfig cfg;
+		Result r = measure(frames, [&]() {
+			g_NumEdges = 0;
+			set_pin(STD_THROTTLE+2, HIGH);
+			return client.SendJoystickState(state, cfg);
+		});
+		print("std::ThrottleClient", r, STD_CYCLES, frames);
+		ok &= r.ok == frames;
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,298 @@
+// x52_hid_bench compares the HID reports built by x52::hid (src/x52_hid.h)
+// straight from the wire format with the setter based send functions of the
+// Fake-X52-Throttle examples, and measures the cost per report of both.
+//
+// The setter path is the send_teensy_usb_joystick_state of the examples on
+// a host copy of the joystick setters of Teensyduino (usb_joystick.h of
+// Teensy 3.x/LC, 12-byte report, manual send mode). For every random state
+// the report of the setters has to be the same as that of
+// BuildReport<TeensyJoystick>. The Gamepad layout is checked against a
+// plain field-by-field builder.
+//
+// Three paths are timed per report:
+//   decode+setters  JoystickState::SetFromBinary and the setters (the examples)
+//   setters         the setters only (the state is already decoded)
+//   BuildReport     x52::hid::BuildReport from the Binary
+//
+// The host numbers are only a relative measure, they don't translate to the
+// cycles of a microcontroller (e.g. a 64-bit shift is one instruction here).
+//
+// Build (from this directory):
+//   g++ -std=c++17 -O2 -Wall -I../host -I../../src x52_hid_bench.cpp -o x52_hid_bench
+//
+// Usage:
+//   x52_hid_bench [--reports <n>] [--seed <n>]
+#include <stdlib.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "x52_hotas.h"
+#include "x52_host_tools.h"
+
+
+namespace {
+
+
+// TeensySetters are the joystick setters of Teensyduino in manual send mode.
+struct TeensySetters {
+	uint32_t data[3] = {0, 0, 0};
+
+	void button(uint8_t button, bool val) {
+		if (--button >= 32)
+			return;
+		if (val)
+			data[0] |= (1UL << button);
+		else
+			data[0] &= ~(1UL << button);
+	}
+
+	void X(unsigned int val) {
+		if (val > 1023) val = 1023;
+		data[1] = (data[1] & 0xFFFFC00F) | (val << 4);
+	}
+
+	void Y(unsigned int val) {
+		if (val > 1023) val = 1023;
+		data[1] = (data[1] & 0xFF003FFF) | (val << 14);
+	}
+
+	void Zrotate(unsigned int val) {
+		if (val > 1023) val = 1023;
+		data[2] = (data[2] & 0xFFFFF003) | (val << 2);
+	}
+
+	void hat(int dir) {
+		uint32_t val = 0;
+		if (dir < 0) val = 15;
+		else if (dir < 23) val = 0;
+		else if (dir < 68) val = 1;
+		else if (dir < 113) val = 2;
+		else if (dir < 158) val = 3;
+		else if (dir < 203) val = 4;
+		else if (dir < 245) val = 5;
+		else if (dir < 293) val = 6;
+		else if (dir < 338) val = 7;
+		data[1] = (data[1] & 0xFFFFFFF0) | val;
+	}
+};
+
+
+const int g_HatAngles[16] = {
+	-1, 90, 180, 135, 270, -1, 225, 180, 0, 45, -1, 90, 315, 0, 270, -1
+};
+
+// send_buttons is the common part of send_teensy_usb_joystick_state of the examples.
+template <typename JoystickState>
+void send_buttons(const JoystickState& state, TeensySetters& joystick) {
+	joystick.hat(g_HatAngles[state.pov_1]);
+	joystick.button(13, bool(state.pov_2 & x52::Up));
+	joystick.button(16, bool(state.pov_2 & x52::Right));
+	joystick.button(14, bool(state.pov_2 & x52::Down));
+	joystick.button(15, bool(state.pov_2 & x52::Left));
+	joystick.button(8, state.trigger_stage_1);
+	joystick.button(29, state.trigger_stage_2);
+	joystick.button(7, state.pinkie_switch);
+	joystick.button(4, state.button_fire);
+	joystick.button(1, state.button_a);
+	joystick.button(2, state.button_b);
+	joystick.button(3, state.button_c);
+	joystick.button(9, state.button_t1);
+	joystick.button(5, state.button_t2);
+	joystick.button(10, state.button_t3);
+	joystick.button(6, state.button_t4);
+	joystick.button(11, state.button_t5);
+	joystick.button(12, state.button_t6);
+	joystick.button(30, state.mode == x52::Mode1);
+	joystick.button(31, state.mode == x52::Mode2);
+	joystick.button(32, state.mode == x52::Mode3);
+}
+
+__attribute__((noinline)) void send_setters(const x52::pro::JoystickState& state, TeensySetters& joystick) {
+	joystick.X(state.x);
+	joystick.Y(state.y);
+	joystick.Zrotate(state.z);
+	send_buttons(state, joystick);
+}
+
+__attribute__((noinline)) void send_setters(const x52::std::JoystickState& state, TeensySetters& joystick) {
+	joystick.X(state.x >> 1);
+	joystick.Y(state.y >> 1);
+	joystick.Zrotate(state.z);
+	send_buttons(state, joystick);
+}
+
+template <typename JoystickState>
+__attribute__((noinline)) void decode_and_send_setters(const typename JoystickState::Binary& b, TeensySetters& joystick) {
+	JoystickState state(x52::UNINITIALIZED);
+	state.SetFromBinary(b);
+	send_setters(state, joystick);
+}
+
+template <typename Binary>
+__attribute__((noinline)) void build_report(const Binary& b, uint8_t* report) {
+	x52::hid::BuildReport<x52::hid::TeensyJoystick>(b, report);
+}
+
+
+// reference_gamepad builds the Gamepad report field by field from the state.
+template <typename JoystickState>
+void reference_gamepad(const JoystickState& state, uint8_t* report) {
+	typedef x52::hid::Gamepad G;
+	TeensySetters buttons;
+	send_buttons(state, buttons);
+	buttons.data[0] &= ~0xF000UL;  // pov_2 is the second hat, not buttons 13..16
+	memset(report, 0, G::REPORT_SIZE);
+	memcpy(report, buttons.data, 4);
+	auto hat = [](int direction) { int a = g_HatAngles[direction]; return a < 0 ? 15 : a / 45; };
+	report[4] = uint8_t(hat(state.pov_1) | (hat(state.pov_2) << 4));
+	int shift = JoystickState::MAX_X > 1023 ? 1 : 0;
+	uint16_t axes[3] = {uint16_t(state.x >> shift), uint16_t(state.y >> shift), state.z};
+	memcpy(report + 5, axes, sizeof(axes));
+}
+
+
+template <typename JoystickState>
+JoystickState random_state(std::mt19937& rng) {
+	static const x52::Direction pov_1[] = {
+		x52::NoDirection, x52::Up, x52::UpRight, x52::Right, x52::DownRight,
+		x52::Down, x52::DownLeft, x52::Left, x52::UpLeft,
+	};
+	JoystickState s;
+	s.x = uint16_t(rng() % (JoystickState::MAX_X + 1));
+	s.y = uint16_t(rng() % (JoystickState::MAX_Y + 1));
+	s.z = uint16_t(rng() % (JoystickState::MAX_Z + 1));
+	s.pov_1 = pov_1[rng() % 9];
+	s.pov_2 = x52::Direction(rng() % 16);
+	s.mode = x52::Mode(rng() % 4);
+	uint32_t r = rng();
+	s.trigger_stage_1 = r & 1;
+	s.trigger_stage_2 = r & 2;
+	s.pinkie_switch = r & 4;
+	s.button_fire = r & 8;
+	s.button_a = r & 16;
+	s.button_b = r & 32;
+	s.button_c = r & 64;
+	s.button_t1 = r & 128;
+	s.button_t2 = r & 256;
+	s.button_t3 = r & 512;
+	s.button_t4 = r & 1024;
+	s.button_t5 = r & 2048;
+	s.button_t6 = r & 4096;
+	return s;
+}
+
+
+struct Timing {
+	double ns;
+	double ticks;
+};
+
+// measure runs f once and returns the cost of one of its `calls` calls.
+template <typename F>
+Timing measure(size_t calls, F f) {
+	uint64_t t0 = x52_host_now_ns();
+	uint64_t c0 = x52_host_now_ticks();
+	f();
+	uint64_t c1 = x52_host_now_ticks();
+	uint64_t t1 = x52_host_now_ns();
+	Timing t;
+	t.ns = double(t1 - t0) / double(calls);
+	t.ticks = double(c1 - c0) / double(calls);
+	return t;
+}
+
+
+template <typename JoystickState>
+int run(const char* name, size_t reports, std::mt19937& rng) {
+	typedef typename JoystickState::Binary Binary;
+	const size_t POOL = 1024;
+	std::vector<JoystickState> states;
+	std::vector<Binary> binaries;
+	for (size_t i=0; i<POOL; i++) {
+		states.push_back(random_state<JoystickState>(rng));
+		Binary b;
+		states.back().ToBinary(b);
+		binaries.push_back(b);
+	}
+
+	// the reports have to be the same
+	unsigned long teensy_bad = 0, gamepad_bad = 0;
+	for (size_t i=0; i<POOL; i++) {
+		TeensySetters joystick;
+		decode_and_send_setters<JoystickState>(binaries[i], joystick);
+		uint8_t report[x52::hid::TeensyJoystick::REPORT_SIZE];
+		build_report(binaries[i], report);
+		if (memcmp(report, joystick.data, sizeof(report)) != 0)
+			teensy_bad++;
+
+		uint8_t gamepad[x52::hid::Gamepad::REPORT_SIZE], expected[x52::hid::Gamepad::REPORT_SIZE];
+		x52::hid::BuildReport<x52::hid::Gamepad>(binaries[i], gamepad);
+		reference_gamepad(states[i], expected);
+		if (memcmp(gamepad, expected, sizeof(gamepad)) != 0)
+			gamepad_bad++;
+	}
+
+	size_t rounds = std::max<size_t>(1, reports / POOL);
+	size_t calls = rounds * POOL;
+	TeensySetters joystick;
+	uint8_t report[x52::hid::TeensyJoystick::REPORT_SIZE];
+	uint32_t sink = 0;
+
+	Timing decode_setters = measure(calls, [&]() {
+		for (size_t r=0; r<rounds; r++) {
+			for (size_t i=0; i<POOL; i++) {
+				decode_and_send_setters<JoystickState>(binaries[i], joystick);
+				sink += joystick.data[0];
+			}
+		}
+	});
+	Timing setters = measure(calls, [&]() {
+		for (size_t r=0; r<rounds; r++) {
+			for (size_t i=0; i<POOL; i++) {
+				send_setters(states[i], joystick);
+				sink += joystick.data[0];
+			}
+		}
+	});
+	Timing build = measure(calls, [&]() {
+		for (size_t r=0; r<rounds; r++) {
+			for (size_t i=0; i<POOL; i++) {
+				build_report(binaries[i], report);
+				sink += report[0];
+			}
+		}
+	});
+
+	printf("%s: %zu states, mismatches: teensy=%lu gamepad=%lu (sink %u)\n", name, POOL, teensy_bad, gamepad_bad, sink & 1);
+	printf("  decode+setters  %6.1f ns/report %6.1f ticks/report\n", decode_setters.ns, decode_setters.ticks);
+	printf("  setters         %6.1f ns/report %6.1f ticks/report\n", setters.ns, setters.ticks);
+	printf("  BuildReport     %6.1f ns/report %6.1f ticks/report\n", build.ns, build.ticks);
+	return teensy_bad || gamepad_bad ? 1 : 0;
+}
+
+
+}  // namespace
+
+
+int main(int argc, char** argv) {
+	size_t reports = 10000000;
+	unsigned seed = 1;
+	for (int i=1; i<argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--reports" && i+1 < argc) {
+			reports = strtoull(argv[++i], nullptr, 10);
+		} else if (arg == "--seed" && i+1 < argc) {
+			seed = unsigned(strtoul(argv[++i], nullptr, 10));
+		} else {
+			fprintf(stderr, "usage: x52_hid_bench [--reports <n>] [--seed <n>]\n");
+			return 2;
+		}
+	}
+
+	std::mt19937 rng(seed);
+	int res = run<x52::pro::JoystickState>("pro", reports, rng);
+	res |= run<x52::std::JoystickState>("std", reports, rng);
+	return res;
+}
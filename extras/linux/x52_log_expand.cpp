@@ -0,0 +1,144 @@
+// x52_log_expand turns the "X52LOG <micros> <id> <args...>" lines of the
+// deferred debug log (X52_DEBUG_LOG_DEFERRED, see src/x52_common.h) back
+// into messages. It reads the serial output of the board from stdin and
+// writes it to stdout with the log lines expanded. Other lines are copied
+// without modification.
+//
+// The message IDs are collected from the X52DebugLog calls of the given
+// source files and directories (searched recursively for .h, .cpp and .ino
+// files) so pass it the sources of your firmware and the library.
+//
+// Build (from this directory):
+//   g++ -std=c++17 -O2 -Wall -I../host -I../../src x52_log_expand.cpp -o x52_log_expand
+//
+// Usage:
+//   x52_log_expand <source-file-or-dir>... < serial_capture.txt
+//   stty -F /dev/ttyACM0 raw && x52_log_expand ../../src MyFirmware/ < /dev/ttyACM0
+#include <stdlib.h>
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include "x52_common.h"
+
+
+namespace {
+
+
+// ParseLiteral parses the C string literal that starts at s[i] (the opening
+// quote) and advances i past the closing quote. It handles the escape
+// sequences that are likely in log messages.
+bool ParseLiteral(const std::string& s, size_t& i, std::string& out) {
+	if (i >= s.size() || s[i] != '"')
+		return false;
+	for (i++; i < s.size(); i++) {
+		char c = s[i];
+		if (c == '"') {
+			i++;
+			return true;
+		}
+		if (c == '\\' && i+1 < s.size()) {
+			c = s[++i];
+			switch (c) {
+				case 'n': c = '\n'; break;
+				case 't': c = '\t'; break;
+				default: break;
+			}
+		}
+		out += c;
+	}
+	return false;
+}
+
+
+void CollectMessages(const std::string& path, std::map<uint16_t, std::string>& messages) {
+	std::ifstream f(path);
+	std::stringstream ss;
+	ss << f.rdbuf();
+	std::string src = ss.str();
+
+	static const std::string macro = "X52DebugLog(";
+	for (size_t pos = src.find(macro); pos != std::string::npos; pos = src.find(macro, pos + 1)) {
+		size_t i = pos + macro.size();
+		while (i < src.size() && isspace(uint8_t(src[i])))
+			i++;
+		std::string msg;
+		if (!ParseLiteral(src, i, msg))
+			continue;  // e.g. the definition of the macro
+
+		uint16_t id = x52::debug_log_id(msg.c_str());
+		auto it = messages.find(id);
+		if (it == messages.end())
+			messages[id] = msg;
+		else if (it->second != msg)
+			std::cerr << "warning: ID collision (" << id << "): \"" << it->second << "\" and \"" << msg << "\"\n";
+	}
+}
+
+
+}  // namespace
+
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		std::cerr << "usage: x52_log_expand <source-file-or-dir>... < serial_capture\n";
+		return 2;
+	}
+
+	namespace fs = std::filesystem;
+	std::map<uint16_t, std::string> messages;
+	for (int i=1; i<argc; i++) {
+		if (fs::is_directory(argv[i])) {
+			for (const auto& e : fs::recursive_directory_iterator(argv[i])) {
+				std::string ext = e.path().extension().string();
+				if (e.is_regular_file() && (ext == ".h" || ext == ".cpp" || ext == ".ino"))
+					CollectMessages(e.path().string(), messages);
+			}
+		} else {
+			CollectMessages(argv[i], messages);
+		}
+	}
+
+	std::string line;
+	while (std::getline(std::cin, line)) {
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		if (line.compare(0, 7, "X52LOG ") != 0) {
+			std::cout << line << std::endl;
+			continue;
+		}
+
+		std::istringstream ls(line.substr(7));
+		unsigned long micros;
+		unsigned id;
+		if (!(ls >> micros >> id)) {
+			std::cout << line << std::endl;
+			continue;
+		}
+
+		std::cout << "[" << micros << "] ";
+		if (id == x52::DebugLog::DROPPED_ID) {
+			long n = 0;
+			ls >> n;
+			std::cout << "(" << n << " log entries dropped: increase X52_DEBUG_LOG_SIZE)" << std::endl;
+			continue;
+		}
+
+		auto it = messages.find(uint16_t(id));
+		if (it == messages.end())
+			std::cout << "<unknown message ID " << id << ">";
+		else
+			std::cout << it->second;
+
+		// The arguments are printed the same way as in non-deferred mode.
+		long arg;
+		for (bool first = true; ls >> arg; first = false)
+			std::cout << (first ? "" : " ") << arg;
+		std::cout << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,248 @@
+// x52_rate_limiter_compare feeds the same simulated update loops to the
+// util::RateLimiter of the library (a GCRA limiter, src/x52_util.h) and to
+// the timestamp-history limiter it replaced (copied below as
+// HistoryRateLimiter) and reports how differently they admit the updates.
+// The GCRA limiter runs twice: with the parameters the examples passed to
+// the old limiter (<250,250>, "gcra") and with the MAX_UPDATE_BURST of the
+// examples ("gcra/8"). Both MAX_BURST values keep the average at 250 per
+// second, but the first lets ~500 updates through in a second after a stall.
+//
+// Every scenario is a loop like that of the examples with simulated time:
+//   d = limiter.MicrosTillNextUpdate(now);
+//   if (d) sleep d (+ the wake-up overshoot of the scenario)
+//   else   update (the work time of the scenario, sometimes a stall)
+// It's run in two ways:
+//   closed loop  each limiter drives its own loop with the same random
+//                sequences of work times and overshoots
+//   same calls   both limiters are asked at exactly the same times (those
+//                of a caller that polls every 100+-50us) and every decision
+//                is compared
+// Reported per limiter: the number of updates, the average rate, the most
+// updates in any 1s window, the shortest interval and the longest run of
+// back-to-back updates (intervals shorter than half of the period).
+//
+// Build (from this directory):
+//   g++ -std=c++17 -O2 -Wall -I../host -I../../src x52_rate_limiter_compare.cpp -o x52_rate_limiter_compare
+//
+// Usage:
+//   x52_rate_limiter_compare [--seconds <n>] [--seed <n>]
+#include <stdlib.h>
+
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "x52_hotas.h"
+
+
+namespace {
+
+
+// HistoryRateLimiter is the RateLimiter of the library before the GCRA one,
+// with the time taken from the caller.
+template <int MAX_UPDATES_PER_SECOND, int NUM_STORED_TIMESTAMPS>
+class HistoryRateLimiter {
+public:
+	HistoryRateLimiter() {
+		m_Index = 0;
+		memset(m_UpdateTimes, 0, sizeof(m_UpdateTimes));
+	}
+
+	unsigned long MicrosTillNextUpdate(unsigned long now) {
+		// using delta to handle the overflows of micros()
+		unsigned long micros_left = m_UpdateTimes[m_Index] - now;
+		if (long(micros_left) > 0)
+			return micros_left;
+		m_UpdateTimes[m_Index] = now + g_StoredPeriod;
+		m_Index = (m_Index + 1) % NUM_STORED_TIMESTAMPS;
+		m_UpdateTimes[m_Index] = min(m_UpdateTimes[m_Index], now + g_OneUpdatePeriod);
+		return 0;
+	}
+
+private:
+	int m_Index;
+	unsigned long m_UpdateTimes[NUM_STORED_TIMESTAMPS];
+
+	static constexpr unsigned long g_OneUpdatePeriod = (1000000 + MAX_UPDATES_PER_SECOND/2) / MAX_UPDATES_PER_SECOND;
+	static constexpr unsigned long g_StoredPeriod = (NUM_STORED_TIMESTAMPS*1000000 + MAX_UPDATES_PER_SECOND/2) / MAX_UPDATES_PER_SECOND;
+};
+
+
+// The limit of the Fake-X52-Pro-Throttle example: BURST is the second
+// parameter it passed to the old limiter and EXAMPLE_BURST its
+// MAX_UPDATE_BURST.
+const int RATE = 250;
+const int BURST = 250;
+const int EXAMPLE_BURST = 8;
+const unsigned long PERIOD = 1000000 / RATE;
+// The simulation starts here: both limiters treat their zero state as "long ago".
+const unsigned long START = 10000000;
+
+typedef x52::util::RateLimiter<RATE, BURST> GcraLimiter;
+typedef x52::util::RateLimiter<RATE, EXAMPLE_BURST> ExampleLimiter;
+typedef HistoryRateLimiter<RATE, BURST> HistoryLimiter;
+
+
+struct Scenario {
+	const char* name;
+	unsigned long work_min, work_max;        // the time of an update
+	double stall_probability;                // per update
+	unsigned long stall_min, stall_max;      // added to the work time of a stalled update
+	unsigned long overshoot_max;             // of the sleeps
+};
+
+const Scenario g_Scenarios[] = {
+	{"on time: 1.2ms updates, <=50us overshoot", 1100, 1300, 0, 0, 0, 50},
+	{"sleepy: 1.2ms updates, <=1ms overshoot", 1100, 1300, 0, 0, 0, 1000},
+	{"late frames: 2% of the updates +5..20ms", 1100, 1300, 0.02, 5000, 20000, 50},
+	{"slow: 5ms updates (over the period)", 4800, 5200, 0, 0, 0, 50},
+	{"stalls: 0.1% of the updates +0.5..2s", 1100, 1300, 0.001, 500000, 2000000, 50},
+};
+
+
+// Random is the input of a scenario: separate streams for the work times
+// and the sleeps so both limiters get the same sequences.
+struct Random {
+	std::mt19937 work, sleep;
+	Random(unsigned seed): work(seed), sleep(seed ^ 0x9e3779b9u) {}
+
+	unsigned long Uniform(std::mt19937& rng, unsigned long lo, unsigned long hi) {
+		return lo + rng() % (hi - lo + 1);
+	}
+
+	unsigned long Work(const Scenario& s) {
+		unsigned long t = Uniform(work, s.work_min, s.work_max);
+		if (s.stall_probability > 0 && std::uniform_real_distribution<double>(0, 1)(work) < s.stall_probability)
+			t += Uniform(work, s.stall_min, s.stall_max);
+		return t;
+	}
+
+	unsigned long Overshoot(const Scenario& s) {
+		return Uniform(sleep, 0, s.overshoot_max);
+	}
+};
+
+
+struct Stats {
+	unsigned long updates = 0;
+	unsigned long max_in_window = 0;
+	unsigned long min_interval = ~0UL;
+	unsigned long longest_burst = 0;
+	unsigned long burst = 0;
+	unsigned long prev = 0;
+	std::deque<unsigned long> window;
+
+	void OnUpdate(unsigned long t) {
+		if (updates) {
+			unsigned long interval = t - prev;
+			min_interval = std::min(min_interval, interval);
+			burst = interval < PERIOD / 2 ? burst + 1 : 0;
+			longest_burst = std::max(longest_burst, burst);
+		}
+		prev = t;
+		updates++;
+		window.push_back(t);
+		while (t - window.front() >= 1000000)
+			window.pop_front();
+		max_in_window = std::max<unsigned long>(max_in_window, window.size());
+	}
+
+	void Print(const char* name, double seconds) const {
+		printf("    %-8s updates=%-7lu rate=%7.2f/s max/1s=%-4lu min interval=%5luus longest burst=%lu\n",
+			name, updates, double(updates) / seconds, max_in_window,
+			updates > 1 ? min_interval : 0, longest_burst);
+	}
+};
+
+
+template <typename Limiter>
+Stats closed_loop(const Scenario& s, unsigned long duration, unsigned seed) {
+	Limiter limiter;
+	Random rnd(seed);
+	Stats stats;
+	for (unsigned long t=START; t-START<duration;) {
+		unsigned long d = limiter.MicrosTillNextUpdate(t);
+		if (d) {
+			t += d + rnd.Overshoot(s);
+			continue;
+		}
+		stats.OnUpdate(t);
+		t += rnd.Work(s);
+	}
+	return stats;
+}
+
+
+// same_calls asks a GCRA limiter and the history at the same times. An
+// admitted update takes the work time of the scenario, a refused one is
+// retried after 100+-50us (without the sleep of the examples that would
+// differ).
+template <typename Limiter>
+void same_calls(const Scenario& s, const char* name, unsigned long duration, unsigned seed, double seconds) {
+	Limiter gcra;
+	HistoryLimiter history;
+	Random rnd(seed);
+	std::mt19937 poll(seed + 1);
+	Stats gs, hs;
+	unsigned long calls = 0, differ = 0, first_difference = 0;
+	for (unsigned long t=START; t-START<duration;) {
+		bool g = gcra.MicrosTillNextUpdate(t) == 0;
+		bool h = history.MicrosTillNextUpdate(t) == 0;
+		calls++;
+		if (g != h) {
+			if (!differ)
+				first_difference = t - START;
+			differ++;
+		}
+		if (g)
+			gs.OnUpdate(t);
+		if (h)
+			hs.OnUpdate(t);
+		t += (g || h) ? rnd.Work(s) : 50 + poll() % 101;
+	}
+	printf("  same calls, %s: %lu calls, different decisions: %lu", name, calls, differ);
+	if (differ)
+		printf(" (first at %.3fs)", double(first_difference) / 1e6);
+	printf("\n");
+	gs.Print(name, seconds);
+	hs.Print("history", seconds);
+}
+
+
+}  // namespace
+
+
+int main(int argc, char** argv) {
+	double seconds = 60;
+	unsigned seed = 1;
+	for (int i=1; i<argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--seconds" && i+1 < argc) {
+			seconds = atof(argv[++i]);
+		} else if (arg == "--seed" && i+1 < argc) {
+			seed = unsigned(strtoul(argv[++i], nullptr, 10));
+		} else {
+			fprintf(stderr, "usage: x52_rate_limiter_compare [--seconds <n>] [--seed <n>]\n");
+			return 2;
+		}
+	}
+	if (seconds <= 0 || seconds > 3600) {
+		fprintf(stderr, "--seconds has to be in (0, 3600]\n");
+		return 2;
+	}
+
+	unsigned long duration = (unsigned long)(seconds * 1e6);
+	printf("RateLimiter<%d, %d> (gcra) and RateLimiter<%d, %d> (gcra/%d) vs the timestamp history<%d, %d> (history), %.0fs per run\n",
+		RATE, BURST, RATE, EXAMPLE_BURST, EXAMPLE_BURST, RATE, BURST, seconds);
+	for (const Scenario& s : g_Scenarios) {
+		printf("%s\n", s.name);
+		printf("  closed loop:\n");
+		closed_loop<GcraLimiter>(s, duration, seed).Print("gcra", seconds);
+		closed_loop<ExampleLimiter>(s, duration, seed).Print("gcra/8", seconds);
+		closed_loop<HistoryLimiter>(s, duration, seed).Print("history", seconds);
+		same_calls<GcraLimiter>(s, "gcra", duration, seed, seconds);
+		same_calls<ExampleLimiter>(s, "gcra/8", duration, seed, seconds);
+	}
+	return 0;
+}
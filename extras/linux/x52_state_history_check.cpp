@@ -0,0 +1,270 @@
+// x52_state_history_check compares util::StateHistory (src/x52_util.h)
+// against a reference model with random operations. The reference is a
+// plain list of blocks of samples: a block is closed when it's full or when
+// a sample is more than 65.5ms after its first sample, and the oldest block
+// is dropped when a new one doesn't fit. After every Add it checks
+//   - Size and the samples of an iteration from Begin (times, states and Changed)
+//   - GetState, GetInterpolatedState and Find at random times: at the
+//     samples, between them, before the oldest one and after the newest one
+//
+// The time steps are random: mostly ~2.5ms, repeated and earlier timestamps
+// (recorded as the latest one), the largest offsets from the first sample of
+// a block, pauses over 65.5ms (the padding at the end of a block) and over
+// 1s (the long spans of the interpolation). The
+// timestamps start just before the wraparound of unsigned long and the
+// buffer wraps around many times. A few random Clear calls restart it.
+//
+// Build (from this directory):
+//   g++ -std=c++17 -O2 -Wall -I../host -I../../src x52_state_history_check.cpp -o x52_state_history_check
+//
+// Usage:
+//   x52_state_history_check [--ops <n>] [--seed <n>]
+#include <stdlib.h>
+#include <limits.h>
+
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "x52_hotas.h"
+
+
+namespace {
+
+
+const x52::Direction g_Dirs[] = {x52::NoDirection, x52::Up, x52::UpRight, x52::Right, x52::DownRight, x52::Down, x52::DownLeft, x52::Left, x52::UpLeft};
+
+
+template <typename JoystickState, int CAPACITY, int BLOCK_SIZE>
+class Check {
+public:
+	typedef x52::util::StateHistory<JoystickState, CAPACITY, BLOCK_SIZE> History;
+	typedef typename JoystickState::Binary Binary;
+	typedef typename JoystickState::View View;
+
+	Check(const char* name, unsigned seed) : m_Name(name), m_Rng(seed) {}
+
+	unsigned long Run(unsigned long ops) {
+		unsigned long t = ULONG_MAX - 20000000UL;
+		JoystickState s;
+		for (unsigned long op=0; op<ops; op++) {
+			if (Rand(2000) == 0) {
+				m_History.Clear();
+				m_Blocks.clear();
+				CheckAll(op);
+				continue;
+			}
+			t = Next(t);
+			if (Rand(3))
+				s = RandomState();
+			Binary b;
+			s.ToBinary(b);
+			m_History.Add(b, t);
+			Add(b, t);
+			CheckAll(op);
+		}
+		printf("%s, StateHistory<%d, %d>: %lu ops, %lu queries, padded blocks: %lu, dropped blocks: %lu, errors: %lu\n",
+			m_Name, CAPACITY, BLOCK_SIZE, ops, m_Queries, m_Padded, m_Dropped, m_Errors);
+		return m_Errors;
+	}
+
+private:
+	struct Sample {
+		unsigned long micros;
+		Binary state;
+	};
+
+	unsigned long Rand(unsigned long n) {
+		return m_Rng() % n;
+	}
+
+	// Next returns the timestamp of the next sample.
+	unsigned long Next(unsigned long t) {
+		switch (Rand(40)) {
+		case 0: return t;
+		case 1: return t - 1 - Rand(5000);  // earlier
+		case 2:
+			// the largest offsets in a block: 0xFFFE fits, 0xFFFF doesn't
+			if (!m_Blocks.empty())
+				return m_Blocks.back().front().micros + 0xFFFD + Rand(3);
+			return t;
+		case 3: return t + 70000 + Rand(200000);
+		case 4: return t + 1000000 + Rand(3000000);
+		default: return t + 2000 + Rand(1000);
+		}
+	}
+
+	JoystickState RandomState() {
+		JoystickState s;
+		s.x = uint16_t(Rand(JoystickState::MAX_X + 1));
+		s.y = uint16_t(Rand(JoystickState::MAX_Y + 1));
+		s.z = uint16_t(Rand(JoystickState::MAX_Z + 1));
+		s.pov_1 = g_Dirs[Rand(9)];
+		s.button_a = Rand(2);
+		s.mode = x52::Mode(Rand(3) + 1);
+		return s;
+	}
+
+	// Add is the reference of StateHistory::Add.
+	void Add(const Binary& b, unsigned long t) {
+		if (!m_Blocks.empty()) {
+			std::vector<Sample>& last = m_Blocks.back();
+			if (long(t - last.back().micros) < 0)
+				t = last.back().micros;
+			if (int(last.size()) < BLOCK_SIZE && t - last.front().micros > 0xFFFE) {
+				m_Padded++;
+				m_Closed = true;
+			}
+		}
+		if (m_Blocks.empty() || m_Closed || int(m_Blocks.back().size()) == BLOCK_SIZE) {
+			if (int(m_Blocks.size()) == CAPACITY / BLOCK_SIZE) {
+				m_Blocks.pop_front();
+				m_Dropped++;
+			}
+			m_Blocks.push_back(std::vector<Sample>());
+			m_Closed = false;
+		}
+		Sample s = {t, b};
+		m_Blocks.back().push_back(s);
+	}
+
+	void Error(unsigned long op, const char* what) {
+		if (m_Errors++ < 10)
+			printf("%s: op %lu: %s\n", m_Name, op, what);
+	}
+
+	void CheckAll(unsigned long op) {
+		std::vector<Sample> ref;
+		for (const std::vector<Sample>& block : m_Blocks)
+			ref.insert(ref.end(), block.begin(), block.end());
+
+		if (m_History.Size() != int(ref.size())) {
+			Error(op, "Size");
+			return;
+		}
+		CheckIteration(op, m_History.Begin(), ref, 0, "Begin");
+		if (ref.empty()) {
+			JoystickState s;
+			if (m_History.GetState(0, s) || m_History.GetInterpolatedState(0, s))
+				Error(op, "a state in an empty history");
+			return;
+		}
+
+		for (int q=0; q<8; q++) {
+			m_Queries++;
+			unsigned long t;
+			switch (Rand(4)) {
+			case 0: t = ref[Rand(ref.size())].micros; break;
+			case 1: t = ref[Rand(ref.size())].micros + Rand(300000); break;
+			case 2: t = ref.front().micros - 1 - Rand(1000); break;
+			default: t = ref.back().micros + Rand(100000); break;
+			}
+			CheckQuery(op, t, ref);
+		}
+	}
+
+	void CheckIteration(unsigned long op, typename History::Iterator it, const std::vector<Sample>& ref, size_t from, const char* what) {
+		for (size_t i=from; i<ref.size(); i++, it.Next()) {
+			if (!it.Valid() || it.Micros() != ref[i].micros || it.State().GetBinary() != ref[i].state ||
+					it.Changed() != (i == from || ref[i].state != ref[i-1].state)) {
+				Error(op, what);
+				return;
+			}
+		}
+		if (it.Valid())
+			Error(op, what);
+	}
+
+	void CheckQuery(unsigned long op, unsigned long t, const std::vector<Sample>& ref) {
+		// the last sample at or before t, -1 if t is older than the oldest one
+		unsigned long elapsed = t - ref.front().micros;
+		long e = -1;
+		for (size_t i=0; long(elapsed) >= 0 && i<ref.size() && ref[i].micros - ref.front().micros <= elapsed; i++)
+			e = long(i);
+
+		CheckIteration(op, m_History.Find(t), ref, size_t(e < 0 ? 0 : e), "Find");
+
+		JoystickState got, interpolated;
+		bool found = m_History.GetState(t, got);
+		bool found_interpolated = m_History.GetInterpolatedState(t, interpolated);
+		if (e < 0) {
+			if (found || found_interpolated)
+				Error(op, "a state before the oldest sample");
+			return;
+		}
+		if (!found || !found_interpolated) {
+			Error(op, "no state");
+			return;
+		}
+		const Sample& a = ref[size_t(e)];
+		Binary b;
+		got.ToBinary(b);
+		if (b != a.state)
+			Error(op, "GetState");
+
+		JoystickState expected = JoystickState(View(a.state));
+		int tolerance = 0;
+		if (size_t(e) + 1 < ref.size()) {
+			const Sample& n = ref[size_t(e) + 1];
+			unsigned long dt = t - a.micros, span = n.micros - a.micros;
+			if (span && dt < span) {
+				View vn(n.state);
+				expected.x = Lerp(expected.x, vn.x(), dt, span);
+				expected.y = Lerp(expected.y, vn.y(), dt, span);
+				expected.z = Lerp(expected.z, vn.z(), dt, span);
+				// StateHistory drops the low bits of the spans over 2^20us
+				tolerance = span >= (1UL << 20) ? 1 : 0;
+			}
+		}
+		bool axes = abs(int(interpolated.x) - int(expected.x)) <= tolerance &&
+			abs(int(interpolated.y) - int(expected.y)) <= tolerance &&
+			abs(int(interpolated.z) - int(expected.z)) <= tolerance;
+		interpolated.x = expected.x;
+		interpolated.y = expected.y;
+		interpolated.z = expected.z;
+		Binary bi, be;
+		interpolated.ToBinary(bi);
+		expected.ToBinary(be);
+		if (!axes || bi != be)
+			Error(op, "GetInterpolatedState");
+	}
+
+	static uint16_t Lerp(uint16_t a, uint16_t b, unsigned long t, unsigned long span) {
+		return uint16_t(int64_t(a) + (int64_t(b) - int64_t(a)) * int64_t(t) / int64_t(span));
+	}
+
+	const char* m_Name;
+	std::mt19937 m_Rng;
+	History m_History;
+	std::deque<std::vector<Sample>> m_Blocks;
+	bool m_Closed = false;
+	unsigned long m_Queries = 0, m_Padded = 0, m_Dropped = 0, m_Errors = 0;
+};
+
+
+}  // namespace
+
+
+int main(int argc, char** argv) {
+	unsigned long ops = 200000;
+	unsigned seed = 1;
+	for (int i=1; i<argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--ops" && i+1 < argc) {
+			ops = strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "--seed" && i+1 < argc) {
+			seed = unsigned(strtoul(argv[++i], nullptr, 10));
+		} else {
+			fprintf(stderr, "usage: x52_state_history_check [--ops <n>] [--seed <n>]\n");
+			return 2;
+		}
+	}
+
+	unsigned long errors = 0;
+	errors += Check<x52::pro::JoystickState, 64, 8>("pro", seed).Run(ops);
+	errors += Check<x52::std::JoystickState, 64, 8>("std", seed).Run(ops);
+	errors += Check<x52::pro::JoystickState, 6, 2>("pro", seed + 1).Run(ops);
+	errors += Check<x52::std::JoystickState, 12, 3>("std", seed + 1).Run(ops);
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,130 @@
+// x52_stream_gen writes a synthetic x52::stream (see src/x52_stream.h) to a
+// file or terminal: a stand-in for the board while testing x52_uinputd.
+//
+// Build (from this directory):
+//   g++ -std=c++17 -O2 -Wall -I../host -I../../src x52_stream_gen.cpp -o x52_stream_gen
+//
+// Usage:
+//   x52_stream_gen [--std] [--rate <frames-per-second>] [--count <frames>] <path>
+//
+// Test with a pseudo-terminal:
+//   ./x52_uinputd --pty --dry-run --latency    # prints "pty: /dev/pts/N"
+//   ./x52_stream_gen --count 1000 /dev/pts/N
+#include <fcntl.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "x52_hotas.h"
+#include "x52_stream.h"
+
+
+namespace {
+
+
+// FdOutput adapts a file descriptor to x52::stream::Writer.
+struct FdOutput {
+	int fd;
+
+	int availableForWrite() { return x52::stream::MAX_FRAME_SIZE; }
+
+	size_t write(const uint8_t* buf, size_t size) {
+		ssize_t n = ::write(fd, buf, size);
+		return n < 0 ? 0 : size_t(n);
+	}
+};
+
+
+template <typename JoystickState>
+void fill_state(JoystickState& s, unsigned long i) {
+	// A slow sweep on the axes and a walking bit on the buttons.
+	s.x = uint16_t(i % (JoystickState::MAX_X + 1));
+	s.y = uint16_t(JoystickState::MAX_Y - i % (JoystickState::MAX_Y + 1));
+	s.z = uint16_t(i / 4 % (JoystickState::MAX_Z + 1));
+	static const x52::Direction dirs[] = {x52::NoDirection, x52::Up, x52::UpRight, x52::Right, x52::DownRight, x52::Down, x52::DownLeft, x52::Left, x52::UpLeft};
+	s.pov_1 = dirs[i / 50 % 9];
+	s.pov_2 = dirs[i / 70 % 9];
+	s.mode = x52::Mode(1 + i / 200 % 3);
+	int b = int(i / 20 % 13);
+	s.trigger_stage_1 = b == 0;
+	s.button_fire = b == 1;
+	s.button_a = b == 2;
+	s.button_b = b == 3;
+	s.button_c = b == 4;
+	s.pinkie_switch = b == 5;
+	s.trigger_stage_2 = b == 6;
+	s.button_t1 = b == 7;
+	s.button_t2 = b == 8;
+	s.button_t3 = b == 9;
+	s.button_t4 = b == 10;
+	s.button_t5 = b == 11;
+	s.button_t6 = b == 12;
+}
+
+
+}  // namespace
+
+
+int main(int argc, char** argv) {
+	bool use_std = false;
+	unsigned long rate = 300, count = 0;
+	const char* path = nullptr;
+
+	for (int i=1; i<argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--std")
+			use_std = true;
+		else if (arg == "--rate" && i+1 < argc)
+			rate = strtoul(argv[++i], nullptr, 10);
+		else if (arg == "--count" && i+1 < argc)
+			count = strtoul(argv[++i], nullptr, 10);
+		else if (arg[0] != '-' && !path)
+			path = argv[i];
+		else
+			path = nullptr, i = argc;
+	}
+	if (!path || rate == 0) {
+		fprintf(stderr, "usage: x52_stream_gen [--std] [--rate <frames-per-second>] [--count <frames>] <path>\n");
+		return 2;
+	}
+
+	int fd = open(path, O_WRONLY | O_NOCTTY | O_CLOEXEC);
+	if (fd < 0) {
+		perror(path);
+		return 1;
+	}
+	termios tio;
+	if (tcgetattr(fd, &tio) == 0) {
+		cfmakeraw(&tio);
+		tcsetattr(fd, TCSANOW, &tio);
+	}
+
+	FdOutput out = {fd};
+	x52::stream::Writer<FdOutput> writer(out);
+	unsigned long period = 1000000 / rate;
+	unsigned long next = micros();
+
+	for (unsigned long i=0; count == 0 || i < count; i++) {
+		while (long(micros() - next) < 0)
+			usleep(100);
+		next += period;
+
+		if (use_std) {
+			x52::std::JoystickState s;
+			fill_state(s, i);
+			x52::std::JoystickState::Binary b;
+			s.ToBinary(b);
+			writer.Write(b, micros());
+		} else {
+			x52::pro::JoystickState s;
+			fill_state(s, i);
+			x52::pro::JoystickState::Binary b;
+			s.ToBinary(b);
+			writer.Write(b, micros());
+		}
+	}
+	close(fd);
+	return 0;
+}
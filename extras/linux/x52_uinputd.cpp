@@ -0,0 +1,460 @@
+// x52_uinputd reads the binary state stream of a board running
+// x52::stream::Writer (see src/x52_stream.h) from a serial device and
+// publishes the joystick states as a Linux input device through uinput.
+//
+// Build (from this directory):
+//   g++ -std=c++17 -O2 -Wall -I../host -I../../src x52_uinputd.cpp -o x52_uinputd
+//
+// Usage:
+//   x52_uinputd [options] <serial-device>
+//     --name <name>   name of the input device (default: "X52 HOTAS")
+//     --dry-run       print the input events instead of writing them to uinput
+//     --pty           create a pseudo-terminal and read from it instead of a
+//                     serial device (its path is printed at startup): a
+//                     stand-in for the board while testing
+//     --latency       print the latency of every frame
+//     --stats <sec>   print statistics periodically (default: 10, 0: off)
+//
+// The input device:
+//   ABS_X, ABS_Y:            stick axes
+//   ABS_RZ:                  twist (the z axis of the JoystickState)
+//   ABS_HAT0X, ABS_HAT0Y:    POV 1
+//   ABS_HAT1X, ABS_HAT1Y:    POV 2
+//   BTN_TRIGGER:             trigger stage 1
+//   BTN_THUMB:               fire
+//   BTN_THUMB2, BTN_TOP, BTN_TOP2: buttons A, B, C
+//   BTN_PINKIE:              pinkie switch
+//   BTN_BASE:                trigger stage 2
+//   BTN_BASE2..BTN_BASE6, BTN_DEAD: toggles T1..T6
+//   BTN_TRIGGER_HAPPY1..3:   mode 1..3
+//   MSC_TIMESTAMP:           the capture timestamp of the board (micros)
+//
+// Latency: the host side latency is measured from the return of the read()
+// that completed the frame to the return of the write() to uinput. The
+// transport latency can't be measured directly because the clocks of the
+// board and the host aren't synchronised: it's reported relative to the
+// fastest frame seen so far (host receive time - capture time - minimum).
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/uinput.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/signalfd.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "x52_hotas.h"
+#include "x52_stream.h"
+
+
+namespace {
+
+
+uint64_t now_micros() {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+// DeviceState is the common denominator of the pro and std JoystickStates.
+struct DeviceState {
+	int x, y, z;
+	x52::Direction pov_1, pov_2;
+	x52::Mode mode;
+	bool buttons[13];
+
+	template <typename JoystickState>
+	void Set(const JoystickState& s) {
+		x = s.x; y = s.y; z = s.z;
+		pov_1 = s.pov_1; pov_2 = s.pov_2;
+		mode = s.mode;
+		bool b[13] = {
+			s.trigger_stage_1, s.button_fire, s.button_a, s.button_b, s.button_c,
+			s.pinkie_switch, s.trigger_stage_2,
+			s.button_t1, s.button_t2, s.button_t3, s.button_t4, s.button_t5, s.button_t6,
+		};
+		memcpy(buttons, b, sizeof(buttons));
+	}
+};
+
+const uint16_t BUTTON_CODES[13] = {
+	BTN_TRIGGER, BTN_THUMB, BTN_THUMB2, BTN_TOP, BTN_TOP2,
+	BTN_PINKIE, BTN_BASE,
+	BTN_BASE2, BTN_BASE3, BTN_BASE4, BTN_BASE5, BTN_BASE6, BTN_DEAD,
+};
+
+const uint16_t MODE_CODES[3] = {BTN_TRIGGER_HAPPY1, BTN_TRIGGER_HAPPY2, BTN_TRIGGER_HAPPY3};
+
+
+int hat_x(x52::Direction d) {
+	return (d & x52::Right) ? 1 : (d & x52::Left) ? -1 : 0;
+}
+
+int hat_y(x52::Direction d) {
+	return (d & x52::Down) ? 1 : (d & x52::Up) ? -1 : 0;
+}
+
+
+// InputDevice collects the events of a received frame into a batch that is
+// written to uinput with a single write() call.
+class InputDevice {
+public:
+	InputDevice(const std::string& name, bool dry_run): m_Name(name), m_DryRun(dry_run), m_Fd(-1), m_Type(0) {}
+
+	~InputDevice() {
+		Destroy();
+	}
+
+	// Open (re)creates the uinput device if the frame type has changed
+	// (the axis ranges depend on the joystick version).
+	bool Open(uint8_t type) {
+		if (type == m_Type)
+			return true;
+		Destroy();
+		m_Type = type;
+		m_HasPrev = false;
+		if (m_DryRun) {
+			printf("device: %s (%s)\n", m_Name.c_str(), type == x52::stream::ProJoystickStateFrame ? "pro" : "std");
+			return true;
+		}
+
+		m_Fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+		if (m_Fd < 0) {
+			perror("open /dev/uinput");
+			return false;
+		}
+
+		ioctl(m_Fd, UI_SET_EVBIT, EV_KEY);
+		for (uint16_t code : BUTTON_CODES)
+			ioctl(m_Fd, UI_SET_KEYBIT, code);
+		for (uint16_t code : MODE_CODES)
+			ioctl(m_Fd, UI_SET_KEYBIT, code);
+
+		ioctl(m_Fd, UI_SET_EVBIT, EV_MSC);
+		ioctl(m_Fd, UI_SET_MSCBIT, MSC_TIMESTAMP);
+
+		bool pro = type == x52::stream::ProJoystickStateFrame;
+		ioctl(m_Fd, UI_SET_EVBIT, EV_ABS);
+		SetupAbs(ABS_X, 0, pro ? x52::pro::JoystickState::MAX_X : x52::std::JoystickState::MAX_X);
+		SetupAbs(ABS_Y, 0, pro ? x52::pro::JoystickState::MAX_Y : x52::std::JoystickState::MAX_Y);
+		SetupAbs(ABS_RZ, 0, pro ? x52::pro::JoystickState::MAX_Z : x52::std::JoystickState::MAX_Z);
+		SetupAbs(ABS_HAT0X, -1, 1);
+		SetupAbs(ABS_HAT0Y, -1, 1);
+		SetupAbs(ABS_HAT1X, -1, 1);
+		SetupAbs(ABS_HAT1Y, -1, 1);
+
+		uinput_setup setup;
+		memset(&setup, 0, sizeof(setup));
+		setup.id.bustype = BUS_USB;
+		setup.id.vendor = 0x06a3;  // Saitek
+		setup.id.product = pro ? 0x0762 : 0x075c;
+		strncpy(setup.name, m_Name.c_str(), UINPUT_MAX_NAME_SIZE - 1);
+		if (ioctl(m_Fd, UI_DEV_SETUP, &setup) < 0 || ioctl(m_Fd, UI_DEV_CREATE) < 0) {
+			perror("uinput device setup");
+			Destroy();
+			return false;
+		}
+		return true;
+	}
+
+	// AddFrame appends the events of the changed fields (all fields after
+	// the device was created) and a SYN_REPORT to the batch.
+	void AddFrame(const DeviceState& s, uint32_t capture_micros) {
+		Add(EV_MSC, MSC_TIMESTAMP, int32_t(capture_micros));
+		AddIfChanged(EV_ABS, ABS_X, s.x, m_Prev.x);
+		AddIfChanged(EV_ABS, ABS_Y, s.y, m_Prev.y);
+		AddIfChanged(EV_ABS, ABS_RZ, s.z, m_Prev.z);
+		AddIfChanged(EV_ABS, ABS_HAT0X, hat_x(s.pov_1), hat_x(m_Prev.pov_1));
+		AddIfChanged(EV_ABS, ABS_HAT0Y, hat_y(s.pov_1), hat_y(m_Prev.pov_1));
+		AddIfChanged(EV_ABS, ABS_HAT1X, hat_x(s.pov_2), hat_x(m_Prev.pov_2));
+		AddIfChanged(EV_ABS, ABS_HAT1Y, hat_y(s.pov_2), hat_y(m_Prev.pov_2));
+		for (int i=0; i<13; i++)
+			AddIfChanged(EV_KEY, BUTTON_CODES[i], s.buttons[i], m_Prev.buttons[i]);
+		for (int i=0; i<3; i++)
+			AddIfChanged(EV_KEY, MODE_CODES[i], s.mode == x52::Mode1 + i, m_Prev.mode == x52::Mode1 + i);
+		Add(EV_SYN, SYN_REPORT, 0);
+		m_Prev = s;
+		m_HasPrev = true;
+	}
+
+	// Flush writes the batch. Returns false on error.
+	bool Flush() {
+		if (m_Batch.empty())
+			return true;
+		bool ok = true;
+		if (m_DryRun) {
+			for (const input_event& e : m_Batch)
+				printf("event: type=%d code=%d value=%d\n", e.type, e.code, e.value);
+			fflush(stdout);
+		} else {
+			size_t size = m_Batch.size() * sizeof(input_event);
+			ssize_t n = write(m_Fd, m_Batch.data(), size);
+			if (n != ssize_t(size)) {
+				perror("write to uinput");
+				ok = false;
+			}
+		}
+		m_Batch.clear();
+		return ok;
+	}
+
+private:
+	void SetupAbs(uint16_t code, int min_value, int max_value) {
+		ioctl(m_Fd, UI_SET_ABSBIT, code);
+		uinput_abs_setup abs;
+		memset(&abs, 0, sizeof(abs));
+		abs.code = code;
+		abs.absinfo.minimum = min_value;
+		abs.absinfo.maximum = max_value;
+		ioctl(m_Fd, UI_ABS_SETUP, &abs);
+	}
+
+	void Add(uint16_t type, uint16_t code, int32_t value) {
+		input_event e;
+		memset(&e, 0, sizeof(e));
+		e.type = type;
+		e.code = code;
+		e.value = value;
+		m_Batch.push_back(e);
+	}
+
+	void AddIfChanged(uint16_t type, uint16_t code, int value, int prev_value) {
+		if (!m_HasPrev || value != prev_value)
+			Add(type, code, value);
+	}
+
+	void Destroy() {
+		if (m_Fd >= 0) {
+			ioctl(m_Fd, UI_DEV_DESTROY);
+			close(m_Fd);
+			m_Fd = -1;
+		}
+		m_Type = 0;
+	}
+
+	std::string m_Name;
+	bool m_DryRun;
+	int m_Fd;
+	uint8_t m_Type;
+	bool m_HasPrev = false;
+	DeviceState m_Prev;
+	std::vector<input_event> m_Batch;
+};
+
+
+struct Stats {
+	unsigned long frames = 0;
+	unsigned long lost_frames = 0;
+	unsigned long bad_payloads = 0;
+	uint64_t host_latency_sum = 0;
+	uint64_t host_latency_max = 0;
+	uint64_t transport_jitter_max = 0;
+
+	void Print(unsigned long crc_errors) {
+		printf("stats: frames=%lu lost=%lu crc_errors=%lu bad_payloads=%lu host_latency_avg=%.1fus host_latency_max=%luus transport_jitter_max=%luus\n",
+			frames, lost_frames, crc_errors, bad_payloads,
+			frames ? double(host_latency_sum) / frames : 0.0,
+			(unsigned long)host_latency_max, (unsigned long)transport_jitter_max);
+		fflush(stdout);
+		*this = Stats();
+	}
+};
+
+
+int open_serial(const char* path) {
+	int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	termios tio;
+	if (tcgetattr(fd, &tio) == 0) {
+		cfmakeraw(&tio);
+		tcsetattr(fd, TCSANOW, &tio);
+	}
+	return fd;
+}
+
+
+int open_pty() {
+	int fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0) {
+		perror("posix_openpt");
+		return -1;
+	}
+	termios tio;
+	if (tcgetattr(fd, &tio) == 0) {
+		cfmakeraw(&tio);
+		tcsetattr(fd, TCSANOW, &tio);
+	}
+	printf("pty: %s\n", ptsname(fd));
+	fflush(stdout);
+	return fd;
+}
+
+
+void usage() {
+	fprintf(stderr, "usage: x52_uinputd [--name <name>] [--dry-run] [--latency] [--stats <sec>] (--pty | <serial-device>)\n");
+	exit(2);
+}
+
+
+}  // namespace
+
+
+int main(int argc, char** argv) {
+	std::string name = "X52 HOTAS";
+	const char* path = nullptr;
+	bool dry_run = false, use_pty = false, print_latency = false;
+	int stats_period = 10;
+
+	for (int i=1; i<argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--name" && i+1 < argc)
+			name = argv[++i];
+		else if (arg == "--stats" && i+1 < argc)
+			stats_period = atoi(argv[++i]);
+		else if (arg == "--dry-run")
+			dry_run = true;
+		else if (arg == "--pty")
+			use_pty = true;
+		else if (arg == "--latency")
+			print_latency = true;
+		else if (arg[0] != '-' && !path)
+			path = argv[i];
+		else
+			usage();
+	}
+	if (!use_pty && !path)
+		usage();
+
+	int fd = use_pty ? open_pty() : open_serial(path);
+	if (fd < 0)
+		return 1;
+
+	sigset_t sigs;
+	sigemptyset(&sigs);
+	sigaddset(&sigs, SIGINT);
+	sigaddset(&sigs, SIGTERM);
+	sigprocmask(SIG_BLOCK, &sigs, nullptr);
+	int sig_fd = signalfd(-1, &sigs, SFD_CLOEXEC);
+
+	int ep = epoll_create1(EPOLL_CLOEXEC);
+	epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+	ev.data.fd = sig_fd;
+	epoll_ctl(ep, EPOLL_CTL_ADD, sig_fd, &ev);
+
+	InputDevice dev(name, dry_run);
+	x52::stream::Decoder decoder;
+	Stats stats;
+	bool has_seq = false;
+	uint8_t next_seq = 0;
+	int64_t min_offset = INT64_MAX;
+	uint64_t next_stats = now_micros() + uint64_t(stats_period) * 1000000;
+
+	for (;;) {
+		int timeout_ms = stats_period > 0 ? int((next_stats - std::min(next_stats, now_micros())) / 1000) : -1;
+		epoll_event events[2];
+		int n = epoll_wait(ep, events, 2, timeout_ms);
+		if (n < 0 && errno != EINTR) {
+			perror("epoll_wait");
+			return 1;
+		}
+
+		if (stats_period > 0 && now_micros() >= next_stats) {
+			stats.Print(decoder.NumErrors());
+			next_stats += uint64_t(stats_period) * 1000000;
+		}
+
+		for (int e=0; e<n; e++) {
+			if (events[e].data.fd == sig_fd)
+				return 0;
+
+			uint8_t buf[4096];
+			ssize_t size = read(fd, buf, sizeof(buf));
+			if (size < 0) {
+				// A pty without a writer on the other side reports EIO.
+				if (errno == EAGAIN || errno == EIO) {
+					if (errno == EIO)
+						usleep(10000);
+					continue;
+				}
+				perror("read");
+				return 1;
+			}
+			if (size == 0)
+				return 0;
+			uint64_t recv_time = now_micros();
+
+			// The frames completed by this read are written to uinput in one batch.
+			std::vector<uint32_t> capture_times;
+			for (ssize_t i=0; i<size; i++) {
+				if (!decoder.Feed(buf[i]))
+					continue;
+
+				if (has_seq && decoder.Seq() != next_seq)
+					stats.lost_frames += uint8_t(decoder.Seq() - next_seq);
+				has_seq = true;
+				next_seq = uint8_t(decoder.Seq() + 1);
+
+				DeviceState s;
+				if (decoder.Type() == x52::stream::ProJoystickStateFrame) {
+					x52::pro::JoystickState::Binary b;
+					if (!decoder.PayloadToBinary(b)) {
+						stats.bad_payloads++;
+						continue;
+					}
+					x52::pro::JoystickState js;
+					js.SetFromBinary(b);
+					s.Set(js);
+				} else if (decoder.Type() == x52::stream::StdJoystickStateFrame) {
+					x52::std::JoystickState::Binary b;
+					x52::std::JoystickState js;
+					if (!decoder.PayloadToBinary(b) || !js.SetFromBinary(b)) {
+						stats.bad_payloads++;
+						continue;
+					}
+					s.Set(js);
+				} else {
+					stats.bad_payloads++;
+					continue;
+				}
+
+				if (!dev.Open(decoder.Type()))
+					return 1;
+				dev.AddFrame(s, decoder.CaptureMicros());
+				capture_times.push_back(decoder.CaptureMicros());
+			}
+
+			if (!dev.Flush())
+				return 1;
+			uint64_t host_latency = now_micros() - recv_time;
+
+			for (uint32_t capture_micros : capture_times) {
+				// The offset between the clocks (plus the transport latency)
+				// modulo 2^32 because the board's micros() wraps around.
+				int64_t offset = int64_t(uint32_t(recv_time - capture_micros));
+				min_offset = std::min(min_offset, offset);
+				uint64_t jitter = uint64_t(offset - min_offset);
+
+				stats.frames++;
+				stats.host_latency_sum += host_latency;
+				stats.host_latency_max = std::max(stats.host_latency_max, host_latency);
+				stats.transport_jitter_max = std::max(stats.transport_jitter_max, jitter);
+				if (print_latency)
+					printf("latency: capture=%lu host=%luus transport_above_min=%luus\n",
+						(unsigned long)capture_micros, (unsigned long)host_latency, (unsigned long)jitter);
+			}
+		}
+	}
+}
@@ -0,0 +1,277 @@
+// x52_upsampler_replay measures the prediction error of util::Upsampler
+// (src/x52_util.h) on a recorded trace of joystick states. A trace is a raw
+// x52::stream capture (see src/x52_stream.h): the serial output of a "Fake
+// X52 Throttle" with STREAM_TO_HOST enabled saved into a file, e.g.
+//   stty -F /dev/ttyACM0 raw && cat /dev/ttyACM0 > trace.bin
+// The states are replayed with their capture timestamps. Without a trace
+// --synthetic generates one: ~52 frames per second with jitter, late frames,
+// sweeps with reversals and +-1 LSB noise on the axes.
+//
+// Two errors are reported per axis (mean and max, in LSB of the axis):
+//   at samples  the prediction for the capture time of every sample against
+//               the sample (GetPredictionError of the Upsampler), next to the
+//               error of holding the previous sample
+//   between     the output queried at --query-hz between two samples against
+//               the linear interpolation of the two samples (the best guess of
+//               the real movement), next to the error of holding the sample
+// It also counts the late frames: the intervals longer than the
+// MAX_EXTRAPOLATION_MICROS of the Upsampler.
+//
+// Build (from this directory):
+//   g++ -std=c++17 -O2 -Wall -I../host -I../../src x52_upsampler_replay.cpp -o x52_upsampler_replay
+//
+// Usage:
+//   x52_upsampler_replay [--query-hz <n>] <trace.bin>
+//   x52_upsampler_replay [--query-hz <n>] --synthetic [--pro] [--seconds <n>] [--seed <n>]
+#include <stdlib.h>
+#include <math.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "x52_hotas.h"
+#include "x52_stream.h"
+
+
+namespace {
+
+
+const unsigned long MAX_EXTRAPOLATION_MICROS = 20000;
+
+
+template <typename JoystickState>
+struct Sample {
+	unsigned long micros;
+	JoystickState state;
+};
+
+
+// VectorOutput collects the frames of a stream::Writer.
+struct VectorOutput {
+	std::vector<uint8_t>* bytes;
+
+	int availableForWrite() { return x52::stream::MAX_FRAME_SIZE; }
+
+	size_t write(const uint8_t* buf, size_t size) {
+		bytes->insert(bytes->end(), buf, buf + size);
+		return size;
+	}
+};
+
+
+// synthetic_trace writes a stream with the timing of the joystick: a frame
+// every ~19.2ms with +-300us jitter and 3% of the frames late by 2..15ms.
+template <typename JoystickState>
+std::vector<uint8_t> synthetic_trace(double seconds, unsigned seed) {
+	std::vector<uint8_t> bytes;
+	VectorOutput out = {&bytes};
+	x52::stream::Writer<VectorOutput> writer(out);
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<double> jitter(-300, 300);
+	std::uniform_real_distribution<double> late(2000, 15000);
+	std::uniform_real_distribution<double> unit(0, 1);
+	std::uniform_int_distribution<int> noise(-1, 1);
+
+	auto axis = [&](double v, uint16_t max) {
+		long a = lround(v * max) + noise(rng);
+		return uint16_t(std::min<long>(std::max<long>(a, 0), max));
+	};
+	double t = 0, prev_t = 0, phase = 0;
+	while (t < seconds * 1e6) {
+		double s = t / 1e6;
+		// x: a sine with a slowly sweeping frequency (0.2..2Hz), y: a
+		// triangle (reversals at constant speed), z: mostly resting
+		double f = 0.2 + 1.8 * (0.5 + 0.5 * sin(s * 0.3));
+		phase += 2 * M_PI * f * (t - prev_t) / 1e6;
+		prev_t = t;
+		JoystickState st;
+		st.x = axis(0.5 + 0.45 * sin(phase), JoystickState::MAX_X);
+		double tri = fmod(s * 0.7, 2.0);
+		st.y = axis(0.05 + 0.9 * (tri < 1 ? tri : 2 - tri), JoystickState::MAX_Y);
+		st.z = axis(0.5 + (fmod(s, 10.0) < 2 ? 0.3 * sin(M_PI * s) : 0), JoystickState::MAX_Z);
+		st.button_a = fmod(s, 1.0) < 0.1;
+		typename JoystickState::Binary b;
+		st.ToBinary(b);
+		writer.Write(b, (unsigned long)(uint64_t(t)));
+		t += 19200 + jitter(rng) + (unit(rng) < 0.03 ? late(rng) : 0);
+	}
+	return bytes;
+}
+
+
+template <typename JoystickState>
+std::vector<Sample<JoystickState>> decode(const std::vector<uint8_t>& bytes, uint8_t type, unsigned long& errors) {
+	std::vector<Sample<JoystickState>> samples;
+	x52::stream::Decoder decoder;
+	for (uint8_t b : bytes) {
+		if (!decoder.Feed(b) || decoder.Type() != type)
+			continue;
+		typename JoystickState::Binary binary;
+		if (!decoder.PayloadToBinary(binary))
+			continue;
+		Sample<JoystickState> s;
+		s.micros = decoder.CaptureMicros();
+		s.state.SetFromBinary(binary);
+		samples.push_back(s);
+	}
+	errors = decoder.NumErrors();
+	return samples;
+}
+
+
+struct ErrorStats {
+	double sum[3] = {0, 0, 0};
+	int max[3] = {0, 0, 0};
+	unsigned long n = 0;
+
+	void Add(const uint16_t* a, const double* truth) {
+		for (int i=0; i<3; i++) {
+			double e = fabs(double(a[i]) - truth[i]);
+			sum[i] += e;
+			max[i] = std::max(max[i], int(lround(e)));
+		}
+		n++;
+	}
+
+	void Print(const char* name) const {
+		printf("  %-28s", name);
+		for (int i=0; i<3; i++)
+			printf("  %c: mean=%6.2f max=%5d", "xyz"[i], n ? sum[i] / double(n) : 0.0, max[i]);
+		printf("\n");
+	}
+};
+
+
+template <typename JoystickState>
+int replay(const std::vector<Sample<JoystickState>>& samples, unsigned long query_hz) {
+	if (samples.size() < 3) {
+		fprintf(stderr, "the trace has only %zu states\n", samples.size());
+		return 1;
+	}
+	x52::util::Upsampler<JoystickState, MAX_EXTRAPOLATION_MICROS> upsampler;
+	ErrorStats hold_at_samples, hold_between, pred_between;
+	unsigned long late = 0, query_period = 1000000 / query_hz;
+
+	for (size_t k=0; k<samples.size(); k++) {
+		const Sample<JoystickState>& cur = samples[k];
+		uint16_t v[3] = {cur.state.x, cur.state.y, cur.state.z};
+		if (k) {
+			const JoystickState& p = samples[k-1].state;
+			double prev[3] = {double(p.x), double(p.y), double(p.z)};
+			hold_at_samples.Add(v, prev);
+		}
+		upsampler.AddSample(cur.state, cur.micros);
+		if (k+1 == samples.size())
+			break;
+
+		const Sample<JoystickState>& next = samples[k+1];
+		unsigned long interval = next.micros - cur.micros;
+		if (interval > MAX_EXTRAPOLATION_MICROS)
+			late++;
+		uint16_t n[3] = {next.state.x, next.state.y, next.state.z};
+		for (unsigned long dt=query_period; dt<interval; dt+=query_period) {
+			JoystickState out;
+			upsampler.GetState(out, cur.micros + dt);
+			double truth[3];
+			for (int i=0; i<3; i++)
+				truth[i] = v[i] + (double(n[i]) - double(v[i])) * double(dt) / double(interval);
+			uint16_t o[3] = {out.x, out.y, out.z};
+			pred_between.Add(o, truth);
+			hold_between.Add(v, truth);
+		}
+	}
+
+	const auto& e = upsampler.GetPredictionError();
+	printf("%zu states over %.1fs, late frames (> %luus): %lu, queries at %luHz: %lu\n",
+		samples.size(), double(samples.back().micros - samples.front().micros) / 1e6,
+		MAX_EXTRAPOLATION_MICROS, late, query_hz, pred_between.n);
+	printf("at samples:\n");
+	hold_at_samples.Print("hold the previous sample");
+	printf("  %-28s", "Upsampler prediction");
+	for (int i=0; i<3; i++) {
+		printf("  %c: mean=%6.2f max=%5u", "xyz"[i],
+			e.num_samples ? double(e.sum_abs_error[i]) / double(e.num_samples) : 0.0, unsigned(e.max_abs_error[i]));
+	}
+	printf("\n");
+	printf("between samples (against the linear interpolation):\n");
+	hold_between.Print("hold the sample");
+	pred_between.Print("Upsampler output");
+	return 0;
+}
+
+
+}  // namespace
+
+
+int main(int argc, char** argv) {
+	std::string path;
+	bool synthetic = false, pro = false;
+	double seconds = 60;
+	unsigned seed = 1;
+	unsigned long query_hz = 1000;
+	for (int i=1; i<argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--synthetic") {
+			synthetic = true;
+		} else if (arg == "--pro") {
+			pro = true;
+		} else if (arg == "--seconds" && i+1 < argc) {
+			seconds = atof(argv[++i]);
+		} else if (arg == "--seed" && i+1 < argc) {
+			seed = unsigned(strtoul(argv[++i], nullptr, 10));
+		} else if (arg == "--query-hz" && i+1 < argc) {
+			query_hz = strtoul(argv[++i], nullptr, 10);
+		} else if (arg[0] != '-' && path.empty()) {
+			path = arg;
+		} else {
+			path.clear();
+			synthetic = false;
+			break;
+		}
+	}
+	if (synthetic == !path.empty() || query_hz == 0 || query_hz > 1000000) {
+		fprintf(stderr, "usage: x52_upsampler_replay [--query-hz <n>] <trace.bin>\n"
+			"       x52_upsampler_replay [--query-hz <n>] --synthetic [--pro] [--seconds <n>] [--seed <n>]\n");
+		return 2;
+	}
+
+	std::vector<uint8_t> bytes;
+	if (synthetic) {
+		bytes = pro ? synthetic_trace<x52::pro::JoystickState>(seconds, seed) : synthetic_trace<x52::std::JoystickState>(seconds, seed);
+	} else {
+		FILE* f = fopen(path.c_str(), "rb");
+		if (!f) {
+			perror(path.c_str());
+			return 1;
+		}
+		uint8_t buf[4096];
+		size_t n;
+		while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+			bytes.insert(bytes.end(), buf, buf + n);
+		fclose(f);
+	}
+
+	// The type of the trace is that of its first state frame.
+	x52::stream::Decoder decoder;
+	uint8_t type = 0;
+	for (size_t i=0; i<bytes.size() && !type; i++) {
+		if (decoder.Feed(bytes[i]) && (decoder.Type() == x52::stream::ProJoystickStateFrame || decoder.Type() == x52::stream::StdJoystickStateFrame))
+			type = decoder.Type();
+	}
+	unsigned long errors = 0;
+	int res;
+	if (type == x52::stream::ProJoystickStateFrame) {
+		printf("pro trace\n");
+		res = replay(decode<x52::pro::JoystickState>(bytes, type, errors), query_hz);
+	} else if (type == x52::stream::StdJoystickStateFrame) {
+		printf("std trace\n");
+		res = replay(decode<x52::std::JoystickState>(bytes, type, errors), query_hz);
+	} else {
+		fprintf(stderr, "no joystick states in the trace\n");
+		return 1;
+	}
+	if (errors)
+		printf("corrupted frames skipped: %lu\n", errors);
+	return res;
+}
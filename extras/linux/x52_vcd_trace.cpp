@@ -0,0 +1,360 @@
+// x52_vcd_trace records the PS/2 wires between a JoystickClient and a
+// ThrottleClient (pro or std) connected on a PC into a VCD file that can be
+// viewed with GTKWave (see extras/host/x52_vcd.h). It's a way to look at
+// the timing of the client loops without a board and a logic analyzer,
+// e.g. to compare the edge response times of PollJoystickState before and
+// after a change.
+//
+// The JoystickClient (throttle side) polls --frames times, the recorder
+// marks the start of every poll as a new frame. The dump contains C01..C04
+// as seen by the throttle side and the frame number. It also prints the
+// response times between the clock edges of the two sides.
+//
+// The two sides run on host threads and the timestamps are the micros() of
+// the host so a host with fewer CPUs than threads shows the scheduler in
+// the response times: compare dumps made on the same machine. With
+// --timestamps changes every change is one tick after the previous one: the
+// dumps of two runs differ only where the sequences of the edges differ.
+// --window-us is in these ticks then.
+//
+// --protocol std-interrupt runs the std::InterruptThrottleClient on the
+// joystick side: its C02 interrupt handler is called by the digitalWrite of
+// the JoystickClient and its C04 pulses are ended by a MockPulseTimer fired
+// from the sending loop. After the frames it also checks that a send
+// without a poll from the throttle fails after its wait_micros.
+//
+// --protocol auto runs the AutoJoystickClient on the throttle side and swaps
+// the joystick side between a pro, a std and a pro ThrottleClient (--frames
+// polls each) like a stick swapped while powered. It checks that the first
+// stick is detected, that the client falls back to the detection after
+// X52_AUTO_DETECT_REPROBE_FAILURES failed polls after the later swaps and that
+// every accepted state is that of the connected stick.
+//
+// Build (from this directory):
+//   g++ -std=c++17 -O2 -Wall -pthread -I../host -I../../src x52_vcd_trace.cpp -o x52_vcd_trace
+//
+// Usage:
+//   x52_vcd_trace [--protocol pro|std|std-interrupt|auto] [--frames <n>] [--record-frames <first>:<last>]
+//                 [--window-us <from>:<to>] [--timestamps micros|changes] [--max-events <n>] [-o <file.vcd>]
+//   gtkwave x52_trace.vcd
+#include <stdlib.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "Arduino.h"
+
+// YieldWait is the BusyWait of the host: the wait loops of the library (e.g.
+// the InterruptPulseWaiter) yield the CPU so the other side of the cable gets
+// to run on a host with fewer CPUs than threads.
+struct YieldWait {
+	static void SetupPin(uint8_t) {}
+
+	static bool WaitForPinState(uint8_t pin, int state, unsigned long deadline_micros) {
+		while (digitalRead(pin) != state) {
+			if (long(micros() - deadline_micros) >= 0)
+				return false;
+			std::this_thread::yield();
+		}
+		return true;
+	}
+
+	static void Idle(unsigned long) {
+		std::this_thread::yield();
+	}
+};
+
+#define X52_WAIT_STRATEGY YieldWait
+#include "x52_hotas.h"
+#include "x52_host_tools.h"
+#include "x52_vcd.h"
+
+
+namespace {
+
+
+// The throttle side (the JoystickClient) uses the pins 1..4, the joystick
+// side (the ThrottleClient) uses 11..14.
+enum {
+	C01 = 1, C02, C03, C04,
+	PEER_OFFSET = 10,
+};
+
+
+// LoopbackHAL connects the two sides: a write sets the pin and the pin of
+// the other side.
+typedef X52HostLoopbackHAL<PEER_OFFSET> LoopbackHAL;
+
+
+// InterruptThrottle runs the std::InterruptThrottleClient on the pins of
+// the joystick side like the ThrottleClient.
+typedef x52::MockPulseTimer<> PulseTimer;
+typedef X52HostInterruptThrottle<x52::std::InterruptThrottleClient<C01+PEER_OFFSET, C02+PEER_OFFSET, C03+PEER_OFFSET, C04+PEER_OFFSET,
+	PulseTimer, LoopbackHAL>, PulseTimer> InterruptThrottle;
+
+// check_armed_timeout sends without a poll from the throttle: the send has
+// to fail with 1 after the wait.
+bool check_armed_timeout(InterruptThrottle& throttle) {
+	const unsigned long WAIT_MICROS = 20000;
+	x52::std::JoystickState s;
+	x52::std::JoystickConfig c;
+	unsigned long start = micros();
+	unsigned long res = throttle.SendJoystickState(s, c, WAIT_MICROS);
+	unsigned long elapsed = micros() - start;
+	bool ok = res == 1 && elapsed >= WAIT_MICROS;
+	printf("send without a poll: result=%lu after %luus (wait_micros=%lu): %s\n",
+		res, elapsed, WAIT_MICROS, ok ? "ok" : "FAILED");
+	return ok;
+}
+
+template <typename ThrottleClient>
+bool check_armed_timeout(ThrottleClient&) {
+	return true;
+}
+
+
+struct Options {
+	unsigned long frames = 20;
+	X52VcdRecorder::Filter filter;
+	X52VcdRecorder::Timestamps timestamps = X52VcdRecorder::MicrosTimestamps;
+	size_t max_events = 1 << 20;
+	std::string output = "x52_trace.vcd";
+};
+
+
+bool parse_range(const char* s, unsigned long long& first, unsigned long long& last) {
+	char* end;
+	first = strtoull(s, &end, 10);
+	if (*end != ':')
+		return false;
+	last = strtoull(end + 1, &end, 10);
+	return *end == 0 && first <= last;
+}
+
+
+template <typename JoystickState, typename JoystickConfig, typename JoystickClient, typename ThrottleClient>
+int run(const char* name, const Options& opt) {
+	JoystickClient joystick_client;
+	ThrottleClient throttle_client;
+	joystick_client.Setup();
+	throttle_client.Setup();
+
+	X52VcdRecorder rec(opt.max_events, opt.timestamps);
+	rec.AddSignal(C01, "C01");
+	rec.AddSignal(C02, "C02");
+	rec.AddSignal(C03, "C03");
+	rec.AddSignal(C04, "C04");
+	rec.SetFilter(opt.filter);
+
+	std::atomic<bool> stop(false);
+	std::thread joystick([&]() {
+		JoystickState s;
+		s.x = 0x155;
+		s.button_a = true;
+		while (!stop) {
+			JoystickConfig c;
+			unsigned long res = throttle_client.SendJoystickState(s, c, 20000);
+			if (res > 1)
+				delayMicroseconds(res);
+		}
+	});
+
+	rec.Start();
+	unsigned long ok = 0, failed = 0;
+	for (unsigned long i=0; i<opt.frames && !rec.Done(); i++) {
+		JoystickState s;
+		JoystickConfig c;
+		rec.BeginFrame();
+		unsigned long res = joystick_client.PollJoystickState(s, c, 50000);
+		if (res) {
+			failed++;
+			delayMicroseconds(std::min(res, 100000UL));
+		} else {
+			ok++;
+		}
+	}
+	rec.Stop();
+	stop = true;
+	joystick.join();
+	if (!check_armed_timeout(throttle_client))
+		ok = 0;
+
+	std::string comment = std::string(name) + " PS/2 wires, throttle side";
+	if (!rec.Write(opt.output.c_str(), comment.c_str())) {
+		perror(opt.output.c_str());
+		return 1;
+	}
+	printf("%s: polls ok=%lu failed=%lu, %zu changes written to %s (dropped: %lu)\n",
+		name, ok, failed, rec.NumEvents(), opt.output.c_str(), rec.NumDropped());
+	printf("response times:\n");
+	rec.PrintResponseTimes(stdout, rec.Signal(C02), rec.Signal(C04));
+	rec.PrintResponseTimes(stdout, rec.Signal(C04), rec.Signal(C02));
+	return ok ? 0 : 1;
+}
+
+
+// Peer runs a ThrottleClient on the joystick side that keeps sending the
+// test state until the Peer is destroyed (the stick is unplugged).
+template <typename ThrottleClient, typename JoystickState, typename JoystickConfig>
+class Peer {
+public:
+	Peer() : m_Stop(false) {
+		m_Client.Setup();
+		m_Thread = std::thread([this]() {
+			JoystickState s;
+			s.x = 0x155;
+			s.button_a = true;
+			while (!m_Stop) {
+				JoystickConfig c;
+				unsigned long res = m_Client.SendJoystickState(s, c, 20000);
+				if (res > 1)
+					delayMicroseconds(res);
+			}
+		});
+	}
+
+	~Peer() {
+		m_Stop = true;
+		m_Thread.join();
+	}
+
+private:
+	ThrottleClient m_Client;
+	std::atomic<bool> m_Stop;
+	std::thread m_Thread;
+};
+
+typedef Peer<x52::pro::ThrottleClient<C01+PEER_OFFSET, C02+PEER_OFFSET, C03+PEER_OFFSET, C04+PEER_OFFSET, LoopbackHAL>,
+	x52::pro::JoystickState, x52::pro::JoystickConfig> ProPeer;
+typedef Peer<x52::std::ThrottleClient<C01+PEER_OFFSET, C02+PEER_OFFSET, C03+PEER_OFFSET, C04+PEER_OFFSET, LoopbackHAL>,
+	x52::std::JoystickState, x52::std::JoystickConfig> StdPeer;
+
+const char* protocol_name(x52::Protocol p) {
+	return p == x52::ProtocolPro ? "pro" : p == x52::ProtocolStd ? "std" : "unknown";
+}
+
+// run_auto swaps the peers under the AutoJoystickClient. A phase passes if
+// the protocol of the peer is detected within the allowed number of polls,
+// all the polls after that succeed and every accepted state is the state of
+// the peer read with the right protocol.
+int run_auto(const Options& opt) {
+	x52::AutoJoystickClient<C01, C02, C03, C04, x52::std::InterruptPulseWaiter<C04>, LoopbackHAL> joystick_client;
+	joystick_client.Setup();
+
+	X52VcdRecorder rec(opt.max_events, opt.timestamps);
+	rec.AddSignal(C01, "C01");
+	rec.AddSignal(C02, "C02");
+	rec.AddSignal(C03, "C03");
+	rec.AddSignal(C04, "C04");
+	rec.SetFilter(opt.filter);
+	rec.Start();
+
+	const x52::Protocol phases[] = {x52::ProtocolPro, x52::ProtocolStd, x52::ProtocolPro};
+	bool ok = true;
+	for (int phase=0; phase<3; phase++) {
+		x52::Protocol expected = phases[phase];
+		ProPeer* pro_peer = expected == x52::ProtocolPro ? new ProPeer : nullptr;
+		StdPeer* std_peer = expected == x52::ProtocolStd ? new StdPeer : nullptr;
+		// The first poll detects the stick. After a swap the client keeps
+		// polling with the old protocol until it gives up.
+		unsigned long allowed = phase ? X52_AUTO_DETECT_REPROBE_FAILURES + 1 : 1;
+		unsigned long until_detected = 0, good = 0, failed = 0, wrong = 0;
+		bool detected = false;
+		for (unsigned long i=0; i<opt.frames; i++) {
+			x52::pro::JoystickState pro_state;
+			x52::pro::JoystickConfig pro_cfg;
+			x52::std::JoystickState std_state;
+			x52::std::JoystickConfig std_cfg;
+			rec.BeginFrame();
+			unsigned long res = joystick_client.PollJoystickState(pro_state, pro_cfg, std_state, std_cfg, 50000);
+			x52::Protocol p = joystick_client.GetProtocol();
+			bool valid = p == x52::ProtocolPro ? pro_state.x == 0x155 && pro_state.button_a :
+				std_state.x == 0x155 && std_state.button_a;
+			if (!res && (p != expected || !valid)) {
+				wrong++;
+			} else if (!res) {
+				good++;
+				detected = true;
+			} else if (detected) {
+				failed++;
+			}
+			if (!detected)
+				until_detected++;
+			if (res)
+				delayMicroseconds(std::min(res, 100000UL));
+		}
+		delete pro_peer;
+		delete std_peer;
+
+		bool phase_ok = detected && until_detected < allowed && !failed && !wrong;
+		printf("auto, %s stick: detected %s after %lu polls (allowed: %lu), good=%lu failed=%lu wrong=%lu: %s\n",
+			protocol_name(expected), protocol_name(joystick_client.GetProtocol()), until_detected, allowed - 1,
+			good, failed, wrong, phase_ok ? "ok" : "FAILED");
+		ok &= phase_ok;
+	}
+	rec.Stop();
+
+	if (!rec.Write(opt.output.c_str(), "AutoJoystickClient PS/2 wires, throttle side")) {
+		perror(opt.output.c_str());
+		return 1;
+	}
+	printf("%zu changes written to %s (dropped: %lu)\n", rec.NumEvents(), opt.output.c_str(), rec.NumDropped());
+	return ok ? 0 : 1;
+}
+
+
+}  // namespace
+
+
+int main(int argc, char** argv) {
+	Options opt;
+	std::string protocol = "pro";
+	for (int i=1; i<argc; i++) {
+		std::string arg = argv[i];
+		unsigned long long first, last;
+		if (arg == "--protocol" && i+1 < argc) {
+			protocol = argv[++i];
+		} else if (arg == "--frames" && i+1 < argc) {
+			opt.frames = strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "--record-frames" && i+1 < argc && parse_range(argv[i+1], first, last)) {
+			i++;
+			opt.filter.first_frame = (unsigned long)first;
+			opt.filter.last_frame = (unsigned long)last;
+		} else if (arg == "--window-us" && i+1 < argc && parse_range(argv[i+1], first, last)) {
+			i++;
+			opt.filter.from = first;
+			opt.filter.to = last;
+		} else if (arg == "--timestamps" && i+1 < argc && (argv[i+1] == std::string("micros") || argv[i+1] == std::string("changes"))) {
+			opt.timestamps = argv[++i] == std::string("changes") ? X52VcdRecorder::ChangeTimestamps : X52VcdRecorder::MicrosTimestamps;
+		} else if (arg == "--max-events" && i+1 < argc) {
+			opt.max_events = strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "-o" && i+1 < argc) {
+			opt.output = argv[++i];
+		} else {
+			fprintf(stderr, "usage: x52_vcd_trace [--protocol pro|std|std-interrupt|auto] [--frames <n>] [--record-frames <first>:<last>] "
+				"[--window-us <from>:<to>] [--timestamps micros|changes] [--max-events <n>] [-o <file.vcd>]\n");
+			return 2;
+		}
+	}
+
+	if (protocol == "pro") {
+		return run<x52::pro::JoystickState, x52::pro::JoystickConfig,
+			x52::pro::JoystickClient<C01, C02, C03, C04, LoopbackHAL>,
+			x52::pro::ThrottleClient<C01+PEER_OFFSET, C02+PEER_OFFSET, C03+PEER_OFFSET, C04+PEER_OFFSET, LoopbackHAL>>("pro", opt);
+	}
+	if (protocol == "std") {
+		return run<x52::std::JoystickState, x52::std::JoystickConfig,
+			x52::std::JoystickClient<C01, C02, C03, C04, x52::std::InterruptPulseWaiter<C04>, LoopbackHAL>,
+			x52::std::ThrottleClient<C01+PEER_OFFSET, C02+PEER_OFFSET, C03+PEER_OFFSET, C04+PEER_OFFSET, LoopbackHAL>>("std", opt);
+	}
+	if (protocol == "std-interrupt") {
+		return run<x52::std::JoystickState, x52::std::JoystickConfig,
+			x52::std::JoystickClient<C01, C02, C03, C04, x52::std::InterruptPulseWaiter<C04>, LoopbackHAL>,
+			InterruptThrottle>("std-interrupt", opt);
+	}
+	if (protocol == "auto")
+		return run_auto(opt);
+	fprintf(stderr, "unknown protocol: %s\n", protocol.c_str());
+	return 2;
+}
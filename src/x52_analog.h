@@ -0,0 +1,354 @@
+// Background analog acquisition for the fake joystick firmwares.
+#pragma once
+
+#include "x52_common.h"
+
+
+// The input sensors of a fake joystick are usually potentiometers/hall
+// sensors on analog pins and switches on digital pins. An analogRead takes
+// ~100us per axis on an AVR and it would sit right between two polls of the
+// throttle. The AnalogPipeline below runs the conversions from the interrupt
+// handler of the ADC in the background instead: it converts the channels
+// round-robin, oversamples and decimates them and debounces the buttons so
+// the loop only has to pick up the latest values. Combined with a
+// PreEncodedState (see x52_common.h) there is a ready-to-send state at all
+// times:
+//
+//   typedef x52::AnalogPipeline<x52::AvrAdc, 3, 4> Pipeline;
+//   Pipeline pipeline;
+//   x52::PreEncodedState<x52::pro::JoystickState> slot;
+//
+//   uint16_t read_buttons() { return uint16_t(~PIND); }  // port reads, it runs in the ISR
+//
+//   void setup() {
+//     static const uint8_t channels[3] = {0, 1, 2};
+//     pipeline.Setup(channels, read_buttons);
+//   }
+//
+//   void loop() {
+//     static uint8_t last_n;
+//     uint8_t n = pipeline.NumBlocks();
+//     if (n != last_n) {
+//       last_n = n;
+//       x52::pro::JoystickState s;
+//       s.x = pipeline.Axis<10>(0);
+//       s.y = pipeline.Axis<10>(1);
+//       s.z = pipeline.Axis<10>(2);
+//       s.button_fire = pipeline.Buttons() & 1;
+//       slot.Publish(s);
+//     }
+//     throttle_client.SendLatestJoystickState(slot, cfg, 1000);
+//   }
+//
+// X52_AVR_ADC_ISR() has to be put at global scope into one of the .ino/.cpp
+// files of the project when the AvrAdc is used.
+//
+// extras/linux/x52_analog_bench.cpp runs the pipeline on a PC with a mock
+// ADC stream and reports the CPU cost per sample.
+
+
+namespace x52 {
+
+
+// An Adc is the ADC backend of the AnalogPipeline. Like the PulseTimers it's
+// a class with static methods because the ADC is a singleton and its
+// interrupt handler can't be bound to an instance:
+//
+//   static void Setup(void (*callback)(uint16_t sample));  // call once before Start
+//   static void Start(uint8_t channel);  // starts a single conversion, the callback gets its result
+//   static void Stop();                  // no more callbacks after this
+//
+// The callback is called from the interrupt handler of the ADC and it may
+// call Start to chain the next conversion. The samples are 10-bit values.
+
+#if defined(__AVR__) && defined(ADCSRA)
+
+// AvrAdc uses the ADC of the AVR (e.g. ATmega328P, ATmega32U4) with AVcc
+// reference and ADC prescaler 128: 104us per conversion at 16MHz, ~9600
+// samples per second shared by the channels. The channels are the MUX values
+// of the ADC (on the ATmega328P channel N is pin AN), don't call analogRead
+// while the AvrAdc is in use.
+class AvrAdc {
+public:
+	typedef void (*CallbackFunc)(uint16_t);
+
+	static void Setup(CallbackFunc callback) {
+		Callback() = callback;
+		ADCSRA = _BV(ADEN) | _BV(ADIF) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+	}
+
+	static void Start(uint8_t channel) {
+#if defined(MUX5)
+		if (channel & 8)
+			ADCSRB |= _BV(MUX5);
+		else
+			ADCSRB &= ~_BV(MUX5);
+#endif
+		ADMUX = _BV(REFS0) | (channel & 7);
+		ADCSRA |= _BV(ADIE) | _BV(ADSC);
+	}
+
+	static void Stop() {
+		ADCSRA &= ~_BV(ADIE);
+	}
+
+	static void InterruptHandler() {
+		Callback()(ADC);
+	}
+
+private:
+	static volatile CallbackFunc& Callback() {
+		static volatile CallbackFunc callback = nullptr;
+		return callback;
+	}
+};
+
+#define X52_AVR_ADC_ISR() \
+	ISR(ADC_vect) { x52::AvrAdc::InterruptHandler(); }
+
+#endif
+
+// MockAdc doesn't touch any hardware. The host side test code plays the ADC:
+// it calls Convert with the sample of the channel returned by Channel().
+template <int ID=0>
+class MockAdc {
+public:
+	static void Setup(void (*callback)(uint16_t)) {
+		m_Callback = callback;
+		m_Running = false;
+	}
+
+	static void Start(uint8_t channel) {
+		m_Channel = channel;
+		m_Running = true;
+	}
+
+	static void Stop() {
+		m_Running = false;
+	}
+
+	static bool IsRunning() {
+		return m_Running;
+	}
+
+	// The channel of the conversion in progress.
+	static uint8_t Channel() {
+		return m_Channel;
+	}
+
+	// Convert finishes the conversion in progress with the given sample.
+	static void Convert(uint16_t sample) {
+		if (!m_Running)
+			return;
+		m_Running = false;
+		m_Callback(sample);
+	}
+
+private:
+	static void (*m_Callback)(uint16_t);
+	static volatile bool m_Running;
+	static uint8_t m_Channel;
+};
+
+template <int ID>
+void (*MockAdc<ID>::m_Callback)(uint16_t) = nullptr;
+
+template <int ID>
+volatile bool MockAdc<ID>::m_Running = false;
+
+template <int ID>
+uint8_t MockAdc<ID>::m_Channel = 0;
+
+
+// AdcOversampler accumulates the 10-bit samples of NUM_CHANNELS channels
+// converted round-robin. A block is 2^SAMPLES_LOG2 rounds: at the end of
+// every block the sums of the channels become the new values and the
+// accumulators restart (decimation). Averaging 4^N samples gives N extra
+// bits if the signal has at least 1 LSB of noise, e.g. SAMPLES_LOG2=2 is
+// enough for the 11-bit axes of the std JoystickState. Without noise the
+// oversampling still filters but the extra bits are zeros.
+//
+// OnSample is the interrupt side, the other methods are for the loop. The
+// values are 16-bit so the reader has to disable the interrupts on AVR
+// (the AnalogPipeline does that).
+template <int NUM_CHANNELS, int SAMPLES_LOG2=4>
+class AdcOversampler {
+public:
+	static_assert(NUM_CHANNELS > 0 && NUM_CHANNELS <= 16, "NUM_CHANNELS has to be 1..16");
+	static_assert(SAMPLES_LOG2 >= 0 && SAMPLES_LOG2 <= 6, "the sums of the 10-bit samples have to fit into 16 bits");
+
+	enum {
+		ADC_BITS = 10,
+		SUM_BITS = ADC_BITS + SAMPLES_LOG2,
+	};
+
+	AdcOversampler() {
+		Reset();
+	}
+
+	void Reset() {
+		memset(m_Acc, 0, sizeof(m_Acc));
+		for (int i=0; i<NUM_CHANNELS; i++)
+			m_Sums[i] = 0;
+		m_Channel = 0;
+		m_Round = 0;
+		m_NumBlocks = 0;
+	}
+
+	// OnSample adds the sample of the current channel and returns the index
+	// of the next channel to convert.
+	uint8_t OnSample(uint16_t sample) {
+		uint8_t ch = m_Channel;
+		m_Acc[ch] += sample;
+		if (++ch < NUM_CHANNELS) {
+			m_Channel = ch;
+			return ch;
+		}
+		m_Channel = 0;
+		if (uint8_t(++m_Round) == (1 << SAMPLES_LOG2)) {
+			m_Round = 0;
+			for (int i=0; i<NUM_CHANNELS; i++) {
+				m_Sums[i] = m_Acc[i];
+				m_Acc[i] = 0;
+			}
+			m_NumBlocks = uint8_t(m_NumBlocks + 1);
+		}
+		return 0;
+	}
+
+	// Value returns the last decimated value of a channel scaled to BITS bits.
+	template <int BITS>
+	uint16_t Value(int channel) const {
+		static_assert(BITS > 0 && BITS <= 16, "BITS has to be 1..16");
+		enum {
+			RIGHT_SHIFT = BITS < SUM_BITS ? SUM_BITS - BITS : 0,
+			LEFT_SHIFT = BITS > SUM_BITS ? BITS - SUM_BITS : 0,
+		};
+		return uint16_t((m_Sums[channel] >> RIGHT_SHIFT) << LEFT_SHIFT);
+	}
+
+	// NumBlocks is the number of finished blocks (mod 256).
+	uint8_t NumBlocks() const {
+		return m_NumBlocks;
+	}
+
+private:
+	uint16_t m_Acc[NUM_CHANNELS];
+	volatile uint16_t m_Sums[NUM_CHANNELS];
+	uint8_t m_Channel;
+	uint8_t m_Round;
+	volatile uint8_t m_NumBlocks;
+};
+
+
+// ButtonDebouncer debounces up to 8*sizeof(Bits) buttons in parallel with
+// two-bit vertical counters: a button changes its state after 4 consecutive
+// samples with the new level. The cost of Update doesn't depend on the
+// number of buttons. Sample at a fixed rate, e.g. 1-2kHz gives 2-4ms.
+template <typename Bits=uint16_t>
+class ButtonDebouncer {
+public:
+	ButtonDebouncer(): m_State(0), m_Count0(Bits(~Bits(0))), m_Count1(Bits(~Bits(0))) {}
+
+	// Update takes the raw levels (1 = pressed) and returns the debounced state.
+	Bits Update(Bits raw) {
+		Bits changed = Bits(m_State ^ raw);
+		// the counters of the unchanged buttons are reset to 3, the others count down
+		m_Count0 = Bits(~(m_Count0 & changed));
+		m_Count1 = Bits(m_Count0 ^ (m_Count1 & changed));
+		// a counter that rolls over (from 0 to 3) toggles the button
+		changed &= Bits(m_Count0 & m_Count1);
+		m_State ^= changed;
+		return m_State;
+	}
+
+	Bits State() const {
+		return m_State;
+	}
+
+private:
+	Bits m_State;
+	Bits m_Count0;
+	Bits m_Count1;
+};
+
+
+// AnalogPipeline connects an Adc to an AdcOversampler and a ButtonDebouncer.
+// The conversions run back-to-back from the interrupt handler of the ADC.
+// The buttons are sampled by the read_buttons callback at the end of every
+// round of the channels (from the interrupt handler so it should read the
+// port registers instead of calling digitalRead for every pin).
+//
+// Only one instance can exist per Adc.
+template <typename Adc, int NUM_CHANNELS, int SAMPLES_LOG2=4, typename ButtonBits=uint16_t>
+class AnalogPipeline {
+public:
+	typedef ButtonBits (*ReadButtonsFunc)();
+
+	// Setup starts the conversions. adc_channels are the channels of the Adc.
+	void Setup(const uint8_t (&adc_channels)[NUM_CHANNELS], ReadButtonsFunc read_buttons=nullptr) {
+		Adc::Stop();
+		memcpy(m_Channels, adc_channels, sizeof(m_Channels));
+		m_ReadButtons = read_buttons;
+		m_Oversampler.Reset();
+		m_Buttons = ButtonDebouncer<ButtonBits>();
+		g_Instance = this;
+		Adc::Setup(SampleHandler);
+		Adc::Start(m_Channels[0]);
+	}
+
+	void Stop() {
+		Adc::Stop();
+	}
+
+	// NumBlocks changes when new axis values are ready (see AdcOversampler).
+	uint8_t NumBlocks() const {
+		return m_Oversampler.NumBlocks();
+	}
+
+	// Axis returns the latest value of the axis on the given channel index
+	// scaled to BITS bits (e.g. 10 for the x axis of the pro JoystickState).
+	template <int BITS>
+	uint16_t Axis(int channel) const {
+		noInterrupts();
+		uint16_t v = m_Oversampler.template Value<BITS>(channel);
+		interrupts();
+		return v;
+	}
+
+	// Buttons returns the debounced state of the buttons.
+	ButtonBits Buttons() const {
+		noInterrupts();
+		ButtonBits b = m_Buttons.State();
+		interrupts();
+		return b;
+	}
+
+	// OnSample is the interrupt side of the pipeline. It's public for the
+	// host side tests and benchmarks.
+	void OnSample(uint16_t sample) {
+		uint8_t next = m_Oversampler.OnSample(sample);
+		Adc::Start(m_Channels[next]);
+		if (next == 0 && m_ReadButtons)
+			m_Buttons.Update(m_ReadButtons());
+	}
+
+private:
+	static void SampleHandler(uint16_t sample) {
+		g_Instance->OnSample(sample);
+	}
+
+	AdcOversampler<NUM_CHANNELS, SAMPLES_LOG2> m_Oversampler;
+	ButtonDebouncer<ButtonBits> m_Buttons;
+	uint8_t m_Channels[NUM_CHANNELS];
+	ReadButtonsFunc m_ReadButtons;
+
+	static AnalogPipeline* volatile g_Instance;
+};
+
+template <typename Adc, int NUM_CHANNELS, int SAMPLES_LOG2, typename ButtonBits>
+AnalogPipeline<Adc, NUM_CHANNELS, SAMPLES_LOG2, ButtonBits>*
+volatile AnalogPipeline<Adc, NUM_CHANNELS, SAMPLES_LOG2, ButtonBits>::g_Instance = nullptr;
+
+
+}  // namespace x52
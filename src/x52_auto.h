@@ -0,0 +1,153 @@
+// Runtime detection of the protocol of the joystick.
+#pragma once
+
+#include "x52_pro.h"
+#include "x52_std.h"
+
+
+// The std joystick answers the frame request (C02=1) with a short C04 pulse
+// (~15us) while the Pro raises C04 and holds it until C02=0. A C04=1 that
+// lasts longer than this is the answer of a Pro.
+#ifndef X52_AUTO_DETECT_MAX_PULSE_MICROS
+	#define X52_AUTO_DETECT_MAX_PULSE_MICROS 200
+#endif
+
+// The AutoJoystickClient forgets the detected protocol after this many
+// failed polls in a row (e.g. the stick was swapped while powered).
+#ifndef X52_AUTO_DETECT_REPROBE_FAILURES
+	#define X52_AUTO_DETECT_REPROBE_FAILURES 8
+#endif
+
+
+namespace x52 {
+
+
+// Protocol is the protocol detected by the AutoJoystickClient.
+enum Protocol {
+	ProtocolUnknown,
+	ProtocolPro,
+	ProtocolStd,
+};
+
+
+// AutoJoystickClient is a JoystickClient for both the X52 Pro and the X52
+// (non-Pro) joystick. The two protocols use the same pins (see the pin
+// config of pro::JoystickClient and std::JoystickClient). The first poll
+// detects the protocol from the answer of the joystick to the frame request
+// and it hands the frame over to the matching client without starting a new
+// one, so the first poll already returns a state:
+//
+// - a C04 pulse: std, the frame continues with std::JoystickClient::FinishPoll
+// - C04=1 for longer than X52_AUTO_DETECT_MAX_PULSE_MICROS: Pro, the
+//   pro::JoystickClient continues the handshake (C02 and C04 are already 1)
+//
+// After the detection the polls go directly to the matching client.
+// Only the state/config pair of the detected protocol is used by
+// PollJoystickState, GetProtocol tells which one.
+//
+// The EdgeRecorder of the InterruptPulseWaiter keeps recording the C04
+// edges while a Pro joystick is connected, that's a short interrupt per edge.
+//
+// Usage:
+//   x52::AutoJoystickClient<16, 5, 3, 2> joystick_client;
+//   x52::pro::JoystickState pro_state;
+//   x52::std::JoystickState std_state;
+//   x52::pro::JoystickConfig pro_cfg;
+//   x52::std::JoystickConfig std_cfg;
+//   unsigned long res = joystick_client.PollJoystickState(pro_state, pro_cfg, std_state, std_cfg);
+//   if (res == 0 && joystick_client.GetProtocol() == x52::ProtocolPro) { /* use pro_state */ }
+template <int PIN_C01, int PIN_C02, int PIN_C03, int PIN_C04, typename PulseWaiter=std::InterruptPulseWaiter<PIN_C04>, typename HAL=ArduinoHAL>
+class AutoJoystickClient {
+public:
+	typedef pro::JoystickClient<PIN_C01, PIN_C02, PIN_C03, PIN_C04, HAL> ProClient;
+	typedef std::JoystickClient<PIN_C01, PIN_C02, PIN_C03, PIN_C04, PulseWaiter, HAL> StdClient;
+
+	// Call Setup from the setup function of your Arduino project to initialize
+	// an AutoJoystickClient instance.
+	void Setup() {
+		m_Std.Setup();
+		// The Pro client sets up the same pins, this sets C01=1 for its desync detection.
+		m_Pro.Setup();
+		Reset();
+	}
+
+	// Reset forgets the detected protocol, the next poll detects it again.
+	void Reset() {
+		m_Protocol = ProtocolUnknown;
+		m_Failures = 0;
+	}
+
+	Protocol GetProtocol() const {
+		return Protocol(m_Protocol);
+	}
+
+	// PollJoystickState has the same return value as the PollJoystickState of
+	// the clients. The default wait is that of the std client because the std
+	// joystick answers only ~50 times per second.
+	unsigned long PollJoystickState(pro::JoystickState& pro_state, const pro::JoystickConfig& pro_cfg,
+			std::JoystickState& std_state, const std::JoystickConfig& std_cfg,
+			unsigned long wait_micros=X52_DEFAULT_POLL_JOYSTICK_STATE_WAIT_MICROS) {
+		unsigned long res;
+		switch (m_Protocol) {
+		case ProtocolPro:
+			res = m_Pro.PollJoystickState(pro_state, pro_cfg, wait_micros);
+			break;
+		case ProtocolStd:
+			res = m_Std.PollJoystickState(std_state, std_cfg, wait_micros);
+			break;
+		default:
+			return Detect(pro_state, pro_cfg, std_state, std_cfg, wait_micros);
+		}
+
+		if (res == 0) {
+			m_Failures = 0;
+		} else if (++m_Failures >= X52_AUTO_DETECT_REPROBE_FAILURES) {
+			X52DebugLog("Too many failed polls, detecting the protocol again.");
+			Reset();
+		}
+		return res;
+	}
+
+	ProClient& Pro() {
+		return m_Pro;
+	}
+
+	StdClient& Std() {
+		return m_Std;
+	}
+
+private:
+	unsigned long Detect(pro::JoystickState& pro_state, const pro::JoystickConfig& pro_cfg,
+			std::JoystickState& std_state, const std::JoystickConfig& std_cfg,
+			unsigned long wait_micros) {
+		switch (m_Std.StartPoll(HAL::Micros()+wait_micros, X52_AUTO_DETECT_MAX_PULSE_MICROS)) {
+		case std::PulseFinished:
+			X52DebugLog("Detected an X52 joystick.");
+			m_Protocol = ProtocolStd;
+			return m_Std.FinishPoll(std_state, std_cfg);
+
+		case std::PulseStarted:
+			if (HAL::Read(PIN_C04)) {
+				X52DebugLog("Detected an X52 Pro joystick.");
+				m_Protocol = ProtocolPro;
+				// The Pro client raises C02 again (a no-op) and finds C04=1 so
+				// it continues with the rest of the handshake.
+				return m_Pro.PollJoystickState(pro_state, pro_cfg, X52_PRO_DEFAULT_POLL_JOYSTICK_STATE_WAIT_MICROS);
+			}
+			HAL::Write(PIN_C02, LOW);
+			return X52_THROTTLE_UNRESPONSIVE_MICROS;
+
+		default:
+			HAL::Write(PIN_C02, LOW);
+			return 1;
+		}
+	}
+
+	ProClient m_Pro;
+	StdClient m_Std;
+	uint8_t m_Protocol;
+	uint8_t m_Failures;
+};
+
+
+}  // namespace x52
@@ -25,10 +25,118 @@
 	#define X52DebugPrintln(x)
 #endif
 
+// X52DebugLog(msg, args...) logs a string literal followed by at most
+// X52_DEBUG_LOG_MAX_ARGS integers. It prints the message immediately
+// unless X52_DEBUG_LOG_DEFERRED is enabled.
+//
+// X52_DEBUG_LOG_DEFERRED turns X52DebugLog into a non-blocking O(1)
+// operation that stores only a 16-bit message ID (a compile-time hash of the
+// string literal), the integer arguments and a timestamp in a RAM ring of
+// X52_DEBUG_LOG_SIZE entries. X52DebugLogDrain() prints the entries later
+// when the bus is idle in "X52LOG <micros> <id> <args...>" format and
+// extras/linux/x52_log_expand.cpp turns these lines back into messages.
+// This way debug builds can run at the same frame rate as release builds.
+// X52DebugLog must not be called from interrupt handlers.
+#ifndef X52_DEBUG_LOG_DEFERRED
+	#define X52_DEBUG_LOG_DEFERRED 0
+#endif
+
+// The number of entries in the ring of the deferred log (a power of two, at most 128).
+#ifndef X52_DEBUG_LOG_SIZE
+	#if defined(__AVR__)
+		#define X52_DEBUG_LOG_SIZE 8
+	#else
+		#define X52_DEBUG_LOG_SIZE 32
+	#endif
+#endif
+
+#ifndef X52_DEBUG_LOG_MAX_ARGS
+	#define X52_DEBUG_LOG_MAX_ARGS 4
+#endif
+
+// X52DebugLogDrain prints at most this many entries per call. A line is
+// usually 20-40 characters long so a few of them fit into the serial TX
+// buffer of most boards without blocking.
+#ifndef X52_DEBUG_LOG_DRAIN_ENTRIES
+	#define X52_DEBUG_LOG_DRAIN_ENTRIES 2
+#endif
+
+// X52DebugLogCanWrite(n) tells whether n bytes can be written to serial
+// without blocking. Redefine it if your serial doesn't have a working
+// availableForWrite (the default implementation of the Print class returns 0).
+#ifndef X52DebugLogCanWrite
+	#define X52DebugLogCanWrite(n) (Serial.availableForWrite() >= int(n))
+#endif
+
+#if X52_DEBUG
+	#define X52DebugLog(msg, ...) x52::DebugLog::Record<x52::DebugLogID<x52::debug_log_id(msg)>::value>(msg, ##__VA_ARGS__)
+	#define X52DebugLogDrain() x52::DebugLog::Drain()
+#else
+	// statements that do nothing so "if (x) X52DebugLog(...);" has a body
+	#define X52DebugLog(msg, ...) do {} while (0)
+	#define X52DebugLogDrain() do {} while (0)
+#endif
+
 #ifndef X52_BUSY_WAIT
 	#define X52_BUSY_WAIT 1
 #endif
 
+// The time it takes to wake up from x52::sleep_until_interrupt() and enter the
+// interrupt handler. The SleepWait strategy wakes up this much earlier than the
+// deadline. These are conservative estimates: measure your own board with
+// SleepWait::MeasureWakeupMicros() and override the value if needed.
+#ifndef X52_SLEEP_WAKEUP_MICROS
+	#if defined(__AVR__)
+		#define X52_SLEEP_WAKEUP_MICROS 8
+	#elif defined(__arm__)
+		#define X52_SLEEP_WAKEUP_MICROS 2
+	#else
+		#define X52_SLEEP_WAKEUP_MICROS 0
+	#endif
+#endif
+
+// The longest period the SleepWait strategy sleeps without re-checking the
+// state of the pin. It limits the damage if an edge can't wake up the CPU
+// (e.g. because the pin's interrupt handler triggers only on the other edge).
+#ifndef X52_SLEEP_WAIT_MAX_MICROS
+	#define X52_SLEEP_WAIT_MAX_MICROS 1000
+#endif
+
+// The number of pins that can have an EdgeRecorder (at most 8).
+#ifndef X52_MAX_EDGE_RECORDERS
+	#define X52_MAX_EDGE_RECORDERS 4
+#endif
+
+// Measured pulse widths can be shorter than the real ones because of the
+// resolution of micros() and the latency of the interrupt handlers. The
+// edges are timestamped with micros() (not with a hardware input capture)
+// so on AVR the tolerance is a micros() step (4us at 16MHz, 8us at 8MHz)
+// plus 8us for an edge delayed by another interrupt handler (e.g. the
+// timer0 overflow of micros()). A larger value turns off the glitch check
+// of the shorter pulses: the first C04 pulse is 15us.
+#ifndef X52_PULSE_WIDTH_TOLERANCE_MICROS
+	#if defined(__AVR__)
+		#define X52_PULSE_WIDTH_TOLERANCE_MICROS (64000000UL / F_CPU + 8)
+	#else
+		#define X52_PULSE_WIDTH_TOLERANCE_MICROS 5
+	#endif
+#endif
+
+// A TimingProfile (see below) learns a frame timeout only after this many
+// successful frames (at most 255).
+#ifndef X52_TIMING_MIN_FRAMES
+	#define X52_TIMING_MIN_FRAMES 16
+#endif
+
+// The learned frame timeout is 1.5x the longest frame plus this.
+#ifndef X52_TIMING_SLACK_MICROS
+	#define X52_TIMING_SLACK_MICROS 1000
+#endif
+
+#if defined(__AVR__)
+	#include <avr/sleep.h>
+#endif
+
 
 namespace x52 {
 
@@ -107,6 +215,34 @@ public:
 			SetBit(index+i, bool(value & (1 << i)));
 	}
 
+	// Bit<INDEX> and UInt<INDEX,WIDTH> are the compile-time variants of Bit
+	// and UInt: the masks and shifts are constants so they compile to a few
+	// instructions instead of the per-bit loops (shift loops on AVR).
+	// A UInt field can't span more than two bytes.
+	template <int INDEX>
+	bool Bit() const {
+		static_assert(INDEX >= 0 && INDEX < NUM_BITS, "invalid bit index");
+		return bool(m_Bits[INDEX>>3] & (1 << (INDEX&7)));
+	}
+
+	template <int INDEX, int WIDTH>
+	uint UInt() const {
+		static_assert(INDEX >= 0 && WIDTH > 0 && INDEX + WIDTH <= NUM_BITS, "invalid bit range");
+		static_assert((INDEX&7) + WIDTH <= 16, "the bit range spans more than two bytes");
+		uint v = uint(m_Bits[INDEX>>3] >> (INDEX&7));
+		if ((INDEX&7) + WIDTH > 8)
+			v |= uint(m_Bits[(INDEX>>3) + 1]) << (8 - (INDEX&7));
+		return v & uint((1UL << WIDTH) - 1);
+	}
+
+	bool operator==(const BitField& other) const {
+		return memcmp(m_Bits, other.m_Bits, sizeof(m_Bits)) == 0;
+	}
+
+	bool operator!=(const BitField& other) const {
+		return !(*this == other);
+	}
+
 	uint8_t BufByte(int index) const {
 		assert(uint(index) < sizeof(m_Bits));
 		return m_Bits[index];
@@ -117,29 +253,1174 @@ public:
 		m_Bits[index] = b;
 	}
 
+	uint8_t* Bytes() {
+		return m_Bits;
+	}
+
+	const uint8_t* Bytes() const {
+		return m_Bits;
+	}
+
 private:
 	uint8_t m_Bits[(NUM_BITS+7)/8];
 };
 
 
+// PreEncodedState is a double-buffered slot for the latest state of a
+// ThrottleClient (pro or std). The sensor code publishes the states whenever
+// they are ready and they are encoded right away, the SendLatestJoystickState
+// of the clients picks up the latest Binary when the throttle's poll arrives
+// so there is no encoding between the poll and the first data bit. This also
+// decouples the sensor rate from the frame rate of the throttle.
+//
+// Publish writes the buffer that isn't the latest one and then flips the
+// index. One side may run in an interrupt handler (e.g. Publish from a sensor
+// interrupt or Get from the InterruptThrottleClient): like with the
+// EdgeRecorder, Get re-reads the slot if it was overwritten during the copy.
+// It isn't meant for two cores, use a DualCoreLink (x52_dual_core.h) there.
+//
+// A new slot holds an all-zero Binary until the first Publish.
+template <typename JoystickState>
+class PreEncodedState {
+public:
+	typedef typename JoystickState::Binary Binary;
+
+	PreEncodedState(): m_Seq(0) {}
+
+	void Publish(const JoystickState& state) {
+		uint8_t seq = uint8_t(m_Seq + 1);
+		state.ToBinary(m_Buf[seq&1]);
+		// The compiler mustn't move the writes of the buffer after the flip.
+		__asm__ __volatile__("" ::: "memory");
+		m_Seq = seq;
+	}
+
+	void Publish(const Binary& b) {
+		uint8_t seq = uint8_t(m_Seq + 1);
+		m_Buf[seq&1] = b;
+		__asm__ __volatile__("" ::: "memory");
+		m_Seq = seq;
+	}
+
+	// Get copies the latest Binary.
+	void Get(Binary& b) const {
+		uint8_t seq;
+		do {
+			seq = m_Seq;
+			__asm__ __volatile__("" ::: "memory");
+			b = m_Buf[seq&1];
+			__asm__ __volatile__("" ::: "memory");
+			// The buffer we copied is overwritten by the second Publish after seq.
+		} while (uint8_t(m_Seq - seq) >= 2);
+	}
+
+	// NumPublished is the number of Publish calls (mod 256). The sensor code
+	// can use it to see whether the slot was updated since it last looked.
+	uint8_t NumPublished() const {
+		return m_Seq;
+	}
+
+private:
+	Binary m_Buf[2];
+	volatile uint8_t m_Seq;  // the latest Binary is m_Buf[m_Seq&1]
+};
+
+
+// A timing policy decides the frame timeout of the clients that poll (the
+// JoystickClients). It's an adaptive frame timeout and nothing else: the
+// other timings of the protocols stay the macros. The timeout macros (e.g.
+// X52_PRO_THROTTLE_TIMEOUT_MICROS) were measured on my units and other
+// firmware versions may differ. After a glitch the client waits for the timeout and then returns the recovery wait
+// (e.g. X52_PRO_THROTTLE_UNRESPONSIVE_MICROS) so a timeout that is longer
+// than necessary adds up to ~17ms to every lost frame. Each JoystickClient
+// has a timing policy instance (see the Timing template parameter and the
+// GetTiming method of the clients) and passes the value of the macro as the
+// limit:
+//
+//   unsigned long FrameTimeout(unsigned long limit);  // the deadline of a frame after its first edge
+//   void FrameDone(unsigned long micros);             // a frame finished successfully in this many micros
+//   void FrameTimedOut(unsigned long limit);          // a frame timed out after its first edge
+//   enum { LEARNS = 0 or 1 };                         // 0: the clients skip the micros() of FrameDone
+//
+// The clients use x52::DefaultTiming that can be changed by defining
+// X52_TIMING before including the library, for example:
+//   #define X52_TIMING x52::TimingProfile
+//
+// The ThrottleClients keep the macros: the joystick side has to time out
+// after the throttle side otherwise it may answer a new poll while the
+// throttle is still in the broken frame. The recovery waits are the macros
+// too: shortening them by trial and error or by the time spent in the failed
+// frame made the throttle join the leftover frames of the joystick in
+// extras/linux/x52_fault_soak.cpp and the X52 Pro frames have no checksum
+// to catch that.
+
+// FixedTiming uses the values of the macros.
+struct FixedTiming {
+	enum { LEARNS = 0 };
+
+	unsigned long FrameTimeout(unsigned long limit) const {
+		return limit;
+	}
+
+	void FrameDone(unsigned long) {}
+	void FrameTimedOut(unsigned long) {}
+};
+
+
+// TimingProfile is the adaptive frame timeout: it starts with the values of
+// the macros and learns shorter frame timeouts from the connected device.
+// It doesn't learn response gaps or recovery waits (see above). The macros
+// stay the upper limits. After X52_TIMING_MIN_FRAMES successful frames the timeout is 1.5x
+// the longest one plus X52_TIMING_SLACK_MICROS. If a frame times out on a
+// learned timeout then the timeout counts as a frame duration so the next
+// timeout is longer (a slow peer costs a few frames until it's learned).
+//
+// GetValues returns the learned values and SetValues restores them so they
+// can be persisted (e.g. in EEPROM) between power cycles. SetValues clamps
+// them into the valid ranges so a blank EEPROM (all 0xFF) is safe too.
+class TimingProfile {
+public:
+	enum { LEARNS = 1 };
+
+	struct Values {
+		uint32_t max_frame_micros;  // the longest successful frame
+		uint8_t num_frames;         // the number of successful frames (saturates at X52_TIMING_MIN_FRAMES)
+	};
+
+	TimingProfile() {
+		Reset();
+	}
+
+	void Reset() {
+		m_Values.max_frame_micros = 0;
+		m_Values.num_frames = 0;
+	}
+
+	const Values& GetValues() const {
+		return m_Values;
+	}
+
+	void SetValues(const Values& v) {
+		m_Values = v;
+		if (m_Values.max_frame_micros > MAX_FRAME_MICROS)
+			m_Values.max_frame_micros = MAX_FRAME_MICROS;
+		if (m_Values.num_frames > X52_TIMING_MIN_FRAMES)
+			m_Values.num_frames = X52_TIMING_MIN_FRAMES;
+	}
+
+	unsigned long FrameTimeout(unsigned long limit) const {
+		unsigned long m = m_Values.max_frame_micros;
+		if (m_Values.num_frames < X52_TIMING_MIN_FRAMES || m >= limit)
+			return limit;
+		unsigned long t = m + m/2 + X52_TIMING_SLACK_MICROS;
+		return t < limit ? t : limit;
+	}
+
+	void FrameDone(unsigned long micros) {
+		if (micros > MAX_FRAME_MICROS)
+			micros = MAX_FRAME_MICROS;
+		if (micros > m_Values.max_frame_micros)
+			m_Values.max_frame_micros = micros;
+		if (m_Values.num_frames < X52_TIMING_MIN_FRAMES)
+			m_Values.num_frames++;
+	}
+
+	void FrameTimedOut(unsigned long limit) {
+		// It may have been our learned timeout rather than the peer.
+		unsigned long t = FrameTimeout(limit);
+		if (t < limit)
+			m_Values.max_frame_micros = t;
+	}
+
+private:
+	enum : uint32_t {
+		MAX_FRAME_MICROS = 1000000,
+	};
+
+	static_assert(X52_TIMING_MIN_FRAMES <= 255, "X52_TIMING_MIN_FRAMES doesn't fit into Values::num_frames");
+
+	Values m_Values;
+};
+
+
+#if defined(X52_TIMING)
+	typedef X52_TIMING DefaultTiming;
+#else
+	typedef FixedTiming DefaultTiming;
+#endif
+
+
+// StateGroup is a group of JoystickState fields in the bit mask passed to
+// the partial state handlers (see NoPartialState).
+enum StateGroup {
+	StateX = 1,
+	StateY = 2,
+	StateZ = 4,
+	StatePov1 = 8,
+	StatePov2 = 16,
+	StateButtons = 32,  // the buttons and the mode
+	StateAllGroups = 63,
+	// The checksum of the std frame matched. The groups of the std frame
+	// are provisional without this bit. The Pro frame has no checksum.
+	StateVerified = 64,
+};
+
+
+// A partial state handler receives the complete groups of the joystick state
+// while the JoystickClient is still receiving the frame. For example the X52
+// Pro sends x and y in the first 20 of its 76 clock cycles and the config
+// phase comes only after the whole state. Pass a handler to the
+// PollJoystickState of the JoystickClients:
+//
+//   void OnPartialState(const JoystickStateView& view, uint8_t groups);
+//
+// The view references the receive buffer of the frame and groups is the
+// mask of the StateGroups that are complete in it (the fields of the other
+// groups are undefined). The handler is called after the last bit of every
+// group between two clock edges, so it has to return within a few
+// microseconds: the joystick waits for the next edge and the frame timeout
+// is running meanwhile.
+//
+// The groups are final only when PollJoystickState returns zero. The std
+// JoystickClient calls the handler once more with StateVerified if the
+// checksum at bits 56..63 matches.
+//
+// NoPartialState is the handler of the PollJoystickState overloads without
+// a handler. It's compiled out.
+struct NoPartialState {
+	template <typename View>
+	void OnPartialState(const View&, uint8_t) {}
+};
+
+template <typename Handler>
+struct PartialStateEnabled {
+	enum { value = 1 };
+};
+
+template <>
+struct PartialStateEnabled<NoPartialState> {
+	enum { value = 0 };
+};
+
+
+// debug_log_id is the 16-bit ID of a deferred log message: the two halves of
+// the 32-bit FNV-1a hash of the message xor-ed together. A message that
+// hashes to 0 gets 1 because 0 is the DebugLog::DROPPED_ID.
+constexpr uint32_t fnv1a(const char* s, uint32_t h=2166136261UL) {
+	return *s ? fnv1a(s+1, (h ^ uint8_t(*s)) * 16777619UL) : h;
+}
+
+constexpr uint16_t debug_log_id_or_1(uint16_t id) {
+	return id ? id : 1;
+}
+
+constexpr uint16_t debug_log_id(const char* msg) {
+	return debug_log_id_or_1(uint16_t((fnv1a(msg) >> 16) ^ fnv1a(msg)));
+}
+
+// DebugLogID forces the evaluation of debug_log_id at compile time.
+template <uint16_t ID>
+struct DebugLogID {
+	static_assert(ID != 0, "0 is reserved for the dropped entries of the DebugLog.");
+	static constexpr uint16_t value = ID;
+};
+
+
+// DebugLog is the backend of X52DebugLog. Use it through the X52DebugLog and
+// X52DebugLogDrain macros that compile to nothing if X52_DEBUG is disabled.
+class DebugLog {
+public:
+	// The ID of the entry that reports the number of dropped entries.
+	// debug_log_id never returns it.
+	static constexpr uint16_t DROPPED_ID = 0;
+
+	template <uint16_t ID, typename... Args>
+	static void Record(const char* msg, Args... args) {
+		static_assert(sizeof...(args) <= X52_DEBUG_LOG_MAX_ARGS, "Too many X52DebugLog arguments. Increase X52_DEBUG_LOG_MAX_ARGS.");
+#if X52_DEBUG_LOG_DEFERRED
+		(void)msg;
+		Ring& r = GetRing();
+		if (uint8_t(r.head - r.tail) >= X52_DEBUG_LOG_SIZE) {
+			r.num_dropped++;
+			return;
+		}
+		Entry& e = r.entries[r.head % X52_DEBUG_LOG_SIZE];
+		e.micros = micros();
+		e.id = ID;
+		e.num_args = sizeof...(args);
+		long a[] = {long(args)..., 0};
+		for (uint8_t i=0; i<sizeof...(args); i++)
+			e.args[i] = a[i];
+		r.head++;
+#else
+		Serial.print(msg);
+		PrintArgs(args...);
+		Serial.print("\n");
+#endif
+	}
+
+	// Drain prints at most max_entries entries of the deferred log.
+	// It doesn't block: it stops when the serial TX buffer is full.
+	static void Drain(int max_entries=X52_DEBUG_LOG_DRAIN_ENTRIES) {
+#if X52_DEBUG_LOG_DEFERRED
+		Ring& r = GetRing();
+		for (int i=0; i<max_entries && r.tail != r.head; i++) {
+			const Entry& e = r.entries[r.tail % X52_DEBUG_LOG_SIZE];
+			if (!X52DebugLogCanWrite(LineSize(e)))
+				return;
+			PrintEntry(e);
+			r.tail++;
+		}
+		// The dropped entries were newer than the ones in the ring.
+		if (r.num_dropped && r.tail == r.head) {
+			Entry e;
+			e.micros = micros();
+			e.id = DROPPED_ID;
+			e.num_args = 1;
+			e.args[0] = long(r.num_dropped);
+			if (!X52DebugLogCanWrite(LineSize(e)))
+				return;
+			PrintEntry(e);
+			r.num_dropped = 0;
+		}
+#else
+		(void)max_entries;
+#endif
+	}
+
+private:
+	static void PrintArgs() {}
+
+	template <typename Arg, typename... Args>
+	static void PrintArgs(Arg arg, Args... args) {
+		Serial.print(long(arg));
+		if (sizeof...(args))
+			Serial.print(" ");
+		PrintArgs(args...);
+	}
+
+	static_assert((X52_DEBUG_LOG_SIZE & (X52_DEBUG_LOG_SIZE-1)) == 0 && X52_DEBUG_LOG_SIZE <= 128, "X52_DEBUG_LOG_SIZE has to be a power of two not greater than 128.");
+
+	struct Entry {
+		unsigned long micros;
+		uint16_t id;
+		uint8_t num_args;
+		long args[X52_DEBUG_LOG_MAX_ARGS];
+	};
+
+	struct Ring {
+		Entry entries[X52_DEBUG_LOG_SIZE];
+		uint8_t head;
+		uint8_t tail;
+		unsigned long num_dropped;
+	};
+
+	static Ring& GetRing() {
+		static Ring ring;
+		return ring;
+	}
+
+	static int NumDigits(unsigned long v) {
+		int n = 1;
+		for (; v >= 10; v /= 10)
+			n++;
+		return n;
+	}
+
+	// LineSize returns the number of characters printed by PrintEntry.
+	static int LineSize(const Entry& e) {
+		int n = 7 + NumDigits(e.micros) + 1 + NumDigits(e.id) + 1;
+		for (uint8_t i=0; i<e.num_args; i++)
+			n += 1 + (e.args[i] < 0) + NumDigits(e.args[i] < 0 ? 0UL-(unsigned long)e.args[i] : (unsigned long)e.args[i]);
+		return n;
+	}
+
+	static void PrintEntry(const Entry& e) {
+		Serial.print("X52LOG ");
+		Serial.print(e.micros);
+		Serial.print(" ");
+		Serial.print(e.id);
+		for (uint8_t i=0; i<e.num_args; i++) {
+			Serial.print(" ");
+			Serial.print(e.args[i]);
+		}
+		Serial.print("\n");
+	}
+};
+
+
+// A Clock is the time source of the deadline checks in the wait loops. The
+// deadlines of the API are micros() values but calling micros() in every
+// iteration of a wait loop is expensive on some boards (on AVR it's a call
+// that disables the interrupts and does several multiplies) and it limits
+// how fast the loop reacts to an edge. A Clock converts the deadline into
+// its own ticks once so the check of an iteration is a read of a counter and
+// a compare. It's a class with static methods:
+//
+//   typedef ... Ticks;                    // an unsigned type that wraps around
+//   static void Setup(uint8_t pin);       // called by the Setup of the clients for the pins they wait for
+//   static Ticks Now();
+//   static Ticks FromMicros(unsigned long micros);  // rounds up, at most MaxMicros()
+//   static unsigned long MaxMicros();     // the longest duration that fits into half of the range of Ticks
+//   static bool Reached(Ticks t);         // Now() is at or after t
+//
+// The loops use x52::Clock that can be changed by defining X52_CLOCK before
+// including the library, for example:
+//   #define X52_CLOCK x52::CycleCounterClock
+//
+// measure_wait_iteration_nanos() measures the time of an iteration of the
+// wait loop (the worst case edge-to-response latency) on your board.
+
+// MicrosClock is the portable default: it checks the deadline with micros().
+struct MicrosClock {
+	typedef unsigned long Ticks;
+
+	static void Setup(uint8_t) {}
+
+	static Ticks Now() {
+		return micros();
+	}
+
+	static Ticks FromMicros(unsigned long micros) {
+		return micros;
+	}
+
+	static unsigned long MaxMicros() {
+		return 0x7FFFFFFFUL;
+	}
+
+	static bool Reached(Ticks t) {
+		// using delta to handle the overflows of micros()
+		return long(micros() - t) >= 0;
+	}
+};
+
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+
+// CycleCounterClock uses the DWT cycle counter of the Cortex-M3/M4/M7
+// (e.g. teensy 3.x/4.x). The Cortex-M0/M0+ (teensy LC, RP2040) doesn't have one.
+struct CycleCounterClock {
+	typedef uint32_t Ticks;
+
+	static void Setup(uint8_t) {
+		DEMCR() |= 1UL << 24;  // TRCENA
+		DWT_CTRL() |= 1;       // CYCCNTENA
+	}
+
+	static Ticks Now() {
+		return DWT_CYCCNT();
+	}
+
+	static Ticks FromMicros(unsigned long micros) {
+		return Ticks(micros * (F_CPU / 1000000UL));
+	}
+
+	static unsigned long MaxMicros() {
+		return 0x7FFFFFFFUL / (F_CPU / 1000000UL);
+	}
+
+	static bool Reached(Ticks t) {
+		return int32_t(DWT_CYCCNT() - t) >= 0;
+	}
+
+private:
+	static volatile uint32_t& DEMCR() { return *(volatile uint32_t*)0xE000EDFC; }
+	static volatile uint32_t& DWT_CTRL() { return *(volatile uint32_t*)0xE0001000; }
+	static volatile uint32_t& DWT_CYCCNT() { return *(volatile uint32_t*)0xE0001004; }
+};
+
+#endif
+
+#if defined(__AVR__) && defined(TCNT0)
+
+// AvrTimer0Clock reads the counter register of Timer0 that the Arduino core
+// runs with prescaler 64 for millis() and micros(): 4us ticks at 16MHz. The
+// counter is 8-bit so a wait is checked against micros() every ~500us.
+struct AvrTimer0Clock {
+	typedef uint8_t Ticks;
+
+	static void Setup(uint8_t) {}
+
+	static Ticks Now() {
+		return TCNT0;
+	}
+
+	static Ticks FromMicros(unsigned long micros) {
+		return Ticks((micros * (F_CPU / 1000000UL) + 63) >> 6);
+	}
+
+	static unsigned long MaxMicros() {
+		return 127UL * 64 / (F_CPU / 1000000UL);
+	}
+
+	static bool Reached(Ticks t) {
+		return int8_t(TCNT0 - t) >= 0;
+	}
+};
+
+#endif
+
+// SpinClock counts the iterations of the wait loops: Now() increments a
+// counter. Setup calibrates the number of iterations per microsecond with
+// the loop of wait_for_pin_state on the given pin. It's for boards without
+// a cheap counter register. The interrupt handlers steal iterations so the
+// waits can be longer than requested (never shorter). The calibration is
+// only valid for the busy loop: the loops that sleep or do more work per
+// iteration (PollingWait, RecordedWait, the InterruptPulseWaiter of the std
+// joystick) check their deadlines with WallClock<SpinClock> = micros().
+struct SpinClock {
+	typedef uint32_t Ticks;
+
+	static void Setup(uint8_t pin) {
+		if (ItersPerMicroQ8())
+			return;
+		// ~1ms of iterations, micros() is checked only after every 64 of them
+		Ticks never = Now() + 0x40000000UL;
+		uint32_t iterations = 0;
+		unsigned long start = micros(), elapsed;
+		do {
+			for (int i=0; i<64; i++) {
+				// an impossible pin state keeps the loop running
+				if (digitalRead(pin) == 2 || Reached(never))
+					break;
+			}
+			iterations += 64;
+			elapsed = micros() - start;
+		} while (elapsed < 1000);
+		uint32_t q8 = (iterations << 8) / elapsed;
+		ItersPerMicroQ8() = q8 ? q8 : 1;
+	}
+
+	static Ticks Now() {
+		return ++Count();
+	}
+
+	static Ticks FromMicros(unsigned long micros) {
+		return Ticks(((micros * ItersPerMicroQ8()) >> 8) + 1);
+	}
+
+	static unsigned long MaxMicros() {
+		// keeps the multiplication of FromMicros within 31 bits
+		return 0x7FFFFFFFUL / (ItersPerMicroQ8() ? ItersPerMicroQ8() : 1);
+	}
+
+	static bool Reached(Ticks t) {
+		return int32_t(Now() - t) >= 0;
+	}
+
+private:
+	static uint32_t& Count() {
+		static uint32_t count = 0;
+		return count;
+	}
+
+	// 24.8 fixed point, zero before the calibration
+	static uint32_t& ItersPerMicroQ8() {
+		static uint32_t q8 = 0;
+		return q8;
+	}
+};
+
+
+// WallClock<C> is C if its ticks measure time and MicrosClock for SpinClock.
+// It's used by the wait loops whose iterations aren't those of the busy
+// loop SpinClock was calibrated on.
+template <typename C>
+struct WallClock {
+	typedef C Type;
+};
+
+template <>
+struct WallClock<SpinClock> {
+	typedef MicrosClock Type;
+};
+
+
+#if defined(X52_CLOCK)
+	typedef X52_CLOCK Clock;
+#else
+	typedef MicrosClock Clock;
+#endif
+
+
+// Deadline converts a micros() deadline into the ticks of a Clock once.
+// Passed is a compare of the clock with the converted deadline. When the
+// clock reaches it Passed confirms it with micros() and converts the rest
+// again if needed (the deadline was further than the range of the clock or
+// the clock runs fast) so a deadline never passes early.
+template <typename C=Clock>
+class Deadline {
+public:
+	explicit Deadline(unsigned long deadline_micros): m_Micros(deadline_micros) {
+		Arm();
+	}
+
+	bool Passed() {
+		if (!C::Reached(m_Ticks))
+			return false;
+		return !Arm();
+	}
+
+private:
+	// Arm returns false if the deadline has passed.
+	bool Arm() {
+		unsigned long left = m_Micros - micros();
+		if (long(left) <= 0) {
+			m_Ticks = C::Now();
+			return false;
+		}
+		m_Ticks = typename C::Ticks(C::Now() + C::FromMicros(min(left, C::MaxMicros())));
+		return true;
+	}
+
+	unsigned long m_Micros;
+	typename C::Ticks m_Ticks;
+};
+
+// With micros() there is nothing to convert.
+template <>
+class Deadline<MicrosClock> {
+public:
+	explicit Deadline(unsigned long deadline_micros): m_Micros(deadline_micros) {}
+
+	bool Passed() const {
+		return MicrosClock::Reached(m_Micros);
+	}
+
+private:
+	unsigned long m_Micros;
+};
+
+
+template <typename C=Clock>
 inline bool wait_for_pin_state(
 	uint8_t pin,
 	int state,
 	unsigned long deadline_micros,
 	unsigned long poll_period_micros=(X52_BUSY_WAIT?0:5)
 ) {
+	if (poll_period_micros) {
+		// A SpinClock doesn't count the time of the delays.
+		Deadline<typename WallClock<C>::Type> deadline(deadline_micros);
+		for (;;) {
+			if (digitalRead(pin) == state)
+				return true;
+			if (deadline.Passed())
+				return false;
+			// On AVR the delay is also busy but it might be able
+			// to save some power on other architectures (ARM).
+			delayMicroseconds(poll_period_micros);
+		}
+	}
+	Deadline<C> deadline(deadline_micros);
 	for (;;) {
 		if (digitalRead(pin) == state)
 			return true;
-		// using delta to handle the overflows of micros()
-		if (long(micros() - deadline_micros) >= 0)
+		if (deadline.Passed())
 			return false;
-		// On AVR the delay is also busy but it might be able
-		// to save some power on other architectures (ARM).
-		if (poll_period_micros)
-			delayMicroseconds(poll_period_micros);
 	}
 }
 
 
+// measure_wait_iteration_nanos returns the average time of an iteration of
+// wait_for_pin_state on the given pin in nanoseconds. An edge is detected at
+// most this much later than it happens (plus the interrupts). Call it after
+// the Setup of the clients (the Clock has to be set up).
+template <typename C=Clock>
+unsigned long measure_wait_iteration_nanos(uint8_t pin, unsigned long duration_micros=2000) {
+	unsigned long iterations = 0;
+	unsigned long start = micros();
+	Deadline<C> deadline(start + duration_micros);
+	// An impossible pin state keeps the loop running till the deadline.
+	while (digitalRead(pin) != 2 && !deadline.Passed())
+		iterations++;
+	unsigned long elapsed = micros() - start;
+	return iterations ? elapsed * 1000UL / iterations : elapsed * 1000UL;
+}
+
+
+// A PulseTimer is a one-shot timer that calls a callback (typically from an
+// ISR) after a given number of microseconds. It's a class with static
+// methods because hardware timers are singletons and interrupt handlers
+// can't be bound to instances:
+//
+//   static void Setup(void (*callback)());   // call once before Start
+//   static void Start(unsigned long micros);  // (re)starts the one-shot timer
+//   static void Stop();                       // cancels the timer if it's running
+//
+// Only one user can own a given PulseTimer at a time.
+
+#if defined(TEENSYDUINO)
+
+// IntervalPulseTimer uses one of the IntervalTimers of the teensy as a one-shot
+// timer. Different ID values give you different timers.
+template <int ID=0>
+class IntervalPulseTimer {
+public:
+	static void Setup(void (*callback)()) {
+		m_Callback = callback;
+	}
+
+	static void Start(unsigned long micros) {
+		m_Timer.begin(InterruptHandler, micros ? micros : 1);
+	}
+
+	static void Stop() {
+		m_Timer.end();
+	}
+
+private:
+	static void InterruptHandler() {
+		m_Timer.end();
+		m_Callback();
+	}
+
+	static IntervalTimer m_Timer;
+	static void (*volatile m_Callback)();
+};
+
+template <int ID>
+IntervalTimer IntervalPulseTimer<ID>::m_Timer;
+
+template <int ID>
+void (*volatile IntervalPulseTimer<ID>::m_Callback)() = nullptr;
+
+#endif
+
+#if defined(__AVR__) && defined(TIMSK1)
+
+// AvrTimer1PulseTimer uses the 16-bit Timer1 of the AVR in compare match mode.
+// Timer1 can't be used for anything else (Servo library, analogWrite on the
+// pins driven by Timer1) while it's in use by the AvrTimer1PulseTimer.
+//
+// The interrupt vector has to be defined in exactly one .ino/.cpp file of your
+// project by putting X52_AVR_TIMER1_PULSE_TIMER_ISR() at global scope.
+class AvrTimer1PulseTimer {
+public:
+	typedef void (*CallbackFunc)();
+
+	static void Setup(CallbackFunc callback) {
+		Callback() = callback;
+		uint8_t sreg = SREG;
+		cli();
+		TIMSK1 &= ~_BV(OCIE1A);
+		TCCR1A = 0;
+		TCCR1B = _BV(CS11);  // prescaler: 8
+		SREG = sreg;
+	}
+
+	static void Start(unsigned long micros) {
+		// 10us units keep the clocks that aren't multiples of 8MHz (e.g.
+		// 12MHz, 20MHz) exact without overflowing the multiplication.
+		const unsigned long TICKS_PER_10_MICROS = F_CPU / 800000UL;
+		const unsigned long MAX_MICROS = 0xFFFFUL * 10 / TICKS_PER_10_MICROS;
+		unsigned long ticks = micros >= MAX_MICROS ? 0xFFFF : micros * TICKS_PER_10_MICROS / 10;
+		// Start can be called from interrupt handlers so it
+		// restores the original interrupt state instead of sei().
+		uint8_t sreg = SREG;
+		cli();
+		TCNT1 = 0;
+		OCR1A = uint16_t(ticks ? ticks : 1);
+		TIFR1 = _BV(OCF1A);
+		TIMSK1 |= _BV(OCIE1A);
+		SREG = sreg;
+	}
+
+	static void Stop() {
+		TIMSK1 &= ~_BV(OCIE1A);
+	}
+
+	static void InterruptHandler() {
+		Stop();
+		Callback()();
+	}
+
+private:
+	static volatile CallbackFunc& Callback() {
+		static volatile CallbackFunc callback = nullptr;
+		return callback;
+	}
+};
+
+#define X52_AVR_TIMER1_PULSE_TIMER_ISR() \
+	ISR(TIMER1_COMPA_vect) { x52::AvrTimer1PulseTimer::InterruptHandler(); }
+
+#endif
+
+// MockPulseTimer doesn't touch any hardware. It's meant for host side testing
+// where the test code decides when the timer fires by calling Fire().
+template <int ID=0>
+class MockPulseTimer {
+public:
+	static void Setup(void (*callback)()) {
+		m_Callback = callback;
+		m_Running = false;
+	}
+
+	static void Start(unsigned long micros) {
+		m_Micros = micros;
+		m_Running = true;
+	}
+
+	static void Stop() {
+		m_Running = false;
+	}
+
+	static bool IsRunning() {
+		return m_Running;
+	}
+
+	// The duration passed to the last Start call.
+	static unsigned long Micros() {
+		return m_Micros;
+	}
+
+	// Fire calls the callback if the timer is running.
+	static void Fire() {
+		if (!m_Running)
+			return;
+		m_Running = false;
+		m_Callback();
+	}
+
+private:
+	static void (*m_Callback)();
+	static volatile bool m_Running;
+	static unsigned long m_Micros;
+};
+
+template <int ID>
+void (*MockPulseTimer<ID>::m_Callback)() = nullptr;
+
+template <int ID>
+volatile bool MockPulseTimer<ID>::m_Running = false;
+
+template <int ID>
+unsigned long MockPulseTimer<ID>::m_Micros = 0;
+
+
+// sleep_until_interrupt has to be called with disabled interrupts. It puts the
+// CPU into a light sleep mode (idle/WFI) in which the peripherals (timers, pin
+// interrupts) keep working and returns with enabled interrupts after the
+// next interrupt. This way there is no race between checking a condition
+// with disabled interrupts and going to sleep.
+//
+// On architectures not listed here it only enables interrupts and returns.
+inline void sleep_until_interrupt() {
+#if defined(__AVR__)
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	sleep_enable();
+	// The instruction after sei() is executed before any pending interrupt.
+	sei();
+	sleep_cpu();
+	sleep_disable();
+#elif defined(__arm__)
+	// WFI wakes up on pending interrupts even if they are masked.
+	__asm__ volatile("wfi");
+	interrupts();
+#else
+	interrupts();
+#endif
+}
+
+
+// A WaitStrategy decides what the CPU does while a client is waiting for the
+// other side of the connection. It's a class with static methods:
+//
+//   // Called by the Setup of the clients for the pins they wait for.
+//   static void SetupPin(uint8_t pin);
+//   // Same as wait_for_pin_state.
+//   static bool WaitForPinState(uint8_t pin, int state, unsigned long deadline_micros);
+//   // Spend (at most) the given time doing nothing. Returning early is allowed.
+//   static void Idle(unsigned long micros);
+//
+// The clients use x52::WaitStrategy that can be changed by defining
+// X52_WAIT_STRATEGY before including the library, for example:
+//   #define X52_WAIT_STRATEGY x52::SleepWait<x52::IntervalPulseTimer<1>>
+
+// BusyWait gives the lowest response time. It keeps the CPU busy all the time.
+struct BusyWait {
+	static void SetupPin(uint8_t pin) {
+		Clock::Setup(pin);
+	}
+
+	static bool WaitForPinState(uint8_t pin, int state, unsigned long deadline_micros) {
+		return wait_for_pin_state(pin, state, deadline_micros, 0);
+	}
+
+	static void Idle(unsigned long) {}
+};
+
+
+// PollingWait checks the pins only every few microseconds.
+struct PollingWait {
+	static void SetupPin(uint8_t pin) {
+		Clock::Setup(pin);
+	}
+
+	static bool WaitForPinState(uint8_t pin, int state, unsigned long deadline_micros) {
+		return wait_for_pin_state(pin, state, deadline_micros, 5);
+	}
+
+	static void Idle(unsigned long micros) {
+		delayMicroseconds(micros);
+	}
+};
+
+
+// EdgeRecorder records the edges of an interrupt-capable pin into a small
+// ring buffer together with their timestamps. The interrupt handler is the
+// only writer and the readers don't have to disable interrupts: a reader
+// keeps its own sequence number and checks whether the slot it has just read
+// was overwritten in the meantime.
+//
+// There can be only one EdgeRecorder per pin (it owns the pin's interrupt).
+// Use ForPin to get it: the recorders of the pins are allocated from a pool
+// of X52_MAX_EDGE_RECORDERS items.
+class EdgeRecorder {
+public:
+	struct Edge {
+		unsigned long micros;
+		bool level;  // the state of the pin right after the edge
+		// The interrupt handler saw the same level as at the previous edge:
+		// the pin visited the opposite level so briefly that both edges
+		// happened before the handler could read the pin (e.g. while the
+		// interrupts were disabled).
+		bool missed_pulse;
+	};
+
+	// The number of edges that can be read back from the ring buffer.
+	// One slot is reserved for the edge being written by the interrupt handler.
+	static constexpr uint8_t HISTORY_SIZE = 7;
+
+	// ForPin returns the recorder of the pin. It sets up the recorder
+	// on its first call. Returns nullptr if the pool is exhausted.
+	static EdgeRecorder* ForPin(uint8_t pin) {
+		static_assert(X52_MAX_EDGE_RECORDERS <= 8, "X52_MAX_EDGE_RECORDERS can't be greater than 8");
+		static void (*const handlers[8])() = {
+			InterruptHandler<0>, InterruptHandler<1>, InterruptHandler<2>, InterruptHandler<3>,
+			InterruptHandler<4>, InterruptHandler<5>, InterruptHandler<6>, InterruptHandler<7>,
+		};
+		EdgeRecorder* pool = Pool();
+		for (int i=0; i<X52_MAX_EDGE_RECORDERS; i++)
+			if (pool[i].m_InUse && pool[i].m_Pin == pin)
+				return &pool[i];
+		for (int i=0; i<X52_MAX_EDGE_RECORDERS; i++) {
+			if (pool[i].m_InUse)
+				continue;
+			EdgeRecorder& r = pool[i];
+			r.m_Pin = pin;
+			r.m_Level = bool(digitalRead(pin));
+			r.m_InUse = true;
+			attachInterrupt(digitalPinToInterrupt(pin), handlers[i], CHANGE);
+			return &r;
+		}
+		X52DebugLog("EdgeRecorder pool exhausted. Increase X52_MAX_EDGE_RECORDERS.");
+		return nullptr;
+	}
+
+	// Find returns the recorder of the pin or nullptr if it doesn't have one.
+	static EdgeRecorder* Find(uint8_t pin) {
+		EdgeRecorder* pool = Pool();
+		for (int i=0; i<X52_MAX_EDGE_RECORDERS; i++)
+			if (pool[i].m_InUse && pool[i].m_Pin == pin)
+				return &pool[i];
+		return nullptr;
+	}
+
+	uint8_t Pin() const {
+		return m_Pin;
+	}
+
+	// Head returns the sequence number of the next edge to be recorded.
+	// Sequence numbers wrap around at 256.
+	uint8_t Head() const {
+		return m_Head;
+	}
+
+	// Read returns false if the edge with the given sequence number has
+	// already been overwritten (the reader is too slow).
+	bool Read(uint8_t seq, Edge& edge) const {
+		uint8_t i = seq & 7;
+		edge.micros = m_Micros[i];
+		edge.level = bool(m_Levels & (1 << i));
+		edge.missed_pulse = bool(m_MissedPulses & (1 << i));
+		return uint8_t(m_Head - seq) <= HISTORY_SIZE;
+	}
+
+	// Level returns the state of the pin after the last recorded edge.
+	bool Level() const {
+		return m_Level;
+	}
+
+	// WaitForPinState is similar to wait_for_pin_state but it returns true
+	// even if the pin visited the requested state only for a very short time
+	// (and has already left it) after the call.
+	bool WaitForPinState(int state, unsigned long deadline_micros) const {
+		uint8_t seq = m_Head;
+		Deadline<WallClock<Clock>::Type> deadline(deadline_micros);
+		for (;;) {
+			if (digitalRead(m_Pin) == state)
+				return true;
+			uint8_t head = m_Head;
+			for (; seq != head; seq++) {
+				Edge e;
+				// An overwritten edge means that we missed a lot of edges:
+				// the pin must have visited both states.
+				if (!Read(seq, e) || e.level == bool(state) || e.missed_pulse)
+					return true;
+			}
+			if (deadline.Passed())
+				return false;
+		}
+	}
+
+private:
+	template <int SLOT>
+	static void InterruptHandler() {
+		// The modulo avoids out of bounds code for the unused handlers.
+		Pool()[SLOT % X52_MAX_EDGE_RECORDERS].OnEdge();
+	}
+
+	void OnEdge() {
+		uint8_t head = m_Head;
+		uint8_t i = head & 7;
+		uint8_t mask = 1 << i;
+		bool level = bool(digitalRead(m_Pin));
+		m_Micros[i] = micros();
+		m_Levels = level ? (m_Levels | mask) : (m_Levels & ~mask);
+		m_MissedPulses = level == m_Level ? (m_MissedPulses | mask) : (m_MissedPulses & ~mask);
+		m_Level = level;
+		// The slot has to be complete before it becomes visible to the readers.
+		m_Head = head + 1;
+	}
+
+	// Zero-initialized static storage, no constructor needed.
+	static EdgeRecorder* Pool() {
+		static EdgeRecorder pool[X52_MAX_EDGE_RECORDERS];
+		return pool;
+	}
+
+	volatile unsigned long m_Micros[8];
+	volatile uint8_t m_Levels;
+	volatile uint8_t m_MissedPulses;
+	volatile uint8_t m_Head;
+	volatile bool m_Level;
+	uint8_t m_Pin;
+	bool m_InUse;
+};
+
+
+// RecordedWait waits with the help of EdgeRecorders so it can't miss short
+// pulses even if the CPU is busy with something else (e.g. an interrupt
+// handler) while the pulse starts and ends. SetupPin allocates a recorder for
+// the pin so it has to be an interrupt-capable pin. Pins without a recorder
+// are polled like with BusyWait.
+struct RecordedWait {
+	static void SetupPin(uint8_t pin) {
+		Clock::Setup(pin);
+		EdgeRecorder::ForPin(pin);
+	}
+
+	static bool WaitForPinState(uint8_t pin, int state, unsigned long deadline_micros) {
+		EdgeRecorder* r = EdgeRecorder::Find(pin);
+		if (!r)
+			return wait_for_pin_state(pin, state, deadline_micros, 0);
+		return r->WaitForPinState(state, deadline_micros);
+	}
+
+	static void Idle(unsigned long) {}
+};
+
+
+// SleepWait puts the CPU to sleep until an edge of the pin or the deadline.
+// SetupPin attaches a CHANGE interrupt to the pin so it must be an
+// interrupt-capable pin. The deadline is handled by a PulseTimer that
+// can't be used for anything else.
+//
+// If the pin gets another interrupt handler after SetupPin (e.g. an
+// EdgeRecorder) then that replaces the handler of SleepWait. Any interrupt
+// wakes up the CPU so this isn't a problem if the new handler also triggers
+// on both edges. Otherwise the other edges are detected with a delay of at
+// most X52_SLEEP_WAIT_MAX_MICROS.
+template <typename PulseTimer>
+class SleepWait {
+public:
+	static void SetupPin(uint8_t pin) {
+		PulseTimer::Setup(WakeUp);
+		// The interrupt handler of an EdgeRecorder wakes us up too.
+		if (!EdgeRecorder::Find(pin))
+			attachInterrupt(digitalPinToInterrupt(pin), WakeUp, CHANGE);
+	}
+
+	static bool WaitForPinState(uint8_t pin, int state, unsigned long deadline_micros) {
+		for (;;) {
+			noInterrupts();
+			if (digitalRead(pin) == state) {
+				interrupts();
+				return true;
+			}
+			// using delta to handle the overflows of micros()
+			unsigned long micros_left = deadline_micros - micros();
+			if (long(micros_left) <= 0) {
+				interrupts();
+				return false;
+			}
+			Sleep(micros_left);
+		}
+	}
+
+	static void Idle(unsigned long micros) {
+		noInterrupts();
+		Sleep(micros);
+	}
+
+	// MeasureWakeupMicros returns the worst observed difference between the
+	// requested and the actual sleep time. It can be used to find the right
+	// X52_SLEEP_WAKEUP_MICROS value for a board.
+	static unsigned long MeasureWakeupMicros(unsigned long sleep_micros=200, int repeat=16) {
+		PulseTimer::Setup(WakeUp);
+		unsigned long worst = 0;
+		for (int i=0; i<repeat; i++) {
+			unsigned long t = micros();
+			noInterrupts();
+			PulseTimer::Start(sleep_micros);
+			sleep_until_interrupt();
+			unsigned long d = micros() - t;
+			PulseTimer::Stop();
+			// Other interrupts (e.g. the millis() timer) wake us up too early.
+			if (d >= sleep_micros && d - sleep_micros > worst)
+				worst = d - sleep_micros;
+		}
+		return worst;
+	}
+
+private:
+	// Called with disabled interrupts, returns with enabled interrupts.
+	static void Sleep(unsigned long micros) {
+		if (micros > X52_SLEEP_WAIT_MAX_MICROS)
+			micros = X52_SLEEP_WAIT_MAX_MICROS;
+		if (micros <= X52_SLEEP_WAKEUP_MICROS) {
+			// Not enough time for a sleep.
+			interrupts();
+			return;
+		}
+		PulseTimer::Start(micros - X52_SLEEP_WAKEUP_MICROS);
+		sleep_until_interrupt();
+		PulseTimer::Stop();
+	}
+
+	static void WakeUp() {}
+};
+
+
+#if defined(X52_WAIT_STRATEGY)
+	typedef X52_WAIT_STRATEGY WaitStrategy;
+#elif X52_BUSY_WAIT
+	typedef BusyWait WaitStrategy;
+#else
+	typedef PollingWait WaitStrategy;
+#endif
+
+
 }  // namespace x52
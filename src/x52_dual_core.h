@@ -0,0 +1,200 @@
+#pragma once
+
+#include <atomic>
+
+#include "x52_engine.h"
+
+
+// A deployment mode for dual-core boards (e.g. RP2040, ESP32): one core runs
+// the client loop continuously so the frame timing isn't disturbed by the
+// USB/filtering work that runs on the other core. The two cores talk through
+// a DualCoreLink: the protocol core publishes the received states, the
+// application core sends the configs back.
+//
+// Example with the arduino-pico core (setup1/loop1 run on the second core):
+//
+//   x52::pro::JoystickClient<2,3,4,5> joystick_client;
+//   x52::DualCoreLink<x52::pro::JoystickState, x52::pro::JoystickConfig> link;
+//
+//   void setup1() { joystick_client.Setup(); }
+//   void loop1() {
+//     unsigned long d = link.PollAndPublish(joystick_client);
+//     if (d)
+//       x52::WaitStrategy::Idle(d);
+//   }
+//
+//   void loop() {
+//     x52::DualCoreLink<...>::StateFrame f;
+//     while (link.ReceiveState(f)) { ... }
+//     link.SendConfig(cfg);
+//   }
+//
+// extras/linux/x52_dual_core_bench.cpp runs the same on a PC with two threads.
+
+
+#if defined(__AVR__)
+	#error x52_dual_core.h is for dual-core boards
+#endif
+
+// The indices of the queues are kept on separate cache lines so the two
+// cores don't invalidate each other's cache line on every access.
+#ifndef X52_CACHE_LINE_SIZE
+	#define X52_CACHE_LINE_SIZE 64
+#endif
+
+
+namespace x52 {
+
+
+// SpscQueue is a lock-free single-producer single-consumer queue.
+// Push is called only by the producer, Pop only by the consumer.
+// SIZE has to be a power of two and the queue holds at most SIZE items.
+template <typename T, int SIZE>
+class SpscQueue {
+public:
+	static_assert(SIZE > 0 && (SIZE & (SIZE-1)) == 0, "SIZE has to be a power of two");
+
+	SpscQueue(): m_Head(0), m_CachedTail(0), m_Tail(0), m_CachedHead(0) {}
+
+	// Push returns false if the queue is full.
+	bool Push(const T& item) {
+		uint32_t tail = m_Tail.load(::std::memory_order_relaxed);
+		if (tail - m_CachedHead == SIZE) {
+			m_CachedHead = m_Head.load(::std::memory_order_acquire);
+			if (tail - m_CachedHead == SIZE)
+				return false;
+		}
+		m_Items[tail & (SIZE-1)] = item;
+		m_Tail.store(tail + 1, ::std::memory_order_release);
+		return true;
+	}
+
+	// Pop returns false if the queue is empty.
+	bool Pop(T& item) {
+		uint32_t head = m_Head.load(::std::memory_order_relaxed);
+		if (head == m_CachedTail) {
+			m_CachedTail = m_Tail.load(::std::memory_order_acquire);
+			if (head == m_CachedTail)
+				return false;
+		}
+		item = m_Items[head & (SIZE-1)];
+		m_Head.store(head + 1, ::std::memory_order_release);
+		return true;
+	}
+
+private:
+	// Written by the consumer. m_CachedTail is the consumer's private copy
+	// of m_Tail: the consumer reads m_Tail only when the queue looks empty.
+	alignas(X52_CACHE_LINE_SIZE) ::std::atomic<uint32_t> m_Head;
+	uint32_t m_CachedTail;
+
+	// Written by the producer.
+	alignas(X52_CACHE_LINE_SIZE) ::std::atomic<uint32_t> m_Tail;
+	uint32_t m_CachedHead;
+
+	alignas(X52_CACHE_LINE_SIZE) T m_Items[SIZE];
+};
+
+
+// DualCoreLink connects the protocol core (producer of the states) with the
+// application core (producer of the configs). It works with the
+// JoystickState/JoystickConfig types of both the pro and std namespaces.
+//
+// A state that doesn't fit into the queue is dropped (the protocol core
+// never waits for the application core) but it still consumes a sequence
+// number so the application can see the gap. Only the latest config
+// matters: the protocol core applies the last one it finds in the queue.
+//
+// The HAL (see x52_engine.h) is used only for the capture timestamps.
+template <typename JoystickState, typename JoystickConfig, int STATE_QUEUE_SIZE=8, int CONFIG_QUEUE_SIZE=4, typename HAL=ArduinoHAL>
+class DualCoreLink {
+public:
+	struct StateFrame {
+		typename JoystickState::Binary state;
+		uint32_t seq;
+		uint32_t capture_micros;  // HAL::Micros() right after the frame was received
+	};
+
+	DualCoreLink(): m_Seq(0), m_NumDropped(0) {}
+
+	// --- protocol core ---
+
+	// Publish queues a received state. Returns false if it was dropped.
+	bool Publish(const typename JoystickState::Binary& state, unsigned long capture_micros) {
+		StateFrame f;
+		f.state = state;
+		f.seq = m_Seq++;
+		f.capture_micros = uint32_t(capture_micros);
+		if (m_States.Push(f))
+			return true;
+		m_NumDropped.store(m_NumDropped.load(::std::memory_order_relaxed) + 1, ::std::memory_order_relaxed);
+		return false;
+	}
+
+	// TakeConfig updates cfg to the last config sent by the application core.
+	// Returns false (and leaves cfg alone) if there is no new config.
+	bool TakeConfig(JoystickConfig& cfg) {
+		bool updated = false;
+		while (m_Configs.Pop(cfg))
+			updated = true;
+		return updated;
+	}
+
+	// PollAndPublish is one iteration of the protocol core's loop: it applies
+	// the new config, polls the joystick and publishes the state. Returns the
+	// return value of client.PollJoystickState (zero on success).
+	template <typename JoystickClient>
+	unsigned long PollAndPublish(JoystickClient& client, unsigned long wait_micros) {
+		TakeConfig(m_Config);
+		JoystickState state;
+		return PublishResult(client.PollJoystickState(state, m_Config, wait_micros), state);
+	}
+
+	template <typename JoystickClient>
+	unsigned long PollAndPublish(JoystickClient& client) {
+		TakeConfig(m_Config);
+		JoystickState state;
+		return PublishResult(client.PollJoystickState(state, m_Config), state);
+	}
+
+	// --- application core ---
+
+	// ReceiveState returns false if there is no new state.
+	bool ReceiveState(StateFrame& f) {
+		return m_States.Pop(f);
+	}
+
+	// SendConfig returns false if the protocol core is too slow to
+	// consume the configs. Sending the same config again later is fine.
+	bool SendConfig(const JoystickConfig& cfg) {
+		return m_Configs.Push(cfg);
+	}
+
+	// NumDropped is the number of states dropped because the application
+	// core didn't keep up. It can be called from any core.
+	uint32_t NumDropped() const {
+		return m_NumDropped.load(::std::memory_order_relaxed);
+	}
+
+private:
+	unsigned long PublishResult(unsigned long res, const JoystickState& state) {
+		if (res)
+			return res;
+		unsigned long now = HAL::Micros();
+		typename JoystickState::Binary b;
+		state.ToBinary(b);
+		Publish(b, now);
+		return 0;
+	}
+
+	SpscQueue<StateFrame, STATE_QUEUE_SIZE> m_States;
+	SpscQueue<JoystickConfig, CONFIG_QUEUE_SIZE> m_Configs;
+
+	// the private state of the protocol core
+	alignas(X52_CACHE_LINE_SIZE) JoystickConfig m_Config;
+	uint32_t m_Seq;
+	::std::atomic<uint32_t> m_NumDropped;
+};
+
+
+}  // namespace x52
@@ -0,0 +1,223 @@
+// The frame engine shared by the clients of the pro and std versions.
+#pragma once
+
+#include "x52_common.h"
+
+
+// With X52_SHARED_FRAME_ENGINE=0 (the default) the engine is inlined into
+// every client instance with compile-time pin numbers. This is the fastest
+// build, especially if the HAL can exploit the constant pins (e.g.
+// digitalWriteFast on the teensy).
+//
+// With X52_SHARED_FRAME_ENGINE=1 the frame transmission code of the clients
+// is compiled with runtime pin numbers so all client instances (pin
+// configurations) of a protocol share a single copy of it. This saves flash
+// on small AVR parts with several clients but the handshake loops are
+// slower: the pins and the hooks are passed in registers and memory (about
+// 7-15% more per clock cycle in x52_frame_bench on the host).
+#ifndef X52_SHARED_FRAME_ENGINE
+	#define X52_SHARED_FRAME_ENGINE 0
+#endif
+
+#define X52_ALWAYS_INLINE inline __attribute__((always_inline))
+
+#if X52_SHARED_FRAME_ENGINE
+	#define X52_FRAME_FUNC __attribute__((noinline))
+#else
+	#define X52_FRAME_FUNC X52_ALWAYS_INLINE
+#endif
+
+
+namespace x52 {
+
+
+// Pins is the pin configuration of a client in runtime form.
+// The pin names are the same as those of the client templates.
+struct Pins {
+	uint8_t c01;
+	uint8_t c02;
+	uint8_t c03;
+	uint8_t c04;
+};
+
+
+// A HAL is the pin I/O policy of the clients and the FrameEngine. It's a
+// class with static methods. ArduinoHAL is the default: it forwards to the
+// Arduino API and to the WaitStrategy (see x52_common.h).
+struct ArduinoHAL {
+	static void PinMode(uint8_t pin, uint8_t mode) {
+		pinMode(pin, mode);
+	}
+
+	// Called by the Setup of the clients for the pins they wait for.
+	static void SetupWaitPin(uint8_t pin) {
+		WaitStrategy::SetupPin(pin);
+	}
+
+	static int Read(uint8_t pin) {
+		return digitalRead(pin);
+	}
+
+	static void Write(uint8_t pin, int value) {
+		digitalWrite(pin, value);
+	}
+
+	static bool WaitForPinState(uint8_t pin, int state, unsigned long deadline_micros) {
+		return WaitStrategy::WaitForPinState(pin, state, deadline_micros);
+	}
+
+	static unsigned long Micros() {
+		return micros();
+	}
+
+	static void DelayMicros(unsigned long us) {
+		delayMicroseconds(us);
+	}
+};
+
+
+// Return values of FrameEngine::Lead and FrameEngine::Follow.
+// The hooks can return their own values starting from FirstHookResult.
+enum CycleResult {
+	CyclesDone,
+	FirstEdgeTimeout,   // the other side didn't answer our first clock edge
+	SecondEdgeTimeout,  // the other side didn't answer our second clock edge
+	FirstHookResult,
+};
+
+
+// FrameEngine implements the clock handshake of both protocols once.
+//
+// A clock cycle of the leader (the side that makes the first move):
+//   hooks.Begin(i); out=out_level; wait(in==in_level);
+//   hooks.Middle(i, deadline); out=!out_level; wait(in==!in_level); hooks.End(i)
+//
+// A clock cycle of the follower (it waits for the first move of the other side):
+//   wait(in==in_level); hooks.Begin(i); out=out_level;
+//   wait(in==!in_level); out=!out_level; hooks.End(i)
+//
+// The hooks are the protocol policy: they move the data bits and implement
+// the desync rules. Begin is void, Middle and End return zero to continue or
+// a value >= FirstHookResult to end the frame. Middle may change the cycle
+// index (to resync) and the deadline.
+//
+// On failure `i` is the index of the failed clock cycle and `out` is LOW.
+template <typename HAL>
+class FrameEngine {
+public:
+	template <typename Hooks>
+	static X52_ALWAYS_INLINE int Lead(Hooks& hooks, uint8_t out, int out_level, uint8_t in, int in_level, int& cycle, int end, unsigned long& frame_deadline) {
+		// Working on copies keeps i and deadline in registers across the HAL calls.
+		int i = cycle;
+		unsigned long deadline = frame_deadline;
+		int res = CyclesDone;
+		for (; i<end; i++) {
+			hooks.Begin(i);
+			HAL::Write(out, out_level);
+			if (!HAL::WaitForPinState(in, in_level, deadline)) {
+				HAL::Write(out, LOW);
+				res = FirstEdgeTimeout;
+				break;
+			}
+			res = hooks.Middle(i, deadline);
+			if (res) {
+				HAL::Write(out, LOW);
+				break;
+			}
+			HAL::Write(out, !out_level);
+			if (!HAL::WaitForPinState(in, !in_level, deadline)) {
+				HAL::Write(out, LOW);
+				res = SecondEdgeTimeout;
+				break;
+			}
+			res = hooks.End(i);
+			if (res)
+				break;
+		}
+		cycle = i;
+		frame_deadline = deadline;
+		return res;
+	}
+
+	template <typename Hooks>
+	static X52_ALWAYS_INLINE int Follow(Hooks& hooks, uint8_t out, int out_level, uint8_t in, int in_level, int& cycle, int end, unsigned long& frame_deadline) {
+		int i = cycle;
+		unsigned long deadline = frame_deadline;
+		int res = CyclesDone;
+		for (; i<end; i++) {
+			if (!HAL::WaitForPinState(in, in_level, deadline)) {
+				HAL::Write(out, LOW);
+				res = FirstEdgeTimeout;
+				break;
+			}
+			hooks.Begin(i);
+			HAL::Write(out, out_level);
+			if (!HAL::WaitForPinState(in, !in_level, deadline)) {
+				HAL::Write(out, LOW);
+				res = SecondEdgeTimeout;
+				break;
+			}
+			HAL::Write(out, !out_level);
+			res = hooks.End(i);
+			if (res)
+				break;
+		}
+		cycle = i;
+		frame_deadline = deadline;
+		return res;
+	}
+
+	// ShiftOut and ShiftIn are the plain data transfers of the std protocol:
+	// bit i of buf in clock cycle i on data_pin, written/sampled in Begin.
+	// A separate function for the leader and the follower keeps the hot
+	// loops free of runtime mode checks.
+	static X52_FRAME_FUNC int LeadShiftOut(uint8_t out, int out_level, uint8_t in, int in_level,
+			uint8_t data_pin, const uint8_t* buf, int& i, int end, unsigned long& deadline) {
+		ShiftOutHooks hooks = {data_pin, buf};
+		return Lead(hooks, out, out_level, in, in_level, i, end, deadline);
+	}
+
+	static X52_FRAME_FUNC int LeadShiftIn(uint8_t out, int out_level, uint8_t in, int in_level,
+			uint8_t data_pin, uint8_t* buf, int& i, int end, unsigned long& deadline) {
+		ShiftInHooks hooks = {data_pin, buf};
+		return Lead(hooks, out, out_level, in, in_level, i, end, deadline);
+	}
+
+	static X52_FRAME_FUNC int FollowShiftIn(uint8_t out, int out_level, uint8_t in, int in_level,
+			uint8_t data_pin, uint8_t* buf, int& i, int end, unsigned long& deadline) {
+		ShiftInHooks hooks = {data_pin, buf};
+		return Follow(hooks, out, out_level, in, in_level, i, end, deadline);
+	}
+
+private:
+	// The hooks address the bits with the cycle index like BitField::Bit:
+	// a walking pointer and mask would need two more registers in the loop.
+	struct ShiftOutHooks {
+		uint8_t data_pin;
+		const uint8_t* buf;
+
+		X52_ALWAYS_INLINE void Begin(int i) {
+			HAL::Write(data_pin, bool(buf[i>>3] & (1 << (i&7))));
+		}
+		int Middle(int&, unsigned long&) { return 0; }
+		int End(int) { return 0; }
+	};
+
+	struct ShiftInHooks {
+		uint8_t data_pin;
+		uint8_t* buf;
+
+		X52_ALWAYS_INLINE void Begin(int i) {
+			uint8_t mask = uint8_t(1 << (i&7));
+			if (HAL::Read(data_pin))
+				buf[i>>3] |= mask;
+			else
+				buf[i>>3] &= uint8_t(~mask);
+		}
+		int Middle(int&, unsigned long&) { return 0; }
+		int End(int) { return 0; }
+	};
+};
+
+
+}  // namespace x52
@@ -0,0 +1,495 @@
+#pragma once
+
+#include "x52_pro.h"
+#include "x52_std.h"
+
+
+// USB HID joystick reports built straight from the wire format.
+//
+// A fake throttle sends the state of the joystick to the PC as a USB joystick.
+// Doing that through the setters of a joystick library means decoding the
+// JoystickState::Binary into a JoystickState and then ~30 setter calls that
+// do their own range checks and read-modify-writes of the report. Most of the
+// fields are plain bit ranges in both formats, so here the report is built by
+// a compile-time mapping table from the Binary: a Mapping lists the Fields
+// (Copy, Lookup, Constant) and Build loads the Binary into a 64-bit word and
+// computes every 32-bit word of the report with a few masks and shifts. The
+// Copy fields of a report word that have the same shift are merged into a
+// single mask-and-shift at compile time.
+//
+// The report layouts are pluggable: a layout is a struct with REPORT_SIZE and
+// a Mapping for the Pro and the std Binary (see TeensyJoystick and Gamepad).
+//
+//   x52::hid::BinaryCapture<x52::pro::JoystickState> capture;
+//   if (joystick_client.PollJoystickState(state, cfg, capture) == 0) {
+//     x52::hid::BuildReport<x52::hid::TeensyJoystick>(capture.binary, (uint8_t*)usb_joystick_data);
+//     Joystick.send_now();
+//   }
+//
+// The reports are exact for the frames encoded by the joysticks. Bit patterns
+// the joysticks don't send (e.g. two mode bits of a Pro frame) are copied as
+// they are while JoystickState would turn them into ModeUndefined. The
+// checksum of the std frames isn't verified by Build (PollJoystickState does).
+//
+// extras/linux/x52_hid_bench.cpp compares the reports and the cost per report
+// with the setter based send functions of the examples.
+
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+	#error x52_hid.h supports only little endian targets
+#endif
+
+#ifndef PROGMEM
+	#define PROGMEM
+#endif
+
+
+namespace x52 {
+namespace hid {
+
+
+enum FieldKind {
+	CopyField,
+	LookupField,
+	ConstantField,
+};
+
+
+// Copy copies WIDTH bits from bit SRC of the Binary to bit DST of the report.
+// A Copy can't span two 32-bit words of the report: split it into two Copies
+// (like the high and low bits of the axes).
+template <int SRC, int DST, int WIDTH=1>
+struct Copy {
+	static_assert(SRC >= 0 && DST >= 0 && WIDTH > 0 && SRC + WIDTH <= 64, "invalid Copy");
+	static_assert((DST & 31) + WIDTH <= 32, "a Copy can't span two 32-bit words of the report");
+
+	enum {
+		KIND = CopyField,
+		SRC_END = SRC + WIDTH,
+		WORD = DST / 32,
+		// the Copies of a word with the same SHIFT are merged
+		SHIFT = DST % 32 - SRC,
+	};
+
+	static constexpr uint64_t SRC_MASK = ((uint64_t(1) << WIDTH) - 1) << SRC;
+	static constexpr uint32_t DST_MASK = uint32_t(((uint64_t(1) << WIDTH) - 1) << (DST % 32));
+};
+
+
+// Lookup writes entry (Binary bits SRC..SRC+SRC_WIDTH-1) of a table of 4-bit
+// entries to DST_WIDTH bits at DST of the report. The table is packed into a
+// uint64_t with entry 0 in the lowest 4 bits (see Nibbles). It's meant for
+// the hat switches: a shift and a mask instead of an array lookup.
+template <int SRC, int SRC_WIDTH, int DST, int DST_WIDTH, uint64_t TABLE>
+struct Lookup {
+	static_assert(SRC >= 0 && SRC_WIDTH > 0 && SRC_WIDTH <= 4 && SRC + SRC_WIDTH <= 64, "invalid Lookup source");
+	static_assert(DST >= 0 && DST_WIDTH > 0 && DST_WIDTH <= 4 && (DST & 31) + DST_WIDTH <= 32, "invalid Lookup destination");
+
+	enum {
+		KIND = LookupField,
+		SRC_END = SRC + SRC_WIDTH,
+		WORD = DST / 32,
+		SHIFT = 0,
+	};
+
+	static constexpr uint64_t SRC_MASK = 0;  // it isn't merged with the Copies
+	static constexpr uint32_t DST_MASK = uint32_t(((1UL << DST_WIDTH) - 1) << (DST % 32));
+
+	static uint32_t Apply(uint64_t w) {
+		uint8_t index = uint8_t(w >> SRC) & ((1 << SRC_WIDTH) - 1);
+		return uint32_t(uint8_t(TABLE >> (index * 4)) & ((1 << DST_WIDTH) - 1)) << (DST % 32);
+	}
+};
+
+
+// Constant sets WIDTH bits at DST of the report to VALUE (e.g. to center an
+// axis that has no source).
+template <int DST, int WIDTH, uint32_t VALUE>
+struct Constant {
+	static_assert(DST >= 0 && WIDTH > 0 && (DST & 31) + WIDTH <= 32, "a Constant can't span two 32-bit words of the report");
+	static_assert(WIDTH == 32 || VALUE < (1UL << WIDTH), "the value doesn't fit");
+
+	enum {
+		KIND = ConstantField,
+		SRC_END = 0,
+		WORD = DST / 32,
+		SHIFT = 0,
+	};
+
+	static constexpr uint64_t SRC_MASK = 0;
+	static constexpr uint32_t DST_MASK = uint32_t(((uint64_t(1) << WIDTH) - 1) << (DST % 32));
+	static constexpr uint32_t VALUE_BITS = uint32_t(VALUE) << (DST % 32);
+};
+
+
+// Nibbles packs the entries of a Lookup table (0..15 each, at most 16).
+constexpr uint64_t Nibbles() {
+	return 0;
+}
+
+template <typename... Rest>
+constexpr uint64_t Nibbles(int first, Rest... rest) {
+	return uint64_t(first & 15) | (Nibbles(rest...) << 4);
+}
+
+
+namespace detail {
+
+
+constexpr uint64_t ShiftBits(uint64_t v, int shift) {
+	return shift >= 0 ? v << shift : v >> -shift;
+}
+
+// SameGroup is true for two Copies that are merged.
+template <typename A, typename B>
+struct SameGroup {
+	enum { value = int(A::KIND) == int(CopyField) && int(B::KIND) == int(CopyField) && int(A::WORD) == int(B::WORD) && int(A::SHIFT) == int(B::SHIFT) };
+};
+
+// GroupMask is the merged source mask of the group of F.
+template <typename F, typename... Fields>
+struct GroupMask {
+	static constexpr uint64_t value = 0;
+};
+
+template <typename F, typename First, typename... Rest>
+struct GroupMask<F, First, Rest...> {
+	static constexpr uint64_t value = (SameGroup<F, First>::value ? First::SRC_MASK : 0) | GroupMask<F, Rest...>::value;
+};
+
+// InGroup is true if one of the Fields is in the group of F.
+template <typename F, typename... Fields>
+struct InGroup {
+	enum { value = 0 };
+};
+
+template <typename F, typename First, typename... Rest>
+struct InGroup<F, First, Rest...> {
+	enum { value = SameGroup<F, First>::value || InGroup<F, Rest...>::value };
+};
+
+// Overlaps is true if F writes a bit of the report that one of the Fields writes too.
+template <typename F, typename... Fields>
+struct Overlaps {
+	enum { value = 0 };
+};
+
+template <typename F, typename First, typename... Rest>
+struct Overlaps<F, First, Rest...> {
+	enum { value = (int(F::WORD) == int(First::WORD) && (F::DST_MASK & First::DST_MASK) != 0) || Overlaps<F, Rest...>::value };
+};
+
+
+// Term is the contribution of a field to word K of the report. A group of
+// Copies is computed by its last Copy (the one that isn't followed by
+// another one of the group).
+template <int KIND>
+struct Term;
+
+template <>
+struct Term<CopyField> {
+	template <typename F, int K, bool LAST, uint64_t GROUP_MASK>
+	static uint32_t Get(uint64_t w) {
+		return int(F::WORD) == K && LAST ? uint32_t(ShiftBits(w & GROUP_MASK, F::SHIFT)) : 0;
+	}
+};
+
+template <>
+struct Term<LookupField> {
+	template <typename F, int K, bool, uint64_t>
+	static uint32_t Get(uint64_t w) {
+		return int(F::WORD) == K ? F::Apply(w) : 0;
+	}
+};
+
+template <>
+struct Term<ConstantField> {
+	template <typename F, int K, bool, uint64_t>
+	static uint32_t Get(uint64_t) {
+		return int(F::WORD) == K ? F::VALUE_BITS : 0;
+	}
+};
+
+
+template <typename... Fields>
+struct List {};
+
+// Word computes word K of the report. All is the List of the fields (for
+// the group masks), the pack is the rest of the list.
+template <typename All, int K, typename... Fields>
+struct Word {
+	static uint32_t Get(uint64_t) {
+		return 0;
+	}
+};
+
+template <typename... AllFields, int K, typename F, typename... Rest>
+struct Word<List<AllFields...>, K, F, Rest...> {
+	static_assert(!Overlaps<F, Rest...>::value, "two fields write the same bit of the report");
+
+	static uint32_t Get(uint64_t w) {
+		return Term<F::KIND>::template Get<F, K, !InGroup<F, Rest...>::value, GroupMask<F, AllFields...>::value>(w) |
+			Word<List<AllFields...>, K, Rest...>::Get(w);
+	}
+};
+
+// Store writes the words K.. of the report.
+template <typename All, int K, int REPORT_SIZE, bool DONE=(K*4 >= REPORT_SIZE)>
+struct Store;
+
+template <typename... Fields, int K, int REPORT_SIZE>
+struct Store<List<Fields...>, K, REPORT_SIZE, false> {
+	static void Run(uint64_t w, uint8_t* report) {
+		uint32_t word = Word<List<Fields...>, K, Fields...>::Get(w);
+		memcpy(report + K*4, &word, K*4 + 4 <= REPORT_SIZE ? 4 : REPORT_SIZE - K*4);
+		Store<List<Fields...>, K+1, REPORT_SIZE>::Run(w, report);
+	}
+};
+
+template <typename All, int K, int REPORT_SIZE>
+struct Store<All, K, REPORT_SIZE, true> {
+	static void Run(uint64_t, uint8_t*) {}
+};
+
+template <typename... Fields>
+struct MaxSrcEnd {
+	enum { value = 0 };
+};
+
+template <typename First, typename... Rest>
+struct MaxSrcEnd<First, Rest...> {
+	enum { value = int(First::SRC_END) > int(MaxSrcEnd<Rest...>::value) ? int(First::SRC_END) : int(MaxSrcEnd<Rest...>::value) };
+};
+
+
+}  // namespace detail
+
+
+// Mapping is the mapping table of a report layout for one of the
+// JoystickStates (pro or std).
+template <typename JoystickState, int REPORT_SIZE, typename... Fields>
+struct Mapping {
+	typedef typename JoystickState::Binary Binary;
+
+	static_assert(REPORT_SIZE > 0 && REPORT_SIZE <= 64, "invalid report size");
+	static_assert(int(detail::MaxSrcEnd<Fields...>::value) <= JoystickState::NUM_BITS, "a field reads beyond the end of the Binary");
+
+	// Build writes REPORT_SIZE bytes to report.
+	static void Build(const Binary& b, uint8_t* report) {
+		uint64_t w = 0;
+		memcpy(&w, b.Bytes(), (JoystickState::NUM_BITS + 7) / 8);
+		detail::Store<detail::List<Fields...>, 0, REPORT_SIZE>::Run(w, report);
+	}
+};
+
+
+// BuildReport builds the report of a layout from the Binary of a Pro or a
+// std JoystickState. The report has to be at least Layout::REPORT_SIZE bytes.
+template <typename Layout>
+void BuildReport(const pro::JoystickState::Binary& b, uint8_t* report) {
+	Layout::Pro::Build(b, report);
+}
+
+template <typename Layout>
+void BuildReport(const std::JoystickState::Binary& b, uint8_t* report) {
+	Layout::Std::Build(b, report);
+}
+
+
+// BinaryCapture is a partial state handler (see NoPartialState in
+// x52_common.h) that keeps a copy of the Binary of the state for BuildReport:
+// pass it to PollJoystickState and use capture.binary if it returns zero.
+// It copies the Binary when all the groups are complete (and once more after
+// the checksum of a std frame) so the work between the two clock edges is
+// a copy of 7-8 bytes.
+template <typename JoystickState>
+struct BinaryCapture {
+	typename JoystickState::Binary binary;
+
+	template <typename View>
+	void OnPartialState(const View& view, uint8_t groups) {
+		if ((groups & StateAllGroups) == StateAllGroups)
+			binary = view.GetBinary();
+	}
+};
+
+
+// The buttons of the layouts below are those of the Fake-X52-Throttle
+// examples. The numbers may look random but they increase the compatibility
+// with xbox and ps controllers (one-based like the button numbers of the PC):
+//
+//   A=1 B=2 C=3 fire=4 T2=5 T4=6 pinkie=7 trigger_stage_1=8 T1=9 T3=10 T5=11
+//   T6=12 pov_2: up=13 down=14 left=15 right=16 trigger_stage_2=29
+//   mode_1=30 mode_2=31 mode_3=32
+//
+// The hat switch values are 0..7 for up, up-right, ... up-left and 15 for the
+// center. pov_2 is four independent switches: three pressed directions count
+// as the middle one and two opposite ones as the center (like the hat_angles
+// table of the examples).
+
+
+// TeensyJoystick is the 12-byte joystick report of Teensyduino (the
+// usb_joystick_data of the "Joystick" USB types of Teensy 3.x/LC/4.x):
+//
+//   bits 0..31:   buttons 1..32
+//   bits 32..35:  hat switch
+//   bits 36..95:  X, Y, Z, Z rotate, slider left, slider right (10 bits each)
+//
+// Teensyduino has the only hat switch so pov_2 is four buttons, and z is
+// Z rotate. The std x and y are 11-bit: their lowest bit is dropped.
+// Z and the sliders are left at zero.
+struct TeensyJoystick {
+	enum {
+		REPORT_SIZE = 12,
+		BUTTONS = 0,
+		HAT = 32,
+		X = 36,
+		Y = 46,
+		Z_ROTATE = 66,
+	};
+
+	typedef Mapping<pro::JoystickState, REPORT_SIZE,
+		Copy<0, X, 8>, Copy<16, X+8, 2>,
+		Copy<8, Y, 8>, Copy<18, Y+8, 2>,
+		Copy<24, Z_ROTATE, 8>, Copy<22, Z_ROTATE+8, 2>,
+		// pro pov_1 codes: 1=down 2=down-right 3=right 4=up-right 5=up 6=up-left 7=left 8=down-left
+		Lookup<32, 4, HAT, 4, Nibbles(15, 4, 3, 2, 1, 0, 7, 6, 5, 15, 15, 15, 15, 15, 15, 15)>,
+		// pov_2 bits: up, right, down, left
+		Copy<36, BUTTONS+12>, Copy<37, BUTTONS+15>, Copy<38, BUTTONS+13>, Copy<39, BUTTONS+14>,
+		Copy<40, BUTTONS+7>,   // trigger_stage_1
+		Copy<41, BUTTONS+3>,   // fire
+		Copy<42, BUTTONS+0>,   // A
+		Copy<43, BUTTONS+2>,   // C
+		Copy<44, BUTTONS+28>,  // trigger_stage_2
+		Copy<45, BUTTONS+29, 3>,  // the one-hot mode bits
+		Copy<48, BUTTONS+1>,   // B
+		Copy<49, BUTTONS+6>,   // pinkie
+		Copy<50, BUTTONS+8>, Copy<51, BUTTONS+4>, Copy<52, BUTTONS+9>,  // T1, T2, T3
+		Copy<53, BUTTONS+5>, Copy<54, BUTTONS+10>, Copy<55, BUTTONS+11>  // T4, T5, T6
+	> Pro;
+
+	typedef Mapping<std::JoystickState, REPORT_SIZE,
+		Copy<1, X, 7>, Copy<16, X+7, 3>,
+		Copy<9, Y, 7>, Copy<19, Y+7, 3>,
+		Copy<24, Z_ROTATE, 8>, Copy<22, Z_ROTATE+8, 2>,
+		// std pov_1 codes: 1=up 2=up-right ... 8=up-left
+		Lookup<32, 4, HAT, 4, Nibbles(15, 0, 1, 2, 3, 4, 5, 6, 7, 15, 15, 15, 15, 15, 15, 15)>,
+		// pov_2 bits: right, down, left, up
+		Copy<36, BUTTONS+15>, Copy<37, BUTTONS+13>, Copy<38, BUTTONS+14>, Copy<39, BUTTONS+12>,
+		Copy<40, BUTTONS+7>,   // trigger_stage_1
+		Copy<41, BUTTONS+28>,  // trigger_stage_2
+		Copy<42, BUTTONS+3>,   // fire
+		Copy<43, BUTTONS+0, 3>,  // A, B, C
+		Copy<46, BUTTONS+6>,   // pinkie
+		Copy<47, BUTTONS+29>,  // mode 1
+		Copy<48, BUTTONS+8>, Copy<49, BUTTONS+4>, Copy<50, BUTTONS+9>,  // T1, T2, T3
+		Copy<51, BUTTONS+5>, Copy<52, BUTTONS+10>, Copy<53, BUTTONS+11>,  // T4, T5, T6
+		// mode bits 54..55: 1=mode 2, 2=mode 3
+		Lookup<54, 2, BUTTONS+30, 2, Nibbles(0, 1, 2, 0)>
+	> Std;
+};
+
+
+// Gamepad is a layout with its own HID report descriptor for the USB stacks
+// that take one, e.g. the PluggableUSB HID of the ATmega32U4 boards:
+//
+//   uint16_t size;  // in setup()
+//   const uint8_t* descriptor = x52::hid::Gamepad::Descriptor(size);
+//   static HIDSubDescriptor node(descriptor, size);
+//   HID().AppendDescriptor(&node);
+//   ...
+//   uint8_t report[x52::hid::Gamepad::REPORT_SIZE];
+//   x52::hid::BuildReport<x52::hid::Gamepad>(capture.binary, report);
+//   HID().SendReport(x52::hid::Gamepad::REPORT_ID, report, sizeof(report));
+//
+// Report (after the report ID):
+//
+//   bits 0..31:   buttons 1..32
+//   bits 32..35:  hat switch 1 (pov_1)
+//   bits 36..39:  hat switch 2 (pov_2)
+//   bits 40..87:  X, Y, Rz (16 bits each, 0..1023)
+struct Gamepad {
+	enum {
+		REPORT_ID = 3,
+		REPORT_SIZE = 11,
+		BUTTONS = 0,
+		HAT_1 = 32,
+		HAT_2 = 36,
+		X = 40,
+		Y = 56,
+		RZ = 72,
+	};
+
+	// Descriptor returns the HID report descriptor (in PROGMEM on AVR).
+	static const uint8_t* Descriptor(uint16_t& size) {
+		static const uint8_t descriptor[] PROGMEM = {
+			0x05, 0x01,        // Usage Page (Generic Desktop)
+			0x09, 0x04,        // Usage (Joystick)
+			0xA1, 0x01,        // Collection (Application)
+			0x85, REPORT_ID,   //   Report ID
+			0x05, 0x09,        //   Usage Page (Button)
+			0x19, 0x01,        //   Usage Minimum (1)
+			0x29, 0x20,        //   Usage Maximum (32)
+			0x15, 0x00,        //   Logical Minimum (0)
+			0x25, 0x01,        //   Logical Maximum (1)
+			0x75, 0x01,        //   Report Size (1)
+			0x95, 0x20,        //   Report Count (32)
+			0x81, 0x02,        //   Input (Data, Variable, Absolute)
+			0x05, 0x01,        //   Usage Page (Generic Desktop)
+			0x09, 0x39,        //   Usage (Hat switch)
+			0x09, 0x39,        //   Usage (Hat switch)
+			0x15, 0x00,        //   Logical Minimum (0)
+			0x25, 0x07,        //   Logical Maximum (7)
+			0x35, 0x00,        //   Physical Minimum (0)
+			0x46, 0x3B, 0x01,  //   Physical Maximum (315)
+			0x65, 0x14,        //   Unit (Degrees)
+			0x75, 0x04,        //   Report Size (4)
+			0x95, 0x02,        //   Report Count (2)
+			0x81, 0x42,        //   Input (Data, Variable, Absolute, Null State)
+			0x65, 0x00,        //   Unit (None)
+			0x45, 0x00,        //   Physical Maximum (0)
+			0x09, 0x30,        //   Usage (X)
+			0x09, 0x31,        //   Usage (Y)
+			0x09, 0x35,        //   Usage (Rz)
+			0x15, 0x00,        //   Logical Minimum (0)
+			0x26, 0xFF, 0x03,  //   Logical Maximum (1023)
+			0x75, 0x10,        //   Report Size (16)
+			0x95, 0x03,        //   Report Count (3)
+			0x81, 0x02,        //   Input (Data, Variable, Absolute)
+			0xC0,              // End Collection
+		};
+		size = sizeof(descriptor);
+		return descriptor;
+	}
+
+	typedef Mapping<pro::JoystickState, REPORT_SIZE,
+		Copy<0, X, 8>, Copy<16, X+8, 2>,
+		Copy<8, Y, 8>, Copy<18, Y+8, 2>,
+		Copy<24, RZ, 8>, Copy<22, RZ+8, 2>,
+		Lookup<32, 4, HAT_1, 4, Nibbles(15, 4, 3, 2, 1, 0, 7, 6, 5, 15, 15, 15, 15, 15, 15, 15)>,
+		// pov_2 bits: up, right, down, left
+		Lookup<36, 4, HAT_2, 4, Nibbles(15, 0, 2, 1, 4, 15, 3, 2, 6, 7, 15, 0, 5, 6, 4, 15)>,
+		Copy<40, BUTTONS+7>, Copy<41, BUTTONS+3>, Copy<42, BUTTONS+0>, Copy<43, BUTTONS+2>,
+		Copy<44, BUTTONS+28>, Copy<45, BUTTONS+29, 3>, Copy<48, BUTTONS+1>, Copy<49, BUTTONS+6>,
+		Copy<50, BUTTONS+8>, Copy<51, BUTTONS+4>, Copy<52, BUTTONS+9>,
+		Copy<53, BUTTONS+5>, Copy<54, BUTTONS+10>, Copy<55, BUTTONS+11>
+	> Pro;
+
+	typedef Mapping<std::JoystickState, REPORT_SIZE,
+		Copy<1, X, 7>, Copy<16, X+7, 3>,
+		Copy<9, Y, 7>, Copy<19, Y+7, 1>, Copy<20, Y+8, 2>,
+		Copy<24, RZ, 8>, Copy<22, RZ+8, 2>,
+		Lookup<32, 4, HAT_1, 4, Nibbles(15, 0, 1, 2, 3, 4, 5, 6, 7, 15, 15, 15, 15, 15, 15, 15)>,
+		// pov_2 bits: right, down, left, up (the bits of Direction)
+		Lookup<36, 4, HAT_2, 4, Nibbles(15, 2, 4, 3, 6, 15, 5, 4, 0, 1, 15, 2, 7, 0, 6, 15)>,
+		Copy<40, BUTTONS+7>, Copy<41, BUTTONS+28>, Copy<42, BUTTONS+3>, Copy<43, BUTTONS+0, 3>,
+		Copy<46, BUTTONS+6>, Copy<47, BUTTONS+29>,
+		Copy<48, BUTTONS+8>, Copy<49, BUTTONS+4>, Copy<50, BUTTONS+9>,
+		Copy<51, BUTTONS+5>, Copy<52, BUTTONS+10>, Copy<53, BUTTONS+11>,
+		Lookup<54, 2, BUTTONS+30, 2, Nibbles(0, 1, 2, 0)>
+	> Std;
+};
+
+
+}  // namespace hid
+}  // namespace x52
@@ -1,5 +1,9 @@
 #pragma once
 
 #include "x52_pro.h"  // the Pro version
+#include "x52_pro_handle.h"  // the internal bus of the Pro joystick
 #include "x52_std.h"  // the Standard (non-Pro) version
+#include "x52_auto.h"  // runtime detection of the Pro/Standard joystick
 #include "x52_util.h" // additional/optional utilities
+#include "x52_analog.h"  // background analog acquisition for fake joysticks
+#include "x52_hid.h"  // USB HID reports built from the wire format
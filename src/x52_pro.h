@@ -1,6 +1,7 @@
 #pragma once
 
 #include "x52_common.h"
+#include "x52_engine.h"
 
 
 // This value is hardcoded into the firmware of my original X52 Pro throttle.
@@ -40,6 +41,27 @@
 	#define X52_PRO_IMPROVED_JOYSTICK_CLIENT_DESYNC_DETECTION 0
 #endif
 
+// Fast desync recovery for the case where both sides of the connection run
+// this library (e.g. a fake throttle talking to a fake joystick). It has to be
+// enabled on both sides because it changes the protocol slightly:
+// - The ThrottleClient doesn't time out after detecting a desync. The position
+//   of the zero desync detection bit on C01 tells it where the throttle is in
+//   the frame so it jumps to that clock cycle and finishes the frame in sync.
+// - The frame after a resync contains garbage so the ThrottleClient marks it
+//   invalid by putting zero on C03 in clock cycle #75 (it's one otherwise).
+//   The JoystickClient checks this marker and discards invalid frames.
+// This feature implies both X52_PRO_IMPROVED_*_CLIENT_DESYNC_DETECTION features.
+#ifndef X52_PRO_FAST_RESYNC
+	#define X52_PRO_FAST_RESYNC 0
+#endif
+
+#if X52_PRO_FAST_RESYNC
+	#undef X52_PRO_IMPROVED_THROTTLE_CLIENT_DESYNC_DETECTION
+	#define X52_PRO_IMPROVED_THROTTLE_CLIENT_DESYNC_DETECTION 1
+	#undef X52_PRO_IMPROVED_JOYSTICK_CLIENT_DESYNC_DETECTION
+	#define X52_PRO_IMPROVED_JOYSTICK_CLIENT_DESYNC_DETECTION 1
+#endif
+
 #ifndef X52_PRO_DEFAULT_POLL_JOYSTICK_STATE_WAIT_MICROS
 	#define X52_PRO_DEFAULT_POLL_JOYSTICK_STATE_WAIT_MICROS 25000
 #endif
@@ -61,6 +83,9 @@ enum LEDColor {
 };
 
 
+class JoystickStateView;
+
+
 // JoystickState is the data sent by the joystick through the PS/2 cable.
 struct JoystickState {
 	static constexpr uint16_t MAX_X = 1023;
@@ -100,8 +125,12 @@ struct JoystickState {
 	// Constructor for the pros who believe they know what they are doing.
 	JoystickState(Uninitialized) {}
 
+	// Decodes all fields of the view.
+	explicit JoystickState(const JoystickStateView&);
+
 	static constexpr int NUM_BITS = 56;
 	typedef BitField<NUM_BITS> Binary;
+	typedef JoystickStateView View;
 
 	void SetFromBinary(const Binary&);
 	void ToBinary(Binary&) const;
@@ -172,66 +201,122 @@ inline void JoystickConfig::ToBinary(Binary& b) const {
 }
 
 
-inline void JoystickState::SetFromBinary(const Binary& b) {
-	x = uint16_t(b.UInt(0, 8) | (b.UInt(16, 2) << 8));
-	y = uint16_t(b.UInt(8, 8) | (b.UInt(18, 2) << 8));
-	z = uint16_t(b.UInt(24, 8) | (b.UInt(22, 2) << 8));
-
-	switch (b.UInt(32, 4)) {
-		case 1: pov_1 = Down; break;
-		case 2: pov_1 = DownRight; break;
-		case 3: pov_1 = Right; break;
-		case 4: pov_1 = UpRight; break;
-		case 5: pov_1 = Up; break;
-		case 6: pov_1 = UpLeft; break;
-		case 7: pov_1 = Left; break;
-		case 8: pov_1 = DownLeft; break;
-		default: pov_1 = NoDirection; break;
+// JoystickStateView decodes the fields of a received JoystickState::Binary
+// on access. It's cheaper than a JoystickState if you need only a few
+// fields, or if you skip the frames that are the same as the previous one
+// (the comparison of two views compares only the raw bits).
+//
+// The view references the Binary without copying it: the Binary has to
+// outlive the view.
+class JoystickStateView {
+public:
+	explicit JoystickStateView(const JoystickState::Binary& b): m_Binary(b) {}
+
+	uint16_t x() const { return uint16_t(m_Binary.UInt<0,8>() | (m_Binary.UInt<16,2>() << 8)); }
+	uint16_t y() const { return uint16_t(m_Binary.UInt<8,8>() | (m_Binary.UInt<18,2>() << 8)); }
+	uint16_t z() const { return uint16_t(m_Binary.UInt<24,8>() | (m_Binary.UInt<22,2>() << 8)); }
+
+	Direction pov_1() const {
+		switch (m_Binary.UInt<32,4>()) {
+			case 1: return Down;
+			case 2: return DownRight;
+			case 3: return Right;
+			case 4: return UpRight;
+			case 5: return Up;
+			case 6: return UpLeft;
+			case 7: return Left;
+			case 8: return DownLeft;
+			default: return NoDirection;
+		}
+	}
+
+	Direction pov_2() const {
+		return Direction(
+			(-m_Binary.Bit<36>() & Up) |
+			(-m_Binary.Bit<37>() & Right) |
+			(-m_Binary.Bit<38>() & Down) |
+			(-m_Binary.Bit<39>() & Left)
+		);
+	}
+
+	Mode mode() const {
+		switch (m_Binary.UInt<45,3>()) {
+			case 1: return Mode1;
+			case 2: return Mode2;
+			case 4: return Mode3;
+			default: return ModeUndefined;
+		}
+	}
+
+	bool trigger_stage_1() const { return m_Binary.Bit<40>(); }
+	bool button_fire() const { return m_Binary.Bit<41>(); }
+	bool button_a() const { return m_Binary.Bit<42>(); }
+	bool button_c() const { return m_Binary.Bit<43>(); }
+	bool trigger_stage_2() const { return m_Binary.Bit<44>(); }
+	bool button_b() const { return m_Binary.Bit<48>(); }
+	bool pinkie_switch() const { return m_Binary.Bit<49>(); }
+	bool button_t1() const { return m_Binary.Bit<50>(); }
+	bool button_t2() const { return m_Binary.Bit<51>(); }
+	bool button_t3() const { return m_Binary.Bit<52>(); }
+	bool button_t4() const { return m_Binary.Bit<53>(); }
+	bool button_t5() const { return m_Binary.Bit<54>(); }
+	bool button_t6() const { return m_Binary.Bit<55>(); }
+
+	const JoystickState::Binary& GetBinary() const {
+		return m_Binary;
 	}
 
-	pov_2 = Direction(
-		(-b.Bit(36) & Up) |
-		(-b.Bit(37) & Right) |
-		(-b.Bit(38) & Down) |
-		(-b.Bit(39) & Left)
-	);
-
-	switch (b.UInt(45, 3)) {
-		case 1: mode = Mode1; break;
-		case 2: mode = Mode2; break;
-		case 4: mode = Mode3; break;
-		default: mode = ModeUndefined; break;
+	bool operator==(const JoystickStateView& other) const {
+		return m_Binary == other.m_Binary;
 	}
 
-	trigger_stage_1 = b.Bit(40);
-	button_fire = b.Bit(41);
-	button_a = b.Bit(42);
-	button_c = b.Bit(43);
-	trigger_stage_2 = b.Bit(44);
-	button_b = b.Bit(48);
-	pinkie_switch = b.Bit(49);
-	button_t1 = b.Bit(50);
-	button_t2 = b.Bit(51);
-	button_t3 = b.Bit(52);
-	button_t4 = b.Bit(53);
-	button_t5 = b.Bit(54);
-	button_t6 = b.Bit(55);
+	bool operator!=(const JoystickStateView& other) const {
+		return m_Binary != other.m_Binary;
+	}
+
+private:
+	const JoystickState::Binary& m_Binary;
+};
+
+
+inline JoystickState::JoystickState(const JoystickStateView& v) {
+	x = v.x();
+	y = v.y();
+	z = v.z();
+	pov_1 = v.pov_1();
+	pov_2 = v.pov_2();
+	mode = v.mode();
+	trigger_stage_1 = v.trigger_stage_1();
+	trigger_stage_2 = v.trigger_stage_2();
+	pinkie_switch = v.pinkie_switch();
+	button_fire = v.button_fire();
+	button_a = v.button_a();
+	button_b = v.button_b();
+	button_c = v.button_c();
+	button_t1 = v.button_t1();
+	button_t2 = v.button_t2();
+	button_t3 = v.button_t3();
+	button_t4 = v.button_t4();
+	button_t5 = v.button_t5();
+	button_t6 = v.button_t6();
+}
+
+
+inline void JoystickState::SetFromBinary(const Binary& b) {
+	*this = JoystickState(JoystickStateView(b));
 }
 
 
 inline void JoystickState::ToBinary(Binary& b) const {
 #if X52_DEBUG
 	if (x > MAX_X) {
-		X52DebugPrint("x52::pro::JoystickState.x exceeds the maximum value. x=");
-		X52DebugPrintln(x);
+		X52DebugLog("x52::pro::JoystickState.x exceeds the maximum value. x=", x);
 	}
 	if (y > MAX_Y) {
-		X52DebugPrint("x52::pro::JoystickState.y exceeds the maximum value. y=");
-		X52DebugPrintln(y);
+		X52DebugLog("x52::pro::JoystickState.y exceeds the maximum value. y=", y);
 	}
 	if (z > MAX_Z) {
-		X52DebugPrint("x52::pro::JoystickState.z exceeds the maximum value. z=");
-		X52DebugPrintln(z);
+		X52DebugLog("x52::pro::JoystickState.z exceeds the maximum value. z=", z);
 	}
 #endif
 
@@ -282,6 +367,394 @@ inline void JoystickState::ToBinary(Binary& b) const {
 }
 
 
+// Frame is the protocol policy of the X52 Pro for the FrameEngine (see
+// x52_engine.h): the frame layout, the data bit windows and the desync rules.
+// The clients below are thin wrappers around its Poll and Send functions.
+//
+// A frame consists of 76 clock pulses on both C02 and C04:
+// the joystick state is sent over C03 in clock cycles 0..55, C01 is zero in
+// the desync detection cycle (56) and the joystick config is sent over C01
+// in clock cycles 57..75.
+template <typename HAL>
+class Frame {
+public:
+	enum {
+		NUM_CYCLES = 76,
+		DESYNC_CYCLE = JoystickState::NUM_BITS,
+		CONFIG_CYCLE = DESYNC_CYCLE + 1,
+	};
+
+	static_assert(CONFIG_CYCLE + JoystickConfig::NUM_BITS == NUM_CYCLES, "invalid frame layout");
+
+	// Poll is the frame transmission of the JoystickClient. The handler
+	// receives the groups of the state during the frame (see NoPartialState
+	// in x52_common.h).
+	template <typename Timing, typename PartialStateHandler>
+	static X52_FRAME_FUNC unsigned long Poll(Pins p, JoystickState& state, const JoystickConfig& cfg, unsigned long wait_micros,
+			Timing& timing, PartialStateHandler& handler) {
+		// C02 has to be LOW when this function returns.
+		//
+		// If X52_PRO_IMPROVED_JOYSTICK_CLIENT_DESYNC_DETECTION==1
+		// then C01 has to be HIGH when this function returns.
+
+		JoystickState::Binary recv_buf;
+		JoystickConfig::Binary send_buf;
+		cfg.ToBinary(send_buf);
+
+		// The frame is clocked in segments with their own hooks so the hot
+		// loops of the state and config bits don't test the cycle index.
+		PollFirstHooks first = {p, recv_buf, timing.FrameTimeout(X52_PRO_THROTTLE_TIMEOUT_MICROS), 0};
+		PollStateHooks<PartialStateHandler> state_hooks = {p.c03, recv_buf, handler};
+		PollDesyncHooks desync_hooks = {p.c01};
+		PollConfigHooks config_hooks = {p, send_buf};
+
+		// deadline for the whole frame transmission
+		unsigned long deadline = HAL::Micros() + wait_micros;
+
+		int i = 0;
+		int res = FrameEngine<HAL>::Lead(first, p.c02, HIGH, p.c04, HIGH, i, 1, deadline);
+		if (res == CyclesDone)
+			res = FrameEngine<HAL>::Lead(state_hooks, p.c02, HIGH, p.c04, HIGH, i, DESYNC_CYCLE, deadline);
+		if (res == CyclesDone)
+			res = FrameEngine<HAL>::Lead(desync_hooks, p.c02, HIGH, p.c04, HIGH, i, CONFIG_CYCLE, deadline);
+		if (res == CyclesDone)
+			res = FrameEngine<HAL>::Lead(config_hooks, p.c02, HIGH, p.c04, HIGH, i, NUM_CYCLES, deadline);
+		switch (res) {
+		case CyclesDone:
+			if (Timing::LEARNS)
+				timing.FrameDone(HAL::Micros() - first.start);
+			state.SetFromBinary(recv_buf);
+			return 0;
+
+		case FirstEdgeTimeout:
+			X52DebugLog("Error waiting for C04=1. Clock cycle: ", i);
+#if X52_PRO_IMPROVED_JOYSTICK_CLIENT_DESYNC_DETECTION
+			if (i >= CONFIG_CYCLE)
+				HAL::Write(p.c01, HIGH);
+#endif
+			// Timing out with i==0 means that the joystick didn't respond to our
+			// initial C02=1 request within the available time frame defined by `wait_micros`.
+			if (i == 0)
+				return 1;
+			// We are in the middle of a frame (already started talking with the joystick).
+			// This means that the joystick will also time out and the throttle should
+			// should try to initiate a new frame only after the joystick's timeout.
+			timing.FrameTimedOut(X52_PRO_THROTTLE_TIMEOUT_MICROS);
+			return X52_PRO_THROTTLE_UNRESPONSIVE_MICROS;
+
+		case SecondEdgeTimeout:
+			X52DebugLog("Error waiting for C04=0. Clock cycle: ", i);
+			timing.FrameTimedOut(X52_PRO_THROTTLE_TIMEOUT_MICROS);
+			return X52_PRO_THROTTLE_UNRESPONSIVE_MICROS;
+
+		default:
+			X52DebugLog("The joystick marked the frame invalid after a resync.");
+			return 1;
+		}
+	}
+
+	// Send is the frame transmission of the ThrottleClient. The state is
+	// either an encoded JoystickState::Binary or a PreEncodedState (see
+	// x52_common.h) that is read when the throttle's poll arrives.
+	template <typename StateSource>
+	static X52_FRAME_FUNC unsigned long Send(Pins p, const StateSource& state, JoystickConfig& cfg, unsigned long wait_micros) {
+		JoystickConfig::Binary recv_buf;
+		JoystickState::Binary latest;
+
+		// waiting for the throttle's poll
+		if (!HAL::WaitForPinState(p.c02, HIGH, HAL::Micros()+wait_micros))
+			return 1;
+
+		unsigned long deadline = HAL::Micros() + X52_PRO_JOYSTICK_TIMEOUT_MICROS;
+
+		int i = 0;
+#if X52_PRO_FAST_RESYNC
+		// The resync jumps to clock cycle 56 from anywhere so the whole frame
+		// is a single loop.
+		ResyncSendHooks hooks = {p, SendState(state, latest), recv_buf, false, false};
+		int res = FrameEngine<HAL>::Lead(hooks, p.c04, HIGH, p.c02, LOW, i, NUM_CYCLES, deadline);
+#else
+		// The frame is clocked in segments with their own hooks like the
+		// Poll of the JoystickClient.
+		SendStateHooks<false> first = {p, SendState(state, latest)};
+		SendStateHooks<true> state_hooks = {p, first.send_buf};
+		SendDesyncHooks desync_hooks = {p.c01};
+		SendConfigHooks config_hooks = {p.c01, recv_buf};
+		int res = FrameEngine<HAL>::Lead(first, p.c04, HIGH, p.c02, LOW, i, 1, deadline);
+		if (res == CyclesDone)
+			res = FrameEngine<HAL>::Lead(state_hooks, p.c04, HIGH, p.c02, LOW, i, DESYNC_CYCLE, deadline);
+		if (res == CyclesDone)
+			res = FrameEngine<HAL>::Lead(desync_hooks, p.c04, HIGH, p.c02, LOW, i, CONFIG_CYCLE, deadline);
+		if (res == CyclesDone)
+			res = FrameEngine<HAL>::Lead(config_hooks, p.c04, HIGH, p.c02, LOW, i, NUM_CYCLES, deadline);
+#endif
+		switch (res) {
+		case CyclesDone:
+#if X52_PRO_FAST_RESYNC
+			// We are in sync with the throttle again but this frame was garbage.
+			if (hooks.resynced)
+				return 1;
+#endif
+			cfg.SetFromBinary(recv_buf);
+			return 0;
+
+		case FirstEdgeTimeout:
+			X52DebugLog("Error waiting for C02=0. Clock cycle: ", i);
+			return X52_PRO_JOYSTICK_UNRESPONSIVE_MICROS;
+
+		case SecondEdgeTimeout:
+			X52DebugLog("Error waiting for C02=1. Clock cycle: ", i);
+			return X52_PRO_JOYSTICK_UNRESPONSIVE_MICROS;
+
+		default:
+			return X52_PRO_JOYSTICK_DESYNC_UNRESPONSIVE_MICROS;
+		}
+	}
+
+private:
+	enum {
+		FrameMarkedInvalid = FirstHookResult,
+		DesyncDetected = FirstHookResult,
+	};
+
+	// CompleteGroups returns the StateGroups received by the end of clock cycle i.
+	static uint8_t CompleteGroups(int i) {
+		return uint8_t((i >= 17 ? StateX : 0) | (i >= 19 ? StateY : 0) | (i >= 31 ? StateZ : 0) |
+			(i >= 35 ? StatePov1 : 0) | (i >= 39 ? StatePov2 : 0) | (i >= 55 ? StateButtons : 0));
+	}
+
+	// PollFirstHooks clocks cycle 0 of a poll: the joystick's answer starts
+	// the frame timeout.
+	struct PollFirstHooks {
+		Pins p;
+		JoystickState::Binary& recv_buf;
+		unsigned long frame_timeout;
+		unsigned long start;  // the first falling edge of C02
+
+		void Begin(int) {}
+
+		int Middle(int&, unsigned long& deadline) {
+			// The original throttle times out if the whole frame isn't
+			// transmitted within X52_PRO_THROTTLE_TIMEOUT_MICROS
+			// measured from the first falling edge of C02 (the timing
+			// policy of the client may shorten it).
+			// The previous deadline value was set up using `wait_micros`,
+			// that timeout applies only to the first rising edge of C04.
+			start = HAL::Micros();
+			deadline = start + frame_timeout;
+			return 0;
+		}
+
+		int End(int) {
+			// The original throttle samples C03 here between the
+			// falling edge of C04 and the rising edge of C02.
+			recv_buf.SetBit(0, bool(HAL::Read(p.c03)));
+#if !X52_PRO_IMPROVED_JOYSTICK_CLIENT_DESYNC_DETECTION
+			// This is what the original throttle does at the start of
+			// cycle 1 but we have a potentially better solution.
+			HAL::Write(p.c01, HIGH);
+#endif
+			return 0;
+		}
+	};
+
+	// PollStateHooks clocks the cycles 1..55 of a poll: the state bits.
+	template <typename PartialStateHandler>
+	struct PollStateHooks {
+		uint8_t c03;
+		JoystickState::Binary& recv_buf;
+		PartialStateHandler& handler;
+
+		void Begin(int) {}
+		int Middle(int&, unsigned long&) { return 0; }
+
+		X52_ALWAYS_INLINE int End(int i) {
+			recv_buf.SetBit(i, bool(HAL::Read(c03)));
+			// the last bits of x (bits 0..7 and 16..17), y (8..15 and 18..19),
+			// z (22..23 and 24..31), pov_1, pov_2 and the buttons and the mode
+			if (PartialStateEnabled<PartialStateHandler>::value &&
+					(i == 17 || i == 19 || i == 31 || i == 35 || i == 39 || i == 55))
+				handler.OnPartialState(JoystickStateView(recv_buf), CompleteGroups(i));
+			return 0;
+		}
+	};
+
+	// PollDesyncHooks clocks the desync detection cycle of a poll.
+	struct PollDesyncHooks {
+		uint8_t c01;
+
+		void Begin(int) {}
+
+		int Middle(int&, unsigned long&) {
+			HAL::Write(c01, LOW);  // desync detection: the joystick becomes unresponsive if this isn't LOW
+			return 0;
+		}
+
+		int End(int) { return 0; }
+	};
+
+	// PollConfigHooks clocks the cycles 57..75 of a poll: the config bits.
+	struct PollConfigHooks {
+		Pins p;
+		const JoystickConfig::Binary& send_buf;
+
+		X52_ALWAYS_INLINE void Begin(int i) {
+			HAL::Write(p.c01, send_buf.Bit(i-CONFIG_CYCLE));
+			// The original joystick samples C01 after this between the
+			// rising edge of C02 and the rising edge of C04.
+		}
+
+		X52_ALWAYS_INLINE int Middle(int&, unsigned long&) {
+#if X52_PRO_IMPROVED_JOYSTICK_CLIENT_DESYNC_DETECTION
+			// The original throttle doesn't do this but perhaps it should
+			// because this makes desync detection more reliable.
+			// The last clock cycle of the frame ends with C01=HIGH
+			// and C01 stays that way until the i==56 of the next frame.
+			HAL::Write(p.c01, HIGH);
+#endif
+			return 0;
+		}
+
+		X52_ALWAYS_INLINE int End(int i) {
+#if X52_PRO_FAST_RESYNC
+			if (i == NUM_CYCLES-1 && !HAL::Read(p.c03))
+				return FrameMarkedInvalid;
+#else
+			(void)i;
+#endif
+			return 0;
+		}
+	};
+
+	static const JoystickState::Binary& SendState(const JoystickState::Binary& state, JoystickState::Binary&) {
+		return state;
+	}
+
+	static const JoystickState::Binary& SendState(const PreEncodedState<JoystickState>& state, JoystickState::Binary& latest) {
+		state.Get(latest);
+		return latest;
+	}
+
+#if X52_PRO_FAST_RESYNC
+	// ResyncSendHooks clocks the whole frame of a send: the resync can move
+	// the cycle index.
+	struct ResyncSendHooks {
+		Pins p;
+		const JoystickState::Binary& send_buf;
+		JoystickConfig::Binary& recv_buf;
+		bool resynced;  // the frame contains garbage
+		bool searching;  // looking for the desync detection bit
+
+		void Begin(int i) {
+			if (i < JoystickState::NUM_BITS) {
+				HAL::Write(p.c03, send_buf.Bit(i));
+			} else {
+				if (i >= CONFIG_CYCLE)
+					// The original joystick samples C01 here between the
+					// rising edge of C02 and the rising edge of C04.
+					recv_buf.SetBit(i-CONFIG_CYCLE, bool(HAL::Read(p.c01)));
+				// The frame validity marker sampled by the JoystickClient in clock cycle #75.
+				HAL::Write(p.c03, !resynced);
+			}
+		}
+
+		int Middle(int& i, unsigned long&) {
+			// The desync detection bit is zero only in clock cycle #56 of the
+			// throttle's frame so it tells us where the throttle is.
+			if (!HAL::Read(p.c01)) {
+				if (i != DESYNC_CYCLE || searching) {
+					X52DebugLog("Desync detected: resyncing to clock cycle 56 from clock cycle: ", i);
+					resynced = true;
+					searching = false;
+					HAL::Write(p.c03, LOW);
+					i = DESYNC_CYCLE;
+				}
+			} else if (i == DESYNC_CYCLE || (searching && i == NUM_CYCLES-1)) {
+				// The throttle isn't in clock cycle #56 but we don't know where
+				// it is so we keep ticking until the desync detection bit arrives.
+				if (!searching) {
+					X52DebugLog("Desync detected: bit 56 isn't zero. Searching for the desync detection bit.");
+					resynced = true;
+					searching = true;
+					HAL::Write(p.c03, LOW);
+				}
+				i = DESYNC_CYCLE;
+			}
+			// The original throttle samples C03 after this between the
+			// falling edge of C04 and the rising edge of C02.
+			return 0;
+		}
+
+		int End(int) { return 0; }
+	};
+#else
+	// SendStateHooks clocks the state bits of a send (cycle 0 without
+	// and the cycles 1..55 with DESYNC_CHECK).
+	template <bool DESYNC_CHECK>
+	struct SendStateHooks {
+		Pins p;
+		const JoystickState::Binary& send_buf;
+
+		X52_ALWAYS_INLINE void Begin(int i) {
+			HAL::Write(p.c03, send_buf.Bit(i));
+		}
+
+		X52_ALWAYS_INLINE int Middle(int& i, unsigned long&) {
+#if X52_PRO_IMPROVED_THROTTLE_CLIENT_DESYNC_DETECTION
+			// This is something that the original joystick doesn't do.
+			// This method leads to very quick and reliable desync detection.
+			// It's based on the assumption that the X52 Pro always sends
+			// ones over C01 while the joystick is sending its state over C03.
+			if (DESYNC_CHECK && !HAL::Read(p.c01)) {
+				X52DebugLog("Desync detected: bits 1..55 aren't all ones. Timing out to force a resync. Clock cycle: ", i);
+				return DesyncDetected;
+			}
+#endif
+			// The original throttle samples C03 after this between the
+			// falling edge of C04 and the rising edge of C02.
+			(void)i;
+			return 0;
+		}
+
+		int End(int) { return 0; }
+	};
+
+	// SendDesyncHooks clocks the desync detection cycle of a send.
+	struct SendDesyncHooks {
+		uint8_t c01;
+
+		void Begin(int) {}
+
+		int Middle(int&, unsigned long&) {
+			// This is something that the original joystick also does.
+			if (HAL::Read(c01)) {
+				X52DebugLog("Desync detected: bit 56 isn't zero. Timing out to force a resync.");
+				return DesyncDetected;
+			}
+			return 0;
+		}
+
+		int End(int) { return 0; }
+	};
+
+	// SendConfigHooks clocks the cycles 57..75 of a send: the config bits.
+	struct SendConfigHooks {
+		uint8_t c01;
+		JoystickConfig::Binary& recv_buf;
+
+		X52_ALWAYS_INLINE void Begin(int i) {
+			// The original joystick samples C01 here between the
+			// rising edge of C02 and the rising edge of C04.
+			recv_buf.SetBit(i-CONFIG_CYCLE, bool(HAL::Read(c01)));
+		}
+
+		int Middle(int&, unsigned long&) { return 0; }
+		int End(int) { return 0; }
+	};
+#endif
+};
+
+
 // JoystickClient makes it possible to use some of your Arduino pins as a
 // connection to the PS/2 socket of an X52 Pro Joystick.
 //
@@ -302,21 +775,22 @@ inline void JoystickState::ToBinary(Binary& b) const {
 //
 // My X52 Pro throttle uses 4.1-4.2V for both power and GPIO but the joystick
 // works with 3.3V too.
-template <int PIN_C01, int PIN_C02, int PIN_C03, int PIN_C04>
+template <int PIN_C01, int PIN_C02, int PIN_C03, int PIN_C04, typename HAL=ArduinoHAL, typename Timing=DefaultTiming>
 class JoystickClient {
 public:
 	// Call Setup from the setup function of your Arduino project to initialize
 	// a JoystickClient instance.
 	void Setup() {
-		pinMode(PIN_C01, OUTPUT);
-		pinMode(PIN_C02, OUTPUT);
+		HAL::PinMode(PIN_C01, OUTPUT);
+		HAL::PinMode(PIN_C02, OUTPUT);
 		// On the teensy the digitalWrite seems to work only after pinMode.
-		digitalWrite(PIN_C02, LOW);
+		HAL::Write(PIN_C02, LOW);
 #if X52_PRO_IMPROVED_JOYSTICK_CLIENT_DESYNC_DETECTION
-		digitalWrite(PIN_C01, HIGH);
+		HAL::Write(PIN_C01, HIGH);
 #endif
-		pinMode(PIN_C03, INPUT);
-		pinMode(PIN_C04, INPUT);
+		HAL::PinMode(PIN_C03, INPUT);
+		HAL::PinMode(PIN_C04, INPUT);
+		HAL::SetupWaitPin(PIN_C04);
 	}
 
 	// PollJoystickState polls the joystick for its state. It creates a frame
@@ -328,91 +802,34 @@ public:
 	// of microseconds to wait before calling PollJoystickState again.
 	// In that situation the value of the JoystickState is undefined.
 	unsigned long PollJoystickState(JoystickState& state, const JoystickConfig& cfg, unsigned long wait_micros=X52_PRO_DEFAULT_POLL_JOYSTICK_STATE_WAIT_MICROS) {
-		// PIN_C02 has to be LOW when this function returns.
-		//
-		// If X52_PRO_IMPROVED_JOYSTICK_CLIENT_DESYNC_DETECTION==1
-		// then PIN_C01 has to be HIGH when this function returns.
-
-		JoystickState::Binary recv_buf;
-		JoystickConfig::Binary send_buf;
-		cfg.ToBinary(send_buf);
-
-		// deadline for the whole frame transmission
-		unsigned long deadline = micros() + wait_micros;
-
-		// A frame consists of 76 clock pulses on both C02 and C04.
-		for (int i=0; i<76; i++) {
-#if !X52_PRO_IMPROVED_JOYSTICK_CLIENT_DESYNC_DETECTION
-			// This is what the original throttle does but we have a potentially better solution.
-			if (i == 1)
-				digitalWrite(PIN_C01, HIGH);
-			else
-#endif
-			if (i >= 57)
-				digitalWrite(PIN_C01, send_buf.Bit(i-57));
-
-			digitalWrite(PIN_C02, HIGH);
-
-			// The original joystick samples C01 here between the
-			// rising edge of C02 and the rising edge of C04.
-
-			if (!wait_for_pin_state(PIN_C04, HIGH, deadline)) {
-				X52DebugPrint("Error waiting for C04=1. Clock cycle: ");
-				X52DebugPrintln(i);
-#if X52_PRO_IMPROVED_JOYSTICK_CLIENT_DESYNC_DETECTION
-				if (i >= 57)
-					digitalWrite(PIN_C01, HIGH);
-#endif
-				digitalWrite(PIN_C02, LOW);
-				// Timing out with i==0 means that the joystick didn't respond to our
-				// initial C02=1 request within the available time frame defined by `wait_micros`.
-				if (i == 0)
-					return 1;
-				// We are in the middle of a frame (already started talking with the joystick).
-				// This means that the joystick will also time out and the throttle should
-				// should try to initiate a new frame only after the joystick's timeout.
-				return X52_PRO_THROTTLE_UNRESPONSIVE_MICROS;
-			}
-
-			if (i == 0)
-				// The original throttle times out if the whole frame isn't
-				// transmitted within X52_PRO_THROTTLE_TIMEOUT_MICROS
-				// measured from the first falling edge of C02.
-				// The previous deadline value was set up using `wait_micros`,
-				// that timeout applies only to the first rising edge of C04.
-				deadline = micros() + X52_PRO_THROTTLE_TIMEOUT_MICROS;
-			else if (i == 56)
-				digitalWrite(PIN_C01, LOW);  // desync detection: the joystick becomes unresponsive if this isn't LOW
-#if X52_PRO_IMPROVED_JOYSTICK_CLIENT_DESYNC_DETECTION
-			// The original throttle doesn't do this but perhaps it should
-			// because this makes desync detection more reliable.
-			// The last iteration of this for loop ends with C01=HIGH
-			// and C01 stays that way until the i==56 of the next frame.
-			else if (i >= 57)
-				digitalWrite(PIN_C01, HIGH);
-#endif
-
-			digitalWrite(PIN_C02, LOW);
-
-			if (!wait_for_pin_state(PIN_C04, LOW, deadline)) {
-				X52DebugPrint("Error waiting for C04=0. Clock cycle: ");
-				X52DebugPrintln(i);
-				return X52_PRO_THROTTLE_UNRESPONSIVE_MICROS;
-			}
-
-			// The original throttle samples C03 here between the
-			// falling edge of C04 and the rising edge of C02.
-			if (i < JoystickState::NUM_BITS)
-				recv_buf.SetBit(i, bool(digitalRead(PIN_C03)));
-		}
+		NoPartialState handler;
+		return PollJoystickState(state, cfg, handler, wait_micros);
+	}
 
-		state.SetFromBinary(recv_buf);
-		return 0;
+	// This PollJoystickState passes the groups of the state to the handler
+	// as soon as they are received (see NoPartialState in x52_common.h):
+	// x and y are available after 20 of the 76 clock cycles of the frame.
+	// The Pro frame has no checksum so they become final only when this
+	// function returns zero.
+	template <typename PartialStateHandler>
+	unsigned long PollJoystickState(JoystickState& state, const JoystickConfig& cfg, PartialStateHandler& handler,
+			unsigned long wait_micros=X52_PRO_DEFAULT_POLL_JOYSTICK_STATE_WAIT_MICROS) {
+		Pins p = {PIN_C01, PIN_C02, PIN_C03, PIN_C04};
+		return Frame<HAL>::Poll(p, state, cfg, wait_micros, m_Timing, handler);
 	}
 
 	void PrepareForPoll() {
-		digitalWrite(PIN_C02, HIGH);
+		HAL::Write(PIN_C02, HIGH);
 	}
+
+	// GetTiming returns the timing policy (see x52_common.h) of the client,
+	// e.g. to persist or restore the values learned by a TimingProfile.
+	Timing& GetTiming() {
+		return m_Timing;
+	}
+
+private:
+	Timing m_Timing;
 };
 
 
@@ -420,18 +837,19 @@ public:
 // connection to the PS/2 socket of an X52 Pro Throttle.
 //
 // The pin config is the same as that of the JoystickClient.
-template <int PIN_C01, int PIN_C02, int PIN_C03, int PIN_C04>
+template <int PIN_C01, int PIN_C02, int PIN_C03, int PIN_C04, typename HAL=ArduinoHAL>
 class ThrottleClient {
 public:
 	// Call Setup from the setup function of your Arduino project to initialize
 	// a ThrottleClient instance.
 	void Setup() {
-		pinMode(PIN_C01, INPUT);
-		pinMode(PIN_C02, INPUT);
-		pinMode(PIN_C03, OUTPUT);
-		pinMode(PIN_C04, OUTPUT);
+		HAL::PinMode(PIN_C01, INPUT);
+		HAL::PinMode(PIN_C02, INPUT);
+		HAL::PinMode(PIN_C03, OUTPUT);
+		HAL::PinMode(PIN_C04, OUTPUT);
 		// On the teensy the digitalWrite seems to work only after pinMode.
-		digitalWrite(PIN_C04, LOW);
+		HAL::Write(PIN_C04, LOW);
+		HAL::SetupWaitPin(PIN_C02);
 	}
 
 	// SendJoystickState sends the JoystickState to the throttle and receives
@@ -442,71 +860,18 @@ public:
 	// to wait before calling SendJoystickState again. In that situation the
 	// value of the JoystickConfig is undefined.
 	unsigned long SendJoystickState(const JoystickState& state, JoystickConfig& cfg, unsigned long wait_micros=X52_PRO_DEFAULT_SEND_JOYSTICK_STATE_WAIT_MICROS) {
-		// waiting for the throttle's poll
-		if (!wait_for_pin_state(PIN_C02, HIGH, micros()+wait_micros))
-			return 1;
-
-		JoystickConfig::Binary recv_buf;
+		Pins p = {PIN_C01, PIN_C02, PIN_C03, PIN_C04};
+		// encoding before the wait keeps it out of the throttle's response window
 		JoystickState::Binary send_buf;
 		state.ToBinary(send_buf);
+		return Frame<HAL>::Send(p, send_buf, cfg, wait_micros);
+	}
 
-		auto deadline = micros() + X52_PRO_JOYSTICK_TIMEOUT_MICROS;
-
-		// A frame consists of 76 clock pulses on both C02 and C04.
-		for (int i=0; i<76; i++) {
-			if (i < JoystickState::NUM_BITS)
-				digitalWrite(PIN_C03, send_buf.Bit(i));
-			else if (i >= 57)
-				// The original joystick samples C01 here between the
-				// rising edge of C02 and the rising edge of C04.
-				recv_buf.SetBit(i-57, bool(digitalRead(PIN_C01)));
-
-			digitalWrite(PIN_C04, HIGH);
-
-			if (!wait_for_pin_state(PIN_C02, LOW, deadline)) {
-				X52DebugPrint("Error waiting for C02=0. Clock cycle: ");
-				X52DebugPrintln(i);
-				digitalWrite(PIN_C04, LOW);
-				return X52_PRO_JOYSTICK_UNRESPONSIVE_MICROS;
-			}
-
-#if X52_PRO_IMPROVED_THROTTLE_CLIENT_DESYNC_DETECTION
-			if (i >= 1 && i <= 55) {
-				// This is something that the original joystick doesn't do.
-				// This method leads to very quick and reliable desync detection.
-				// It's based on the assumption that the X52 Pro always sends
-				// ones over C01 while the joystick is sending its state over C03.
-				if (!digitalRead(PIN_C01)) {
-					X52DebugPrint("Desync detected: bits 1..55 aren't all ones. Timing out to force a resync. Clock cycle: ");
-					X52DebugPrintln(i);
-					digitalWrite(PIN_C04, LOW);
-					return X52_PRO_JOYSTICK_DESYNC_UNRESPONSIVE_MICROS;
-				}
-			} else
-#endif
-			if (i == 56) {
-				// This is something that the original joystick also does.
-				if (digitalRead(PIN_C01)) {
-					X52DebugPrintln("Desync detected: bit 56 isn't zero. Timing out to force a resync.");
-					digitalWrite(PIN_C04, LOW);
-					return X52_PRO_JOYSTICK_DESYNC_UNRESPONSIVE_MICROS;
-				}
-			}
-
-			digitalWrite(PIN_C04, LOW);
-
-			// The original throttle samples C03 here between the
-			// falling edge of C04 and the rising edge of C02.
-
-			if (!wait_for_pin_state(PIN_C02, HIGH, deadline)) {
-				X52DebugPrint("Error waiting for C02=1. Clock cycle: ");
-				X52DebugPrintln(i);
-				return X52_PRO_JOYSTICK_UNRESPONSIVE_MICROS;
-			}
-		}
-
-		cfg.SetFromBinary(recv_buf);
-		return 0;
+	// SendLatestJoystickState is SendJoystickState with the state that was
+	// most recently published into the slot when the throttle's poll arrives.
+	unsigned long SendLatestJoystickState(const PreEncodedState<JoystickState>& slot, JoystickConfig& cfg, unsigned long wait_micros=X52_PRO_DEFAULT_SEND_JOYSTICK_STATE_WAIT_MICROS) {
+		Pins p = {PIN_C01, PIN_C02, PIN_C03, PIN_C04};
+		return Frame<HAL>::Send(p, slot, cfg, wait_micros);
 	}
 
 	// IsPollInProgress returns true if the throttle is waiting for the
@@ -514,7 +879,7 @@ public:
 	// a call to SendJoystickState is less likely to block in a waiting state
 	// (or fail as a result of wait timeout).
 	bool IsPollInProgress() {
-		return bool(digitalRead(PIN_C02));
+		return bool(HAL::Read(PIN_C02));
 	}
 };
 
@@ -0,0 +1,520 @@
+#pragma once
+
+#include "x52_pro.h"
+
+
+// This is the internal bus between the two MCUs of the X52 Pro joystick:
+// the main-MCU (on the mainboard in the base) and the handle-MCU (in the
+// handle). The protocol is described in docs/X52-Pro.md.
+
+
+// This value is hardcoded into the firmware of my original X52 Pro handle:
+// a frame transmission request (D0=1) times out after this period.
+#ifndef X52_PRO_HANDLE_REQUEST_TIMEOUT_MICROS
+	#define X52_PRO_HANDLE_REQUEST_TIMEOUT_MICROS 60000
+#endif
+
+// This value is hardcoded into the firmware of my original X52 Pro handle:
+// the length of the D0=0 gap after a timed out request.
+#ifndef X52_PRO_HANDLE_REQUEST_GAP_MICROS
+	#define X52_PRO_HANDLE_REQUEST_GAP_MICROS 650
+#endif
+
+// The timeout of a frame transmission request (CLK=1) sent by the HandleClient.
+// It has to be lower than X52_PRO_HANDLE_REQUEST_TIMEOUT_MICROS: if the two
+// sides request a frame at the same time then the HandleClient gives up first
+// so the (more important) HandleState frame of the handle wins the collision.
+#ifndef X52_PRO_DEFAULT_SEND_HANDLE_CONFIG_WAIT_MICROS
+	#define X52_PRO_DEFAULT_SEND_HANDLE_CONFIG_WAIT_MICROS 20000
+#endif
+
+#if X52_PRO_DEFAULT_SEND_HANDLE_CONFIG_WAIT_MICROS >= X52_PRO_HANDLE_REQUEST_TIMEOUT_MICROS
+	#error X52_PRO_DEFAULT_SEND_HANDLE_CONFIG_WAIT_MICROS has to be lower than X52_PRO_HANDLE_REQUEST_TIMEOUT_MICROS
+#endif
+
+// The whole frame has to be transmitted within this period after the
+// first handshake. I didn't measure the timeout of the original MCUs.
+#ifndef X52_PRO_HANDLE_FRAME_TIMEOUT_MICROS
+	#define X52_PRO_HANDLE_FRAME_TIMEOUT_MICROS 5000
+#endif
+
+// The recommended wait after a frame that failed in the middle:
+// it lets the other side time out too.
+#ifndef X52_PRO_HANDLE_UNRESPONSIVE_MICROS
+	#define X52_PRO_HANDLE_UNRESPONSIVE_MICROS (X52_PRO_HANDLE_FRAME_TIMEOUT_MICROS + 1000)
+#endif
+
+#ifndef X52_PRO_DEFAULT_RECEIVE_HANDLE_STATE_WAIT_MICROS
+	#define X52_PRO_DEFAULT_RECEIVE_HANDLE_STATE_WAIT_MICROS 25000
+#endif
+
+#ifndef X52_PRO_DEFAULT_RECEIVE_HANDLE_CONFIG_WAIT_MICROS
+	#define X52_PRO_DEFAULT_RECEIVE_HANDLE_CONFIG_WAIT_MICROS 25000
+#endif
+
+
+namespace x52 {
+namespace pro {
+
+
+// HandleState is the data sent by the handle-MCU to the main-MCU.
+// Its binary format is the same as that of bits 32..49 of the JoystickState.
+struct HandleState {
+	Direction pov_1;
+	Direction pov_2;
+	Mode mode;
+
+	bool trigger_stage_1: 1;
+	bool trigger_stage_2: 1;
+	bool pinkie_switch: 1;
+	bool button_fire: 1;
+	bool button_a: 1;
+	bool button_b: 1;
+	bool button_c: 1;
+
+	HandleState() {
+		memset(this, 0, sizeof(*this));
+	}
+
+	// Constructor for the pros who believe they know what they are doing.
+	HandleState(Uninitialized) {}
+
+	static constexpr int NUM_BITS = 18;
+	typedef BitField<NUM_BITS> Binary;
+
+	void SetFromBinary(const Binary&);
+	void ToBinary(Binary&) const;
+
+	// These copy the handle related fields between a HandleState and a JoystickState.
+	void SetFromJoystickState(const JoystickState&);
+	void ToJoystickState(JoystickState&) const;
+};
+
+
+// HandleConfig is the data sent by the main-MCU to the handle-MCU.
+// Its binary format is the same as that of bits 6..10 of the JoystickConfig.
+// The other LEDs of the handle are controlled directly by the main-MCU.
+struct HandleConfig {
+	bool button_fire_led;
+
+	LEDColor pov_2_led: 2;
+	LEDColor button_a_led: 2;
+
+	HandleConfig() {
+		button_fire_led = true;
+		pov_2_led = Green;
+		button_a_led = Green;
+	}
+
+	// Constructor for the pros who believe they know what they are doing.
+	HandleConfig(Uninitialized) {}
+
+	static constexpr int NUM_BITS = 5;
+	typedef BitField<NUM_BITS> Binary;
+
+	void SetFromBinary(const Binary&);
+	void ToBinary(Binary&) const;
+
+	// These copy the handle related fields between a HandleConfig and a JoystickConfig.
+	void SetFromJoystickConfig(const JoystickConfig&);
+	void ToJoystickConfig(JoystickConfig&) const;
+};
+
+
+inline void HandleState::SetFromBinary(const Binary& b) {
+	switch (b.UInt(0, 4)) {
+		case 1: pov_1 = Down; break;
+		case 2: pov_1 = DownRight; break;
+		case 3: pov_1 = Right; break;
+		case 4: pov_1 = UpRight; break;
+		case 5: pov_1 = Up; break;
+		case 6: pov_1 = UpLeft; break;
+		case 7: pov_1 = Left; break;
+		case 8: pov_1 = DownLeft; break;
+		default: pov_1 = NoDirection; break;
+	}
+
+	pov_2 = Direction(
+		(-b.Bit(4) & Up) |
+		(-b.Bit(5) & Right) |
+		(-b.Bit(6) & Down) |
+		(-b.Bit(7) & Left)
+	);
+
+	switch (b.UInt(13, 3)) {
+		case 1: mode = Mode1; break;
+		case 2: mode = Mode2; break;
+		case 4: mode = Mode3; break;
+		default: mode = ModeUndefined; break;
+	}
+
+	trigger_stage_1 = b.Bit(8);
+	button_fire = b.Bit(9);
+	button_a = b.Bit(10);
+	button_c = b.Bit(11);
+	trigger_stage_2 = b.Bit(12);
+	button_b = b.Bit(16);
+	pinkie_switch = b.Bit(17);
+}
+
+
+inline void HandleState::ToBinary(Binary& b) const {
+	uint8_t pov;
+	switch (pov_1) {
+		case Down: pov = 1; break;
+		case DownRight: pov = 2; break;
+		case Right: pov = 3; break;
+		case UpRight: pov = 4; break;
+		case Up: pov = 5; break;
+		case UpLeft: pov = 6; break;
+		case Left: pov = 7; break;
+		case DownLeft: pov = 8; break;
+		default: pov = 0; break;
+	}
+	b.SetUInt(0, 4, pov);
+
+	b.SetBit(4, bool(pov_2 & Up));
+	b.SetBit(5, bool(pov_2 & Right));
+	b.SetBit(6, bool(pov_2 & Down));
+	b.SetBit(7, bool(pov_2 & Left));
+
+	b.SetBit(8, trigger_stage_1);
+	b.SetBit(9, button_fire);
+	b.SetBit(10, button_a);
+	b.SetBit(11, button_c);
+	b.SetBit(12, trigger_stage_2);
+	b.SetBit(13, mode == Mode1);
+	b.SetBit(14, mode == Mode2);
+	b.SetBit(15, mode == Mode3);
+	b.SetBit(16, button_b);
+	b.SetBit(17, pinkie_switch);
+}
+
+
+inline void HandleState::SetFromJoystickState(const JoystickState& s) {
+	pov_1 = s.pov_1;
+	pov_2 = s.pov_2;
+	mode = s.mode;
+	trigger_stage_1 = s.trigger_stage_1;
+	trigger_stage_2 = s.trigger_stage_2;
+	pinkie_switch = s.pinkie_switch;
+	button_fire = s.button_fire;
+	button_a = s.button_a;
+	button_b = s.button_b;
+	button_c = s.button_c;
+}
+
+
+inline void HandleState::ToJoystickState(JoystickState& s) const {
+	s.pov_1 = pov_1;
+	s.pov_2 = pov_2;
+	s.mode = mode;
+	s.trigger_stage_1 = trigger_stage_1;
+	s.trigger_stage_2 = trigger_stage_2;
+	s.pinkie_switch = pinkie_switch;
+	s.button_fire = button_fire;
+	s.button_a = button_a;
+	s.button_b = button_b;
+	s.button_c = button_c;
+}
+
+
+inline void HandleConfig::SetFromBinary(const Binary& b) {
+	button_a_led = LEDColor(b.UInt(0, 2));
+	pov_2_led = LEDColor(b.UInt(2, 2));
+	button_fire_led = !b.Bit(4);
+}
+
+
+inline void HandleConfig::ToBinary(Binary& b) const {
+	b.SetUInt(0, 2, button_a_led);
+	b.SetUInt(2, 2, pov_2_led);
+	b.SetBit(4, !button_fire_led);
+}
+
+
+inline void HandleConfig::SetFromJoystickConfig(const JoystickConfig& cfg) {
+	button_fire_led = cfg.button_fire_led;
+	pov_2_led = cfg.pov_2_led;
+	button_a_led = cfg.button_a_led;
+}
+
+
+inline void HandleConfig::ToJoystickConfig(JoystickConfig& cfg) const {
+	cfg.button_fire_led = button_fire_led;
+	cfg.pov_2_led = pov_2_led;
+	cfg.button_a_led = button_a_led;
+}
+
+
+// HandleClient makes it possible to use some of your Arduino pins as a
+// connection to the handle-MCU of an X52 Pro joystick in place of the
+// main-MCU. The handle-MCU sends a HandleState only when the state of its
+// buttons changes so this is a way to get the button edges right when they
+// happen instead of waiting for the next PS/2 frame.
+//
+// These pin names were printed on the mainboard of my X52 Pro joystick:
+//
+// PIN_CLK: clock output of the main-MCU (main → handle frames)
+// PIN_D:   data output of the main-MCU (main → handle frames)
+//          and clock output of the main-MCU (handle → main frames)
+// PIN_D0:  clock output of the handle-MCU (handle → main frames)
+// PIN_D1:  clock output of the handle-MCU (main → handle frames)
+//          and data output of the handle-MCU (handle → main frames)
+template <int PIN_CLK, int PIN_D, int PIN_D0, int PIN_D1>
+class HandleClient {
+public:
+	// Call Setup from the setup function of your Arduino project to initialize
+	// a HandleClient instance.
+	void Setup() {
+		pinMode(PIN_CLK, OUTPUT);
+		pinMode(PIN_D, OUTPUT);
+		// On the teensy the digitalWrite seems to work only after pinMode.
+		digitalWrite(PIN_CLK, LOW);
+		digitalWrite(PIN_D, LOW);
+		pinMode(PIN_D0, INPUT);
+		pinMode(PIN_D1, INPUT);
+		WaitStrategy::SetupPin(PIN_D0);
+		WaitStrategy::SetupPin(PIN_D1);
+	}
+
+	// ReceiveHandleState waits for a frame transmission request of the
+	// handle-MCU and receives the HandleState. Returns zero on success.
+	//
+	// A nonzero return value means error and gives the recommended number
+	// of microseconds to wait before calling ReceiveHandleState again.
+	// In that situation the value of the HandleState is undefined.
+	unsigned long ReceiveHandleState(HandleState& state, unsigned long wait_micros=X52_PRO_DEFAULT_RECEIVE_HANDLE_STATE_WAIT_MICROS) {
+		// PIN_D has to be LOW when this function returns.
+
+		// waiting for the handle's request
+		if (!WaitStrategy::WaitForPinState(PIN_D0, HIGH, micros()+wait_micros))
+			return 1;
+
+		HandleState::Binary recv_buf;
+		unsigned long deadline = micros() + X52_PRO_HANDLE_FRAME_TIMEOUT_MICROS;
+
+		// A frame consists of 21 clock pulses on both D0 and D. The first
+		// rising edge of D0 doesn't carry data and the last two data bits
+		// are always zero.
+		for (int i=0; i<21; i++) {
+			if (i > 0 && !WaitStrategy::WaitForPinState(PIN_D0, HIGH, deadline)) {
+				X52DebugLog("Error waiting for D0=1. Clock cycle: ", i);
+				return X52_PRO_HANDLE_UNRESPONSIVE_MICROS;
+			}
+
+			// The handle puts the data on D1 before the rising edge of D0.
+			if (i >= 1 && i-1 < HandleState::NUM_BITS)
+				recv_buf.SetBit(i-1, bool(digitalRead(PIN_D1)));
+
+			digitalWrite(PIN_D, HIGH);
+
+			if (!WaitStrategy::WaitForPinState(PIN_D0, LOW, deadline)) {
+				X52DebugLog("Error waiting for D0=0. Clock cycle: ", i);
+				digitalWrite(PIN_D, LOW);
+				return X52_PRO_HANDLE_UNRESPONSIVE_MICROS;
+			}
+
+			digitalWrite(PIN_D, LOW);
+		}
+
+		state.SetFromBinary(recv_buf);
+		return 0;
+	}
+
+	// SendHandleConfig sends the HandleConfig to the handle-MCU.
+	// Returns zero on success.
+	//
+	// The requests of the handle-MCU have priority: SendHandleConfig fails
+	// without doing anything if the handle is requesting a frame and the
+	// request of SendHandleConfig times out after `wait_micros` (that is
+	// lower than the request timeout of the handle) if the two requests
+	// collide. Call ReceiveHandleState after a failed SendHandleConfig.
+	//
+	// A nonzero return value means error and gives the recommended number
+	// of microseconds to wait before calling SendHandleConfig again.
+	unsigned long SendHandleConfig(const HandleConfig& cfg, unsigned long wait_micros=X52_PRO_DEFAULT_SEND_HANDLE_CONFIG_WAIT_MICROS) {
+		// PIN_CLK and PIN_D have to be LOW when this function returns.
+
+		if (IsHandleStateAvailable() || digitalRead(PIN_D1))
+			return 1;
+
+		HandleConfig::Binary send_buf;
+		cfg.ToBinary(send_buf);
+
+		// deadline for the request
+		unsigned long deadline = micros() + wait_micros;
+
+		// A frame consists of 6 clock pulses on both CLK and D1. The first
+		// rising edge of CLK doesn't carry data.
+		for (int i=0; i<6; i++) {
+			if (i >= 1)
+				digitalWrite(PIN_D, send_buf.Bit(i-1));
+
+			digitalWrite(PIN_CLK, HIGH);
+
+			if (!WaitStrategy::WaitForPinState(PIN_D1, HIGH, deadline)) {
+				X52DebugLog("Error waiting for D1=1. Clock cycle: ", i);
+				digitalWrite(PIN_CLK, LOW);
+				digitalWrite(PIN_D, LOW);
+				// Timing out with i==0 means that the handle didn't respond to
+				// our request: it is probably waiting for us to receive its frame.
+				if (i == 0)
+					return 1;
+				return X52_PRO_HANDLE_UNRESPONSIVE_MICROS;
+			}
+
+			if (i == 0)
+				deadline = micros() + X52_PRO_HANDLE_FRAME_TIMEOUT_MICROS;
+
+			digitalWrite(PIN_CLK, LOW);
+
+			if (!WaitStrategy::WaitForPinState(PIN_D1, LOW, deadline)) {
+				X52DebugLog("Error waiting for D1=0. Clock cycle: ", i);
+				digitalWrite(PIN_D, LOW);
+				return X52_PRO_HANDLE_UNRESPONSIVE_MICROS;
+			}
+		}
+
+		// D is zeroed out where the 7th rising edge of CLK would come.
+		digitalWrite(PIN_D, LOW);
+		return 0;
+	}
+
+	// IsHandleStateAvailable returns true if the handle-MCU is requesting
+	// a frame transmission. In that situation a call to ReceiveHandleState
+	// doesn't have to wait for the request.
+	bool IsHandleStateAvailable() {
+		return bool(digitalRead(PIN_D0));
+	}
+};
+
+
+// MainboardClient makes it possible to use some of your Arduino pins as a
+// connection to the main-MCU of an X52 Pro joystick in place of the
+// handle-MCU.
+//
+// The pin config is the same as that of the HandleClient.
+template <int PIN_CLK, int PIN_D, int PIN_D0, int PIN_D1>
+class MainboardClient {
+public:
+	// Call Setup from the setup function of your Arduino project to initialize
+	// a MainboardClient instance.
+	void Setup() {
+		pinMode(PIN_CLK, INPUT);
+		pinMode(PIN_D, INPUT);
+		pinMode(PIN_D0, OUTPUT);
+		pinMode(PIN_D1, OUTPUT);
+		// On the teensy the digitalWrite seems to work only after pinMode.
+		digitalWrite(PIN_D0, LOW);
+		digitalWrite(PIN_D1, LOW);
+		WaitStrategy::SetupPin(PIN_CLK);
+		WaitStrategy::SetupPin(PIN_D);
+	}
+
+	// SendHandleState sends the HandleState to the main-MCU. The original
+	// handle-MCU does this only when the state of its buttons changes.
+	// Returns zero on success.
+	//
+	// A nonzero return value means error and gives the recommended number
+	// of microseconds to wait before calling SendHandleState again.
+	unsigned long SendHandleState(const HandleState& state, unsigned long wait_micros=X52_PRO_HANDLE_REQUEST_TIMEOUT_MICROS) {
+		// PIN_D0 and PIN_D1 have to be LOW when this function returns.
+
+		HandleState::Binary send_buf;
+		state.ToBinary(send_buf);
+
+		// deadline for the request
+		unsigned long deadline = micros() + wait_micros;
+
+		if (!WaitStrategy::WaitForPinState(PIN_D, LOW, deadline))
+			return 1;
+
+		// A frame consists of 21 clock pulses on both D0 and D. The first
+		// rising edge of D0 doesn't carry data and the original handle sends
+		// zeros in the last two clock cycles.
+		for (int i=0; i<21; i++) {
+			if (i >= 1)
+				digitalWrite(PIN_D1, i-1 < HandleState::NUM_BITS && send_buf.Bit(i-1));
+
+			digitalWrite(PIN_D0, HIGH);
+
+			if (!WaitStrategy::WaitForPinState(PIN_D, HIGH, deadline)) {
+				X52DebugLog("Error waiting for D=1. Clock cycle: ", i);
+				digitalWrite(PIN_D0, LOW);
+				digitalWrite(PIN_D1, LOW);
+				// This is what the original handle does after a timed out request.
+				if (i == 0)
+					return X52_PRO_HANDLE_REQUEST_GAP_MICROS;
+				return X52_PRO_HANDLE_UNRESPONSIVE_MICROS;
+			}
+
+			if (i == 0)
+				deadline = micros() + X52_PRO_HANDLE_FRAME_TIMEOUT_MICROS;
+
+			digitalWrite(PIN_D0, LOW);
+
+			if (!WaitStrategy::WaitForPinState(PIN_D, LOW, deadline)) {
+				X52DebugLog("Error waiting for D=0. Clock cycle: ", i);
+				digitalWrite(PIN_D1, LOW);
+				return X52_PRO_HANDLE_UNRESPONSIVE_MICROS;
+			}
+		}
+
+		digitalWrite(PIN_D1, LOW);
+		return 0;
+	}
+
+	// ReceiveHandleConfig waits for a frame transmission request of the
+	// main-MCU and receives the HandleConfig. Returns zero on success.
+	//
+	// A nonzero return value means error and gives the recommended number
+	// of microseconds to wait before calling ReceiveHandleConfig again.
+	// In that situation the value of the HandleConfig is undefined.
+	unsigned long ReceiveHandleConfig(HandleConfig& cfg, unsigned long wait_micros=X52_PRO_DEFAULT_RECEIVE_HANDLE_CONFIG_WAIT_MICROS) {
+		// PIN_D1 has to be LOW when this function returns.
+
+		// waiting for the main-MCU's request
+		if (!WaitStrategy::WaitForPinState(PIN_CLK, HIGH, micros()+wait_micros))
+			return 1;
+
+		HandleConfig::Binary recv_buf;
+		unsigned long deadline = micros() + X52_PRO_HANDLE_FRAME_TIMEOUT_MICROS;
+
+		// A frame consists of 6 clock pulses on both CLK and D1.
+		for (int i=0; i<6; i++) {
+			if (i > 0 && !WaitStrategy::WaitForPinState(PIN_CLK, HIGH, deadline)) {
+				X52DebugLog("Error waiting for CLK=1. Clock cycle: ", i);
+				return X52_PRO_HANDLE_UNRESPONSIVE_MICROS;
+			}
+
+			// The main-MCU puts the data on D before the rising edge of CLK.
+			if (i >= 1)
+				recv_buf.SetBit(i-1, bool(digitalRead(PIN_D)));
+
+			digitalWrite(PIN_D1, HIGH);
+
+			if (!WaitStrategy::WaitForPinState(PIN_CLK, LOW, deadline)) {
+				X52DebugLog("Error waiting for CLK=0. Clock cycle: ", i);
+				digitalWrite(PIN_D1, LOW);
+				return X52_PRO_HANDLE_UNRESPONSIVE_MICROS;
+			}
+
+			digitalWrite(PIN_D1, LOW);
+		}
+
+		cfg.SetFromBinary(recv_buf);
+		return 0;
+	}
+
+	// IsHandleConfigAvailable returns true if the main-MCU is requesting
+	// a frame transmission. In that situation a call to ReceiveHandleConfig
+	// doesn't have to wait for the request.
+	bool IsHandleConfigAvailable() {
+		return bool(digitalRead(PIN_CLK));
+	}
+};
+
+
+}  // namespace pro
+}  // namespace x52
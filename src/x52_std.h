@@ -1,6 +1,7 @@
 #pragma once
 
 #include "x52_common.h"
+#include "x52_engine.h"
 
 
 // I don't have a non-Pro throttle to measure its timeout values.
@@ -45,6 +46,9 @@ namespace x52 {
 namespace std {
 
 
+class JoystickStateView;
+
+
 // JoystickState is the data sent by the joystick through the PS/2 cable.
 struct JoystickState {
 	static constexpr uint16_t MAX_X = 2047;
@@ -84,8 +88,12 @@ struct JoystickState {
 	// Constructor for the pros who believe they know what they are doing.
 	JoystickState(Uninitialized) {}
 
+	// Decodes all fields of the view. It doesn't verify the checksum.
+	explicit JoystickState(const JoystickStateView&);
+
 	static constexpr int NUM_BITS = 64;
 	typedef BitField<NUM_BITS> Binary;
+	typedef JoystickStateView View;
 
 	bool SetFromBinary(const Binary&);
 	void ToBinary(Binary&) const;
@@ -129,54 +137,119 @@ inline void JoystickConfig::ToBinary(Binary& b) const {
 }
 
 
-inline bool JoystickState::SetFromBinary(const Binary& b) {
-	if (Checksum(b) != b.BufByte(7))
-		return false;
+// JoystickStateView decodes the fields of a received JoystickState::Binary
+// on access. It's cheaper than a JoystickState if you need only a few
+// fields, or if you skip the frames that are the same as the previous one
+// (the comparison of two views compares only the raw bits).
+//
+// The view doesn't verify the checksum: call ChecksumOK before using the
+// fields of a Binary received by a ThrottleClient.
+//
+// The view references the Binary without copying it: the Binary has to
+// outlive the view.
+class JoystickStateView {
+public:
+	explicit JoystickStateView(const JoystickState::Binary& b): m_Binary(b) {}
+
+	bool ChecksumOK() const {
+		return JoystickState::Checksum(m_Binary) == m_Binary.BufByte(7);
+	}
 
-	x = uint16_t(b.UInt(0, 8) | (b.UInt(16, 3) << 8));
-	y = uint16_t(b.UInt(8, 8) | (b.UInt(19, 3) << 8));
-	z = uint16_t(b.UInt(24, 8) | (b.UInt(22, 2) << 8));
-
-	switch (b.UInt(32, 4)) {
-		case 1: pov_1 = Up; break;
-		case 2: pov_1 = UpRight; break;
-		case 3: pov_1 = Right; break;
-		case 4: pov_1 = DownRight; break;
-		case 5: pov_1 = Down; break;
-		case 6: pov_1 = DownLeft; break;
-		case 7: pov_1 = Left; break;
-		case 8: pov_1 = UpLeft; break;
-		default: pov_1 = NoDirection; break;
-	}
-
-	pov_2 = Direction(
-		(-b.Bit(36) & Right) |
-		(-b.Bit(37) & Down) |
-		(-b.Bit(38) & Left) |
-		(-b.Bit(39) & Up)
-	);
-
-	switch (b.UInt(54, 2)) {
-		case 0: mode = b.Bit(47) ? Mode1 : ModeUndefined; break;
-		case 1: mode = Mode2; break;
-		case 2: mode = Mode3; break;
-		default: mode = ModeUndefined; break;
-	}
-
-	trigger_stage_1 = b.Bit(40);
-	trigger_stage_2 = b.Bit(41);
-	button_fire = b.Bit(42);
-	button_a = b.Bit(43);
-	button_b = b.Bit(44);
-	button_c = b.Bit(45);
-	pinkie_switch = b.Bit(46);
-	button_t1 = b.Bit(48);
-	button_t2 = b.Bit(49);
-	button_t3 = b.Bit(50);
-	button_t4 = b.Bit(51);
-	button_t5 = b.Bit(52);
-	button_t6 = b.Bit(53);
+	uint16_t x() const { return uint16_t(m_Binary.UInt<0,8>() | (m_Binary.UInt<16,3>() << 8)); }
+	uint16_t y() const { return uint16_t(m_Binary.UInt<8,8>() | (m_Binary.UInt<19,3>() << 8)); }
+	uint16_t z() const { return uint16_t(m_Binary.UInt<24,8>() | (m_Binary.UInt<22,2>() << 8)); }
+
+	Direction pov_1() const {
+		switch (m_Binary.UInt<32,4>()) {
+			case 1: return Up;
+			case 2: return UpRight;
+			case 3: return Right;
+			case 4: return DownRight;
+			case 5: return Down;
+			case 6: return DownLeft;
+			case 7: return Left;
+			case 8: return UpLeft;
+			default: return NoDirection;
+		}
+	}
 
+	Direction pov_2() const {
+		return Direction(
+			(-m_Binary.Bit<36>() & Right) |
+			(-m_Binary.Bit<37>() & Down) |
+			(-m_Binary.Bit<38>() & Left) |
+			(-m_Binary.Bit<39>() & Up)
+		);
+	}
+
+	Mode mode() const {
+		switch (m_Binary.UInt<54,2>()) {
+			case 0: return m_Binary.Bit<47>() ? Mode1 : ModeUndefined;
+			case 1: return Mode2;
+			case 2: return Mode3;
+			default: return ModeUndefined;
+		}
+	}
+
+	bool trigger_stage_1() const { return m_Binary.Bit<40>(); }
+	bool trigger_stage_2() const { return m_Binary.Bit<41>(); }
+	bool button_fire() const { return m_Binary.Bit<42>(); }
+	bool button_a() const { return m_Binary.Bit<43>(); }
+	bool button_b() const { return m_Binary.Bit<44>(); }
+	bool button_c() const { return m_Binary.Bit<45>(); }
+	bool pinkie_switch() const { return m_Binary.Bit<46>(); }
+	bool button_t1() const { return m_Binary.Bit<48>(); }
+	bool button_t2() const { return m_Binary.Bit<49>(); }
+	bool button_t3() const { return m_Binary.Bit<50>(); }
+	bool button_t4() const { return m_Binary.Bit<51>(); }
+	bool button_t5() const { return m_Binary.Bit<52>(); }
+	bool button_t6() const { return m_Binary.Bit<53>(); }
+
+	const JoystickState::Binary& GetBinary() const {
+		return m_Binary;
+	}
+
+	bool operator==(const JoystickStateView& other) const {
+		return m_Binary == other.m_Binary;
+	}
+
+	bool operator!=(const JoystickStateView& other) const {
+		return m_Binary != other.m_Binary;
+	}
+
+private:
+	const JoystickState::Binary& m_Binary;
+};
+
+
+inline JoystickState::JoystickState(const JoystickStateView& v) {
+	x = v.x();
+	y = v.y();
+	z = v.z();
+	pov_1 = v.pov_1();
+	pov_2 = v.pov_2();
+	mode = v.mode();
+	trigger_stage_1 = v.trigger_stage_1();
+	trigger_stage_2 = v.trigger_stage_2();
+	pinkie_switch = v.pinkie_switch();
+	button_fire = v.button_fire();
+	button_a = v.button_a();
+	button_b = v.button_b();
+	button_c = v.button_c();
+	button_t1 = v.button_t1();
+	button_t2 = v.button_t2();
+	button_t3 = v.button_t3();
+	button_t4 = v.button_t4();
+	button_t5 = v.button_t5();
+	button_t6 = v.button_t6();
+}
+
+
+inline bool JoystickState::SetFromBinary(const Binary& b) {
+	JoystickStateView v(b);
+	if (!v.ChecksumOK())
+		return false;
+	*this = JoystickState(v);
 	return true;
 }
 
@@ -184,16 +257,13 @@ inline bool JoystickState::SetFromBinary(const Binary& b) {
 inline void JoystickState::ToBinary(Binary& b) const {
 #if X52_DEBUG
 	if (x > MAX_X) {
-		X52DebugPrint("x52::std::JoystickState.x exceeds the maximum value. x=");
-		X52DebugPrintln(x);
+		X52DebugLog("x52::std::JoystickState.x exceeds the maximum value. x=", x);
 	}
 	if (y > MAX_Y) {
-		X52DebugPrint("x52::std::JoystickState.y exceeds the maximum value. y=");
-		X52DebugPrintln(y);
+		X52DebugLog("x52::std::JoystickState.y exceeds the maximum value. y=", y);
 	}
 	if (z > MAX_Z) {
-		X52DebugPrint("x52::std::JoystickState.z exceeds the maximum value. z=");
-		X52DebugPrintln(z);
+		X52DebugLog("x52::std::JoystickState.z exceeds the maximum value. z=", z);
 	}
 #endif
 
@@ -273,7 +343,7 @@ enum PulseWaitResult {
 // This bit-banging worked well on my 96MHz teensy 3.2. However, it's better
 // to be safe than sorry and use the InterruptPulseWaiter whenever possible.
 // That works well on slower MCUs too but it requires a pin that can trigger
-// interrupts on falling edges. That isn't a huge requirement. I'd use this
+// interrupts on both edges. That isn't a huge requirement. I'd use this
 // BitBangPulseWaiter only if I had no interrupt pins available (basically "never").
 // This naive implementation is still useful as a form of documentation because
 // the code explains very clearly what we want to achieve with the more
@@ -283,65 +353,277 @@ class BitBangPulseWaiter {
 public:
 	void Setup() {}
 
+	// Pulses shorter than min_pulse_micros are treated as glitches and ignored.
+	// A pulse longer than a nonzero max_pulse_micros returns PulseStarted
+	// without waiting for the deadline.
 	template <typename PulseTriggerFunc>
-	PulseWaitResult WaitForPulse(unsigned long deadline, PulseTriggerFunc trigger) {
+	PulseWaitResult WaitForPulse(unsigned long deadline, PulseTriggerFunc trigger, unsigned long min_pulse_micros=0, unsigned long max_pulse_micros=0) {
 		trigger();
-		if (!wait_for_pin_state(PIN_C04, HIGH, deadline, 0))
-			return PulseNotStarted;
-		if (!wait_for_pin_state(PIN_C04, LOW, deadline, 0))
-			return PulseStarted;
-		return PulseFinished;
+		for (;;) {
+			if (!wait_for_pin_state(PIN_C04, HIGH, deadline, 0))
+				return PulseNotStarted;
+			unsigned long t = micros();
+			unsigned long fall_deadline = deadline;
+			if (max_pulse_micros && long(deadline - (t + max_pulse_micros)) > 0)
+				fall_deadline = t + max_pulse_micros;
+			if (!wait_for_pin_state(PIN_C04, LOW, fall_deadline, 0))
+				return PulseStarted;
+			if (micros() - t + X52_PULSE_WIDTH_TOLERANCE_MICROS >= min_pulse_micros)
+				return PulseFinished;
+			X52DebugLog("Ignoring a glitch on C04.");
+		}
 	}
 };
 
 
-// The InterruptPulseWaiter attaches an interrupt handler to the C04 pin to be
-// able to reliably detect pulses. This whole "waiting for a pulse" problem
-// affects only the non-Pro joystick. My X52 Pro uses a different protocol that
-// is completely bitbang-friendly even on slower MCUs (as long as they are fast
-// enough to transmit the whole frame within 17ms).
+// The InterruptPulseWaiter uses the EdgeRecorder (see x52_common.h) of the
+// C04 pin to be able to reliably detect pulses. The recorded timestamps make
+// it possible to tell real pulses from glitches. This whole "waiting for a
+// pulse" problem affects only the non-Pro joystick. My X52 Pro uses a
+// different protocol that is completely bitbang-friendly even on slower MCUs
+// (as long as they are fast enough to transmit the whole frame within 17ms).
+//
+// If the pool of the EdgeRecorders is full (see X52_MAX_EDGE_RECORDERS)
+// then it falls back to the BitBangPulseWaiter.
 template <int PIN_C04>
 class InterruptPulseWaiter {
 public:
 	void Setup() {
-		attachInterrupt(digitalPinToInterrupt(PIN_C04), InterruptHandler, FALLING);
+		m_Recorder = EdgeRecorder::ForPin(PIN_C04);
+		if (!m_Recorder)
+			X52DebugLog("No EdgeRecorder for C04, bit-banging the pulses. Pin: ", PIN_C04);
 	}
 
+	// Pulses shorter than min_pulse_micros are treated as glitches and ignored.
+	// A pulse longer than a nonzero max_pulse_micros returns PulseStarted
+	// without waiting for the deadline.
 	template <typename PulseTriggerFunc>
-	PulseWaitResult WaitForPulse(unsigned long deadline, PulseTriggerFunc trigger) {
-		int c0 = Counter();
+	PulseWaitResult WaitForPulse(unsigned long deadline, PulseTriggerFunc trigger, unsigned long min_pulse_micros=0, unsigned long max_pulse_micros=0) {
+		if (!m_Recorder)
+			return m_Fallback.WaitForPulse(deadline, trigger, min_pulse_micros, max_pulse_micros);
+		uint8_t seq = m_Recorder->Head();
+		bool high = false;
+		unsigned long rise_micros = 0;
+		int num_pulses = 0;
+		// The loop idles so a SpinClock would run slow.
+		Deadline<WallClock<Clock>::Type> d(deadline);
+
 		trigger();
 		for (;;) {
-			int c = Counter();
-			if (c != c0)
-				return (c == c0 + 1) ? PulseFinished : TooManyPulses;
-			// using delta to handle the overflows of micros()
-			unsigned long micros_left = deadline - micros();
-			if (long(micros_left) <= 0)
+			uint8_t head = m_Recorder->Head();
+			for (; seq != head; seq++) {
+				EdgeRecorder::Edge e;
+				if (!m_Recorder->Read(seq, e))
+					return TooManyPulses;
+				if (e.level) {
+					// A missed LOW between two rising edges ended the pulse in progress.
+					if (high && e.missed_pulse)
+						num_pulses += IsPulse(e.micros - rise_micros, min_pulse_micros);
+					high = true;
+					rise_micros = e.micros;
+					continue;
+				}
+				if (!high) {
+					// Both edges of a pulse happened before the interrupt handler
+					// could read the pin. Its width is unknown so it's counted
+					// without the glitch check (like the falling edges were counted
+					// before the timestamps). A falling edge without a missed pulse
+					// is the end of a pulse that started before the trigger.
+					if (e.missed_pulse)
+						num_pulses++;
+					continue;
+				}
+				high = false;
+				num_pulses += IsPulse(e.micros - rise_micros, min_pulse_micros);
+			}
+			if (num_pulses)
+				return (num_pulses == 1) ? PulseFinished : TooManyPulses;
+			if (high && max_pulse_micros && micros() - rise_micros > max_pulse_micros)
+				return PulseStarted;
+			if (d.Passed())
 				return digitalRead(PIN_C04) ? PulseStarted : PulseNotStarted;
-#if !X52_BUSY_WAIT
-			delayMicroseconds(min(10, micros_left));
-#endif
+			// Idle may return early and it may overshoot the deadline by at most 10us.
+			WaitStrategy::Idle(10);
 		}
 	}
 
 private:
-	static int Counter() {
-		noInterrupts();
-		int c = m_Counter;
-		interrupts();
-		return c;
+	static int IsPulse(unsigned long width_micros, unsigned long min_pulse_micros) {
+		if (width_micros + X52_PULSE_WIDTH_TOLERANCE_MICROS >= min_pulse_micros)
+			return 1;
+		X52DebugLog("Ignoring a glitch on C04.");
+		return 0;
+	}
+
+	EdgeRecorder* m_Recorder;
+	BitBangPulseWaiter<PIN_C04> m_Fallback;
+};
+
+
+// Frame is the protocol policy of the X52 (non-Pro) for the FrameEngine
+// (see x52_engine.h). A frame consists of a C04 pulse, 64 state bits over
+// C03, another C04 pulse and 8 config bits over C01. The two pulses don't
+// require an ACK so they are handled by the clients (the JoystickClient
+// waits for them with its PulseWaiter) and this class implements the
+// handshaked parts.
+template <typename HAL>
+class Frame {
+public:
+	// ReceiveState receives the state bits after the first C04 pulse. The
+	// handler receives the groups of the state during the frame (see
+	// NoPartialState in x52_common.h).
+	template <typename PartialStateHandler>
+	static X52_FRAME_FUNC unsigned long ReceiveState(Pins p, JoystickState::Binary& recv_buf, unsigned long& deadline,
+			PartialStateHandler& handler) {
+		// I don't have an X52 throttle to test this but the throttle must
+		// be sampling C03 between falling-C04 and falling-C02.
+		// The other sensible option (between rising-C04 and rising-C02)
+		// wouldn't work because the joystick often removes the data bit
+		// from C03 before the rising-C02 edge.
+		ReceiveHooks<PartialStateHandler> hooks = {p.c03, recv_buf, handler};
+		int i = 0;
+		int res = FrameEngine<HAL>::Lead(hooks, p.c02, LOW, p.c04, HIGH, i, JoystickState::NUM_BITS-1, deadline);
+		if (res) {
+			if (res == FirstEdgeTimeout) {
+				X52DebugLog("Error waiting for C04=1 while receiving the joystick state. Clock cycle: ", i);
+			} else {
+				X52DebugLog("Error waiting for C04=0 while receiving the joystick state. Clock cycle: ", i);
+			}
+			return X52_THROTTLE_UNRESPONSIVE_MICROS;
+		}
+		recv_buf.SetBit(JoystickState::NUM_BITS-1, bool(HAL::Read(p.c03)));
+		if (PartialStateEnabled<PartialStateHandler>::value) {
+			JoystickStateView view(recv_buf);
+			if (view.ChecksumOK())
+				handler.OnPartialState(view, StateAllGroups | StateVerified);
+		}
+		return 0;
 	}
 
-	static void InterruptHandler() {
-		m_Counter++;
+	// SendConfig sends the config bits after the second C04 pulse.
+	static X52_FRAME_FUNC unsigned long SendConfig(Pins p, const JoystickConfig& cfg, unsigned long& deadline) {
+		JoystickConfig::Binary send_buf;
+		cfg.ToBinary(send_buf);
+
+		// The joystick samples C01 between rising-C02 and rising-C04 (last 8 rising edges of C02)
+		int i = 0;
+		int res = FrameEngine<HAL>::LeadShiftOut(p.c02, HIGH, p.c04, HIGH, p.c01, send_buf.Bytes(), i, JoystickConfig::NUM_BITS, deadline);
+		if (res) {
+			if (res == FirstEdgeTimeout) {
+				X52DebugLog("Error waiting for C04=1 while sending the joystick config. Clock cycle: ", i);
+			} else {
+				X52DebugLog("Error waiting for C04=0 while sending the joystick config. Clock cycle: ", i);
+			}
+			return X52_THROTTLE_UNRESPONSIVE_MICROS;
+		}
+		// The value of C01 is allowed to be anything between frames (undefined).
+		return 0;
 	}
 
-	static volatile int m_Counter;
-};
+	// Send is the whole frame transmission of the ThrottleClient. The state
+	// is either an encoded JoystickState::Binary or a PreEncodedState (see
+	// x52_common.h) that is read when the throttle's poll arrives.
+	template <typename StateSource>
+	static X52_FRAME_FUNC unsigned long Send(Pins p, const StateSource& state, JoystickConfig& cfg, unsigned long wait_micros) {
+		JoystickState::Binary latest;
+		JoystickConfig::Binary recv_buf;
 
-template <int PIN_C04>
-volatile int InterruptPulseWaiter<PIN_C04>::m_Counter = 0;
+		if (!HAL::WaitForPinState(p.c02, HIGH, HAL::Micros()+wait_micros))
+			return 1;
+
+		const uint8_t* send_bytes = SendBytes(state, latest);
+
+		auto deadline = HAL::Micros() + X52_JOYSTICK_TIMEOUT_MICROS;
+
+		// The first data bit has to be on C03 before the falling edge of C04
+		HAL::Write(p.c03, send_bytes[0] & 1);
+
+		// The first C04 pulse that doesn't require an ACK from the throttle
+		HAL::Write(p.c04, HIGH);
+		// The original joystick uses a >=15us pulse and I don't have a throttle to test shorter pulses.
+		HAL::DelayMicros(X52_FIRST_C04_PULSE_MICROS);
+		HAL::Write(p.c04, LOW);
+
+		// The throttle samples C03 for the first data bit here between falling-C04 and falling-C02.
+
+		if (!HAL::WaitForPinState(p.c02, LOW, deadline)) {
+			X52DebugLog("Error waiting for C02=0 while sending the first bit of the joystick state.");
+			return X52_JOYSTICK_UNRESPONSIVE_MICROS;
+		}
+
+		// Sending the rest of the joystick state. The data bit has to be on
+		// C03 before the falling edge of C04 and the throttle samples it
+		// between falling-C04 and falling-C02.
+		int i = 1;
+		int res = FrameEngine<HAL>::LeadShiftOut(p.c04, HIGH, p.c02, HIGH, p.c03, send_bytes, i, JoystickState::NUM_BITS, deadline);
+		if (res) {
+			if (res == FirstEdgeTimeout) {
+				X52DebugLog("Error waiting for C02=1 while sending the joystick state. Clock cycle: ", i);
+			} else {
+				X52DebugLog("Error waiting for C02=0 while sending the joystick state. Clock cycle: ", i);
+			}
+			return X52_JOYSTICK_UNRESPONSIVE_MICROS;
+		}
+
+		// The second C04 pulse that doesn't require an ACK from the throttle
+		HAL::Write(p.c04, HIGH);
+		// The original joystick uses a >=50us pulse and I don't have a throttle to test shorter pulses.
+		HAL::DelayMicros(X52_SECOND_C04_PULSE_MICROS);
+		HAL::Write(p.c04, LOW);
+
+		// Receiving the config from the throttle. The joystick samples C01
+		// between rising-C02 and rising-C04 (last 8 rising edges of C02).
+		i = 0;
+		res = FrameEngine<HAL>::FollowShiftIn(p.c04, HIGH, p.c02, HIGH, p.c01, recv_buf.Bytes(), i, JoystickConfig::NUM_BITS, deadline);
+		if (res) {
+			if (res == FirstEdgeTimeout) {
+				X52DebugLog("Error waiting for C02=1 while receiving the joystick config. Clock cycle: ", i);
+			} else {
+				X52DebugLog("Error waiting for C02=0 while receiving the joystick config. Clock cycle: ", i);
+			}
+			return X52_JOYSTICK_UNRESPONSIVE_MICROS;
+		}
+
+		cfg.SetFromBinary(recv_buf);
+		return 0;
+	}
+
+private:
+	static const uint8_t* SendBytes(const JoystickState::Binary& state, JoystickState::Binary&) {
+		return state.Bytes();
+	}
+
+	static const uint8_t* SendBytes(const PreEncodedState<JoystickState>& state, JoystickState::Binary& latest) {
+		state.Get(latest);
+		return latest.Bytes();
+	}
+
+	// CompleteGroups returns the StateGroups received with bit i.
+	static uint8_t CompleteGroups(int i) {
+		return uint8_t((i >= 18 ? StateX : 0) | (i >= 21 ? StateY : 0) | (i >= 31 ? StateZ : 0) |
+			(i >= 35 ? StatePov1 : 0) | (i >= 39 ? StatePov2 : 0) | (i >= 55 ? StateButtons : 0));
+	}
+
+	// ReceiveHooks are the shift-in hooks of the FrameEngine with the calls
+	// of the partial state handler after the last bits of the groups:
+	// x: 0..7 and 16..18, y: 8..15 and 19..21, z: 22..31, pov_1: 32..35,
+	// pov_2: 36..39, buttons and mode: 40..55.
+	template <typename PartialStateHandler>
+	struct ReceiveHooks {
+		uint8_t data_pin;
+		JoystickState::Binary& buf;
+		PartialStateHandler& handler;
+
+		X52_ALWAYS_INLINE void Begin(int i) {
+			buf.SetBit(i, bool(HAL::Read(data_pin)));
+			if (PartialStateEnabled<PartialStateHandler>::value &&
+					(i == 18 || i == 21 || i == 31 || i == 35 || i == 39 || i == 55))
+				handler.OnPartialState(JoystickStateView(buf), CompleteGroups(i));
+		}
+		int Middle(int&, unsigned long&) { return 0; }
+		int End(int) { return 0; }
+	};
+};
 
 
 // JoystickClient makes it possible to use some of your Arduino pins as a
@@ -363,20 +645,21 @@ volatile int InterruptPulseWaiter<PIN_C04>::m_Counter = 0;
 // Pin #5 of the PS/2 female socket is VCC.
 //
 // My joystick claims to be 5V 500mW but works with 3.3V too.
-template <int PIN_C01, int PIN_C02, int PIN_C03, int PIN_C04, typename PulseWaiter=InterruptPulseWaiter<PIN_C04>>
+template <int PIN_C01, int PIN_C02, int PIN_C03, int PIN_C04, typename PulseWaiter=InterruptPulseWaiter<PIN_C04>, typename HAL=ArduinoHAL, typename Timing=DefaultTiming>
 class JoystickClient {
 public:
 	// Call Setup from the setup function of your Arduino project to initialize
 	// a JoystickClient instance.
 	void Setup() {
-		pinMode(PIN_C01, OUTPUT);
+		HAL::PinMode(PIN_C01, OUTPUT);
 		// The value of C01 is allowed to be anything between frames (undefined).
-		// digitalWrite(PIN_C01, LOW);
-		pinMode(PIN_C02, OUTPUT);
+		// HAL::Write(PIN_C01, LOW);
+		HAL::PinMode(PIN_C02, OUTPUT);
 		// On the teensy the digitalWrite seems to work only after pinMode.
-		digitalWrite(PIN_C02, LOW);
-		pinMode(PIN_C03, INPUT);
-		pinMode(PIN_C04, INPUT);
+		HAL::Write(PIN_C02, LOW);
+		HAL::PinMode(PIN_C03, INPUT);
+		HAL::PinMode(PIN_C04, INPUT);
+		HAL::SetupWaitPin(PIN_C04);
 		m_PulseWaiter.Setup();
 	}
 
@@ -391,102 +674,103 @@ public:
 	//
 	// My X52 joystick is willing to send its state at most ~50 times per second.
 	unsigned long PollJoystickState(JoystickState& state, const JoystickConfig& cfg, unsigned long wait_micros=X52_DEFAULT_POLL_JOYSTICK_STATE_WAIT_MICROS) {
-		// Note: PIN_C02 has to be LOW when this function returns.
-
-		{
-			// deadline for the initial response
-			unsigned long wait_deadline = micros()+wait_micros;
-
-			if (!wait_for_pin_state(PIN_C04, LOW, wait_deadline))
-				return 1;
+		NoPartialState handler;
+		return PollJoystickState(state, cfg, handler, wait_micros);
+	}
 
-			// The original joystick's C04 pulse seems to be at least 15us long.
+	// This PollJoystickState passes the groups of the state to the handler
+	// as soon as they are received (see NoPartialState in x52_common.h).
+	// They are provisional until the handler is called with StateVerified
+	// after the checksum (bit 63), that's still before the config phase.
+	template <typename PartialStateHandler>
+	unsigned long PollJoystickState(JoystickState& state, const JoystickConfig& cfg, PartialStateHandler& handler,
+			unsigned long wait_micros=X52_DEFAULT_POLL_JOYSTICK_STATE_WAIT_MICROS) {
+		// Note: PIN_C02 has to be LOW when this function returns.
 
-			auto trigger = [](){
-				digitalWrite(PIN_C02, HIGH);
-			};
-			auto wait_res = m_PulseWaiter.WaitForPulse(wait_deadline, trigger);
-			if (wait_res != PulseFinished) {
-				X52DebugPrintln("Timed out while waiting for the C04 pulse before receiving the joystick state.");
-				digitalWrite(PIN_C02, LOW);
-				return (wait_res == PulseNotStarted) ? 1 : X52_THROTTLE_UNRESPONSIVE_MICROS;
-			}
+		auto wait_res = StartPoll(HAL::Micros()+wait_micros);
+		if (wait_res != PulseFinished) {
+			X52DebugLog("Timed out while waiting for the C04 pulse before receiving the joystick state.");
+			HAL::Write(PIN_C02, LOW);
+			return (wait_res == PulseNotStarted) ? 1 : X52_THROTTLE_UNRESPONSIVE_MICROS;
 		}
+		return FinishPoll(state, cfg, handler);
+	}
 
-		// deadline for the whole frame transmission
-		unsigned long deadline = micros() + X52_THROTTLE_TIMEOUT_MICROS;
-
-		JoystickState::Binary recv_buf;
-
-		for (int i=0; i<(JoystickState::NUM_BITS-1); i++) {
+	// StartPoll is the first half of PollJoystickState: it requests a frame
+	// (C02=1) and waits for the first C04 pulse of the joystick. The frame
+	// has to be finished with FinishPoll if it returns PulseFinished,
+	// otherwise C02 has to be set to LOW by the caller.
+	//
+	// With a nonzero max_pulse_micros it returns PulseStarted as soon as C04
+	// has been HIGH for that long. The AutoJoystickClient (x52_auto.h) uses
+	// this to tell the std joystick from the Pro that holds C04=1 until C02=0.
+	PulseWaitResult StartPoll(unsigned long wait_deadline, unsigned long max_pulse_micros=0) {
+		if (!HAL::WaitForPinState(PIN_C04, LOW, wait_deadline))
+			return PulseNotStarted;
 
-			// I don't have an X52 throttle to test this but the throttle must
-			// be sampling C03 between falling-C04 and falling-C02.
-			// The other sensible option (between rising-C04 and rising-C02)
-			// wouldn't work because the joystick often removes the data bit
-			// from C03 before the rising-C02 edge.
-			recv_buf.SetBit(i, bool(digitalRead(PIN_C03)));
+		// The original joystick's C04 pulse seems to be at least 15us long.
 
-			digitalWrite(PIN_C02, LOW);
+		auto trigger = [](){
+			HAL::Write(PIN_C02, HIGH);
+		};
+		return m_PulseWaiter.WaitForPulse(wait_deadline, trigger, X52_FIRST_C04_PULSE_MICROS, max_pulse_micros);
+	}
 
-			if (!wait_for_pin_state(PIN_C04, HIGH, deadline)) {
-				X52DebugPrint("Error waiting for C04=1 while receiving the joystick state. Clock cycle: ");
-				X52DebugPrintln(i);
-				digitalWrite(PIN_C02, LOW);
-				return X52_THROTTLE_UNRESPONSIVE_MICROS;
-			}
+	// FinishPoll is the second half of PollJoystickState (see StartPoll).
+	unsigned long FinishPoll(JoystickState& state, const JoystickConfig& cfg) {
+		NoPartialState handler;
+		return FinishPoll(state, cfg, handler);
+	}
 
-			digitalWrite(PIN_C02, HIGH);
+	template <typename PartialStateHandler>
+	unsigned long FinishPoll(JoystickState& state, const JoystickConfig& cfg, PartialStateHandler& handler) {
+		// deadline for the whole frame transmission
+		unsigned long start = HAL::Micros();
+		unsigned long deadline = start + m_Timing.FrameTimeout(X52_THROTTLE_TIMEOUT_MICROS);
 
-			if (!wait_for_pin_state(PIN_C04, LOW, deadline)) {
-				X52DebugPrint("Error waiting for C04=0 while receiving the joystick state. Clock cycle: ");
-				X52DebugPrintln(i);
-				digitalWrite(PIN_C02, LOW);
-				return X52_THROTTLE_UNRESPONSIVE_MICROS;
-			}
+		Pins p = {PIN_C01, PIN_C02, PIN_C03, PIN_C04};
+		JoystickState::Binary recv_buf;
+		unsigned long res = Frame<HAL>::ReceiveState(p, recv_buf, deadline, handler);
+		if (res) {
+			m_Timing.FrameTimedOut(X52_THROTTLE_TIMEOUT_MICROS);
+			return res;
 		}
-		recv_buf.SetBit(JoystickState::NUM_BITS-1, bool(digitalRead(PIN_C03)));
 
 		// The original joystick's C04 pulse seems to be at least 50us long.
 
 		auto trigger = [](){
-			digitalWrite(PIN_C02, LOW);
+			HAL::Write(PIN_C02, LOW);
 		};
-		auto wait_res = m_PulseWaiter.WaitForPulse(deadline, trigger);
+		auto wait_res = m_PulseWaiter.WaitForPulse(deadline, trigger, X52_SECOND_C04_PULSE_MICROS);
 		if (wait_res != PulseFinished) {
-			X52DebugPrintln("Timed out while waiting for the C04 pulse before sending the joystick config.");
+			X52DebugLog("Timed out while waiting for the C04 pulse before sending the joystick config.");
+			m_Timing.FrameTimedOut(X52_THROTTLE_TIMEOUT_MICROS);
 			return X52_THROTTLE_UNRESPONSIVE_MICROS;
 		}
 
-		JoystickConfig::Binary send_buf;
-		cfg.ToBinary(send_buf);
-
-		for (int i=0; i<JoystickConfig::NUM_BITS; i++) {
-			// The joystick samples C01 between rising-C02 and rising-C04 (last 8 rising edges of C02)
-			digitalWrite(PIN_C01, send_buf.Bit(i));
-			digitalWrite(PIN_C02, HIGH);
-			if (!wait_for_pin_state(PIN_C04, HIGH, deadline)) {
-				X52DebugPrint("Error waiting for C04=1 while sending the joystick config. Clock cycle: ");
-				X52DebugPrintln(i);
-				digitalWrite(PIN_C02, LOW);
-				return X52_THROTTLE_UNRESPONSIVE_MICROS;
-			}
-			digitalWrite(PIN_C02, LOW);
-			if (!wait_for_pin_state(PIN_C04, LOW, deadline)) {
-				X52DebugPrint("Error waiting for C04=0 while sending the joystick config. Clock cycle: ");
-				X52DebugPrintln(i);
-				return X52_THROTTLE_UNRESPONSIVE_MICROS;
-			}
+		res = Frame<HAL>::SendConfig(p, cfg, deadline);
+		if (res) {
+			m_Timing.FrameTimedOut(X52_THROTTLE_TIMEOUT_MICROS);
+			return res;
 		}
-		// The value of C01 is allowed to be anything between frames (undefined).
-		// digitalWrite(PIN_C01, LOW);
 
 		// SetFromBinary verifies the checksum and returns false on error
-		return state.SetFromBinary(recv_buf) ? 0 : X52_THROTTLE_UNRESPONSIVE_MICROS;
+		if (!state.SetFromBinary(recv_buf))
+			return X52_THROTTLE_UNRESPONSIVE_MICROS;
+		if (Timing::LEARNS)
+			m_Timing.FrameDone(HAL::Micros() - start);
+		return 0;
+	}
+
+	// GetTiming returns the timing policy (see x52_common.h) of the client,
+	// e.g. to persist or restore the values learned by a TimingProfile.
+	Timing& GetTiming() {
+		return m_Timing;
 	}
 
 private:
 	PulseWaiter m_PulseWaiter;
+	Timing m_Timing;
 };
 
 
@@ -494,18 +778,19 @@ private:
 // connection to the PS/2 socket of an X52 (non-Pro) Throttle.
 //
 // The pin config is the same as that of the JoystickClient.
-template <int PIN_C01, int PIN_C02, int PIN_C03, int PIN_C04>
+template <int PIN_C01, int PIN_C02, int PIN_C03, int PIN_C04, typename HAL=ArduinoHAL>
 class ThrottleClient {
 public:
 	// Call Setup from the setup function of your Arduino project to initialize
 	// a ThrottleClient instance.
 	void Setup() {
-		pinMode(PIN_C01, INPUT);
-		pinMode(PIN_C02, INPUT);
-		pinMode(PIN_C03, OUTPUT);
-		pinMode(PIN_C04, OUTPUT);
+		HAL::PinMode(PIN_C01, INPUT);
+		HAL::PinMode(PIN_C02, INPUT);
+		HAL::PinMode(PIN_C03, OUTPUT);
+		HAL::PinMode(PIN_C04, OUTPUT);
 		// On the teensy the digitalWrite seems to work only after pinMode.
-		digitalWrite(PIN_C04, LOW);
+		HAL::Write(PIN_C04, LOW);
+		HAL::SetupWaitPin(PIN_C02);
 	}
 
 	// SendJoystickState sends the JoystickState to the throttle and receives
@@ -516,99 +801,257 @@ public:
 	// to wait before calling SendJoystickState again. In that situation the
 	// value of the JoystickConfig is undefined.
 	unsigned long SendJoystickState(const JoystickState& state, JoystickConfig& cfg, unsigned long wait_micros=X52_DEFAULT_SEND_JOYSTICK_STATE_WAIT_MICROS) {
-		if (!wait_for_pin_state(PIN_C02, HIGH, micros()+wait_micros))
-			return 1;
-
+		Pins p = {PIN_C01, PIN_C02, PIN_C03, PIN_C04};
+		// encoding before the wait keeps it out of the throttle's response window
 		JoystickState::Binary send_buf;
 		state.ToBinary(send_buf);
+		return Frame<HAL>::Send(p, send_buf, cfg, wait_micros);
+	}
 
-		auto deadline = micros() + X52_JOYSTICK_TIMEOUT_MICROS;
+	// SendLatestJoystickState is SendJoystickState with the state that was
+	// most recently published into the slot when the throttle's poll arrives.
+	unsigned long SendLatestJoystickState(const PreEncodedState<JoystickState>& slot, JoystickConfig& cfg, unsigned long wait_micros=X52_DEFAULT_SEND_JOYSTICK_STATE_WAIT_MICROS) {
+		Pins p = {PIN_C01, PIN_C02, PIN_C03, PIN_C04};
+		return Frame<HAL>::Send(p, slot, cfg, wait_micros);
+	}
 
-		// The first data bit has to be on C03 before the falling edge of C04
-		digitalWrite(PIN_C03, send_buf.Bit(0));
+	// IsPollInProgress returns true if the throttle is waiting for the
+	// JoystickState on the other side of the connection. In that situation
+	// a call to SendJoystickState is less likely to block in a waiting state
+	// (or fail as a result of wait timeout).
+	bool IsPollInProgress() {
+		return bool(HAL::Read(PIN_C02));
+	}
+};
 
-		// The first C04 pulse that doesn't require an ACK from the throttle
-		digitalWrite(PIN_C04, HIGH);
-		// The original joystick uses a >=15us pulse and I don't have a throttle to test shorter pulses.
-		delayMicroseconds(X52_FIRST_C04_PULSE_MICROS);
-		digitalWrite(PIN_C04, LOW);
 
-		// The throttle samples C03 for the first data bit here between falling-C04 and falling-C02.
+// InterruptThrottleClient does the same job as the ThrottleClient but it
+// doesn't block the caller. The frame transmission is driven by an interrupt
+// handler attached to C02 and the two C04 pulses are ended by a PulseTimer
+// (see x52_common.h) so the CPU is free to do something else (e.g. sampling
+// sensors) while the throttle is clocking the frame.
+//
+// PIN_C02 must be an interrupt-capable digital pin. Only one instance can
+// exist per pin configuration and the PulseTimer can't be shared. The pin
+// I/O goes through the HAL (see x52_engine.h) like that of the other
+// clients, the interrupt is attached with attachInterrupt so a host HAL has
+// to deliver the writes of the other side to PIN_C02 with digitalWrite.
+//
+// Usage:
+//   StartSendJoystickState(state);
+//   while (IsSendInProgress()) { /* do something useful */ }
+//   unsigned long timeout_micros = FinishSendJoystickState(cfg);
+template <int PIN_C01, int PIN_C02, int PIN_C03, int PIN_C04, typename PulseTimer, typename HAL=ArduinoHAL>
+class InterruptThrottleClient {
+public:
+	// Call Setup from the setup function of your Arduino project to initialize
+	// an InterruptThrottleClient instance.
+	void Setup() {
+		m_Phase = Idle;
+		m_Result = 0;
+		m_Slot = nullptr;
+		g_Instance = this;
+		HAL::PinMode(PIN_C01, INPUT);
+		HAL::PinMode(PIN_C02, INPUT);
+		HAL::PinMode(PIN_C03, OUTPUT);
+		HAL::PinMode(PIN_C04, OUTPUT);
+		// On the teensy the digitalWrite seems to work only after pinMode.
+		HAL::Write(PIN_C04, LOW);
+		PulseTimer::Setup(PulseTimerHandler);
+		attachInterrupt(digitalPinToInterrupt(PIN_C02), C02InterruptHandler, CHANGE);
+	}
 
-		if (!wait_for_pin_state(PIN_C02, LOW, deadline)) {
-			X52DebugPrintln("Error waiting for C02=0 while sending the first bit of the joystick state.");
-			return X52_JOYSTICK_UNRESPONSIVE_MICROS;
-		}
+	// StartSendJoystickState encodes the state and arms the client. The frame
+	// transmission starts as soon as the throttle requests it (C02=1). If
+	// that doesn't happen within wait_micros then the send fails like the
+	// SendJoystickState of the ThrottleClient (FinishSendJoystickState returns 1).
+	// Calling this while a previous send is in progress is an error.
+	void StartSendJoystickState(const JoystickState& state, unsigned long wait_micros=X52_DEFAULT_SEND_JOYSTICK_STATE_WAIT_MICROS) {
+		state.ToBinary(m_SendBuf);
+		Arm(nullptr, wait_micros);
+	}
 
-		// sending the rest of the joystick state
-		for (int i=1; i<JoystickState::NUM_BITS; i++) {
+	// StartSendLatestJoystickState arms the client with a slot: the interrupt
+	// handler sends the state that was most recently published into the slot
+	// when the throttle's poll arrives. The slot has to outlive the send.
+	void StartSendLatestJoystickState(const PreEncodedState<JoystickState>& slot, unsigned long wait_micros=X52_DEFAULT_SEND_JOYSTICK_STATE_WAIT_MICROS) {
+		Arm(&slot, wait_micros);
+	}
 
-			// I don't have an X52 throttle to test this but the throttle must
-			// be sampling C03 between falling-C04 and falling-C02.
-			// The other sensible option (between rising-C04 and rising-C02)
-			// wouldn't work because the joystick often removes the data bit
-			// from C03 before the rising-C02 edge.
+	// IsSendInProgress returns true while the client is waiting for the
+	// throttle's poll or transmitting the frame. It also checks the wait and
+	// frame timeouts so it has to be called regularly while it returns true.
+	bool IsSendInProgress() {
+		noInterrupts();
+		uint8_t phase = m_Phase;
+		bool timed_out = phase >= Armed && phase < Finished && long(HAL::Micros() - m_Deadline) >= 0;
+		if (timed_out) {
+			PulseTimer::Stop();
+			HAL::Write(PIN_C04, LOW);
+			m_Phase = Failed;
+			// no poll from the throttle: the same result as a failed wait of the ThrottleClient
+			m_Result = phase == Armed ? 1 : X52_JOYSTICK_UNRESPONSIVE_MICROS;
+		}
+		interrupts();
+		if (timed_out) {
+			if (phase != Armed)
+				X52DebugLog("Timed out while sending the joystick state. Phase: ", int(phase));
+			return false;
+		}
+		return phase >= Armed && phase < Finished;
+	}
 
-			// The data bit has to be on C03 before the falling edge of C04.
-			digitalWrite(PIN_C03, send_buf.Bit(i));
+	// FinishSendJoystickState has to be called after IsSendInProgress returned false.
+	// Its return value has the same meaning as that of ThrottleClient::SendJoystickState.
+	unsigned long FinishSendJoystickState(JoystickConfig& cfg) {
+		uint8_t phase = m_Phase;
+		m_Phase = Idle;
+		if (phase != Finished)
+			return phase == Failed ? m_Result : 1;
+		cfg.SetFromBinary(m_RecvBuf);
+		return 0;
+	}
 
-			digitalWrite(PIN_C04, HIGH);
-			if (!wait_for_pin_state(PIN_C02, HIGH, deadline)) {
-				X52DebugPrint("Error waiting for C02=1 while sending the joystick state. Clock cycle: ");
-				X52DebugPrintln(i);
-				digitalWrite(PIN_C04, LOW);
-				return X52_JOYSTICK_UNRESPONSIVE_MICROS;
-			}
+	// IsPollInProgress returns true if the throttle is waiting for the
+	// JoystickState on the other side of the connection.
+	bool IsPollInProgress() {
+		return bool(HAL::Read(PIN_C02));
+	}
 
-			digitalWrite(PIN_C04, LOW);
-			// This is where the throttle samples C03 for the data bit
-			if (!wait_for_pin_state(PIN_C02, LOW, deadline)) {
-				X52DebugPrint("Error waiting for C02=0 while sending the joystick state. Clock cycle: ");
-				X52DebugPrintln(i);
-				return X52_JOYSTICK_UNRESPONSIVE_MICROS;
-			}
-		}
+private:
+	enum Phase {
+		Idle,
+		Armed,              // waiting for C02=1
+		FirstPulse,         // C04=1 until the PulseTimer fires
+		SendingState,       // waiting for C02=0 (C04=0) or C02=1 (C04=1)
+		SecondPulse,        // C04=1 until the PulseTimer fires
+		ReceivingConfig,    // waiting for C02=1 (C04=0) or C02=0 (C04=1)
+		Finished,
+		Failed,
+	};
+
+	void Arm(const PreEncodedState<JoystickState>* slot, unsigned long wait_micros) {
+		noInterrupts();
+		m_Slot = slot;
+		m_Deadline = HAL::Micros() + wait_micros;
+		m_Phase = Armed;
+		// The throttle may already be waiting for us.
+		if (HAL::Read(PIN_C02))
+			OnC02Edge(HIGH);
+		interrupts();
+	}
 
-		// The second C04 pulse that doesn't require an ACK from the throttle
-		digitalWrite(PIN_C04, HIGH);
-		// The original joystick uses a >=50us pulse and I don't have a throttle to test shorter pulses.
-		delayMicroseconds(X52_SECOND_C04_PULSE_MICROS);
-		digitalWrite(PIN_C04, LOW);
+	static void C02InterruptHandler() {
+		g_Instance->OnC02Edge(HAL::Read(PIN_C02));
+	}
 
-		JoystickConfig::Binary recv_buf;
+	static void PulseTimerHandler() {
+		g_Instance->OnPulseEnd();
+	}
 
-		// receiving the config from the throttle
-		for (int i=0; i<JoystickConfig::NUM_BITS; i++) {
-			if (!wait_for_pin_state(PIN_C02, HIGH, deadline)) {
-				X52DebugPrint("Error waiting for C02=1 while receiving the joystick config. Clock cycle: ");
-				X52DebugPrintln(i);
-				return X52_JOYSTICK_UNRESPONSIVE_MICROS;
+	// The same steps as those of ThrottleClient::SendJoystickState but each
+	// wait_for_pin_state call is replaced with a return to the caller and
+	// the next step is executed by the next edge of C02.
+	void OnC02Edge(int c02) {
+		switch (m_Phase) {
+		case Armed:
+			if (!c02)
+				return;
+			m_Deadline = HAL::Micros() + X52_JOYSTICK_TIMEOUT_MICROS;
+			if (m_Slot)
+				m_Slot->Get(m_SendBuf);
+			m_Index = 0;
+			m_ClockHigh = false;
+			// The first data bit has to be on C03 before the falling edge of C04
+			HAL::Write(PIN_C03, m_SendBuf.Bit(0));
+			// The first C04 pulse that doesn't require an ACK from the throttle
+			m_Phase = FirstPulse;
+			HAL::Write(PIN_C04, HIGH);
+			PulseTimer::Start(X52_FIRST_C04_PULSE_MICROS);
+			return;
+
+		case SendingState:
+			if (m_ClockHigh) {
+				if (!c02)
+					return;
+				m_ClockHigh = false;
+				HAL::Write(PIN_C04, LOW);
+				// This is where the throttle samples C03 for the data bit
+				return;
+			}
+			if (c02)
+				return;
+			if (++m_Index < JoystickState::NUM_BITS) {
+				// The data bit has to be on C03 before the falling edge of C04.
+				HAL::Write(PIN_C03, m_SendBuf.Bit(m_Index));
+				m_ClockHigh = true;
+				HAL::Write(PIN_C04, HIGH);
+				return;
 			}
-			// The joystick samples C01 between rising-C02 and rising-C04 (last 8 rising edges of C02)
-			recv_buf.SetBit(i, bool(digitalRead(PIN_C01)));
-			digitalWrite(PIN_C04, HIGH);
-			if (!wait_for_pin_state(PIN_C02, LOW, deadline)) {
-				X52DebugPrint("Error waiting for C02=0 while receiving the joystick config. Clock cycle: ");
-				X52DebugPrintln(i);
-				digitalWrite(PIN_C04, LOW);
-				return X52_JOYSTICK_UNRESPONSIVE_MICROS;
+			// The second C04 pulse that doesn't require an ACK from the throttle
+			m_Phase = SecondPulse;
+			HAL::Write(PIN_C04, HIGH);
+			PulseTimer::Start(X52_SECOND_C04_PULSE_MICROS);
+			return;
+
+		case ReceivingConfig:
+			if (!m_ClockHigh) {
+				if (!c02)
+					return;
+				// The joystick samples C01 between rising-C02 and rising-C04 (last 8 rising edges of C02)
+				m_RecvBuf.SetBit(m_Index, bool(HAL::Read(PIN_C01)));
+				m_ClockHigh = true;
+				HAL::Write(PIN_C04, HIGH);
+				return;
 			}
-			digitalWrite(PIN_C04, LOW);
+			if (c02)
+				return;
+			m_ClockHigh = false;
+			HAL::Write(PIN_C04, LOW);
+			if (++m_Index == JoystickConfig::NUM_BITS)
+				m_Phase = Finished;
+			return;
+
+		default:
+			return;
 		}
-
-		cfg.SetFromBinary(recv_buf);
-		return 0;
 	}
 
-	// IsPollInProgress returns true if the throttle is waiting for the
-	// JoystickState on the other side of the connection. In that situation
-	// a call to SendJoystickState is less likely to block in a waiting state
-	// (or fail as a result of wait timeout).
-	bool IsPollInProgress() {
-		return bool(digitalRead(PIN_C02));
+	void OnPulseEnd() {
+		switch (m_Phase) {
+		case FirstPulse:
+			m_Phase = SendingState;
+			HAL::Write(PIN_C04, LOW);
+			// The throttle samples C03 for the first data bit here between falling-C04 and falling-C02.
+			return;
+
+		case SecondPulse:
+			m_Index = 0;
+			m_Phase = ReceivingConfig;
+			HAL::Write(PIN_C04, LOW);
+			return;
+
+		default:
+			return;
+		}
 	}
+
+	volatile uint8_t m_Phase;
+	volatile bool m_ClockHigh;
+	volatile uint8_t m_Index;
+	volatile unsigned long m_Deadline;  // the end of the wait for the poll while Armed, then the frame timeout
+	unsigned long m_Result;
+	JoystickState::Binary m_SendBuf;
+	const PreEncodedState<JoystickState>* m_Slot;  // nullptr: m_SendBuf is set by StartSendJoystickState
+	JoystickConfig::Binary m_RecvBuf;
+
+	static InterruptThrottleClient* volatile g_Instance;
 };
 
+template <int PIN_C01, int PIN_C02, int PIN_C03, int PIN_C04, typename PulseTimer, typename HAL>
+InterruptThrottleClient<PIN_C01, PIN_C02, PIN_C03, PIN_C04, PulseTimer, HAL>*
+volatile InterruptThrottleClient<PIN_C01, PIN_C02, PIN_C03, PIN_C04, PulseTimer, HAL>::g_Instance = nullptr;
+
 
 }  // namespace std
 }  // namespace x52
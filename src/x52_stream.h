@@ -0,0 +1,274 @@
+#pragma once
+
+#include "x52_pro.h"
+#include "x52_std.h"
+
+
+// A compact framed binary format for streaming joystick states from the board
+// to a host (e.g. over USB serial). extras/linux/x52_uinputd.cpp is the host
+// side that turns the stream into a Linux input device.
+//
+// The same format works in the other direction: extras/linux/x52_evdev_feeder.cpp
+// streams the states of a PC joystick to a fake joystick board (see the
+// Receiver below) and the board streams the JoystickConfigs of the throttle
+// back.
+//
+// Frame layout (multi-byte fields are little endian):
+//
+//   byte 0:      SYNC (0xA5)
+//   byte 1:      frame type (FrameType)
+//   byte 2:      payload size in bytes
+//   byte 3:      sequence number (increments by one per frame, wraps around)
+//   bytes 4..7:  capture timestamp: micros() of the board when the state was received
+//                (the host's monotonic clock in micros for the frames from the host)
+//   bytes 8..:   payload: the packed JoystickState::Binary
+//   last byte:   CRC-8 (polynomial 0x07) of the bytes 1..(end of payload)
+//
+// The receiver finds the frame boundaries by looking for SYNC and validating
+// the CRC so it can join the stream at any point and resync after garbage.
+
+
+namespace x52 {
+namespace stream {
+
+
+enum FrameType {
+	ProJoystickStateFrame = 1,  // payload: pro::JoystickState::Binary (7 bytes)
+	StdJoystickStateFrame = 2,  // payload: std::JoystickState::Binary (8 bytes)
+	ProJoystickConfigFrame = 3,  // payload: pro::JoystickConfig::Binary (3 bytes)
+	StdJoystickConfigFrame = 4,  // payload: std::JoystickConfig::Binary (1 byte)
+};
+
+static constexpr uint8_t SYNC = 0xA5;
+static constexpr int HEADER_SIZE = 8;
+static constexpr int MAX_PAYLOAD_SIZE = 16;
+static constexpr int MAX_FRAME_SIZE = HEADER_SIZE + MAX_PAYLOAD_SIZE + 1;
+
+
+inline uint8_t crc8(uint8_t crc, uint8_t b) {
+	crc ^= b;
+	for (int i=0; i<8; i++)
+		crc = uint8_t((crc << 1) ^ (-(crc >> 7) & 0x07));
+	return crc;
+}
+
+
+// EncodeFrame writes a frame into `buf` (that has to be at least
+// MAX_FRAME_SIZE bytes long) and returns the size of the frame.
+inline int EncodeFrame(uint8_t* buf, uint8_t type, uint8_t seq, uint32_t capture_micros, const uint8_t* payload, int payload_size) {
+	assert(uint(payload_size) <= uint(MAX_PAYLOAD_SIZE));
+	buf[0] = SYNC;
+	buf[1] = type;
+	buf[2] = uint8_t(payload_size);
+	buf[3] = seq;
+	for (int i=0; i<4; i++)
+		buf[4+i] = uint8_t(capture_micros >> (i*8));
+	memcpy(buf + HEADER_SIZE, payload, payload_size);
+
+	uint8_t crc = 0;
+	for (int i=1; i<HEADER_SIZE+payload_size; i++)
+		crc = crc8(crc, buf[i]);
+	buf[HEADER_SIZE+payload_size] = crc;
+	return HEADER_SIZE + payload_size + 1;
+}
+
+
+// Writer is the board side of the stream. Output can be anything with the
+// availableForWrite() and write(const uint8_t*, size_t) methods of the
+// Arduino Serial classes.
+//
+// The Write methods never block: a frame that doesn't fit into the output
+// buffer is dropped. Dropped frames still consume a sequence number so the
+// host can see the gap.
+template <typename Output>
+class Writer {
+public:
+	Writer(Output& out): m_Out(out), m_Seq(0), m_NumDropped(0) {}
+
+	bool Write(const pro::JoystickState::Binary& b, unsigned long capture_micros) {
+		return WriteBinary(ProJoystickStateFrame, b, capture_micros);
+	}
+
+	bool Write(const std::JoystickState::Binary& b, unsigned long capture_micros) {
+		return WriteBinary(StdJoystickStateFrame, b, capture_micros);
+	}
+
+	bool Write(const pro::JoystickConfig::Binary& b, unsigned long capture_micros) {
+		return WriteBinary(ProJoystickConfigFrame, b, capture_micros);
+	}
+
+	bool Write(const std::JoystickConfig::Binary& b, unsigned long capture_micros) {
+		return WriteBinary(StdJoystickConfigFrame, b, capture_micros);
+	}
+
+	// The number of frames dropped because of a full output buffer.
+	unsigned long NumDropped() const { return m_NumDropped; }
+
+private:
+	template <int NUM_BITS>
+	bool WriteBinary(FrameType type, const BitField<NUM_BITS>& b, unsigned long capture_micros) {
+		constexpr int PAYLOAD_SIZE = (NUM_BITS+7) / 8;
+		uint8_t payload[PAYLOAD_SIZE];
+		for (int i=0; i<PAYLOAD_SIZE; i++)
+			payload[i] = b.BufByte(i);
+
+		uint8_t frame[MAX_FRAME_SIZE];
+		int size = EncodeFrame(frame, type, m_Seq++, uint32_t(capture_micros), payload, PAYLOAD_SIZE);
+		if (m_Out.availableForWrite() < size) {
+			m_NumDropped++;
+			return false;
+		}
+		m_Out.write(frame, size);
+		return true;
+	}
+
+	Output& m_Out;
+	uint8_t m_Seq;
+	unsigned long m_NumDropped;
+};
+
+
+// Decoder is the host side of the stream. Feed it the received bytes one by
+// one: Feed returns true when a valid frame has been completed and the
+// accessors return the fields of that frame until the next call to Feed.
+class Decoder {
+public:
+	Decoder(): m_Size(0), m_NumErrors(0) {}
+
+	bool Feed(uint8_t b) {
+		m_Buf[m_Size++] = b;
+		for (;;) {
+			if (m_Buf[0] != SYNC) {
+				Resync();
+				if (m_Size == 0)
+					return false;
+				continue;
+			}
+			if (m_Size < 3)
+				return false;
+			if (m_Buf[2] > MAX_PAYLOAD_SIZE) {
+				m_NumErrors++;
+				Resync();
+				continue;
+			}
+			int frame_size = HEADER_SIZE + m_Buf[2] + 1;
+			if (m_Size < frame_size)
+				return false;
+
+			uint8_t crc = 0;
+			for (int i=1; i<frame_size-1; i++)
+				crc = crc8(crc, m_Buf[i]);
+			if (crc != m_Buf[frame_size-1]) {
+				m_NumErrors++;
+				Resync();
+				continue;
+			}
+			// The frame is consumed by the next call to Feed.
+			m_Size = 0;
+			return true;
+		}
+	}
+
+	uint8_t Type() const { return m_Buf[1]; }
+	uint8_t Seq() const { return m_Buf[3]; }
+	int PayloadSize() const { return m_Buf[2]; }
+	const uint8_t* Payload() const { return m_Buf + HEADER_SIZE; }
+
+	uint32_t CaptureMicros() const {
+		return uint32_t(m_Buf[4]) | (uint32_t(m_Buf[5]) << 8) | (uint32_t(m_Buf[6]) << 16) | (uint32_t(m_Buf[7]) << 24);
+	}
+
+	// PayloadToBinary copies the payload into a BitField. Returns false if
+	// the payload size doesn't match the size of the BitField.
+	template <int NUM_BITS>
+	bool PayloadToBinary(BitField<NUM_BITS>& b) const {
+		if (PayloadSize() != (NUM_BITS+7) / 8)
+			return false;
+		for (int i=0; i<PayloadSize(); i++)
+			b.SetBufByte(i, Payload()[i]);
+		return true;
+	}
+
+	// The number of corrupted frames skipped so far.
+	unsigned long NumErrors() const { return m_NumErrors; }
+
+private:
+	// Resync drops the first byte of the buffer and everything up to the next SYNC.
+	void Resync() {
+		int i = 1;
+		while (i < m_Size && m_Buf[i] != SYNC)
+			i++;
+		memmove(m_Buf, m_Buf + i, m_Size - i);
+		m_Size -= i;
+	}
+
+	uint8_t m_Buf[MAX_FRAME_SIZE];
+	int m_Size;
+	unsigned long m_NumErrors;
+};
+
+
+// Receiver is the board side of a stream of states from the host (e.g.
+// extras/linux/x52_evdev_feeder.cpp). Input can be anything with the
+// available() and read() methods of the Arduino Serial classes.
+//
+// Poll reads only the bytes that have already arrived and publishes the
+// received states into a PreEncodedState slot (see x52_common.h), so the
+// SendLatestJoystickState of a ThrottleClient sends the latest one when the
+// throttle's poll arrives. The frames of the other types are skipped. Call
+// Poll before every SendLatestJoystickState: it doesn't wait for the input so
+// it delays the answer to the poll only by the decoding of the frames that
+// arrived since the previous call.
+template <typename Input>
+class Receiver {
+public:
+	Receiver(Input& in): m_In(in), m_NumReceived(0), m_CaptureMicros(0) {}
+
+	// Poll returns the number of states published into the slot.
+	int Poll(PreEncodedState<pro::JoystickState>& slot) {
+		return PollSlot(ProJoystickStateFrame, slot);
+	}
+
+	int Poll(PreEncodedState<std::JoystickState>& slot) {
+		return PollSlot(StdJoystickStateFrame, slot);
+	}
+
+	// The number of states received so far.
+	unsigned long NumReceived() const { return m_NumReceived; }
+
+	// The capture timestamp of the latest state (sent by the host, it's
+	// in the time base of the host).
+	uint32_t CaptureMicros() const { return m_CaptureMicros; }
+
+	const Decoder& GetDecoder() const { return m_Decoder; }
+
+private:
+	template <typename JoystickState>
+	int PollSlot(uint8_t type, PreEncodedState<JoystickState>& slot) {
+		int n = 0;
+		for (int avail = m_In.available(); avail > 0; avail--) {
+			int b = m_In.read();
+			if (b < 0)
+				break;
+			if (!m_Decoder.Feed(uint8_t(b)) || m_Decoder.Type() != type)
+				continue;
+			typename JoystickState::Binary binary;
+			if (!m_Decoder.PayloadToBinary(binary))
+				continue;
+			slot.Publish(binary);
+			m_CaptureMicros = m_Decoder.CaptureMicros();
+			m_NumReceived++;
+			n++;
+		}
+		return n;
+	}
+
+	Input& m_In;
+	Decoder m_Decoder;
+	unsigned long m_NumReceived;
+	uint32_t m_CaptureMicros;
+};
+
+
+}  // namespace stream
+}  // namespace x52
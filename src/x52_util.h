@@ -7,59 +7,674 @@ namespace x52 {
 namespace util {
 
 
-template <unsigned long LOG_PERIOD_MILLIS>
+// FrameStats collects the statistics of the intervals between frames with
+// fixed memory and O(1) integer work per frame. Feed it with the timestamps
+// of the frames (micros()) and take a Snapshot whenever and wherever you
+// want to report them.
+//
+// The percentiles come from a log-linear histogram: every power of two is
+// split into 2^SUB_BUCKET_BITS buckets and the percentile is interpolated
+// within its bucket, so the error is below 1/2^SUB_BUCKET_BITS of the
+// interval. Intervals of 2^(MAX_MSB+1)us or more share the last bucket (the
+// max is exact). The histogram takes 2*(MAX_MSB-SUB_BUCKET_BITS+2)*2^SUB_BUCKET_BITS
+// bytes: 304 with the defaults.
+//
+// When a histogram counter would overflow all counters are halved which
+// keeps the proportions (this is rare and it's the only loop of OnFrame).
+template <int SUB_BUCKET_BITS=3, int MAX_MSB=20>
+class BasicFrameStats {
+public:
+	enum {
+		SUB_BUCKETS = 1 << SUB_BUCKET_BITS,
+		NUM_BUCKETS = (MAX_MSB - SUB_BUCKET_BITS + 2) * SUB_BUCKETS,
+	};
+
+	static_assert(SUB_BUCKET_BITS >= 0 && MAX_MSB >= SUB_BUCKET_BITS && MAX_MSB < 32, "invalid BasicFrameStats parameters");
+	static_assert(NUM_BUCKETS <= 256, "too many buckets");
+
+	struct Snapshot {
+		unsigned long num_intervals;
+		unsigned long min_micros;
+		unsigned long max_micros;    // the longest gap between two frames
+		unsigned long mean_micros;
+		unsigned long p50_micros;
+		unsigned long p99_micros;
+		unsigned long p999_micros;   // p99.9
+		unsigned long max_end_micros; // the timestamp of the frame that ended the longest gap
+	};
+
+	BasicFrameStats() {
+		Reset();
+	}
+
+	// Reset clears the statistics. The next frame starts a new interval
+	// only if keep_last_frame is true.
+	void Reset(bool keep_last_frame=false) {
+		memset(m_Buckets, 0, sizeof(m_Buckets));
+		m_NumIntervals = 0;
+		m_SumMicros = 0;
+		m_SumCount = 0;
+		m_MinMicros = ~0UL;
+		m_MaxMicros = 0;
+		m_MaxEndMicros = 0;
+		if (!keep_last_frame)
+			m_HasLastFrame = false;
+	}
+
+	void OnFrame(unsigned long now_micros) {
+		if (!m_HasLastFrame) {
+			m_HasLastFrame = true;
+			m_LastFrameMicros = now_micros;
+			return;
+		}
+		// using delta to handle the overflows of micros()
+		unsigned long interval = now_micros - m_LastFrameMicros;
+		m_LastFrameMicros = now_micros;
+
+		uint8_t b = Bucket(interval);
+		if (m_Buckets[b] == 0xFFFF || m_SumMicros + interval < m_SumMicros)
+			Halve();
+		m_Buckets[b]++;
+		m_NumIntervals++;
+		m_SumMicros += interval;
+		m_SumCount++;
+
+		if (interval < m_MinMicros)
+			m_MinMicros = interval;
+		if (interval >= m_MaxMicros) {
+			m_MaxMicros = interval;
+			m_MaxEndMicros = now_micros;
+		}
+	}
+
+	void OnFrame() {
+		OnFrame(micros());
+	}
+
+	unsigned long NumIntervals() const {
+		return m_NumIntervals;
+	}
+
+	// Percentile returns the interval at the given percentile in 0.1% units
+	// (e.g. 990 is p99). Returns 0 without data.
+	unsigned long Percentile(unsigned permille) const {
+		unsigned long total = 0;
+		for (int i=0; i<NUM_BUCKETS; i++)
+			total += m_Buckets[i];
+		if (!total)
+			return 0;
+		// the rank of the percentile rounded up (total * permille could overflow)
+		unsigned long rank = total / 1000 * permille + (total % 1000 * permille + 999) / 1000;
+		if (!rank)
+			rank = 1;
+		unsigned long n = 0;
+		for (int i=0; i<NUM_BUCKETS; i++) {
+			if (n + m_Buckets[i] < rank) {
+				n += m_Buckets[i];
+				continue;
+			}
+			unsigned long lo = BucketLowerBound(i);
+			unsigned long hi = i == NUM_BUCKETS - 1 ? m_MaxMicros : BucketLowerBound(i + 1) - 1;
+			// linear interpolation with a 1/256 step without overflows
+			unsigned long w = hi - lo;
+			unsigned long frac = ((rank - n) << 8) / m_Buckets[i];
+			unsigned long v = lo + (w >> 8) * frac + (((w & 0xFF) * frac) >> 8);
+			return max(min(v, m_MaxMicros), m_MinMicros);
+		}
+		return m_MaxMicros;
+	}
+
+	void GetSnapshot(Snapshot& s) const {
+		s.num_intervals = m_NumIntervals;
+		s.min_micros = m_NumIntervals ? m_MinMicros : 0;
+		s.max_micros = m_MaxMicros;
+		s.mean_micros = m_SumCount ? m_SumMicros / m_SumCount : 0;
+		s.p50_micros = Percentile(500);
+		s.p99_micros = Percentile(990);
+		s.p999_micros = Percentile(999);
+		s.max_end_micros = m_MaxEndMicros;
+	}
+
+private:
+	static uint8_t Bucket(unsigned long interval) {
+		if (interval < SUB_BUCKETS)
+			return uint8_t(interval);
+		int msb = int(sizeof(unsigned long) * 8 - 1) - __builtin_clzl(interval);
+		if (msb > MAX_MSB)
+			return NUM_BUCKETS - 1;
+		int shift = msb - SUB_BUCKET_BITS;
+		return uint8_t(((shift + 1) << SUB_BUCKET_BITS) + ((interval >> shift) & (SUB_BUCKETS - 1)));
+	}
+
+	static unsigned long BucketLowerBound(int bucket) {
+		if (bucket < SUB_BUCKETS)
+			return bucket;
+		int shift = (bucket >> SUB_BUCKET_BITS) - 1;
+		unsigned long sub = (bucket & (SUB_BUCKETS - 1)) | SUB_BUCKETS;
+		return sub << shift;
+	}
+
+	// Halve keeps the proportions of the histogram and the mean.
+	void Halve() {
+		for (int i=0; i<NUM_BUCKETS; i++)
+			m_Buckets[i] = (m_Buckets[i] + 1) >> 1;
+		m_SumMicros >>= 1;
+		m_SumCount = (m_SumCount + 1) >> 1;
+	}
+
+	uint16_t m_Buckets[NUM_BUCKETS];
+	unsigned long m_NumIntervals;
+	unsigned long m_SumMicros;
+	unsigned long m_SumCount;
+	unsigned long m_MinMicros;
+	unsigned long m_MaxMicros;
+	unsigned long m_MaxEndMicros;
+	unsigned long m_LastFrameMicros;
+	bool m_HasLastFrame;
+};
+
+typedef BasicFrameStats<> FrameStats;
+
+
+// RateLogger prints the update rate and the FrameStats of the updates to
+// Serial every LOG_PERIOD_MILLIS. Use FrameStats directly if you want to
+// decide when and where to report.
+//
+// SUB_BUCKET_BITS and MAX_MSB are those of its BasicFrameStats. The defaults
+// keep the histogram at 64 bytes: the percentiles are coarser (the error is
+// below half of the interval) and intervals of 65ms or more share the last
+// bucket. RateLogger<LOG_PERIOD_MILLIS, 3, 20> gives the precision of
+// FrameStats for 304 bytes.
+template <unsigned long LOG_PERIOD_MILLIS, int SUB_BUCKET_BITS=1, int MAX_MSB=15>
 class RateLogger {
 public:
-	RateLogger(): m_NumUpdates(0), m_PrevLogTime(0) {}
+	RateLogger(): m_PrevLogTime(0) {}
 
 	void OnUpdate() {
-		m_NumUpdates++;
+		unsigned long now_micros = micros();
+		m_Stats.OnFrame(now_micros);
 		unsigned long now = millis();
 		// using delta to handle the overflows of millis()
 		unsigned long elapsed = now - m_PrevLogTime;
 		if (elapsed < LOG_PERIOD_MILLIS)
 			return;
-		Serial.print("Updates per second: ");
-		Serial.println(double(m_NumUpdates) / double(elapsed) * 1000.0);
-		m_NumUpdates = 0;
+		typename Stats::Snapshot s;
+		m_Stats.GetSnapshot(s);
+		m_Stats.Reset(true);
 		m_PrevLogTime = now;
+		if (!s.num_intervals)
+			return;
+
+		Serial.print("Updates per second: ");
+		Serial.print(s.mean_micros ? (1000000UL + s.mean_micros/2) / s.mean_micros : 0UL);
+		Serial.print(", interval us min/p50/p99/p99.9/max: ");
+		Serial.print(s.min_micros);
+		Serial.print('/');
+		Serial.print(s.p50_micros);
+		Serial.print('/');
+		Serial.print(s.p99_micros);
+		Serial.print('/');
+		Serial.print(s.p999_micros);
+		Serial.print('/');
+		Serial.println(s.max_micros);
 	}
 
 private:
-	unsigned long m_NumUpdates;
+	typedef BasicFrameStats<SUB_BUCKET_BITS, MAX_MSB> Stats;
+
+	Stats m_Stats;
 	unsigned long m_PrevLogTime;
 };
 
 
-// Rate limiter with a history buffer to be able to deal with some jitter.
-// A lower NUM_STORED_TIMESTAMPS value reduces the memory consumption but
-// makes the RateLimiter less effective at dealing with jitter.
-template <int MAX_UPDATES_PER_SECOND, int NUM_STORED_TIMESTAMPS>
+// RateLimiter limits the average update rate to MAX_UPDATES_PER_SECOND but
+// tolerates jitter: updates that were late can be followed by faster ones
+// to catch up. MAX_BURST is the number of updates that can be let through
+// at once after an idle period, so in any window of T seconds there are at
+// most T*MAX_UPDATES_PER_SECOND + MAX_BURST - 1 updates. A lower MAX_BURST
+// value gives a steadier rate, a higher one catches up after longer delays.
+//
+// It's a GCRA (generic cell rate algorithm) limiter: the only state is the
+// theoretical arrival time of the next update. An update is allowed if it
+// isn't earlier than that minus the burst tolerance of MAX_BURST-1 periods.
+// A catch-up of updates that take time themselves is longer than MAX_BURST
+// updates (e.g. ~356 updates of 1.2ms with <250,250>).
+//
+// The second parameter of the timestamp-history limiter it replaced was the
+// number of stored timestamps and the same value isn't the same limit:
+// <250,250> allowed up to ~424 updates in a second and now allows 499.
+// Pass a small MAX_BURST (e.g. 8) for a steady rate.
+// extras/linux/x52_rate_limiter_compare compares them.
+template <int MAX_UPDATES_PER_SECOND, int MAX_BURST>
 class RateLimiter {
 public:
-	RateLimiter() {
-		m_Index = 0;
-		memset(m_UpdateTimes, 0, sizeof(m_UpdateTimes));
-	}
+	RateLimiter(): m_ArrivalTime(0) {}
 
 	unsigned long MicrosTillNextUpdate() {
-		unsigned long now = micros();
+		return MicrosTillNextUpdate(micros());
+	}
+
+	// This one takes the current time (micros()) from the caller, e.g. to
+	// share one micros() call with other stages of the loop.
+	unsigned long MicrosTillNextUpdate(unsigned long now) {
 		// using delta to handle the overflows of micros()
-		unsigned long micros_left = m_UpdateTimes[m_Index] - now;
-		if (long(micros_left) > 0)
-			return micros_left;
-		m_UpdateTimes[m_Index] = now + g_StoredPeriod;
-		m_Index = (m_Index + 1) % NUM_STORED_TIMESTAMPS;
-		m_UpdateTimes[m_Index] = min(m_UpdateTimes[m_Index], now + g_OneUpdatePeriod);
+		unsigned long ahead = m_ArrivalTime - now;
+		if (ahead > g_Tolerance + g_Period) {
+			// m_ArrivalTime is in the past (idle limiter, first call or an
+			// overflow of micros() since the last update).
+			m_ArrivalTime = now;
+		} else if (ahead > g_Tolerance) {
+			return ahead - g_Tolerance;
+		}
+		m_ArrivalTime += g_Period;
 		return 0;
 	}
 
 private:
-	int m_Index;
-	unsigned long m_UpdateTimes[NUM_STORED_TIMESTAMPS];
+	unsigned long m_ArrivalTime;
+
+	static_assert(MAX_UPDATES_PER_SECOND > 0 && MAX_BURST > 0, "invalid RateLimiter parameters");
+
+	static constexpr unsigned long g_Period = (1000000 + MAX_UPDATES_PER_SECOND/2) / MAX_UPDATES_PER_SECOND;
+	static constexpr unsigned long g_Tolerance = (MAX_BURST-1) * g_Period;
+};
+
+
+// Upsampler is an optional stage after the JoystickClient. It makes it
+// possible to feed the consumer (e.g. a USB HID report loop) with fresh axis
+// values at a higher rate than the joystick's frame rate. This is mainly
+// useful with the X52 non-Pro joystick that sends only about 50 frames per
+// second while a USB host polls at 125-1000Hz.
+//
+// The x/y/z axes are extrapolated from the last two samples with a constant
+// velocity. Everything else (buttons, POV switches, mode) is taken from the
+// last sample without modification. A new sample replaces the extrapolated
+// values immediately.
+//
+// The prediction is switched off (the last sample is held) when the
+// prediction can't be trusted:
+// - the last two steps of the axis were in opposite directions (noise, reversal)
+// - the last two samples are more than MAX_SAMPLE_INTERVAL_MICROS apart
+// The predicted value never overshoots the last sample by more than the
+// step between the last two samples and it stops moving (it's held, not
+// dropped back to the last sample) MAX_EXTRAPOLATION_MICROS after the last
+// sample so a late frame doesn't make the output jump backwards.
+//
+// The timestamps should be the capture times of the frames (e.g. micros()
+// right after a successful PollJoystickState) in order to avoid adding
+// the jitter of your loop to the prediction.
+template <typename JoystickState, unsigned long MAX_EXTRAPOLATION_MICROS=20000, unsigned long MAX_SAMPLE_INTERVAL_MICROS=40000>
+class Upsampler {
+public:
+	// Prediction error statistics collected by AddSample by comparing the
+	// predicted axis values with the real ones at the time of the new sample.
+	struct PredictionError {
+		unsigned long num_samples;
+		unsigned long sum_abs_error[3];  // x, y, z
+		uint16_t max_abs_error[3];       // x, y, z
+	};
+
+	static_assert(MAX_SAMPLE_INTERVAL_MICROS <= 1000000, "MAX_SAMPLE_INTERVAL_MICROS is too large");
+
+	Upsampler(): m_SampleMicros(0), m_SampleInterval(0), m_NumSamples(0) {
+		memset(m_PrevAxes, 0, sizeof(m_PrevAxes));
+		memset(m_Steps, 0, sizeof(m_Steps));
+		memset(m_Velocity, 0, sizeof(m_Velocity));
+		ResetPredictionError();
+	}
+
+	void AddSample(const JoystickState& state, unsigned long micros) {
+		if (m_NumSamples) {
+			uint16_t v[3] = { state.x, state.y, state.z };
+			for (int i=0; i<3; i++) {
+				int e = abs(int(Predict(i, micros)) - int(v[i]));
+				m_Error.sum_abs_error[i] += e;
+				if (e > m_Error.max_abs_error[i])
+					m_Error.max_abs_error[i] = uint16_t(e);
+			}
+			m_Error.num_samples++;
+		}
+
+		bool first = !m_NumSamples;
+		if (m_NumSamples < 2)
+			m_NumSamples++;
+		m_PrevAxes[0] = m_State.x;
+		m_PrevAxes[1] = m_State.y;
+		m_PrevAxes[2] = m_State.z;
+		m_SampleInterval = micros - m_SampleMicros;
+		m_SampleMicros = micros;
+		m_State = state;
+
+		for (int i=0; i<3; i++) {
+			int step = first ? 0 : int(Axis(m_State, i)) - int(m_PrevAxes[i]);
+			// Low confidence: the direction of the movement has changed.
+			if ((step > 0 && m_Steps[i] < 0) || (step < 0 && m_Steps[i] > 0))
+				m_Velocity[i] = 0;
+			else
+				m_Velocity[i] = step;
+			m_Steps[i] = step;
+		}
+	}
+
+	// GetState returns the last sample with extrapolated axis values.
+	// Returns false if there is no sample yet.
+	bool GetState(JoystickState& state, unsigned long micros) const {
+		if (!m_NumSamples)
+			return false;
+		state = m_State;
+		state.x = Predict(0, micros);
+		state.y = Predict(1, micros);
+		state.z = Predict(2, micros);
+		return true;
+	}
+
+	const PredictionError& GetPredictionError() const {
+		return m_Error;
+	}
+
+	void ResetPredictionError() {
+		memset(&m_Error, 0, sizeof(m_Error));
+	}
+
+private:
+	static uint16_t Axis(const JoystickState& state, int i) {
+		return i == 0 ? state.x : (i == 1 ? state.y : state.z);
+	}
+
+	static uint16_t AxisMax(int i) {
+		return i == 0 ? JoystickState::MAX_X : (i == 1 ? JoystickState::MAX_Y : JoystickState::MAX_Z);
+	}
+
+	uint16_t Predict(int i, unsigned long micros) const {
+		long v = Axis(m_State, i);
+		if (m_NumSamples < 2 || !m_Velocity[i])
+			return uint16_t(v);
+		// using delta to handle the overflows of micros()
+		unsigned long elapsed = micros - m_SampleMicros;
+		if (long(elapsed) <= 0)
+			return uint16_t(v);
+		if (m_SampleInterval == 0 || m_SampleInterval > MAX_SAMPLE_INTERVAL_MICROS)
+			return uint16_t(v);
+		if (elapsed > MAX_EXTRAPOLATION_MICROS)
+			elapsed = MAX_EXTRAPOLATION_MICROS;
+		if (elapsed > m_SampleInterval)
+			elapsed = m_SampleInterval;
+		// |velocity| <= 2047 and elapsed <= MAX_SAMPLE_INTERVAL_MICROS so this fits into a long
+		v += long(m_Velocity[i]) * long(elapsed) / long(m_SampleInterval);
+		if (v < 0)
+			v = 0;
+		else if (v > long(AxisMax(i)))
+			v = AxisMax(i);
+		return uint16_t(v);
+	}
+
+	JoystickState m_State;
+	unsigned long m_SampleMicros;
+	unsigned long m_SampleInterval;
+	uint16_t m_PrevAxes[3];
+	int16_t m_Steps[3];
+	int16_t m_Velocity[3];
+	uint8_t m_NumSamples;
+	PredictionError m_Error;
+};
+
+
+
+// StateHistory keeps the last CAPACITY states (pro or std) with their
+// timestamps for lag compensation and post-mortems. A sample is the packed
+// wire Binary (7 bytes pro, 8 bytes std) and a 16-bit time offset: the
+// samples are stored in blocks of BLOCK_SIZE and only the first sample of a
+// block has a full 32-bit timestamp. A sample takes 9.5 (pro) or 10.5 (std)
+// bytes with the defaults instead of the 12-20+ bytes of a JoystickState, e.g.
+// 3 seconds at 400 fps take ~11.4KB.
+//
+// The oldest block is dropped as a whole when the buffer is full, so the
+// history holds between CAPACITY-BLOCK_SIZE+1 and CAPACITY samples. A sample
+// that is more than 65.5ms after the first sample of its block starts a new
+// block and the rest of the current block stays unused (this happens only
+// after a pause of the input, the history holds fewer samples then).
+//
+// Find is a binary search on the blocks and then on the offsets of a block.
+// The Iterator gives JoystickStateViews so the fields are decoded only when
+// they are read, and Changed tells the repeated states without decoding.
+//
+// The timestamps have to be non-decreasing micros() values (an earlier one
+// is recorded as the latest one). Add(view.GetBinary(), micros) stores the
+// received bits without decoding them, e.g. from the partial state handler
+// of PollJoystickState (see NoPartialState in x52_common.h).
+//
+// extras/linux/x52_state_history_check compares it with a reference model.
+template <typename JoystickState, int CAPACITY, int BLOCK_SIZE=8>
+class StateHistory {
+public:
+	typedef typename JoystickState::Binary Binary;
+	typedef typename JoystickState::View View;
+
+	static_assert(BLOCK_SIZE >= 2 && CAPACITY % BLOCK_SIZE == 0 && CAPACITY / BLOCK_SIZE >= 2,
+		"CAPACITY has to be at least two blocks");
+	static_assert(CAPACITY <= 0x7FFF, "CAPACITY is too large");
+
+	// Iterator walks the samples from older to newer.
+	class Iterator {
+	public:
+		bool Valid() const {
+			return m_Pos < m_History->m_Count;
+		}
+
+		void Next() {
+			m_Prev = m_History->Slot(m_Pos);
+			m_Pos = m_History->NextSample(m_Pos);
+		}
+
+		unsigned long Micros() const {
+			return m_History->SlotMicros(m_History->Slot(m_Pos));
+		}
+
+		View State() const {
+			return View(m_History->m_States[m_History->Slot(m_Pos)]);
+		}
+
+		// Changed returns false if the state is the same as that of the
+		// previous sample of the iteration (the first sample is a change).
+		bool Changed() const {
+			return m_Prev < 0 || m_History->m_States[m_Prev] != m_History->m_States[m_History->Slot(m_Pos)];
+		}
+
+	private:
+		friend class StateHistory;
+		Iterator(const StateHistory* h, int pos): m_History(h), m_Pos(pos), m_Prev(-1) {}
+
+		const StateHistory* m_History;
+		int m_Pos;  // logical position (0 is the oldest slot)
+		int m_Prev;  // the slot of the previous sample or -1
+	};
+
+	StateHistory() {
+		Clear();
+	}
+
+	void Clear() {
+		m_Head = 0;
+		m_Count = 0;
+		m_NumSamples = 0;
+	}
+
+	// Size is the number of samples.
+	int Size() const {
+		return m_NumSamples;
+	}
+
+	void Add(const JoystickState& state, unsigned long micros) {
+		Binary b;
+		state.ToBinary(b);
+		Add(b, micros);
+	}
+
+	void Add(const Binary& state, unsigned long micros) {
+		if (m_NumSamples) {
+			unsigned long last = SlotMicros(LastSample());
+			if (long(micros - last) < 0)
+				micros = last;
+			if (m_Head % BLOCK_SIZE) {
+				unsigned long offset = micros - m_BlockMicros[m_Head / BLOCK_SIZE];
+				if (offset > MAX_OFFSET) {
+					while (m_Head % BLOCK_SIZE)
+						Append(PADDING);
+				}
+			}
+		}
+
+		if (m_Head % BLOCK_SIZE == 0) {
+			if (m_Count == CAPACITY)
+				DropOldestBlock();
+			m_BlockMicros[m_Head / BLOCK_SIZE] = micros;
+		}
+		m_States[m_Head] = state;
+		Append(uint16_t(micros - m_BlockMicros[m_Head / BLOCK_SIZE]));
+		m_NumSamples++;
+	}
+
+	Iterator Begin() const {
+		Iterator it(this, 0);
+		return it;
+	}
+
+	// Find returns an iterator at the last sample at or before the given
+	// time. It's at the oldest sample if the time is older than that.
+	Iterator Find(unsigned long micros) const {
+		Iterator it(this, FindPos(micros));
+		return it;
+	}
+
+	// GetState returns the state at the given time: that of the last sample
+	// at or before it. Returns false if the history is empty or the time is
+	// older than the oldest sample.
+	bool GetState(unsigned long micros, JoystickState& state) const {
+		if (!m_NumSamples || long(micros - SlotMicros(Slot(0))) < 0)
+			return false;
+		state = JoystickState(View(m_States[Slot(FindPos(micros))]));
+		return true;
+	}
+
+	// GetInterpolatedState is GetState with the axes interpolated linearly
+	// between the samples before and after the given time. The buttons are
+	// those of the sample before it. After the newest sample it returns the
+	// newest state.
+	bool GetInterpolatedState(unsigned long micros, JoystickState& state) const {
+		if (!m_NumSamples || long(micros - SlotMicros(Slot(0))) < 0)
+			return false;
+		int pos = FindPos(micros);
+		int a = Slot(pos);
+		state = JoystickState(View(m_States[a]));
+		int next = NextSample(pos);
+		if (next >= m_Count)
+			return true;
+		int b = Slot(next);
+		unsigned long t = micros - SlotMicros(a);
+		unsigned long span = SlotMicros(b) - SlotMicros(a);
+		if (!span || t >= span)
+			return true;
+		View vb(m_States[b]);
+		state.x = Lerp(state.x, vb.x(), t, span);
+		state.y = Lerp(state.y, vb.y(), t, span);
+		state.z = Lerp(state.z, vb.z(), t, span);
+		return true;
+	}
+
+private:
+	enum {
+		NUM_BLOCKS = CAPACITY / BLOCK_SIZE,
+		PADDING = 0xFFFF,  // an unused slot at the end of a block
+		MAX_OFFSET = 0xFFFE,
+	};
+
+	static uint16_t Lerp(uint16_t a, uint16_t b, unsigned long t, unsigned long span) {
+		// the axes have at most 11 bits so this fits into a long if span < 2^20
+		while (span >= (1UL << 20)) {
+			span >>= 1;
+			t >>= 1;
+		}
+		return uint16_t(long(a) + (long(b) - long(a)) * long(t) / long(span));
+	}
+
+	int Slot(int pos) const {
+		int s = m_Head - m_Count + pos;
+		return s < 0 ? s + CAPACITY : s;
+	}
+
+	unsigned long SlotMicros(int slot) const {
+		return m_BlockMicros[slot / BLOCK_SIZE] + m_Offsets[slot];
+	}
+
+	int LastSample() const {
+		// the last slot is never padding
+		return Slot(m_Count - 1);
+	}
+
+	int NextSample(int pos) const {
+		while (++pos < m_Count && m_Offsets[Slot(pos)] == PADDING) {}
+		return pos;
+	}
+
+	void Append(uint16_t offset) {
+		m_Offsets[m_Head] = offset;
+		if (++m_Head == CAPACITY)
+			m_Head = 0;
+		m_Count++;
+	}
+
+	// The oldest slot is always the first slot of a block.
+	void DropOldestBlock() {
+		int first = Slot(0);
+		for (int i=0; i<BLOCK_SIZE; i++) {
+			if (m_Offsets[first + i] != PADDING)
+				m_NumSamples--;
+		}
+		m_Count -= BLOCK_SIZE;
+	}
+
+	// FindPos returns the logical position of the last sample at or before
+	// the given time or 0.
+	int FindPos(unsigned long micros) const {
+		if (!m_NumSamples)
+			return 0;
+		// the times are compared as the elapsed times since the oldest sample
+		unsigned long t = micros - SlotMicros(Slot(0));
+		if (long(t) < 0)
+			return 0;
+		int num_blocks = (m_Count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+		int first_block = Slot(0) / BLOCK_SIZE;
+		int lo = 0, hi = num_blocks - 1;
+		while (lo < hi) {
+			int mid = (lo + hi + 1) / 2;
+			int block = (first_block + mid) % NUM_BLOCKS;
+			if (m_BlockMicros[block] - m_BlockMicros[first_block] <= t)
+				lo = mid;
+			else
+				hi = mid - 1;
+		}
+
+		// the offsets of a block are non-decreasing and the padding is at the end
+		int block = (first_block + lo) % NUM_BLOCKS;
+		unsigned long offset = t - (m_BlockMicros[block] - m_BlockMicros[first_block]);
+		int n = min(BLOCK_SIZE, m_Count - lo * BLOCK_SIZE);
+		int a = 0, b = n - 1;
+		while (a < b) {
+			int mid = (a + b + 1) / 2;
+			if (m_Offsets[block * BLOCK_SIZE + mid] <= offset && m_Offsets[block * BLOCK_SIZE + mid] != PADDING)
+				a = mid;
+			else
+				b = mid - 1;
+		}
+		return lo * BLOCK_SIZE + a;
+	}
 
-	static constexpr unsigned long g_OneUpdatePeriod = (1000000 + MAX_UPDATES_PER_SECOND/2) / MAX_UPDATES_PER_SECOND;
-	static constexpr unsigned long g_StoredPeriod = (NUM_STORED_TIMESTAMPS*1000000 + MAX_UPDATES_PER_SECOND/2) / MAX_UPDATES_PER_SECOND;
+	Binary m_States[CAPACITY];
+	uint16_t m_Offsets[CAPACITY];
+	unsigned long m_BlockMicros[NUM_BLOCKS];
+	int m_Head;  // the next slot to write
+	int m_Count;  // the used slots including the padding
+	int m_NumSamples;
 };
 
 